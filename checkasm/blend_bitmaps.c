@@ -27,6 +27,9 @@
 #define MIN_WIDTH  1
 #define SRC1_STRIDE 96
 #define SRC2_STRIDE 128
+#define RGBA_STRIDE 256
+#define SURFACE_BLOCK 32
+#define SURFACE_STRIDE 263  // deliberately unaligned
 
 static void check_blend_bitmaps(BitmapBlendFunc func, const char *name)
 {
@@ -99,10 +102,139 @@ static void check_mul_bitmaps(BitmapMulFunc func)
     report("mul_bitmaps");
 }
 
+static int32_t rnd_range(int32_t min, int32_t max)
+{
+    return min + (int32_t) ((unsigned) rnd() % (unsigned) (max - min));
+}
+
+static void check_gradient_rgba(GradientRGBAFunc func)
+{
+    ALIGN(uint8_t src[SRC1_STRIDE * HEIGHT], 32);
+    ALIGN(uint8_t dst_ref[RGBA_STRIDE * HEIGHT], 32);
+    ALIGN(uint8_t dst_new[RGBA_STRIDE * HEIGHT], 32);
+    declare_func(void,
+                 uint8_t *dst, ptrdiff_t dst_stride,
+                 const uint8_t *src, ptrdiff_t src_stride,
+                 size_t width, size_t height,
+                 const GradientRGBAParams *param);
+
+    if (check_func(func, "gradient_rgba")) {
+        GradientRGBAParams param;
+        for (int w = MIN_WIDTH; w <= RGBA_STRIDE / 4; w++) {
+            for (int i = 0; i < sizeof(src); i++)
+                src[i] = rnd();
+
+            // slightly out of range values to exercise clamping
+            for (int k = 0; k < 4; k++) {
+                param.start[k] = rnd_range(-(32 << 22), 288 << 22);
+                param.dx[k]    = rnd_range(-(2 << 22), 2 << 22);
+                param.dy[k]    = rnd_range(-(2 << 22), 2 << 22);
+                param.dxy[k]   = rnd_range(-(1 << 16), 1 << 16);
+            }
+
+            memset(dst_ref, 0, sizeof(dst_ref));
+            memset(dst_new, 0, sizeof(dst_new));
+
+            call_ref(dst_ref, RGBA_STRIDE, src, SRC1_STRIDE, w, HEIGHT, &param);
+            call_new(dst_new, RGBA_STRIDE, src, SRC1_STRIDE, w, HEIGHT, &param);
+
+            for (int y = 0; y < HEIGHT; y++) {
+                if (memcmp(dst_ref + y * RGBA_STRIDE, dst_new + y * RGBA_STRIDE, 4 * w)) {
+                    fail();
+                    break;
+                }
+            }
+        }
+
+        bench_new(dst_new, RGBA_STRIDE, src, SRC1_STRIDE, RGBA_STRIDE / 4, HEIGHT, &param);
+    }
+
+    report("gradient_rgba");
+}
+
+static void check_blend_color(BlendColorFunc func, const char *name, int bpp)
+{
+    ALIGN(uint8_t src[RGBA_STRIDE * HEIGHT + 1], 32);
+    ALIGN(uint8_t dst_ref[SURFACE_STRIDE * HEIGHT + 1], 32);
+    ALIGN(uint8_t dst_new[SURFACE_STRIDE * HEIGHT + 1], 32);
+    declare_func(void,
+                 uint8_t *dst, ptrdiff_t dst_stride,
+                 const uint8_t *src, ptrdiff_t src_stride,
+                 size_t width, size_t height, uint32_t color);
+
+    if (check_func(func, name)) {
+        uint32_t color = 0;
+        for (int w = SURFACE_BLOCK; bpp * w < SURFACE_STRIDE; w += SURFACE_BLOCK) {
+            for (int i = 0; i < sizeof(src); i++)
+                src[i] = rnd();
+
+            for (int i = 0; i < sizeof(dst_ref); i++)
+                dst_ref[i] = dst_new[i] = rnd();
+
+            color = rnd();
+            call_ref(dst_ref + 1, SURFACE_STRIDE, src + 1, RGBA_STRIDE, w, HEIGHT, color);
+            call_new(dst_new + 1, SURFACE_STRIDE, src + 1, RGBA_STRIDE, w, HEIGHT, color);
+
+            if (memcmp(dst_ref, dst_new, sizeof(dst_ref))) {
+                fail();
+                break;
+            }
+        }
+
+        bench_new(dst_new + 1, SURFACE_STRIDE, src + 1, RGBA_STRIDE,
+                  SURFACE_BLOCK, HEIGHT, color);
+    }
+
+    report(name);
+}
+
+static void check_blend_premul(BlendPremulFunc func)
+{
+    ALIGN(uint8_t src[RGBA_STRIDE * HEIGHT + 1], 32);
+    ALIGN(uint8_t dst_ref[SURFACE_STRIDE * HEIGHT + 1], 32);
+    ALIGN(uint8_t dst_new[SURFACE_STRIDE * HEIGHT + 1], 32);
+    declare_func(void,
+                 uint8_t *dst, ptrdiff_t dst_stride,
+                 const uint8_t *src, ptrdiff_t src_stride,
+                 size_t width, size_t height);
+
+    if (check_func(func, "blend_premul")) {
+        for (int w = SURFACE_BLOCK; 4 * w < SURFACE_STRIDE; w += SURFACE_BLOCK) {
+            // keep the source properly premultiplied
+            for (int i = 0; i < sizeof(src) - 4; i += 4) {
+                uint8_t a = rnd();
+                for (int k = 0; k < 3; k++)
+                    src[i + k] = rnd_range(0, a);
+                src[i + 3] = a;
+            }
+
+            for (int i = 0; i < sizeof(dst_ref); i++)
+                dst_ref[i] = dst_new[i] = rnd();
+
+            call_ref(dst_ref + 1, SURFACE_STRIDE, src, RGBA_STRIDE, w, HEIGHT);
+            call_new(dst_new + 1, SURFACE_STRIDE, src, RGBA_STRIDE, w, HEIGHT);
+
+            if (memcmp(dst_ref, dst_new, sizeof(dst_ref))) {
+                fail();
+                break;
+            }
+        }
+
+        bench_new(dst_new + 1, SURFACE_STRIDE, src, RGBA_STRIDE,
+                  SURFACE_BLOCK, HEIGHT);
+    }
+
+    report("blend_premul");
+}
+
 void checkasm_check_blend_bitmaps(unsigned cpu_flag)
 {
     BitmapEngine engine = ass_bitmap_engine_init(cpu_flag);
     check_blend_bitmaps(engine.add_bitmaps, "add_bitmaps");
     check_blend_bitmaps(engine.imul_bitmaps, "imul_bitmaps");
     check_mul_bitmaps(engine.mul_bitmaps);
+    check_gradient_rgba(engine.gradient_rgba);
+    check_blend_color(engine.blend_plane, "blend_plane", 1);
+    check_blend_color(engine.blend_color, "blend_color", 4);
+    check_blend_premul(engine.blend_premul);
 }
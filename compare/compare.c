@@ -21,6 +21,7 @@
 #include "../libass/ass_filesystem.h"
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <math.h>
 #include <string.h>
 
 #if defined(_WIN32) && !defined(__CYGWIN__)
@@ -80,6 +81,21 @@ static void blend_all_rgba(Image8 *frame, int32_t x0, int32_t y0,
         blend_image_rgba(frame, x0, y0, img);
 }
 
+// Render a frame into an 8-bit image with inverted alpha
+// (0 is opaque), like the target images.
+static bool render_frame8(Image8 *frame, ASS_Renderer *renderer,
+                          ASS_Track *track, int64_t time)
+{
+    frame->buffer = malloc(4 * (size_t) frame->width * frame->height);
+    if (!frame->buffer)
+        return false;
+
+    ASS_ImageRGBA *img = ass_render_frame_rgba(renderer, track, time, NULL);
+    blend_all_rgba(frame, 0, 0, img);
+    ass_free_images_rgba(img);
+    return true;
+}
+
 inline static uint16_t abs_diff(uint16_t a, uint16_t b)
 {
     return a > b ? a - b : b - a;
@@ -135,18 +151,16 @@ static void calc_grad(const Image16 *target, uint16_t *grad)
 }
 
 static int compare1(const Image16 *target, const uint16_t *grad,
-                    const ASS_ImageRGBA *img, const char *path, double *result)
+                    ASS_Renderer *renderer, ASS_Track *track, int64_t time,
+                    const char *path, double *result)
 {
     Image8 frame;
     frame.width  = target->width;
     frame.height = target->height;
     size_t size = (size_t) frame.width * frame.height;
-    frame.buffer = malloc(4 * size);
-    if (!frame.buffer)
+    if (!render_frame8(&frame, renderer, track, time))
         return 0;
 
-    blend_all_rgba(&frame, 0, 0, img);
-
     double max_err = 0;
     const uint8_t *ptr = frame.buffer;
     const uint16_t *tg = target->buffer;
@@ -166,39 +180,33 @@ static int compare1(const Image16 *target, const uint16_t *grad,
     return flag;
 }
 
-static int compare(const Image16 *target, const uint16_t *grad,
-                   const ASS_ImageRGBA *img, const char *path,
-                   double *result, int scale_x, int scale_y)
+// Render a 16-bit frame of preset extents,
+// downsampling the rendering result by the scale factors.
+static bool render_frame16(Image16 *frame, ASS_Renderer *renderer,
+                           ASS_Track *track, int64_t time,
+                           int scale_x, int scale_y)
 {
-    if (scale_x == 1 && scale_y == 1)
-        return compare1(target, grad, img, path, result);
     int scale_area = scale_x * scale_y;
-
-    Image16 frame;
-    frame.width  = target->width;
-    frame.height = target->height;
-    size_t size = (size_t) frame.width * frame.height;
-    frame.buffer = malloc(8 * size);
-    if (!frame.buffer)
-        return 0;
+    size_t size = (size_t) frame->width * frame->height;
+    frame->buffer = malloc(8 * size);
+    if (!frame->buffer)
+        return false;
 
     Image8 temp;
-    temp.width  = scale_x * target->width;
-    temp.height = scale_y * target->height;
-    temp.buffer = malloc(4 * scale_area * size);
-    if (!temp.buffer) {
-        free(frame.buffer);
-        return 0;
+    temp.width  = scale_x * frame->width;
+    temp.height = scale_y * frame->height;
+    if (!render_frame8(&temp, renderer, track, time)) {
+        free(frame->buffer);
+        return false;
     }
-    blend_all_rgba(&temp, 0, 0, img);
 
-    uint16_t *dst = frame.buffer;
+    uint16_t *dst = frame->buffer;
     const uint8_t *src = temp.buffer;
     int32_t stride = 4 * temp.width;
     const uint32_t offs = ((uint32_t) 1 << 19) - 1;
     uint32_t mul = ((uint32_t) 257 << 20) / scale_area;
-    for (int32_t y = 0; y < frame.height; y++) {
-        for (int32_t x = 0; x < frame.width; x++) {
+    for (int32_t y = 0; y < frame->height; y++) {
+        for (int32_t x = 0; x < frame->width; x++) {
             uint16_t res[4] = {0};
             const uint8_t *ptr = src;
             for (int i = 0; i < scale_y; i++) {
@@ -216,6 +224,22 @@ static int compare(const Image16 *target, const uint16_t *grad,
     }
 
     free(temp.buffer);
+    return true;
+}
+
+static int compare(const Image16 *target, const uint16_t *grad,
+                   ASS_Renderer *renderer, ASS_Track *track, int64_t time,
+                   const char *path, double *result, int scale_x, int scale_y)
+{
+    if (scale_x == 1 && scale_y == 1)
+        return compare1(target, grad, renderer, track, time, path, result);
+
+    Image16 frame;
+    frame.width  = target->width;
+    frame.height = target->height;
+    size_t size = (size_t) frame.width * frame.height;
+    if (!render_frame16(&frame, renderer, track, time, scale_x, scale_y))
+        return 0;
 
     double max_err = 0;
     const uint16_t *ptr = frame.buffer;
@@ -302,6 +326,365 @@ typedef enum {
     R_SAME, R_GOOD, R_BAD, R_FAIL, R_ERROR
 } Result;
 
+// Background of the surface checks: fixed noise, so that every sample
+// changed by the renderer is noticed
+static void fill_noise(uint8_t *buf, size_t size)
+{
+    uint32_t state = 1;
+    for (size_t i = 0; i < size; i++) {
+        state = state * 1103515245 + 12345;
+        buf[i] = state >> 24;
+    }
+}
+
+static bool in_rects(const ASS_DirtyRect *rects, int n, int x, int y)
+{
+    for (int i = 0; i < n; i++)
+        if (x >= rects[i].x0 && x < rects[i].x1 &&
+                y >= rects[i].y0 && y < rects[i].y1)
+            return true;
+    return false;
+}
+
+#define MAX_RECTS 64
+// images are blended one at a time, each rounding its samples
+#define SURFACE_TOLERANCE 4
+
+typedef struct {
+    int w, h, cw, ch;
+    uint8_t *premul;            // scalar blend of the RGBA images over transparency
+    uint8_t *bg;                // noise, 4 bytes per pixel
+    uint8_t *rgba, *bgra;
+    uint8_t *nv12, *i420;
+    uint16_t *p010;
+    ASS_DirtyRect rects[MAX_RECTS];
+    int n_rects;
+} SurfaceCheck;
+
+static bool render_surface(SurfaceCheck *c, ASS_Renderer *renderer,
+                           ASS_Track *track, int64_t time,
+                           ASS_SurfaceFormat format, uint8_t *buf,
+                           bool want_rects)
+{
+    int w = c->w, h = c->h, cw = c->cw, ch = c->ch;
+    ASS_Surface surface = { .format = format, .w = w, .h = h };
+    switch (format) {
+    case ASS_SURFACE_RGBA:
+    case ASS_SURFACE_BGRA:
+        surface.planes[0] = buf;
+        surface.strides[0] = 4 * w;
+        break;
+    case ASS_SURFACE_NV12:
+    case ASS_SURFACE_P010: {
+        int size = format == ASS_SURFACE_P010 ? 2 : 1;
+        surface.planes[0] = buf;
+        surface.planes[1] = buf + size * w * h;
+        surface.strides[0] = size * w;
+        surface.strides[1] = 2 * size * cw;
+        break;
+    }
+    case ASS_SURFACE_I420:
+        surface.planes[0] = buf;
+        surface.planes[1] = buf + w * h;
+        surface.planes[2] = buf + w * h + cw * ch;
+        surface.strides[0] = w;
+        surface.strides[1] = surface.strides[2] = cw;
+        break;
+    }
+    int n = ass_render_frame_into(renderer, track, time, &surface,
+                                  want_rects ? c->rects : NULL,
+                                  want_rects ? MAX_RECTS : 0, NULL);
+    if (want_rects)
+        c->n_rects = n;
+    return n >= 0;
+}
+
+// BT.601 TV range luma of a premultiplied color over the background
+static double ref_luma(const uint8_t *p, unsigned bg)
+{
+    double y = 0.299 * p[0] + 0.587 * p[1] + 0.114 * p[2];
+    return (y * 219 + 16 * p[3]) / 255 + bg * (255 - p[3]) / 255.0;
+}
+
+static const char *check_packed(const SurfaceCheck *c)
+{
+    for (int y = 0; y < c->h; y++) {
+        for (int x = 0; x < c->w; x++) {
+            size_t i = 4 * ((size_t) y * c->w + x);
+            const uint8_t *p = c->premul + i, *out = c->rgba + i;
+            const uint8_t *bg = c->bg + i, *swap = c->bgra + i;
+            for (int k = 0; k < 4; k++) {
+                double ref = p[k] + bg[k] * (255 - p[3]) / 255.0;
+                if (fabs(out[k] - ref) > SURFACE_TOLERANCE)
+                    return "RGBA over background";
+                if (swap[k < 3 ? 2 - k : k] != out[k])
+                    return "BGRA against RGBA";
+            }
+            if (memcmp(out, bg, 4) && !in_rects(c->rects, c->n_rects, x, y))
+                return "RGBA dirty rectangles";
+        }
+    }
+    return NULL;
+}
+
+static const char *check_yuv(const SurfaceCheck *c)
+{
+    size_t luma = (size_t) c->w * c->h, chroma = (size_t) c->cw * c->ch;
+    const uint8_t *bg = c->bg;
+    for (int y = 0; y < c->h; y++) {
+        for (int x = 0; x < c->w; x++) {
+            size_t i = (size_t) y * c->w + x;
+            if (c->nv12[i] != c->i420[i])
+                return "I420 luma against NV12";
+            if (abs((c->p010[i] >> 8) - c->nv12[i]) > 1 || c->p010[i] & 63)
+                return "P010 luma against NV12";
+            if (fabs(c->nv12[i] - ref_luma(c->premul + 4 * i, bg[i])) > SURFACE_TOLERANCE)
+                return "NV12 luma over background";
+            if (c->nv12[i] != bg[i] && !in_rects(c->rects, c->n_rects, x, y))
+                return "NV12 dirty rectangles";
+        }
+    }
+    for (int y = 0; y < c->ch; y++) {
+        for (int x = 0; x < c->cw; x++) {
+            size_t i = (size_t) y * c->cw + x;
+            const uint8_t *uv = c->nv12 + luma + 2 * i;
+            const uint16_t *uv10 = c->p010 + luma + 2 * i;
+            if (uv[0] != c->i420[luma + i] || uv[1] != c->i420[luma + chroma + i])
+                return "I420 chroma against NV12";
+            bool covered = false;
+            for (int k = 0; k < 4; k++) {
+                int lx = FFMIN(2 * x + (k & 1), c->w - 1);
+                int ly = FFMIN(2 * y + (k >> 1), c->h - 1);
+                covered |= c->premul[4 * ((size_t) ly * c->w + lx) + 3] != 0;
+            }
+            for (int k = 0; k < 2; k++) {
+                if (abs((uv10[k] >> 8) - uv[k]) > 1 || uv10[k] & 63)
+                    return "P010 chroma against NV12";
+                if (!covered && uv[k] != bg[luma + 2 * i + k])
+                    return "NV12 chroma outside of images";
+                if (uv[k] != bg[luma + 2 * i + k] &&
+                        !in_rects(c->rects, c->n_rects, 2 * x, 2 * y))
+                    return "NV12 dirty rectangles";
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Render the frame into surfaces of every format over a noisy background
+ * and check them against the scalar blend of ass_render_frame_rgba()
+ * over transparency: every format must agree with it, and every changed sample
+ * must lie inside of the reported dirty rectangles.
+ */
+static Result check_surfaces(ASS_Renderer *renderer, ASS_Track *track,
+                             int64_t time, int w, int h)
+{
+    SurfaceCheck c = { .w = w, .h = h, .cw = (w + 1) / 2, .ch = (h + 1) / 2 };
+    size_t size = (size_t) w * h;
+    size_t yuv_size = size + 2 * (size_t) c.cw * c.ch;
+    c.bg = malloc(4 * size);
+    c.rgba = malloc(4 * size);
+    c.bgra = malloc(4 * size);
+    c.nv12 = malloc(yuv_size);
+    c.i420 = malloc(yuv_size);
+    c.p010 = malloc(2 * yuv_size);
+
+    Result res = R_ERROR;
+    const char *error = NULL;
+    if (!c.bg || !c.rgba || !c.bgra || !c.nv12 || !c.i420 || !c.p010)
+        goto end;
+
+    // independent reference: the scalar blend of ass_render_frame_rgba()
+    Image8 ref = { .width = w, .height = h };
+    if (!render_frame8(&ref, renderer, track, time))
+        goto end;
+    c.premul = ref.buffer;
+    for (size_t i = 3; i < 4 * size; i += 4)
+        c.premul[i] = 255 - c.premul[i];
+
+    fill_noise(c.bg, 4 * size);
+    memcpy(c.rgba, c.bg, 4 * size);
+    for (size_t i = 0; i < 4 * size; i += 4) {
+        c.bgra[i + 0] = c.bg[i + 2];
+        c.bgra[i + 1] = c.bg[i + 1];
+        c.bgra[i + 2] = c.bg[i + 0];
+        c.bgra[i + 3] = c.bg[i + 3];
+    }
+    if (!render_surface(&c, renderer, track, time, ASS_SURFACE_BGRA, c.bgra, false) ||
+            !render_surface(&c, renderer, track, time, ASS_SURFACE_RGBA, c.rgba, true))
+        goto end;
+    error = check_packed(&c);
+    if (!error) {
+        // background of the YUV surfaces, same samples in every layout
+        memcpy(c.nv12, c.bg, yuv_size);
+        memcpy(c.i420, c.bg, size);
+        for (size_t i = 0; i < (size_t) c.cw * c.ch; i++) {
+            c.i420[size + i] = c.bg[size + 2 * i];
+            c.i420[size + (size_t) c.cw * c.ch + i] = c.bg[size + 2 * i + 1];
+        }
+        for (size_t i = 0; i < yuv_size; i++)
+            c.p010[i] = c.bg[i] << 8;
+        if (!render_surface(&c, renderer, track, time, ASS_SURFACE_I420, c.i420, false) ||
+                !render_surface(&c, renderer, track, time, ASS_SURFACE_P010,
+                                (uint8_t *) c.p010, false) ||
+                !render_surface(&c, renderer, track, time, ASS_SURFACE_NV12, c.nv12, true))
+            goto end;
+        error = check_yuv(&c);
+    }
+    res = R_SAME;
+    if (error) {
+        printf("surface check failed: %s, ", error);
+        res = R_FAIL;
+    }
+
+end:
+    free(c.premul);
+    free(c.bg);
+    free(c.rgba);
+    free(c.bgra);
+    free(c.nv12);
+    free(c.i420);
+    free(c.p010);
+    return res;
+}
+
+// Copy of the glyph atlas kept up to date from the reported changes only,
+// the way a texture of the application would be
+typedef struct {
+    uint8_t *pixels;
+    int w, h;
+} AtlasMirror;
+
+typedef struct {
+    const unsigned char *bitmap;
+    int atlas_x, atlas_y;
+} PackedImage;
+
+static const char no_memory[] = "out of memory";
+
+static const char *update_mirror(AtlasMirror *mirror, const ASS_AtlasFrame *frame)
+{
+    if (frame->reset) {
+        size_t size = (size_t) frame->atlas_w * frame->atlas_h;
+        uint8_t *pixels = realloc(mirror->pixels, size ? size : 1);
+        if (!pixels)
+            return no_memory;
+        mirror->pixels = pixels;
+        mirror->w = frame->atlas_w;
+        mirror->h = frame->atlas_h;
+        for (int y = 0; y < mirror->h; y++)
+            memcpy(mirror->pixels + (size_t) y * mirror->w,
+                   frame->atlas + (size_t) y * frame->atlas_stride, mirror->w);
+        return NULL;
+    }
+    if (frame->atlas_w != mirror->w || frame->atlas_h != mirror->h)
+        return "atlas resized without reset";
+    for (int i = 0; i < frame->n_updates; i++) {
+        const ASS_DirtyRect *r = frame->updates + i;
+        if (r->x0 < 0 || r->y0 < 0 || r->x1 > mirror->w || r->y1 > mirror->h)
+            return "update outside of the atlas";
+        for (int y = r->y0; y < r->y1; y++)
+            memcpy(mirror->pixels + (size_t) y * mirror->w + r->x0,
+                   frame->atlas + (size_t) y * frame->atlas_stride + r->x0,
+                   r->x1 - r->x0);
+    }
+    return NULL;
+}
+
+/*
+ * Check every quad against the images of ass_render_frame()
+ * and against the coverage of the mirrored atlas.
+ * The atlas positions of the images are stored into packed, if given.
+ */
+static const char *check_quads(const AtlasMirror *mirror,
+                               const ASS_AtlasFrame *frame, const ASS_Image *img,
+                               PackedImage *packed)
+{
+    int n = 0;
+    for (; img; img = img->next, n++) {
+        if (n >= frame->n_quads)
+            return "missing quads";
+        const ASS_AtlasQuad *q = frame->quads + n;
+        if (q->w != img->w || q->h != img->h ||
+                q->dst_x != img->dst_x || q->dst_y != img->dst_y ||
+                q->color != img->color || q->type != img->type)
+            return "quad does not match its image";
+        if (q->atlas_x < 0 || q->atlas_y < 0 ||
+                q->atlas_x + q->w > mirror->w || q->atlas_y + q->h > mirror->h)
+            return "quad outside of the atlas";
+        for (int y = 0; y < q->h; y++)
+            if (memcmp(mirror->pixels + (size_t) (q->atlas_y + y) * mirror->w + q->atlas_x,
+                       img->bitmap + (size_t) y * img->stride, q->w))
+                return "quad coverage differs from its image";
+        if (packed)
+            packed[n] = (PackedImage) { img->bitmap, q->atlas_x, q->atlas_y };
+    }
+    return n == frame->n_quads ? NULL : "extra quads";
+}
+
+/*
+ * Check that a repeated frame keeps the bitmaps that are still the same
+ * where they were.
+ */
+static const char *check_reuse(const ASS_AtlasFrame *frame, const ASS_Image *img,
+                               const PackedImage *packed, int n_packed)
+{
+    if (frame->reset)
+        return "repeated frame reset the atlas";
+    for (int i = 0; img && i < n_packed; img = img->next, i++) {
+        const ASS_AtlasQuad *q = frame->quads + i;
+        if (img->bitmap == packed[i].bitmap &&
+                (q->atlas_x != packed[i].atlas_x || q->atlas_y != packed[i].atlas_y))
+            return "repeated frame moved a bitmap";
+    }
+    return NULL;
+}
+
+/*
+ * Render the frame into the glyph atlas twice, following the updates
+ * in a mirror of the atlas. The mirror persists over all the images,
+ * so packing, reuse and release of the bitmaps are exercised across
+ * frames, and atlas resets on the way.
+ */
+static Result check_atlas(ASS_Renderer *renderer, ASS_Track *track,
+                          int64_t time, AtlasMirror *mirror)
+{
+    const ASS_AtlasFrame *frame = ass_render_frame_atlas(renderer, track, time, NULL);
+    if (!frame)
+        return R_ERROR;
+    const char *error = update_mirror(mirror, frame);
+    if (error == no_memory)
+        return R_ERROR;
+
+    int n_packed = frame->n_quads;
+    PackedImage *packed = malloc((n_packed + 1) * sizeof(PackedImage));
+    if (!packed)
+        return R_ERROR;
+
+    if (!error)
+        error = check_quads(mirror, frame,
+                            ass_render_frame(renderer, track, time, NULL), packed);
+    if (!error) {
+        frame = ass_render_frame_atlas(renderer, track, time, NULL);
+        error = frame ? update_mirror(mirror, frame) : no_memory;
+    }
+    if (!error) {
+        const ASS_Image *img = ass_render_frame(renderer, track, time, NULL);
+        error = check_quads(mirror, frame, img, NULL);
+        if (!error)
+            error = check_reuse(frame, img, packed, n_packed);
+    }
+    free(packed);
+
+    if (error == no_memory)
+        return R_ERROR;
+    if (!error)
+        return R_SAME;
+    printf("atlas check failed: %s, ", error);
+    return R_FAIL;
+}
+
 static const char *result_text[R_ERROR] = {
     "SAME", "GOOD", "BAD", "FAIL"
 };
@@ -318,10 +701,38 @@ Result classify_result(double error)
         return R_FAIL;
 }
 
+/**
+ * Replace the target image with the rendering result of the stroker,
+ * so that the distance transform border engine is compared against it.
+ * Only the extents of the original target image are used, if any.
+ */
+static bool render_border_target(ASS_Renderer *renderer, ASS_Track *track,
+                                 int64_t time, Image16 *target,
+                                 int scale_x, int scale_y)
+{
+    Image16 frame;
+    frame.width  = target->width;
+    frame.height = target->height;
+    ass_set_border_engine(renderer, ASS_BORDER_STROKER);
+    bool res = render_frame16(&frame, renderer, track, time, scale_x, scale_y);
+    ass_set_border_engine(renderer, ASS_BORDER_DISTANCE);
+    if (!res)
+        return false;
+    free(target->buffer);
+    target->buffer = frame.buffer;
+    return true;
+}
+
+/**
+ * Render one frame and compare it against the target image input/file.
+ * With border set, input can be NULL: the stroker rendering becomes
+ * the target without any image file, in a frame of the script resolution.
+ */
 static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
                             const char *input, const char *output,
                             const char *file, int64_t time,
-                            int scale_x, int scale_y)
+                            int scale_x, int scale_y, bool border,
+                            bool surfaces, AtlasMirror *atlas)
 {
     uint64_t tm = time;
     unsigned msec = tm % 1000;  tm /= 1000;
@@ -330,11 +741,29 @@ static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
     printf("  Time %u:%02u:%02u.%03u - ", (unsigned) tm, min, sec, msec);
 
     char path[4096];
-    snprintf(path, sizeof(path), "%s/%s", input, file);
-
     Image16 target;
-    if (!read_png(path, &target)) {
-        printf("PNG reading failed!\n");
+    if (input) {
+        snprintf(path, sizeof(path), "%s/%s", input, file);
+        if (!read_png(path, &target)) {
+            printf("PNG reading failed!\n");
+            return R_ERROR;
+        }
+    } else {
+        if (track->PlayResX <= 0 || track->PlayResY <= 0) {
+            printf("Missing PlayResX or PlayResY!\n");
+            return R_ERROR;
+        }
+        target.width  = track->PlayResX;
+        target.height = track->PlayResY;
+        target.buffer = NULL;
+    }
+
+    ass_set_storage_size(renderer, target.width, target.height);
+    ass_set_frame_size(renderer, scale_x * target.width, scale_y * target.height);
+    if (border && !render_border_target(renderer, track, time, &target,
+                                        scale_x, scale_y)) {
+        free(target.buffer);
+        out_of_memory();
         return R_ERROR;
     }
 
@@ -346,18 +775,15 @@ static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
     }
     calc_grad(&target, grad);
 
-    ass_set_storage_size(renderer, target.width, target.height);
-    ass_set_frame_size(renderer, scale_x * target.width, scale_y * target.height);
-    ASS_ImageRGBA *img = ass_render_frame_rgba(renderer, track, time, NULL);
-
     const char *out_file = NULL;
     if (output) {
         snprintf(path, sizeof(path), "%s/%s", output, file);
         out_file = path;
     }
     double max_err;
-    int res = compare(&target, grad, img, out_file, &max_err, scale_x, scale_y);
-    ass_free_images_rgba(img);
+    int res = compare(&target, grad, renderer, track, time, out_file,
+                      &max_err, scale_x, scale_y);
+    int32_t width = scale_x * target.width, height = scale_y * target.height;
     free(target.buffer);
     free(grad);
     if (!res) {
@@ -365,6 +791,22 @@ static Result process_image(ASS_Renderer *renderer, ASS_Track *track,
         return R_ERROR;
     }
     Result flag = classify_result(max_err);
+    if (surfaces) {
+        Result check = check_surfaces(renderer, track, time, width, height);
+        if (check == R_ERROR) {
+            out_of_memory();
+            return R_ERROR;
+        }
+        flag = FFMAX(flag, check);
+    }
+    if (atlas) {
+        Result check = check_atlas(renderer, track, time, atlas);
+        if (check == R_ERROR) {
+            out_of_memory();
+            return R_ERROR;
+        }
+        flag = FFMAX(flag, check);
+    }
     printf("%.3f %s\n", max_err, result_text[flag]);
     if (res < 0)
         printf("Cannot write PNG to file '%s'!\n", path);
@@ -534,7 +976,7 @@ static bool process_input(ItemList *list, const char *path, ASS_Library *lib)
 
 
 enum {
-    OUTPUT, SCALE, LEVEL, INPUT
+    OUTPUT, SCALE, LEVEL, BORDER, SURFACES, ATLAS, INPUT
 };
 
 static int *parse_cmdline(int argc, char *argv[])
@@ -550,6 +992,18 @@ static int *parse_cmdline(int argc, char *argv[])
             pos[input++] = i;
             continue;
         }
+        if (argv[i][1] == 'b' && !argv[i][2] && !pos[BORDER]) {
+            pos[BORDER] = i;
+            continue;
+        }
+        if (argv[i][1] == 'y' && !argv[i][2] && !pos[SURFACES]) {
+            pos[SURFACES] = i;
+            continue;
+        }
+        if (argv[i][1] == 'a' && !argv[i][2] && !pos[ATLAS]) {
+            pos[ATLAS] = i;
+            continue;
+        }
         int index;
         switch (argv[i][1]) {
         case 'i':  index = input++;  break;
@@ -568,9 +1022,13 @@ static int *parse_cmdline(int argc, char *argv[])
 fail:
     free(pos);
     const char *fmt =
-        "Usage: %s ([-i] <input-dir>)+ [-o <output-dir>] [-s <scale:1-8>[x<scale:1-8>]] [-p <pass-level:0-3>]\n"
+        "Usage: %s ([-i] <input-dir>)+ [-o <output-dir>] [-s <scale:1-8>[x<scale:1-8>]] [-p <pass-level:0-3>] [-b] [-y] [-a]\n"
         "\n"
-        "Scale can be a single uniform scaling factor or a pair of independent horizontal and vertical factors. -s N is equivalent to -s NxN.\n";
+        "Scale can be a single uniform scaling factor or a pair of independent horizontal and vertical factors. -s N is equivalent to -s NxN.\n"
+        "With -b, borders drawn by the distance transform are compared against the stroker instead of the target images;\n"
+        "scripts without target images are then checked at the middle of each event.\n"
+        "With -y, every frame is also rendered into surfaces of all formats, which are checked for consistency.\n"
+        "With -a, every frame is also rendered into the glyph atlas, which is checked against the images.\n";
     printf(fmt, argv[0] ? argv[0] : "compare");
     return NULL;
 }
@@ -657,6 +1115,9 @@ int main(int argc, char *argv[])
         goto end;
     }
     ass_set_fonts(renderer, NULL, NULL, ASS_FONTPROVIDER_NONE, NULL, 0);
+    bool border = pos[BORDER];
+    bool surfaces = pos[SURFACES];
+    AtlasMirror atlas = {0};
 
     result = 0;
     size_t prefix = 0;
@@ -680,6 +1141,24 @@ int main(int argc, char *argv[])
                 total++;
             } else if (i + 1 < list.n_items && list.items[i + 1].time >= 0)
                 track = load_track(lib, list.items[i].dir, prev);
+            else if (border && (track = load_track(lib, list.items[i].dir, prev))) {
+                // no target images: every event is checked at its midpoint
+                for (int j = 0; j < track->n_events; j++) {
+                    const ASS_Event *event = &track->events[j];
+                    long long time = event->Start + event->Duration / 2;
+                    char file[4096];
+                    snprintf(file, sizeof(file), "%.*s-%04lld.png",
+                             (int) len, name, time);
+                    total++;
+                    Result res = process_image(renderer, track, NULL, output,
+                                               file, time, scale_x, scale_y,
+                                               true, surfaces,
+                                               pos[ATLAS] ? &atlas : NULL);
+                    result = FFMAX(result, res);
+                    if (res <= level)
+                        good++;
+                }
+            }
             continue;
         }
         if (list.items[i].time < 0) {
@@ -691,7 +1170,8 @@ int main(int argc, char *argv[])
             continue;
         Result res = process_image(renderer, track, list.items[i].dir, output,
                                    name, list.items[i].time,
-                                   scale_x, scale_y);
+                                   scale_x, scale_y, border, surfaces,
+                                   pos[ATLAS] ? &atlas : NULL);
         result = FFMAX(result, res);
         if (res <= level)
             good++;
@@ -699,6 +1179,7 @@ int main(int argc, char *argv[])
     if (track)
         ass_free_track(track);
     ass_renderer_done(renderer);
+    free(atlas.pixels);
 
     if (!total) {
         printf("No images found!\n");
@@ -38,6 +38,7 @@
 #include "ass_priv.h"
 #include "ass_shaper.h"
 #include "ass_string.h"
+#include "ass_strpool.h"
 
 #define ass_atof(STR) (ass_strtod((STR),NULL))
 
@@ -58,12 +59,44 @@ static const char *const ssa_event_format =
         "MarginL, MarginR, MarginV, Effect, Text";
 
 #define ASS_STYLES_ALLOC 20
+#define STREAM_CHUNK_SIZE (64 * 1024)
 
 int ass_library_version(void)
 {
     return LIBASS_VERSION;
 }
 
+static void free_stream(ASS_ParserPriv *parser_priv)
+{
+    ParserStream *stream = parser_priv->stream;
+    if (!stream)
+        return;
+    if (stream->close)
+        stream->close(stream->priv);
+    free(stream->buf);
+    free(stream);
+    parser_priv->stream = NULL;
+}
+
+static void free_unpooled(ASS_StringPool *pool, char *str)
+{
+    if (!ass_strpool_owns(pool, str))
+        free(str);
+}
+
+static void free_pooled_events(ASS_Track *track)
+{
+    // pooled strings are freed along with the pool
+    ASS_StringPool *pool = &track->parser_priv->strings;
+    for (int i = 0; i < track->n_events; ++i) {
+        ASS_Event *event = track->events + i;
+        free_unpooled(pool, event->Name);
+        free_unpooled(pool, event->Effect);
+        free_unpooled(pool, event->Text);
+        ass_free_render_priv(event->render_priv);
+    }
+}
+
 void ass_free_track(ASS_Track *track)
 {
     int i;
@@ -71,12 +104,6 @@ void ass_free_track(ASS_Track *track)
     if (!track)
         return;
 
-    if (track->parser_priv) {
-        free(track->parser_priv->read_order_bitmap);
-        free(track->parser_priv->fontname);
-        free(track->parser_priv->fontdata);
-        free(track->parser_priv);
-    }
     free(track->style_format);
     free(track->event_format);
     free(track->Language);
@@ -86,10 +113,26 @@ void ass_free_track(ASS_Track *track)
     }
     free(track->styles);
     if (track->events) {
-        for (i = 0; i < track->n_events; ++i)
-            ass_free_event(track, i);
+        if (track->parser_priv->pool_strings) {
+            free_pooled_events(track);
+        } else {
+            for (i = 0; i < track->n_events; ++i)
+                ass_free_event(track, i);
+        }
     }
     free(track->events);
+    if (track->parser_priv) {
+        ass_strpool_done(&track->parser_priv->strings);
+        EventIndex *index = &track->parser_priv->event_index;
+        free(index->spans);
+        free(index->max_end);
+        free(index->active);
+        free(track->parser_priv->read_order_bitmap);
+        free(track->parser_priv->fontname);
+        free(track->parser_priv->fontdata);
+        free_stream(track->parser_priv);
+        free(track->parser_priv);
+    }
     free(track->name);
     free(track);
 }
@@ -140,14 +183,47 @@ int ass_alloc_event(ASS_Track *track)
     return eid;
 }
 
+/**
+ * \brief Copy a string for an event, into the pool if the track uses one.
+ * \param intern the field has few distinct values, share equal strings
+ */
+static char *new_event_string(ASS_Track *track, const char *str, size_t len,
+                              bool intern)
+{
+    ASS_ParserPriv *parser_priv = track->parser_priv;
+    if (!parser_priv->pool_strings)
+        return ass_copy_string((ASS_StringView) { str, len });
+    if (intern)
+        return ass_strpool_intern(&parser_priv->strings, str, len);
+    return ass_strpool_add(&parser_priv->strings, str, len);
+}
+
+/**
+ * \brief Release an event string, which the application may have
+ * replaced with a string of its own.
+ */
+static void free_event_string(ASS_Track *track, char *str)
+{
+    ASS_ParserPriv *parser_priv = track->parser_priv;
+    if (!parser_priv->pool_strings ||
+            !ass_strpool_release(&parser_priv->strings, str))
+        free(str);
+}
+
 void ass_free_event(ASS_Track *track, int eid)
 {
     ASS_Event *event = track->events + eid;
 
-    free(event->Name);
-    free(event->Effect);
-    free(event->Text);
-    free(event->render_priv);
+    free_event_string(track, event->Name);
+    free_event_string(track, event->Effect);
+    free_event_string(track, event->Text);
+    event->Name = event->Effect = event->Text = NULL;
+    ass_free_render_priv(event->render_priv);
+    event->render_priv = NULL;
+
+    // the slot may be refilled with different timing
+    if (eid < track->parser_priv->event_index.n_spans)
+        track->parser_priv->event_index.n_spans = 0;
 }
 
 void ass_free_style(ASS_Track *track, int sid)
@@ -425,6 +501,15 @@ static int parse_ycbcr_matrix(char *str)
             target->name = new_str; \
         }
 
+// event fields with few distinct values share their storage when pooled
+#define INTERNVAL(name) \
+    } else if (ass_strcasecmp(tname, #name) == 0) { \
+        char *new_str = new_event_string(track, token, strlen(token), true); \
+        if (new_str) { \
+            free_event_string(track, target->name); \
+            target->name = new_str; \
+        }
+
 #define COLORVAL(name) ANYVAL(name,parse_color_header)
 #define INTVAL(name) ANYVAL(name,parse_int_header)
 #define FPVAL(name) ANYVAL(name,ass_atof)
@@ -494,13 +579,11 @@ static int process_event_tail(ASS_Track *track, ASS_Event *event,
     while (1) {
         NEXTNAME(q, tname);
         if (ass_strcasecmp(tname, "Text") == 0) {
-            event->Text = strdup(p);
-            if (event->Text && *event->Text != 0) {
-                char *end = event->Text + strlen(event->Text);
-                while (end > event->Text &&
-                       (end[-1] == '\r' || end[-1] == '\t' || end[-1] == ' '))
-                    *--end = 0;
-            }
+            size_t len = strlen(p);
+            while (len &&
+                   (p[len - 1] == '\r' || p[len - 1] == '\t' || p[len - 1] == ' '))
+                len--;
+            event->Text = new_event_string(track, p, len, false);
             event->Duration -= event->Start;
             free(format);
             return event->Text ? 0 : -1;           // "Text" is always the last
@@ -512,8 +595,8 @@ static int process_event_tail(ASS_Track *track, ASS_Event *event,
         PARSE_START
             INTVAL(Layer)
             STYLEVAL(Style)
-            STRVAL(Name)
-            STRVAL(Effect)
+            INTERNVAL(Name)
+            INTERNVAL(Effect)
             INTVAL(MarginL)
             INTVAL(MarginR)
             INTVAL(MarginV)
@@ -1046,21 +1129,6 @@ static int process_events_line(ASS_Track *track, char *str)
     return 0;
 }
 
-static unsigned char *decode_chars(const unsigned char *src,
-                                   unsigned char *dst, size_t cnt_in)
-{
-    uint32_t value = 0;
-    for (size_t i = 0; i < cnt_in; i++)
-        value |= (uint32_t) ((src[i] - 33u) & 63) << 6 * (3 - i);
-
-    *dst++ = value >> 16;
-    if (cnt_in >= 3)
-        *dst++ = value >> 8 & 0xff;
-    if (cnt_in >= 4)
-        *dst++ = value & 0xff;
-    return dst;
-}
-
 static void reset_embedded_font_parsing(ASS_ParserPriv *parser_priv)
 {
     free(parser_priv->fontname);
@@ -1071,46 +1139,25 @@ static void reset_embedded_font_parsing(ASS_ParserPriv *parser_priv)
     parser_priv->fontdata_used = 0;
 }
 
+/**
+ * \brief Hand the collected data of an embedded font over to the library.
+ * The data stays uuencoded until the font is first opened.
+ */
 static int decode_font(ASS_Track *track)
 {
-    unsigned char *p;
-    unsigned char *q;
-    size_t i;
-    size_t size;                   // original size
-    size_t dsize;                  // decoded size
-    unsigned char *buf = 0;
+    ASS_ParserPriv *parser_priv = track->parser_priv;
+    size_t size = parser_priv->fontdata_used;
 
-    ass_msg(track->library, MSGL_V, "Font: %zu bytes encoded data",
-            track->parser_priv->fontdata_used);
-    size = track->parser_priv->fontdata_used;
+    ass_msg(track->library, MSGL_V, "Font: %zu bytes encoded data", size);
     if (size % 4 == 1) {
         ass_msg(track->library, MSGL_ERR, "Bad encoded data size");
-        goto error_decode_font;
-    }
-    buf = malloc(size / 4 * 3 + FFMAX(size % 4, 1) - 1);
-    if (!buf)
-        goto error_decode_font;
-    q = buf;
-    for (i = 0, p = (unsigned char *) track->parser_priv->fontdata;
-         i < size / 4; i++, p += 4) {
-        q = decode_chars(p, q, 4);
-    }
-    if (size % 4 == 2) {
-        q = decode_chars(p, q, 2);
-    } else if (size % 4 == 3) {
-        q = decode_chars(p, q, 3);
-    }
-    dsize = q - buf;
-    assert(dsize == size / 4 * 3 + FFMAX(size % 4, 1) - 1);
-
-    if (track->library->extract_fonts) {
-        ass_add_font(track->library, track->parser_priv->fontname,
-                     (char *) buf, dsize);
+    } else if (track->library->extract_fonts &&
+               ass_add_font_encoded(track->library, parser_priv->fontname,
+                                    parser_priv->fontdata, size)) {
+        parser_priv->fontdata = NULL;
     }
 
-error_decode_font:
-    free(buf);
-    reset_embedded_font_parsing(track->parser_priv);
+    reset_embedded_font_parsing(parser_priv);
     return 0;
 }
 
@@ -1203,7 +1250,7 @@ static int process_line(ASS_Track *track, char *str)
     return 0;
 }
 
-static int process_text(ASS_Track *track, char *str)
+static void process_lines(ASS_Track *track, char *str)
 {
     char *p = str;
     while (1) {
@@ -1227,6 +1274,11 @@ static int process_text(ASS_Track *track, char *str)
             break;
         p = q;
     }
+}
+
+static int process_text(ASS_Track *track, char *str)
+{
+    process_lines(track, str);
     // there is no explicit end-of-font marker in ssa/ass
     if (track->parser_priv->fontname)
         decode_font(track);
@@ -1288,6 +1340,13 @@ void ass_set_check_readorder(ASS_Track *track, int check_readorder)
     track->parser_priv->check_readorder = check_readorder == 1;
 }
 
+void ass_set_pooled_event_strings(ASS_Track *track, int enable)
+{
+    // events that exist already own malloc'd strings
+    if (!track->n_events)
+        track->parser_priv->pool_strings = enable;
+}
+
 /**
  * \brief Process a chunk of subtitle stream data. In Matroska, this contains exactly 1 event (or a commentary).
  * \param track track
@@ -1371,6 +1430,7 @@ void ass_flush_events(ASS_Track *track)
             ass_free_event(track, eid);
         track->n_events = 0;
     }
+    track->parser_priv->event_index.n_spans = 0;
     free(track->parser_priv->read_order_bitmap);
     track->parser_priv->read_order_bitmap = NULL;
     track->parser_priv->read_order_elems = 0;
@@ -1414,6 +1474,197 @@ void ass_prune_events(ASS_Track *track, long long deadline)
         }
     }
     track->n_events = n_kept;
+    // ids of kept events have shifted
+    track->parser_priv->event_index.n_spans = 0;
+}
+
+static int cmp_event_span(const void *a, const void *b)
+{
+    const EventSpan *s1 = a, *s2 = b;
+    if (s1->start != s2->start)
+        return s1->start < s2->start ? -1 : 1;
+    return s1->id - s2->id;
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    return *(const int *) a - *(const int *) b;
+}
+
+static void update_max_end(EventIndex *index, int pos)
+{
+    int node = index->size + pos;
+    index->max_end[node] = index->spans[pos].end;
+    for (node /= 2; node; node /= 2)
+        index->max_end[node] = FFMAX(index->max_end[2 * node],
+                                     index->max_end[2 * node + 1]);
+}
+
+static bool resize_event_index(EventIndex *index, int size)
+{
+    if (size > INT_MAX / 2)
+        return false;
+    if (!ASS_REALLOC_ARRAY(index->spans, size) ||
+            !ASS_REALLOC_ARRAY(index->max_end, 2 * size) ||
+            !ASS_REALLOC_ARRAY(index->active, size))
+        return false;
+    index->size = size;
+    return true;
+}
+
+static void build_max_end(EventIndex *index)
+{
+    for (int i = 0; i < index->size; i++)
+        index->max_end[index->size + i] =
+            i < index->n_spans ? index->spans[i].end : LLONG_MIN;
+    for (int node = index->size - 1; node; node--)
+        index->max_end[node] = FFMAX(index->max_end[2 * node],
+                                     index->max_end[2 * node + 1]);
+}
+
+static bool rebuild_event_index(ASS_Track *track)
+{
+    EventIndex *index = &track->parser_priv->event_index;
+    index->n_spans = 0;
+
+    int size = 1;
+    while (size < track->n_events)
+        size *= 2;
+    if (size > index->size && !resize_event_index(index, size))
+        return false;
+
+    for (int i = 0; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        index->spans[i].start = event->Start;
+        index->spans[i].end = event->Start + event->Duration;
+        index->spans[i].id = i;
+    }
+    index->n_spans = track->n_events;
+    qsort(index->spans, index->n_spans, sizeof(EventSpan), cmp_event_span);
+    build_max_end(index);
+    return true;
+}
+
+/**
+ * \brief Bring the event index in sync with track->events
+ * Events appended in chronological order are inserted incrementally,
+ * anything else triggers a full rebuild.
+ */
+static bool update_event_index(ASS_Track *track)
+{
+    EventIndex *index = &track->parser_priv->event_index;
+    if (track->n_events < index->n_spans)
+        return rebuild_event_index(track);
+
+    while (index->n_spans < track->n_events) {
+        ASS_Event *event = track->events + index->n_spans;
+        if (index->n_spans &&
+                event->Start < index->spans[index->n_spans - 1].start)
+            return rebuild_event_index(track);
+
+        if (index->n_spans == index->size) {
+            if (!resize_event_index(index, FFMAX(2 * index->size, 64)))
+                return false;
+            build_max_end(index);
+        }
+        EventSpan *span = index->spans + index->n_spans;
+        span->start = event->Start;
+        span->end = event->Start + event->Duration;
+        span->id = index->n_spans;
+        update_max_end(index, index->n_spans++);
+    }
+    return true;
+}
+
+static int collect_active_events(const EventIndex *index, int node,
+                                 int lo, int hi, int limit, long long now,
+                                 int *out, int count)
+{
+    if (lo >= limit || index->max_end[node] <= now)
+        return count;
+    if (node >= index->size) {
+        out[count++] = index->spans[lo].id;
+        return count;
+    }
+    int mid = lo + (hi - lo) / 2;
+    count = collect_active_events(index, 2 * node, lo, mid,
+                                  limit, now, out, count);
+    return collect_active_events(index, 2 * node + 1, mid, hi,
+                                 limit, now, out, count);
+}
+
+// number of events starting no later than now
+static int count_started_events(const EventIndex *index, long long now)
+{
+    int lo = 0, hi = index->n_spans;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (index->spans[mid].start <= now)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/**
+ * \brief Find events active at the given time
+ * Once the index is in sync with track->events, the track is only read,
+ * so queries with separate buffers may run concurrently.
+ * \param buf room for track->n_events ids, or NULL to use a buffer
+ *            owned by the track and valid until its next change
+ * \param ids receives indices into track->events in increasing order
+ * \return number of active events or -1 on allocation failure
+ */
+int ass_find_active_events(ASS_Track *track, long long now,
+                           int *buf, const int **ids)
+{
+    EventIndex *index = &track->parser_priv->event_index;
+    if (!update_event_index(track)) {
+        index->n_spans = 0;
+        return -1;
+    }
+    int *out = buf ? buf : index->active;
+    *ids = out;
+    if (!index->n_spans)
+        return 0;
+
+    int lo = count_started_events(index, now);
+    int count = collect_active_events(index, 1, 0, index->size, lo, now,
+                                      out, 0);
+    qsort(out, count, sizeof(int), cmp_int);
+    return count;
+}
+
+/**
+ * \brief Find the earliest start of an event later than now
+ * \return LLONG_MAX if there is none
+ */
+long long ass_find_next_event_start(ASS_Track *track, long long now)
+{
+    EventIndex *index = &track->parser_priv->event_index;
+    if (!update_event_index(track)) {
+        index->n_spans = 0;
+        long long next = LLONG_MAX;
+        for (int i = 0; i < track->n_events; i++) {
+            long long start = track->events[i].Start;
+            if (start > now && start < next)
+                next = start;
+        }
+        return next;
+    }
+    int lo = count_started_events(index, now);
+    return lo < index->n_spans ? index->spans[lo].start : LLONG_MAX;
+}
+
+int ass_track_active_events(ASS_Track *track, long long now,
+                            int *ids, int max_ids)
+{
+    const int *active;
+    int count = ass_find_active_events(track, now, NULL, &active);
+    if (count > 0 && ids && max_ids > 0)
+        memcpy(ids, active, FFMIN(count, max_ids) * sizeof(int));
+    return count;
 }
 
 #ifdef CONFIG_ICONV
@@ -1628,6 +1879,162 @@ ASS_Track *ass_read_memory(ASS_Library *library, char *buf,
     return track;
 }
 
+/**
+ * \brief Parse the lines of the stream buffer up to its last line break,
+ * or all of it at the end of the stream.
+ */
+static void process_stream_lines(ASS_Track *track, bool eof)
+{
+    ParserStream *stream = track->parser_priv->stream;
+    size_t end = stream->len;
+    if (eof) {
+        stream->buf[end] = '\0';
+    } else {
+        while (end && stream->buf[end - 1] != '\n' &&
+               stream->buf[end - 1] != '\r')
+            end--;
+        if (!end)
+            return;
+        stream->buf[end - 1] = '\0';
+    }
+
+    int old_n_events = track->n_events;
+    process_lines(track, stream->buf);
+    memmove(stream->buf, stream->buf + end, stream->len - end);
+    stream->len -= end;
+
+    // external SSA/ASS subs does not have ReadOrder field
+    for (int i = old_n_events; i < track->n_events; i++) {
+        ASS_Event *event = track->events + i;
+        event->ReadOrder = stream->read_order++;
+        stream->max_start = FFMAX(stream->max_start, event->Start);
+    }
+
+    // a font ends where its section does
+    if (track->parser_priv->fontname &&
+            (eof || track->parser_priv->state != PST_FONTS))
+        decode_font(track);
+}
+
+/**
+ * \brief Read and parse one chunk of a streaming track.
+ * \return 1 if more data remains, 0 at the end of the stream,
+ * negative value on failure
+ */
+static int read_stream_chunk(ASS_Track *track)
+{
+    ParserStream *stream = track->parser_priv->stream;
+
+    // keep room for a whole chunk after a partial line, plus terminator
+    if (stream->size - stream->len < STREAM_CHUNK_SIZE + 1) {
+        size_t size = stream->len + STREAM_CHUNK_SIZE + 1;
+        if (!ASS_REALLOC_ARRAY(stream->buf, size))
+            return -1;
+        stream->size = size;
+    }
+
+    long res = stream->read(stream->priv, stream->buf + stream->len,
+                            STREAM_CHUNK_SIZE);
+    if (res < 0)
+        return -1;
+    stream->len += res;
+    process_stream_lines(track, !res);
+    return res > 0;
+}
+
+int ass_read_stream_until(ASS_Track *track, long long now)
+{
+    ParserStream *stream = track->parser_priv->stream;
+    if (!stream)
+        return 0;
+
+    while (stream->max_start <= now) {
+        int res = read_stream_chunk(track);
+        if (res <= 0) {
+            if (res < 0)
+                ass_msg(track->library, MSGL_WARN,
+                        "Failed to read subtitle stream");
+            free_stream(track->parser_priv);
+            ass_msg(track->library, MSGL_V,
+                    "Finished subtitle stream (%d styles, %d events)",
+                    track->n_styles, track->n_events);
+            return res;
+        }
+    }
+    return 1;
+}
+
+/**
+ * \brief Read subtitles from a stream.
+ * Parses up to the first event; the rest is parsed as needed.
+ */
+ASS_Track *ass_read_stream(ASS_Library *library, ASS_ReadCallback read,
+                           void (*close)(void *priv), void *priv)
+{
+    ASS_Track *track = ass_new_track(library);
+    ParserStream *stream = track ? calloc(1, sizeof(*stream)) : NULL;
+    if (!stream) {
+        ass_free_track(track);
+        if (close)
+            close(priv);
+        return NULL;
+    }
+    stream->read = read;
+    stream->close = close;
+    stream->priv = priv;
+    stream->max_start = LLONG_MIN;
+    track->parser_priv->stream = stream;
+
+    // headers precede the events, so the first event completes them
+    if (ass_read_stream_until(track, LLONG_MIN) < 0 ||
+            track->track_type == TRACK_TYPE_UNKNOWN) {
+        ass_free_track(track);
+        return NULL;
+    }
+
+    ass_process_force_style(track);
+    return track;
+}
+
+static long read_file_stream(void *priv, char *buf, size_t size)
+{
+    FILE *fp = priv;
+    size_t res = fread(buf, 1, size, fp);
+    if (!res && ferror(fp))
+        return -1;
+    return res;
+}
+
+static void close_file_stream(void *priv)
+{
+    fclose(priv);
+}
+
+/**
+ * \brief Read subtitles from file as a stream.
+ */
+ASS_Track *ass_read_file_stream(ASS_Library *library, const char *fname)
+{
+    FILE *fp = ass_open_file(fname, FN_EXTERNAL);
+    if (!fp) {
+        ass_msg(library, MSGL_WARN,
+                "ass_read_file_stream(%s): fopen failed", fname);
+        return NULL;
+    }
+
+    ASS_Track *track = ass_read_stream(library, read_file_stream,
+                                       close_file_stream, fp);
+    if (!track)
+        return NULL;
+
+    track->name = strdup(fname);
+
+    ass_msg(library, MSGL_INFO,
+            "Streaming subtitle file: '%s' (%d styles, %d events so far)",
+            fname, track->n_styles, track->n_events);
+    return track;
+}
+
 static char *read_file_recode(ASS_Library *library, const char *fname,
                               const char *codepage, size_t *size)
 {
@@ -1726,6 +2133,8 @@ long long ass_step_sub(ASS_Track *track, long long now, int movement)
     do {
         ASS_Event *closest = NULL;
         long long closest_time = now;
+        if (direction > 0)
+            ass_read_stream_until(track, target);
         for (i = 0; i < track->n_events; i++) {
             if (direction < 0) {
                 long long end =
@@ -22,6 +22,7 @@
 
 #include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include "ass_types.h"
 
 #define LIBASS_VERSION 0x01704000
@@ -85,6 +86,15 @@ typedef struct ass_image {
     // New fields can be added here in new ABI-compatible library releases.
 } ASS_Image;
 
+/*
+ * A premultiplied RGBA image.
+ *
+ * IMPORTANT: the rgba buffer is READ-ONLY. It is usually shared with the
+ * renderer's caches and with images of other frames, possibly of other
+ * renderers attached to the same cache store, so writing to it corrupts
+ * later output. Copy the pixels before modifying them. Buffers stay valid
+ * until the list is freed with ass_free_images_rgba().
+ */
 typedef struct ass_image_rgba {
     int w, h;                   // Bitmap width/height
     int stride;                 // Bytes per row
@@ -94,6 +104,67 @@ typedef struct ass_image_rgba {
     struct ass_image_rgba *next;
 } ASS_ImageRGBA;
 
+/*
+ * Pixel formats of caller-owned surfaces, see ass_render_frame_into().
+ * Packed formats have one plane of 4-byte pixels named in memory order;
+ * their alpha channel is composited like the color channels.
+ * YUV formats are 4:2:0: NV12 and P010 have a luma plane and an interleaved
+ * CbCr plane, I420 has a luma plane, then a Cb and a Cr plane.
+ * P010 samples are native-endian 16-bit words holding 10 bits in the top.
+ */
+typedef enum {
+    ASS_SURFACE_RGBA,
+    ASS_SURFACE_BGRA,
+    ASS_SURFACE_NV12,
+    ASS_SURFACE_P010,
+    ASS_SURFACE_I420
+    // New enum values can be added here in new ABI-compatible library releases.
+} ASS_SurfaceFormat;
+
+typedef struct ass_surface {
+    ASS_SurfaceFormat format;
+    int w, h;                   // Size in pixels (luma samples for YUV)
+    uint8_t *planes[3];         // Pixels, or the planes of YUV formats in order
+    ptrdiff_t strides[3];       // Bytes per row of each plane
+    ASS_YCbCrMatrix matrix;     // RGB to YCbCr conversion for YUV formats;
+                                // DEFAULT, UNKNOWN and NONE mean BT.601 TV
+} ASS_Surface;
+
+typedef struct ass_dirty_rect {
+    int x0, y0, x1, y1;         // Half-open pixel bounds
+} ASS_DirtyRect;
+
+/*
+ * A coverage bitmap placed on the screen, see ass_render_frame_atlas().
+ */
+typedef struct ass_atlas_quad {
+    int atlas_x, atlas_y;       // Top-left corner of the coverage in the atlas
+    int w, h;                   // Size in pixels
+    int dst_x, dst_y;           // Placement inside the video frame
+    uint32_t color;             // Color and alpha, RGBA, as in ASS_Image
+    int type;                   // IMAGE_TYPE_* of the ASS_Image
+} ASS_AtlasQuad;
+
+/*
+ * A frame rendered into the renderer's glyph atlas.
+ * The atlas is an 8-bit coverage texture that persists between frames,
+ * so only the areas in updates need to be uploaded again, unless reset
+ * is set. Everything here is owned by the renderer and stays valid until
+ * the next call of ass_render_frame_atlas() or ass_renderer_done().
+ */
+typedef struct ass_atlas_frame {
+    const unsigned char *atlas; // Coverage, one byte per pixel;
+                                // NULL until something was packed
+    int atlas_w, atlas_h;       // Atlas size in pixels
+    int atlas_stride;           // Bytes per atlas line
+    int reset;                  // 1 if the atlas was resized or repacked,
+                                // so all of it must be uploaded
+    const ASS_DirtyRect *updates; // Atlas areas written since the last frame
+    int n_updates;
+    const ASS_AtlasQuad *quads; // Images in blending order, like ASS_Image
+    int n_quads;
+} ASS_AtlasFrame;
+
 typedef struct ass_render_result {
     ASS_Image *imgs;            // Legacy bitmap list
     ASS_ImageRGBA *imgs_rgba;   // RGBA list (premultiplied)
@@ -134,6 +205,27 @@ typedef enum {
     ASS_SHAPING_COMPLEX
 } ASS_ShapingLevel;
 
+/**
+ * \brief Border rendering methods.
+ *
+ * STROKER strokes the glyph outline and rasterizes the result. It is exact,
+ * but its cost grows quickly with the border size.
+ * DISTANCE rasterizes the glyph once and grows the bitmap by the border
+ * with a distance transform. Its cost depends only on the bitmap size;
+ * it differs from the stroker by a fraction of a pixel along the edges
+ * and can be used only for borders that stay elliptical on screen
+ * (no perspective or shearing), otherwise the stroker is used anyway.
+ * AUTO uses the distance transform for large borders only.
+ *
+ * The default is ASS_BORDER_STROKER: the distance transform has not been
+ * validated against the stroker on real glyphs yet, so it is opt-in.
+ */
+typedef enum {
+    ASS_BORDER_STROKER = 0,
+    ASS_BORDER_AUTO,
+    ASS_BORDER_DISTANCE
+} ASS_BorderEngine;
+
 /**
  * \brief Style override options. See
  * ass_set_selective_style_override_enabled() for details.
@@ -332,6 +424,19 @@ void ass_library_done(ASS_Library *priv);
  */
 void ass_set_fonts_dir(ASS_Library *priv, const char *fonts_dir);
 
+/**
+ * \brief Set a file used to persist the metadata of fonts from fonts_dir
+ * and of embedded fonts between sessions.
+ * Fonts found in this index are registered without being opened,
+ * and the index is updated whenever new fonts are scanned.
+ * Files from fonts_dir are identified by path, size and modification time,
+ * embedded fonts by a hash of their data.
+ * The file is created if it does not exist.
+ * \param priv library handle
+ * \param path index file path, or NULL to disable (default)
+ */
+void ass_set_font_index_file(ASS_Library *priv, const char *path);
+
 /**
  * \brief Whether fonts should be extracted from track data.
  * \param priv library handle
@@ -442,6 +547,12 @@ void ass_set_storage_size(ASS_Renderer *priv, int w, int h);
  */
 void ass_set_shaper(ASS_Renderer *priv, ASS_ShapingLevel level);
 
+/**
+ * \brief Set the method used to render glyph borders.
+ * \param engine border engine, see ASS_BorderEngine
+ */
+void ass_set_border_engine(ASS_Renderer *priv, ASS_BorderEngine engine);
+
 /**
  * \brief Set frame margins.  These values may be negative if pan-and-scan
  * is used. The margins are in pixels. Each value specifies the distance from
@@ -616,11 +727,179 @@ int ass_fonts_update(ASS_Renderer *priv);
  *
  * \param priv renderer handle
  * \param glyph_max maximum number of cached glyphs
- * \param bitmap_max_size maximum bitmap cache size (in MB)
+ * \param bitmap_max_size maximum bitmap cache size (in MB), a third of it
+ * for composited images; cached RGBA images may use as much as composited
+ * ones on top of that
  */
 void ass_set_cache_limits(ASS_Renderer *priv, int glyph_max,
                           int bitmap_max_size);
 
+/**
+ * \brief Set one memory budget for all cached images.
+ * Instead of the fixed split of ass_set_cache_limits() between glyph
+ * bitmaps, composited bitmaps and RGBA images, the caches share the budget
+ * according to how long their contents took to build. Within each cache,
+ * images that are expensive to rebuild for their size are kept longer
+ * than cheap ones used equally recently.
+ *
+ * \param priv renderer handle
+ * \param budget_mb maximum total size of cached images (in MB),
+ * 0 to go back to the limits set with ass_set_cache_limits()
+ */
+void ass_set_cache_budget(ASS_Renderer *priv, int budget_mb);
+
+typedef enum {
+    ASS_MEMORY_PRESSURE_MODERATE = 1,   // cut the caches to half their limits
+    ASS_MEMORY_PRESSURE_CRITICAL = 2,   // drop everything that is not in use
+} ASS_MemoryPressure;
+
+/**
+ * \brief Signal that the system is running low on memory.
+ * The caches are trimmed once, below their usual limits; with critical
+ * pressure the renderer also drops the images it keeps for reuse between
+ * frames. For a shared cache store, trimming is deferred until the frames
+ * being rendered by other renderers end.
+ *
+ * \param priv renderer handle
+ * \param level how much memory to release
+ */
+void ass_set_memory_pressure(ASS_Renderer *priv, ASS_MemoryPressure level);
+
+/**
+ * \brief Create a cache store that can be shared by several renderers.
+ * Fonts, glyph outlines, bitmaps and composited images built by one attached
+ * renderer are reused by the others. Attached renderers may render
+ * concurrently from different threads; cache limits (ass_set_cache_limits)
+ * then apply to the store as a whole, and are enforced at the start of
+ * a frame while no other attached renderer is rendering. Once the caches
+ * outgrow their limits by more than a quarter, new frames wait for the
+ * running ones to end so that the store can be trimmed.
+ *
+ * All renderers attached to one store must use the same ASS_Library and the
+ * same font settings (ass_set_fonts). Attaching, detaching, destroying an
+ * attached renderer or changing its fonts must not happen while another
+ * renderer attached to the same store is rendering.
+ *
+ * \return newly created store, or NULL on failure
+ */
+ASS_CacheStore *ass_cache_store_init(void);
+
+/**
+ * \brief Release a cache store created by ass_cache_store_init.
+ * The store itself is freed once no renderer is attached to it anymore.
+ * \param store store to release, may be NULL
+ */
+void ass_cache_store_done(ASS_CacheStore *store);
+
+/**
+ * \brief Attach a renderer to a shared cache store.
+ * The renderer's previous caches are released.
+ *
+ * \param priv renderer handle
+ * \param store store created by ass_cache_store_init, or NULL to give the
+ * renderer private caches again
+ */
+void ass_set_cache_store(ASS_Renderer *priv, ASS_CacheStore *store);
+
+/**
+ * \brief Set the number of threads used to render the events of a frame.
+ * With more than one thread, the active events of each frame are rendered
+ * in parallel; the resulting image lists are identical to serial rendering.
+ * Text shaping and font loading are still serialized internally.
+ * The message callback may then be invoked from the worker threads.
+ * The worker threads are started here and kept idle between frames
+ * until the thread count changes or the renderer is freed.
+ * Has no effect if libass was built without thread support.
+ *
+ * \param priv renderer handle
+ * \param threads number of threads including the calling one;
+ * 1 (the default) disables parallel rendering
+ */
+void ass_set_threads(ASS_Renderer *priv, int threads);
+
+/**
+ * \brief Allocate frame output from arenas kept by the renderer.
+ * Image nodes and the RGBA pixels they own are then bump-allocated from
+ * memory that is reused every other frame instead of being allocated and
+ * freed one by one. The arenas of a frame are recycled when the frame
+ * after the next one is started: RGBA lists must be freed with
+ * ass_free_images_rgba() before that and must not be used afterwards.
+ *
+ * \param priv renderer handle
+ * \param block_size initial arena size in bytes per rendering thread;
+ * arenas grow as needed. 0 (the default) disables arenas.
+ */
+void ass_set_frame_arena(ASS_Renderer *priv, size_t block_size);
+
+typedef enum {
+    ASS_CACHE_FONT,
+    ASS_CACHE_OUTLINE,
+    ASS_CACHE_BITMAP,
+    ASS_CACHE_COMPOSITE,
+    ASS_CACHE_RGBA,
+    ASS_CACHE_FACE_SIZE_METRICS,
+    ASS_CACHE_GLYPH_METRICS,
+    ASS_CACHE_SHAPED_RUN,
+    ASS_CACHE_COUNT
+} ASS_CacheType;
+
+typedef struct ass_cache_stats {
+    uint64_t lookups;
+    uint64_t hits;
+    uint64_t misses;            // lookups that constructed a new item
+    uint64_t evictions;         // items dropped to stay within the limits
+    uint64_t construct_ns;      // time spent constructing items
+    size_t size;                // current size in the unit of its limit:
+                                // bytes for the image and shaped run caches,
+                                // items otherwise
+    size_t items;               // current number of items
+} ASS_CacheStats;
+
+/*
+ * Stages of event rendering. Nested work is only counted in the inner stage,
+ * e.g. rasterizing the glyphs of a clip counts as clipping.
+ */
+typedef enum {
+    ASS_STAGE_PARSE,            // override tag parsing
+    ASS_STAGE_SHAPE,            // font selection and text shaping
+    ASS_STAGE_LAYOUT,           // line wrapping and positioning
+    ASS_STAGE_OUTLINE,          // glyph outline retrieval
+    ASS_STAGE_STROKE,           // border outline generation
+    ASS_STAGE_RASTERIZE,        // glyph and border rasterization
+    ASS_STAGE_BLUR,             // combining glyph bitmaps, blur and shadow
+    ASS_STAGE_COMPOSITE,        // building image lists from the bitmaps
+    ASS_STAGE_RGBA,             // RGBA conversion and gradients
+    ASS_STAGE_CLIP,             // vector clips
+    ASS_STAGE_COUNT
+} ASS_RenderStage;
+
+typedef struct ass_renderer_stats {
+    uint64_t frames;            // frames rendered
+    uint64_t events_rendered;
+    uint64_t events_reused;     // static events kept from the previous frame
+    uint64_t stage_ns[ASS_STAGE_COUNT];     // time spent in each stage,
+                                            // summed over all threads
+    ASS_CacheStats caches[ASS_CACHE_COUNT];
+} ASS_RendererStats;
+
+/**
+ * \brief Retrieve rendering statistics.
+ * Counters accumulate from renderer creation or the last reset; resetting
+ * after every frame gives per-frame numbers. Cache counters belong to the
+ * cache store, so with a shared store they include the lookups of all
+ * attached renderers and are reset for all of them.
+ * Stage times are only measured from the first call on, so call it once
+ * before rendering (e.g. with reset set) to get them for all frames.
+ * Must not be called while the renderer is rendering.
+ * New members may be appended to these structures in future versions.
+ *
+ * \param priv renderer handle
+ * \param stats filled with the current counters
+ * \param reset clear the counters after reading them
+ */
+void ass_renderer_get_stats(ASS_Renderer *priv, ASS_RendererStats *stats,
+                            int reset);
+
 /**
  * \brief Render a frame, producing a list of ASS_Image.
  * \param priv renderer handle
@@ -639,6 +918,122 @@ void ass_free_images_rgba(ASS_ImageRGBA *img);
 int ass_track_has_rgba(ASS_Track *track);
 int ass_frame_needs_rgba(ASS_Renderer *priv);
 
+/**
+ * \brief Get the areas that differ between the two last rendered frames.
+ * Like detect_change of ass_render_frame, this is based on the placement
+ * and identity of the images rather than on their pixels, but it is
+ * localized: outside of the returned rectangles both frames composite
+ * to exactly the same result, so only these areas need to be redrawn.
+ * A frame that fails to render counts as empty.
+ * Frames are only compared once this has been called: the first call
+ * reports the whole frame, and following calls the actual changes.
+ * \param priv renderer handle
+ * \param rects array receiving the rectangles in frame pixels;
+ * they may overlap
+ * \param max_rects capacity of rects, nearby areas are merged to fit
+ * \return number of rectangles stored, 0 if nothing changed
+ */
+int ass_get_changed_rects(ASS_Renderer *priv, ASS_DirtyRect *rects,
+                          int max_rects);
+
+/**
+ * \brief Find when the rendered output may change next.
+ * Event boundaries, animations (transforms, movement and fades, including
+ * the VSFilterMod variants), karaoke, jitter and scrolling effects are
+ * accounted for: until the returned time, ass_render_frame() produces
+ * the same images as at now, so the previous frame can be kept on screen.
+ * This relies on the events active at now having been rendered by priv
+ * with the look they have at now, normally by rendering the frame at now;
+ * otherwise now + 1 is returned. Changes to the track or to the renderer
+ * settings made afterwards are not taken into account.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \return earliest timestamp after now at which the output may differ,
+ * or LLONG_MAX if it never changes again
+ */
+long long ass_next_change(ASS_Renderer *priv, ASS_Track *track, long long now);
+
+/**
+ * \brief Render a frame and blend it directly into a caller-owned surface.
+ * Both the plain and the RGBA image lists are composited as appropriate,
+ * using the renderer's SIMD blend functions where available. Colors are
+ * converted with surface->matrix as is; no VSFilter color mangling is
+ * applied (see ASS_YCbCrMatrix). The surface is not cleared beforehand.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param surface destination, its size normally matches the frame size
+ * \param rects array receiving the areas that were drawn to; rectangles
+ * may overlap, and nearby areas are merged once max_rects are in use.
+ * For YUV formats they are expanded to even coordinates. May be NULL.
+ * \param max_rects capacity of rects
+ * \param detect_change same as for ass_render_frame
+ * \return number of rectangles stored in rects, or -1 if the surface
+ * description is invalid
+ */
+int ass_render_frame_into(ASS_Renderer *priv, ASS_Track *track, long long now,
+                          const ASS_Surface *surface, ASS_DirtyRect *rects,
+                          int max_rects, int *detect_change);
+
+/**
+ * \brief Render a frame into a persistent glyph atlas.
+ * Instead of one bitmap per image, the coverage of all images is packed
+ * into a single atlas texture, and the frame is returned as quads
+ * sampling it. Bitmaps keep their place in the atlas for as long as
+ * consecutive frames use them, so these usually upload little or nothing.
+ * The space of bitmaps a frame no longer uses is cleared, which is part
+ * of the updates, and reused. Like ass_render_frame(), this produces flat
+ * colored coverage only; gradients require ass_render_frame_rgba().
+ * Every pair of packed bitmaps is separated by at least one empty pixel.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param now video timestamp in milliseconds
+ * \param detect_change same as for ass_render_frame
+ * \return frame description owned by the renderer, or NULL on failure
+ */
+const ASS_AtlasFrame *ass_render_frame_atlas(ASS_Renderer *priv,
+                                             ASS_Track *track, long long now,
+                                             int *detect_change);
+
+/**
+ * \brief Callback receiving the frames of ass_render_frames_batch().
+ * \param priv private data passed to ass_render_frames_batch()
+ * \param index index of the frame in the times array
+ * \param images image list of the frame, valid until the callback
+ * returns unless referenced with ass_frame_ref(); NULL if the frame is
+ * empty or could not be rendered
+ * \param detect_change same as for ass_render_frame, relative to the
+ * previously delivered frame
+ */
+typedef void (*ASS_FrameCallback)(void *priv, int index, ASS_Image *images,
+                                  int detect_change);
+
+/**
+ * \brief Render a sequence of frames, using the threads set with
+ * ass_set_threads() to render several frames at once.
+ * Frames are delivered to the callback in order, on the calling thread,
+ * and are identical to calling ass_render_frame() for each timestamp:
+ * collisions are resolved in timestamp order as usual.
+ * Consecutive timestamps are rendered by the same thread, so timestamps
+ * in playback order make the best use of the caches. The following frames
+ * are rendered while the callback runs.
+ * The track is read up to the last timestamp at once, and events are only
+ * pruned (see ass_configure_prune) after all frames are delivered.
+ * The track and the renderer must not be used from other threads,
+ * nor modified from the callback.
+ * \param priv renderer handle
+ * \param track subtitle track
+ * \param times video timestamps in milliseconds
+ * \param n_times number of timestamps
+ * \param callback function receiving the frames
+ * \param cb_priv private data passed to the callback
+ * \return number of frames rendered successfully
+ */
+int ass_render_frames_batch(ASS_Renderer *priv, ASS_Track *track,
+                            const long long *times, int n_times,
+                            ASS_FrameCallback callback, void *cb_priv);
+
 
 /*
  * The following functions operate on track objects and do not need
@@ -763,6 +1158,21 @@ void ass_process_chunk(ASS_Track *track, const char *data, int size,
  */
 void ass_set_check_readorder(ASS_Track *track, int check_readorder);
 
+/**
+ * \brief Set whether the strings of parsed events are kept in a pool
+ * owned by the track. Text is packed into shared chunks, and equal Name
+ * and Effect values are stored only once, which saves allocations and
+ * memory on large tracks.
+ * While enabled, these strings must not be modified or freed by the
+ * application, as they may be shared between events. The fields may still
+ * be replaced with malloc'd strings, which the track then frees as usual.
+ * Has no effect once the track contains events.
+ * \param track track
+ * \param enable 1 to pool the strings, 0 to allocate each one with malloc()
+ * If this function is not called, the default value is 0.
+ */
+void ass_set_pooled_event_strings(ASS_Track *track, int enable);
+
 /**
  * \brief Prune events that preceed deadline.
  * \param track track
@@ -781,6 +1191,23 @@ void ass_prune_events(ASS_Track *track, long long deadline);
  */
 void ass_configure_prune(ASS_Track *track, long long delay);
 
+/**
+ * \brief Find events displayed at the given time.
+ * Uses a time index maintained by the track, so the cost depends on
+ * the number of active events rather than the size of the track.
+ * Like ass_render_frame, this snapshots the timing of all events
+ * currently in the track, see GENERAL NOTE in ass_types.h.
+ * \param track track
+ * \param now timestamp in milliseconds
+ * \param ids array receiving indices into track->events of active events
+ * in increasing order, at most max_ids of them; can be NULL
+ * \param max_ids size of the ids array
+ * \return total number of active events, which can exceed max_ids,
+ * or negative value on failure
+ */
+int ass_track_active_events(ASS_Track *track, long long now,
+                            int *ids, int max_ids);
+
 /**
  * \brief Flush buffered events.
  * \param track track
@@ -812,6 +1239,53 @@ ASS_Track *ass_read_file(ASS_Library *library, const char *fname,
 */
 ASS_Track *ass_read_memory(ASS_Library *library, char *buf,
                            size_t bufsize, const char *codepage);
+/**
+ * \brief Callback supplying subtitle data to ass_read_stream().
+ * \param priv private data passed to ass_read_stream()
+ * \param buf buffer to fill
+ * \param size size of buf
+ * \return number of bytes written to buf, 0 at the end of the data
+ * or negative value on error
+ */
+typedef long (*ASS_ReadCallback)(void *priv, char *buf, size_t size);
+
+/**
+ * \brief Read subtitles incrementally from a stream.
+ * Only the headers and the first event are parsed before returning,
+ * the rest of the data is parsed in chunks as playback advances:
+ * ass_render_frame() and ass_step_sub() read events up to the requested
+ * time, ass_read_stream_until() can be used to read ahead explicitly.
+ * Events are expected in chronological order; an event is not shown
+ * before the stream has been read up to its position.
+ * The data must be in UTF-8, no recoding is done.
+ * \param library library handle
+ * \param read callback supplying the data
+ * \param close optional callback releasing priv, called once the end of
+ * the data is reached, on failure or when the track is freed
+ * \param priv private data passed to the callbacks
+ * \return newly allocated track or NULL on failure
+ */
+ASS_Track *ass_read_stream(ASS_Library *library, ASS_ReadCallback read,
+                           void (*close)(void *priv), void *priv);
+
+/**
+ * \brief Read subtitles incrementally from file, see ass_read_stream().
+ * \param library library handle
+ * \param fname file name, see ass_read_file()
+ * \return newly allocated track or NULL on failure
+ */
+ASS_Track *ass_read_file_stream(ASS_Library *library, const char *fname);
+
+/**
+ * \brief Parse more of a track created by ass_read_stream().
+ * \param track track
+ * \param now read until an event starting after this time (ms) is found;
+ * pass LLONG_MAX to read everything
+ * \return 1 if more data remains, 0 once the whole stream has been read
+ * or for tracks not read from a stream, negative value on error
+ */
+int ass_read_stream_until(ASS_Track *track, long long now);
+
 /**
  * \brief Read styles from file into already initialized track.
  * \param fname file name
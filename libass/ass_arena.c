@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include "ass_utils.h"
+#include "ass_arena.h"
+
+struct arena_block {
+    ArenaBlock *next;
+    size_t size;
+    // followed by size bytes of data
+};
+
+void ass_arena_init(ASS_Arena *arena, size_t block_size)
+{
+    memset(arena, 0, sizeof(*arena));
+    arena->block_size = block_size;
+}
+
+/**
+ * \brief Allocate memory that stays valid until the arena is reset.
+ * \param align power of two
+ */
+void *ass_arena_alloc(ASS_Arena *arena, size_t size, size_t align)
+{
+    ArenaBlock *block = arena->cur;
+    size_t used = arena->used;
+    while (block) {
+        uintptr_t base = (uintptr_t) (block + 1);
+        uintptr_t ptr = (base + used + align - 1) & ~(uintptr_t) (align - 1);
+        size_t offs = ptr - base;
+        if (offs <= block->size && size <= block->size - offs) {
+            arena->cur = block;
+            arena->used = offs + size;
+            return (void *) ptr;
+        }
+        // blocks after cur are unused since the last reset
+        block = block->next;
+        used = 0;
+    }
+
+    if (size > SIZE_MAX - sizeof(ArenaBlock) - align)
+        return NULL;
+    size_t block_size = FFMAX(arena->block_size, size + align);
+    block = malloc(sizeof(ArenaBlock) + block_size);
+    if (!block)
+        return NULL;
+    block->next = NULL;
+    block->size = block_size;
+    if (arena->last)
+        arena->last->next = block;
+    else
+        arena->first = block;
+    arena->last = block;
+    // grow geometrically, so that a frame settles in a few blocks
+    if (block_size <= SIZE_MAX / 4 - sizeof(ArenaBlock))
+        arena->block_size = 2 * block_size;
+
+    uintptr_t base = (uintptr_t) (block + 1);
+    uintptr_t ptr = (base + align - 1) & ~(uintptr_t) (align - 1);
+    arena->cur = block;
+    arena->used = ptr - base + size;
+    return (void *) ptr;
+}
+
+/**
+ * \brief Release all allocations at once, keeping the blocks for reuse.
+ */
+void ass_arena_reset(ASS_Arena *arena)
+{
+    arena->cur = arena->first;
+    arena->used = 0;
+}
+
+/**
+ * \brief Free all blocks. The arena can be used again afterwards.
+ */
+void ass_arena_done(ASS_Arena *arena)
+{
+    ArenaBlock *block = arena->first;
+    while (block) {
+        ArenaBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->first = arena->last = arena->cur = NULL;
+    arena->used = 0;
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_ARENA_H
+#define LIBASS_ARENA_H
+
+#include <stddef.h>
+
+// alignment sufficient for any struct allocated from an arena
+#define ASS_ARENA_ALIGN 16
+
+typedef struct arena_block ArenaBlock;
+
+// Bump allocator for memory released all at once.
+// Blocks are kept when the arena is reset, so once an arena has grown
+// to the size of its typical workload, allocations no longer hit malloc.
+typedef struct {
+    ArenaBlock *first, *last;
+    ArenaBlock *cur;        // block allocations are currently taken from
+    size_t used;            // bytes used in cur
+    size_t block_size;      // size of the next block to be created
+} ASS_Arena;
+
+void ass_arena_init(ASS_Arena *arena, size_t block_size);
+void *ass_arena_alloc(ASS_Arena *arena, size_t size, size_t align);
+void ass_arena_reset(ASS_Arena *arena);
+void ass_arena_done(ASS_Arena *arena);
+
+#endif /* LIBASS_ARENA_H */
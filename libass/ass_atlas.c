@@ -0,0 +1,560 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_render.h"
+#include "ass_utils.h"
+
+#define ATLAS_MIN_SIZE 1024
+#define ATLAS_MAX_SIZE 8192
+#define ATLAS_PADDING 1         // empty pixels between bitmaps
+#define SHELF_ALIGN 4           // shelf heights are multiples of this
+
+// free run of pixels along a shelf
+typedef struct {
+    int x, w;
+} AtlasSpan;
+
+// row of bitmaps of similar height
+typedef struct {
+    int y, h;
+    AtlasSpan *spans;           // free runs, sorted by x and never adjacent
+    int n_spans, max_spans;
+} AtlasShelf;
+
+// bitmap packed into the atlas
+typedef struct {
+    const uint8_t *key;         // bitmap plane of a composite or image pixels,
+                                // NULL if the bitmap has no stable identity
+    CompositeHashValue *source; // referenced while packed
+    void *image_buffer;         // referenced while packed
+    int shelf;
+    int x, y, w, h;             // area taken, padding included
+    unsigned frame;             // last frame using the bitmap
+} AtlasEntry;
+
+struct atlas {
+    uint8_t *pixels;            // free space is always zero
+    int w, h;                   // stride is w
+    bool can_grow;              // grow when full instead of repacking
+    unsigned frame_id;
+
+    AtlasShelf *shelves;
+    int n_shelves, max_shelves;
+    int shelf_end;              // y below the last shelf
+
+    AtlasEntry *entries;
+    int n_entries, max_entries;
+    int *table;                 // entry index + 1 by key, 0 if free
+    size_t table_size;
+
+    ASS_AtlasFrame frame;
+    ASS_DirtyRect *updates;
+    int max_updates;
+    ASS_AtlasQuad *quads;
+    int max_quads;
+};
+
+static void release_entry(AtlasEntry *entry)
+{
+    ass_cache_dec_ref(entry->source);
+    ass_image_buffer_unref(entry->image_buffer);
+}
+
+static void clear_atlas(ASS_Atlas *atlas)
+{
+    for (int i = 0; i < atlas->n_entries; i++)
+        release_entry(atlas->entries + i);
+    atlas->n_entries = 0;
+    if (atlas->table)
+        memset(atlas->table, 0, atlas->table_size * sizeof(int));
+    for (int i = 0; i < atlas->n_shelves; i++)
+        free(atlas->shelves[i].spans);
+    atlas->n_shelves = 0;
+    atlas->shelf_end = 0;
+    if (atlas->pixels)
+        memset(atlas->pixels, 0, (size_t) atlas->w * atlas->h);
+    atlas->frame.reset = 1;
+}
+
+void ass_atlas_free(ASS_Atlas *atlas)
+{
+    if (!atlas)
+        return;
+    clear_atlas(atlas);
+    free(atlas->pixels);
+    free(atlas->shelves);
+    free(atlas->entries);
+    free(atlas->table);
+    free(atlas->updates);
+    free(atlas->quads);
+    free(atlas);
+}
+
+static inline size_t hash_key(const uint8_t *key, size_t mask)
+{
+    return ((uintptr_t) key >> 4) * 0x9E3779B1u & mask;
+}
+
+static AtlasEntry *find_entry(ASS_Atlas *atlas, const uint8_t *key)
+{
+    if (!atlas->table_size || !key)
+        return NULL;
+    size_t mask = atlas->table_size - 1;
+    for (size_t i = hash_key(key, mask); atlas->table[i];
+            i = (i + 1) & mask) {
+        AtlasEntry *entry = atlas->entries + atlas->table[i] - 1;
+        if (entry->key == key)
+            return entry;
+    }
+    return NULL;
+}
+
+static void insert_entry(ASS_Atlas *atlas, int index)
+{
+    const uint8_t *key = atlas->entries[index].key;
+    if (!key)
+        return;
+    size_t mask = atlas->table_size - 1;
+    size_t i = hash_key(key, mask);
+    while (atlas->table[i])
+        i = (i + 1) & mask;
+    atlas->table[i] = index + 1;
+}
+
+static bool add_update(ASS_Atlas *atlas, int x, int y, int w, int h)
+{
+    ASS_AtlasFrame *frame = &atlas->frame;
+    if (frame->n_updates == atlas->max_updates) {
+        int max_updates = FFMAX(2 * atlas->max_updates, 64);
+        if (!ASS_REALLOC_ARRAY(atlas->updates, max_updates))
+            return false;
+        atlas->max_updates = max_updates;
+    }
+    atlas->updates[frame->n_updates++] = (ASS_DirtyRect) {
+        x, y, x + w, y + h
+    };
+    return true;
+}
+
+static bool add_span(AtlasShelf *shelf, int index, int x, int w)
+{
+    if (shelf->n_spans == shelf->max_spans) {
+        int max_spans = FFMAX(2 * shelf->max_spans, 4);
+        if (!ASS_REALLOC_ARRAY(shelf->spans, max_spans))
+            return false;
+        shelf->max_spans = max_spans;
+    }
+    memmove(shelf->spans + index + 1, shelf->spans + index,
+            (shelf->n_spans - index) * sizeof(AtlasSpan));
+    shelf->spans[index] = (AtlasSpan) { x, w };
+    shelf->n_spans++;
+    return true;
+}
+
+static void remove_span(AtlasShelf *shelf, int index)
+{
+    shelf->n_spans--;
+    memmove(shelf->spans + index, shelf->spans + index + 1,
+            (shelf->n_spans - index) * sizeof(AtlasSpan));
+}
+
+/**
+ * \brief Return an area to the free runs of its shelf.
+ * Shelves left empty at the bottom are dropped.
+ * \return false on allocation failure
+ */
+static bool free_space(ASS_Atlas *atlas, int index, int x, int w)
+{
+    AtlasShelf *shelf = atlas->shelves + index;
+    int i = 0;
+    while (i < shelf->n_spans && shelf->spans[i].x < x)
+        i++;
+    bool join_prev = i > 0 &&
+        shelf->spans[i - 1].x + shelf->spans[i - 1].w == x;
+    bool join_next = i < shelf->n_spans && x + w == shelf->spans[i].x;
+    if (join_prev && join_next) {
+        shelf->spans[i - 1].w += w + shelf->spans[i].w;
+        remove_span(shelf, i);
+    } else if (join_prev) {
+        shelf->spans[i - 1].w += w;
+    } else if (join_next) {
+        shelf->spans[i].x = x;
+        shelf->spans[i].w += w;
+    } else if (!add_span(shelf, i, x, w))
+        return false;
+
+    while (atlas->n_shelves) {
+        shelf = atlas->shelves + atlas->n_shelves - 1;
+        if (shelf->n_spans != 1 || shelf->spans[0].w != atlas->w)
+            break;
+        free(shelf->spans);
+        atlas->shelf_end = shelf->y;
+        atlas->n_shelves--;
+    }
+    return true;
+}
+
+/**
+ * \brief Drop the bitmaps that the current frame does not use.
+ * Their pixels are cleared, so that free space stays empty.
+ * \return false on allocation failure
+ */
+static bool release_unused(ASS_Atlas *atlas)
+{
+    int n = 0;
+    bool ok = true;
+    for (int i = 0; i < atlas->n_entries; i++) {
+        AtlasEntry *entry = atlas->entries + i;
+        if (entry->frame == atlas->frame_id) {
+            atlas->entries[n++] = *entry;
+            continue;
+        }
+        uint8_t *dst = atlas->pixels + (size_t) entry->y * atlas->w + entry->x;
+        for (int y = 0; y < entry->h; y++)
+            memset(dst + (size_t) y * atlas->w, 0, entry->w);
+        ok &= add_update(atlas, entry->x, entry->y, entry->w, entry->h);
+        ok &= free_space(atlas, entry->shelf, entry->x, entry->w);
+        release_entry(entry);
+    }
+    if (n == atlas->n_entries)
+        return ok;
+
+    atlas->n_entries = n;
+    memset(atlas->table, 0, atlas->table_size * sizeof(int));
+    for (int i = 0; i < n; i++)
+        insert_entry(atlas, i);
+    return ok;
+}
+
+/**
+ * \brief Enlarge the atlas, keeping the position of everything packed.
+ */
+static bool grow_atlas(ASS_Atlas *atlas)
+{
+    int w = atlas->w, h = atlas->h;
+    if (!w)
+        w = h = ATLAS_MIN_SIZE;
+    else if (h < w)
+        h *= 2;
+    else if (w < ATLAS_MAX_SIZE)
+        w *= 2;
+    else
+        return false;
+    if (h > ATLAS_MAX_SIZE)
+        return false;
+
+    uint8_t *pixels = calloc((size_t) w * h, 1);
+    if (!pixels)
+        return false;
+    for (int y = 0; y < atlas->h; y++)
+        memcpy(pixels + (size_t) y * w, atlas->pixels + (size_t) y * atlas->w,
+               atlas->w);
+
+    // the new part of every shelf is free,
+    // failing to record it only wastes the space
+    for (int i = 0; i < atlas->n_shelves && w > atlas->w; i++) {
+        AtlasShelf *shelf = atlas->shelves + i;
+        AtlasSpan *last = shelf->spans + shelf->n_spans - 1;
+        if (shelf->n_spans && last->x + last->w == atlas->w)
+            last->w += w - atlas->w;
+        else
+            add_span(shelf, shelf->n_spans, atlas->w, w - atlas->w);
+    }
+    free(atlas->pixels);
+    atlas->pixels = pixels;
+    atlas->w = w;
+    atlas->h = h;
+    atlas->frame.reset = 1;
+    return true;
+}
+
+/**
+ * \brief Open a new shelf below the others.
+ * \return shelf index, or -1 if there is no room
+ */
+static int add_shelf(ASS_Atlas *atlas, int h)
+{
+    int shelf_h = (h + SHELF_ALIGN - 1) & ~(SHELF_ALIGN - 1);
+    if (atlas->h - atlas->shelf_end < shelf_h)
+        return -1;
+    if (atlas->n_shelves == atlas->max_shelves) {
+        int max_shelves = FFMAX(2 * atlas->max_shelves, 32);
+        if (!ASS_REALLOC_ARRAY(atlas->shelves, max_shelves))
+            return -1;
+        atlas->max_shelves = max_shelves;
+    }
+    AtlasShelf *shelf = atlas->shelves + atlas->n_shelves;
+    *shelf = (AtlasShelf) { .y = atlas->shelf_end, .h = shelf_h };
+    if (!add_span(shelf, 0, 0, atlas->w))
+        return -1;
+    atlas->shelf_end += shelf_h;
+    return atlas->n_shelves++;
+}
+
+/**
+ * \brief Find room for a bitmap on the shelves.
+ * Takes the lowest shelf that fits, and opens a new shelf if none does.
+ * Within a shelf, the first free run that is wide enough is used.
+ */
+static bool find_space(ASS_Atlas *atlas, int w, int h, int *shelf_index,
+                       int *x, int *y)
+{
+    if (w > atlas->w)
+        return false;
+
+    int best = -1, best_span = 0;
+    for (int i = 0; i < atlas->n_shelves; i++) {
+        AtlasShelf *shelf = atlas->shelves + i;
+        if (shelf->h < h || (best >= 0 && shelf->h >= atlas->shelves[best].h))
+            continue;
+        for (int j = 0; j < shelf->n_spans; j++) {
+            if (shelf->spans[j].w >= w) {
+                best = i;
+                best_span = j;
+                break;
+            }
+        }
+    }
+
+    if (best < 0) {
+        best = add_shelf(atlas, h);
+        if (best < 0)
+            return false;
+        best_span = 0;
+    }
+
+    AtlasShelf *shelf = atlas->shelves + best;
+    AtlasSpan *span = shelf->spans + best_span;
+    *shelf_index = best;
+    *x = span->x;
+    *y = shelf->y;
+    span->x += w;
+    span->w -= w;
+    if (!span->w)
+        remove_span(shelf, best_span);
+    return true;
+}
+
+/**
+ * \brief Copy a bitmap into free space of the atlas.
+ * \return false if the atlas is full
+ */
+static bool pack_bitmap(ASS_Atlas *atlas, AtlasEntry *entry,
+                        const uint8_t *src, ptrdiff_t stride, int w, int h)
+{
+    entry->w = w + ATLAS_PADDING;
+    entry->h = h + ATLAS_PADDING;
+    while (!find_space(atlas, entry->w, entry->h,
+                       &entry->shelf, &entry->x, &entry->y))
+        if (!atlas->can_grow || !grow_atlas(atlas))
+            return false;
+
+    if (!add_update(atlas, entry->x, entry->y, w, h)) {
+        free_space(atlas, entry->shelf, entry->x, entry->w);
+        return false;
+    }
+
+    uint8_t *dst = atlas->pixels + (size_t) entry->y * atlas->w + entry->x;
+    for (int i = 0; i < h; i++)
+        memcpy(dst + (size_t) i * atlas->w, src + i * stride, w);
+    return true;
+}
+
+static bool add_entry(ASS_Atlas *atlas, const AtlasEntry *entry)
+{
+    if (atlas->n_entries == atlas->max_entries) {
+        int max_entries = FFMAX(2 * atlas->max_entries, 64);
+        if (!ASS_REALLOC_ARRAY(atlas->entries, max_entries))
+            return false;
+        atlas->max_entries = max_entries;
+    }
+    if (2 * (size_t) (atlas->n_entries + 1) > atlas->table_size) {
+        size_t table_size = FFMAX(2 * atlas->table_size, 128);
+        int *table = calloc(table_size, sizeof(int));
+        if (!table)
+            return false;
+        free(atlas->table);
+        atlas->table = table;
+        atlas->table_size = table_size;
+        for (int i = 0; i < atlas->n_entries; i++)
+            insert_entry(atlas, i);
+    }
+
+    AtlasEntry *dst = atlas->entries + atlas->n_entries;
+    *dst = *entry;
+    ass_cache_inc_ref(dst->source);
+    ass_image_buffer_ref(dst->image_buffer);
+    insert_entry(atlas, atlas->n_entries++);
+    return true;
+}
+
+/**
+ * \brief Find the cached bitmap plane an image was cut from.
+ */
+static const Bitmap *get_source_bitmap(const ASS_Image *img)
+{
+    CompositeHashValue *source = ((const ASS_ImagePriv *) img)->source;
+    if (!source)
+        return NULL;
+    const Bitmap *planes[] = { &source->bm, &source->bm_o, &source->bm_s };
+    uintptr_t ptr = (uintptr_t) img->bitmap;
+    for (int i = 0; i < 3; i++) {
+        const Bitmap *bm = planes[i];
+        uintptr_t start = (uintptr_t) bm->buffer;
+        if (bm->buffer && ptr >= start && ptr < start + bm->stride * bm->h)
+            return bm;
+    }
+    return NULL;
+}
+
+/**
+ * \brief Get the key of the packed bitmap holding the coverage of an image.
+ * Bitmaps of the composite cache are packed whole, so that every image
+ * cut from them shares one entry. Other images own their pixels, which
+ * are shared with clones of the image in later frames.
+ */
+static const uint8_t *get_entry_key(const ASS_Image *img, const Bitmap **bm)
+{
+    *bm = get_source_bitmap(img);
+    if (*bm)
+        return (*bm)->buffer;
+    return ((const ASS_ImagePriv *) img)->buffer ? img->bitmap : NULL;
+}
+
+/**
+ * \brief Make the coverage of an image available in the atlas.
+ * \return false if the atlas is full
+ */
+static bool add_quad(ASS_Atlas *atlas, const ASS_Image *img)
+{
+    ASS_AtlasQuad *quad = atlas->quads + atlas->frame.n_quads;
+    quad->w = img->w;
+    quad->h = img->h;
+    quad->dst_x = img->dst_x;
+    quad->dst_y = img->dst_y;
+    quad->color = img->color;
+    quad->type = img->type;
+
+    const Bitmap *bm;
+    const uint8_t *key = get_entry_key(img, &bm);
+    AtlasEntry *entry = find_entry(atlas, key);
+    if (!entry) {
+        const ASS_ImagePriv *priv = (const ASS_ImagePriv *) img;
+        AtlasEntry new_entry = {
+            .key = key,
+            .source = bm ? priv->source : NULL,
+            .image_buffer = bm ? NULL : priv->buffer,
+            .frame = atlas->frame_id,
+        };
+        bool packed = bm ?
+            pack_bitmap(atlas, &new_entry, bm->buffer, bm->stride, bm->w, bm->h) :
+            pack_bitmap(atlas, &new_entry, img->bitmap, img->stride, img->w, img->h);
+        if (!packed)
+            return false;
+        // without an entry, the space would never be freed
+        if (!add_entry(atlas, &new_entry)) {
+            free_space(atlas, new_entry.shelf, new_entry.x, new_entry.w);
+            return false;
+        }
+        entry = atlas->entries + atlas->n_entries - 1;
+    }
+
+    if (bm) {
+        ptrdiff_t offset = img->bitmap - bm->buffer;
+        quad->atlas_x = entry->x + offset % bm->stride;
+        quad->atlas_y = entry->y + offset / bm->stride;
+    } else {
+        quad->atlas_x = entry->x;
+        quad->atlas_y = entry->y;
+    }
+    atlas->frame.n_quads++;
+    return true;
+}
+
+const ASS_AtlasFrame *ass_render_frame_atlas(ASS_Renderer *priv,
+                                             ASS_Track *track, long long now,
+                                             int *detect_change)
+{
+    ASS_Image *imgs = ass_render_frame(priv, track, now, detect_change);
+
+    ASS_Atlas *atlas = priv->atlas;
+    if (!atlas) {
+        atlas = priv->atlas = calloc(1, sizeof(ASS_Atlas));
+        if (!atlas)
+            return NULL;
+    }
+
+    int n_imgs = 0;
+    for (ASS_Image *img = imgs; img; img = img->next)
+        n_imgs++;
+    if (n_imgs > atlas->max_quads) {
+        if (!ASS_REALLOC_ARRAY(atlas->quads, n_imgs))
+            return NULL;
+        atlas->max_quads = n_imgs;
+    }
+
+    ASS_AtlasFrame *frame = &atlas->frame;
+    frame->reset = 0;
+    frame->n_updates = 0;
+    frame->n_quads = 0;
+    atlas->frame_id++;
+
+    // Bitmaps stay packed for as long as consecutive frames use them,
+    // the space of the others is freed before packing the new ones.
+    for (ASS_Image *img = imgs; img; img = img->next) {
+        const Bitmap *bm;
+        AtlasEntry *entry = find_entry(atlas, get_entry_key(img, &bm));
+        if (entry)
+            entry->frame = atlas->frame_id;
+    }
+    bool complete = release_unused(atlas);
+
+    // If the atlas is still full, it is repacked with the bitmaps of
+    // this frame only, and grown if they do not fit, so its size
+    // follows the largest frame rather than the whole video.
+    ASS_Image *img = imgs;
+    atlas->can_grow = false;
+    while (complete && img && add_quad(atlas, img))
+        img = img->next;
+    if (!complete || img) {
+        clear_atlas(atlas);
+        frame->n_updates = 0;
+        frame->n_quads = 0;
+        atlas->can_grow = true;
+        complete = true;
+        for (img = imgs; img; img = img->next)
+            complete &= add_quad(atlas, img);
+        if (!complete)
+            ass_msg(priv->library, MSGL_WARN,
+                    "Frame does not fit into the glyph atlas");
+    }
+
+    frame->atlas = atlas->pixels;
+    frame->atlas_w = atlas->w;
+    frame->atlas_h = atlas->h;
+    frame->atlas_stride = atlas->w;
+    frame->updates = atlas->updates;
+    frame->quads = atlas->quads;
+    return frame;
+}
@@ -47,6 +47,7 @@
     BitmapBlendFunc ass_add_bitmaps_  ## suffix; \
     BitmapBlendFunc ass_imul_bitmaps_ ## suffix; \
     BitmapMulFunc   ass_mul_bitmaps_  ## suffix; \
+    GradientRGBAFunc ass_gradient_rgba_ ## suffix; \
     BeBlurFunc      ass_be_blur_      ## suffix;
 
 #define GENERIC_FUNCTION(name, suffix) \
@@ -56,9 +57,21 @@
     GENERIC_FUNCTION(add_bitmaps,  suffix) \
     GENERIC_FUNCTION(imul_bitmaps, suffix) \
     GENERIC_FUNCTION(mul_bitmaps,  suffix) \
+    GENERIC_FUNCTION(gradient_rgba, suffix) \
     GENERIC_FUNCTION(be_blur,      suffix)
 
 
+#define SURFACE_PROTOTYPES(suffix) \
+    BlendColorFunc  ass_blend_plane_  ## suffix; \
+    BlendColorFunc  ass_blend_color_  ## suffix; \
+    BlendPremulFunc ass_blend_premul_ ## suffix;
+
+#define SURFACE_FUNCTIONS(suffix) \
+    GENERIC_FUNCTION(blend_plane,  suffix) \
+    GENERIC_FUNCTION(blend_color,  suffix) \
+    GENERIC_FUNCTION(blend_premul, suffix)
+
+
 #define PARAM_BLUR_SET(suffix) \
     ass_blur4_ ## suffix, \
     ass_blur5_ ## suffix, \
@@ -164,8 +177,10 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
 {
     ALL_PROTOTYPES(16, c)
     BLUR_PROTOTYPES(32, c)
+    SURFACE_PROTOTYPES(c)
     BitmapEngine engine = {0};
     engine.tile_order = mask & ASS_FLAG_LARGE_TILES ? 5 : 4;
+    SURFACE_FUNCTIONS(c)
 
 #if CONFIG_ASM
     unsigned flags = ass_get_cpu_flags(mask);
@@ -173,10 +188,14 @@ BitmapEngine ass_bitmap_engine_init(unsigned mask)
     if (flags & ASS_CPU_FLAG_X86_AVX2) {
         ALL_PROTOTYPES(32, avx2)
         ALL_FUNCTIONS(5, 32, avx2)
+        SURFACE_PROTOTYPES(avx2)
+        SURFACE_FUNCTIONS(avx2)
         return engine;
     } else if (flags & ASS_CPU_FLAG_X86_SSE2) {
         ALL_PROTOTYPES(16, sse2)
         ALL_FUNCTIONS(4, 16, sse2)
+        SURFACE_PROTOTYPES(sse2)
+        SURFACE_FUNCTIONS(sse2)
         if (flags & ASS_CPU_FLAG_X86_SSSE3) {
             ALL_PROTOTYPES(16, ssse3)
             RASTERIZER_FUNCTION(fill_generic, ssse3)
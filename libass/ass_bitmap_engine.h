@@ -27,8 +27,16 @@
  * - Widths and heights must be > 0
  * - For be_blur, width and height must be > 1
  * - All strides must be multiples of the engine alignment
- * - All buffers, except for BitmapBlendFunc and sources of BitmapMulFunc,
- *   must be aligned to the engine alignment
+ * - All buffers, except for BitmapBlendFunc and sources of BitmapMulFunc
+ *   and GradientRGBAFunc, must be aligned to the engine alignment
+ * - GradientRGBAFunc can read up to 3 bytes past the end of a source row
+ *   and write past 4 * width bytes of a destination row up to its stride
+ *
+ * Surface blend functions (BlendColorFunc and BlendPremulFunc) work on
+ * caller-owned framebuffers instead and have their own rules:
+ * - Width must be a multiple of 32 pixels
+ * - Buffers and strides need no alignment
+ * - Exactly width pixels of every row are read and written
  */
 
 struct segment;
@@ -48,6 +56,31 @@ typedef void BitmapMulFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
                            const uint8_t *restrict src2, ptrdiff_t src2_stride,
                            size_t width, size_t height);
 
+// bilinear gradient in 10.22 fixed point, lanes are R, G, B and transparency:
+// value(x, y) = start + y * dy + x * (dx + y * dxy)
+typedef struct {
+    int32_t start[4], dx[4], dy[4], dxy[4];
+} GradientRGBAParams;
+
+// premultiplied RGBA from coverage mask and per-pixel gradient color
+typedef void GradientRGBAFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                              const uint8_t *restrict src, ptrdiff_t src_stride,
+                              size_t width, size_t height,
+                              const GradientRGBAParams *param);
+
+// alpha blending of a solid color through a coverage mask into a surface,
+// color holds up to 3 channel values in destination order (low bytes first)
+// and the opacity in the top byte; for packed pixels the fourth channel
+// is treated as alpha and blended towards 255
+typedef void BlendColorFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                            const uint8_t *restrict src, ptrdiff_t src_stride,
+                            size_t width, size_t height, uint32_t color);
+
+// premultiplied 4-channel source over packed destination of the same order
+typedef void BlendPremulFunc(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                             const uint8_t *restrict src, ptrdiff_t src_stride,
+                             size_t width, size_t height);
+
 typedef void BeBlurFunc(uint8_t *restrict buf, ptrdiff_t stride,
                         size_t width, size_t height, uint16_t *restrict tmp);
 
@@ -75,6 +108,11 @@ typedef struct {
     // blend functions
     BitmapBlendFunc *add_bitmaps, *imul_bitmaps;
     BitmapMulFunc *mul_bitmaps;
+    GradientRGBAFunc *gradient_rgba;
+
+    // surface blend functions, 8-bit plane and packed 4-byte pixels
+    BlendColorFunc *blend_plane, *blend_color;
+    BlendPremulFunc *blend_premul;
 
     // be blur function
     BeBlurFunc *be_blur;
@@ -21,14 +21,17 @@
 #include "ass_compat.h"
 
 #include <inttypes.h>
+#include <string.h>
 #include <ft2build.h>
 #include FT_OUTLINE_H
+#include FT_SIZES_H
 #include <assert.h>
 
 #include "ass_utils.h"
 #include "ass_font.h"
 #include "ass_outline.h"
 #include "ass_cache.h"
+#include "ass_threading.h"
 
 // Always enable native-endian mode, since we don't care about cross-platform consistency of the hash
 #define WYHASH_LITTLE_ENDIAN 1
@@ -177,6 +180,59 @@ const CacheDesc composite_cache_desc = {
 };
 
 
+// RGBA cache
+static ass_hashcode rgba_hash(void *key, ass_hashcode hval)
+{
+    RGBAHashKey *k = key;
+    hval = ass_hash_buf(&k->source, sizeof(k->source), hval);
+    hval = ass_hash_buf(&k->mask, sizeof(k->mask), hval);
+    hval = ass_hash_buf(&k->w, sizeof(k->w), hval);
+    hval = ass_hash_buf(&k->h, sizeof(k->h), hval);
+    hval = ass_hash_buf(&k->stride, sizeof(k->stride), hval);
+    return ass_hash_buf(&k->param, sizeof(k->param), hval);
+}
+
+static bool rgba_compare(void *a, void *b)
+{
+    RGBAHashKey *ak = a;
+    RGBAHashKey *bk = b;
+    return ak->source == bk->source && ak->mask == bk->mask &&
+        ak->w == bk->w && ak->h == bk->h && ak->stride == bk->stride &&
+        !memcmp(&ak->param, &bk->param, sizeof(ak->param));
+}
+
+static bool rgba_key_move(void *dst, void *src)
+{
+    RGBAHashKey *d = dst, *s = src;
+    if (!d)
+        return true;
+
+    *d = *s;
+    ass_cache_inc_ref(s->source);
+    return true;
+}
+
+static void rgba_destruct(void *key, void *value)
+{
+    RGBAHashValue *v = value;
+    RGBAHashKey *k = key;
+    ass_aligned_free(v->rgba);
+    ass_cache_dec_ref(k->source);
+}
+
+size_t ass_rgba_construct(void *key, void *value, void *priv);
+
+const CacheDesc rgba_cache_desc = {
+    .hash_func = rgba_hash,
+    .compare_func = rgba_compare,
+    .key_move_func = rgba_key_move,
+    .construct_func = ass_rgba_construct,
+    .destruct_func = rgba_destruct,
+    .key_size = sizeof(RGBAHashKey),
+    .value_size = sizeof(RGBAHashValue)
+};
+
+
 // outline cache
 static ass_hashcode outline_hash(void *key, ass_hashcode hval)
 {
@@ -278,6 +334,11 @@ static bool face_size_metrics_key_move(void *dst, void *src)
 static void face_size_metrics_destruct(void *key, void *value)
 {
     FaceSizeMetricsHashKey *k = key;
+    FaceSizeMetricsHashValue *v = value;
+    if (v->hb_font)
+        hb_font_destroy(v->hb_font);
+    if (v->ft_size)
+        FT_Done_Size(v->ft_size);
     ass_cache_dec_ref(k->font);
 }
 
@@ -290,7 +351,7 @@ const CacheDesc face_size_metrics_cache_desc = {
     .construct_func = ass_face_size_metrics_construct,
     .destruct_func = face_size_metrics_destruct,
     .key_size = sizeof(FaceSizeMetricsHashKey),
-    .value_size = sizeof(FT_Size_Metrics)
+    .value_size = sizeof(FaceSizeMetricsHashValue)
 };
 
 
@@ -326,23 +387,94 @@ const CacheDesc glyph_metrics_cache_desc = {
 
 
 
+// shaped run cache
+static bool shaped_run_key_move(void *dst, void *src)
+{
+    ShapedRunHashKey *d = dst, *s = src;
+    if (!d)
+        return true;
+
+    *d = *s;
+    d->text.str = ass_copy_string(s->text);
+    if (!d->text.str)
+        return false;
+    ass_cache_inc_ref(s->font);
+    return true;
+}
+
+static void shaped_run_destruct(void *key, void *value)
+{
+    ShapedRunHashKey *k = key;
+    ShapedRunHashValue *v = value;
+    free(v->glyphs);
+    free((char *) k->text.str);
+    ass_cache_dec_ref(k->font);
+}
+
+size_t ass_shaped_run_construct(void *key, void *value, void *priv);
+
+const CacheDesc shaped_run_cache_desc = {
+    .hash_func = shaped_run_hash,
+    .compare_func = shaped_run_compare,
+    .key_move_func = shaped_run_key_move,
+    .construct_func = ass_shaped_run_construct,
+    .destruct_func = shaped_run_destruct,
+    .key_size = sizeof(ShapedRunHashKey),
+    .value_size = sizeof(ShapedRunHashValue)
+};
+
 // Cache data
+typedef struct cache_shard CacheShard;
+
 typedef struct cache_item {
-    Cache *cache;
+    CacheShard *shard;  // NULL once the item is detached by ass_cache_empty()
     const CacheDesc *desc;
-    struct cache_item *next, **prev;
+    ass_hashcode hash;
+    bool listed;        // in the shard's table, cleared by ass_cache_evict()
     struct cache_item *queue_next, **queue_prev;
     size_t size, ref_count;
+    uint64_t cost;      // construction time in ns
+    unsigned chances;   // eviction passes survived since the last use
 } CacheItem;
 
-struct cache {
-    unsigned buckets;
-    CacheItem **map;
+// Slots of a shard's hash table. Keys are only compared once the full
+// hashes match, which keeps probing cheap for large keys.
+typedef struct {
+    ass_hashcode hash;
+    CacheItem *item;    // NULL if the slot is free
+} CacheSlot;
+
+// Items are distributed over shards, each with its own lock, hash table
+// and LRU queue, so that threads working on different keys rarely wait
+// for each other. Hits and reference counting take the shard lock too:
+// a hit moves the item in the LRU queue, and the last reference may only
+// be dropped while no lookup can find the item, which plain atomic counters
+// cannot guarantee without deferred reclamation.
+#define CACHE_SHARDS 16
+
+// Shard tables use open addressing with Robin Hood probing and backward
+// shift deletion, and double whenever they become 3/4 full.
+#define CACHE_MIN_SLOTS 16
+
+struct cache_shard {
+    // guards the shard's table, its queue and reference counts of its items
+    ASS_Mutex lock;
+    CacheSlot *slots;
+    size_t n_slots;     // power of two, 0 until the first insertion
+    size_t n_items;
     CacheItem *queue_first, **queue_last;
+    size_t cache_size;
+    uint64_t cache_cost;    // total construction time of the items
+
+    // counters for ass_cache_stats(), construction time includes items
+    // that were discarded or have been dropped since
+    uint64_t hits, misses, evictions, construct_ns;
+};
 
+struct cache {
     const CacheDesc *desc;
 
-    size_t cache_size;
+    CacheShard shards[CACHE_SHARDS];
 };
 
 #define CACHE_ALIGN 8
@@ -365,79 +497,218 @@ Cache *ass_cache_create(const CacheDesc *desc)
     Cache *cache = calloc(1, sizeof(*cache));
     if (!cache)
         return NULL;
-    cache->buckets = 0xFFFF;
-    cache->queue_last = &cache->queue_first;
     cache->desc = desc;
-    cache->map = calloc(cache->buckets, sizeof(CacheItem *));
-    if (!cache->map) {
-        free(cache);
-        return NULL;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        shard->queue_last = &shard->queue_first;
+        if (!ass_mutex_init(&shard->lock, false)) {
+            while (i--)
+                ass_mutex_destroy(&cache->shards[i].lock);
+            free(cache);
+            return NULL;
+        }
     }
 
     return cache;
 }
 
+static inline void destroy_item(const CacheDesc *desc, CacheItem *item)
+{
+    assert(item->desc == desc);
+    char *value = (char *) item + CACHE_ITEM_SIZE;
+    desc->destruct_func(value + align_cache(desc->value_size), value);
+    free(item);
+}
+
+// Move a found item to the end of the LRU queue, taking a queue reference if needed.
+static inline void touch_item(CacheShard *shard, CacheItem *item)
+{
+    if (!item->queue_prev || item->queue_next) {
+        if (item->queue_prev) {
+            item->queue_next->queue_prev = item->queue_prev;
+            *item->queue_prev = item->queue_next;
+        } else
+            item->ref_count++;
+        item->chances = 0;
+        *shard->queue_last = item;
+        item->queue_prev = shard->queue_last;
+        shard->queue_last = &item->queue_next;
+        item->queue_next = NULL;
+    }
+}
+
+static inline CacheShard *hash_to_shard(Cache *cache, ass_hashcode hash)
+{
+    return &cache->shards[hash % CACHE_SHARDS];
+}
+
+// Preferred slot of a hash; the low bits already select the shard
+static inline size_t home_slot(ass_hashcode hash, size_t mask)
+{
+    return (size_t) (hash / CACHE_SHARDS) & mask;
+}
+
+// Distance of slot i from the preferred slot of its item
+static inline size_t probe_distance(const CacheSlot *slot, size_t i, size_t mask)
+{
+    return (i - home_slot(slot->hash, mask)) & mask;
+}
+
+static inline CacheItem *find_item(Cache *cache, CacheShard *shard,
+                                   ass_hashcode hash, void *key)
+{
+    if (!shard->n_slots)
+        return NULL;
+    const CacheDesc *desc = cache->desc;
+    size_t key_offs = CACHE_ITEM_SIZE + align_cache(desc->value_size);
+    size_t mask = shard->n_slots - 1;
+    size_t i = home_slot(hash, mask);
+    for (size_t dist = 0;; dist++, i = (i + 1) & mask) {
+        CacheSlot *slot = &shard->slots[i];
+        // a richer slot means the key would have been placed before it
+        if (!slot->item || probe_distance(slot, i, mask) < dist)
+            return NULL;
+        if (slot->hash == hash &&
+                desc->compare_func(key, (char *) slot->item + key_offs)) {
+            assert(slot->item->size);
+            return slot->item;
+        }
+    }
+}
+
+static void place_slot(CacheSlot *slots, size_t mask, CacheSlot entry)
+{
+    size_t i = home_slot(entry.hash, mask);
+    for (size_t dist = 0; slots[i].item; dist++, i = (i + 1) & mask) {
+        size_t d = probe_distance(&slots[i], i, mask);
+        if (d < dist) {
+            CacheSlot tmp = slots[i];
+            slots[i] = entry;
+            entry = tmp;
+            dist = d;
+        }
+    }
+    slots[i] = entry;
+}
+
+static bool grow_shard(CacheShard *shard)
+{
+    size_t n_slots = shard->n_slots ? 2 * shard->n_slots : CACHE_MIN_SLOTS;
+    CacheSlot *slots = calloc(n_slots, sizeof(CacheSlot));
+    if (!slots)
+        return false;
+    for (size_t i = 0; i < shard->n_slots; i++)
+        if (shard->slots[i].item)
+            place_slot(slots, n_slots - 1, shard->slots[i]);
+    free(shard->slots);
+    shard->slots = slots;
+    shard->n_slots = n_slots;
+    return true;
+}
+
+static bool insert_item(CacheShard *shard, CacheItem *item)
+{
+    if (4 * (shard->n_items + 1) > 3 * shard->n_slots &&
+            !grow_shard(shard) && shard->n_items == shard->n_slots)
+        return false;
+    CacheSlot entry = { item->hash, item };
+    place_slot(shard->slots, shard->n_slots - 1, entry);
+    shard->n_items++;
+    return true;
+}
+
+static void remove_item(CacheShard *shard, CacheItem *item)
+{
+    size_t mask = shard->n_slots - 1;
+    size_t i = home_slot(item->hash, mask);
+    while (shard->slots[i].item != item)
+        i = (i + 1) & mask;
+
+    // shift the following displaced slots back by one
+    size_t next = (i + 1) & mask;
+    while (shard->slots[next].item &&
+            probe_distance(&shard->slots[next], next, mask)) {
+        shard->slots[i] = shard->slots[next];
+        i = next;
+        next = (next + 1) & mask;
+    }
+    shard->slots[i].item = NULL;
+    shard->n_items--;
+}
+
 // Retrieve a value corresponding to a particular cache key,
 // creating one if it does not already exist.
 // The returned item is guaranteed to be valid until the next ass_cache_cut call;
 // to extend its lifetime further, call ass_cache_inc_ref().
+// Safe to call concurrently from several render threads: values are
+// constructed outside the shard lock, and if two threads race to construct
+// the same key, the later one discards its copy and returns the existing item.
 void *ass_cache_get(Cache *cache, void *key, void *priv)
 {
     const CacheDesc *desc = cache->desc;
     size_t key_offs = CACHE_ITEM_SIZE + align_cache(desc->value_size);
-    unsigned bucket = desc->hash_func(key, ASS_HASH_INIT) % cache->buckets;
-    CacheItem *item = cache->map[bucket];
-    while (item) {
-        if (desc->compare_func(key, (char *) item + key_offs)) {
-            assert(item->size);
-            if (!item->queue_prev || item->queue_next) {
-                if (item->queue_prev) {
-                    item->queue_next->queue_prev = item->queue_prev;
-                    *item->queue_prev = item->queue_next;
-                } else
-                    item->ref_count++;
-                *cache->queue_last = item;
-                item->queue_prev = cache->queue_last;
-                cache->queue_last = &item->queue_next;
-                item->queue_next = NULL;
-            }
-            desc->key_move_func(NULL, key);
-
-            return (char *) item + CACHE_ITEM_SIZE;
-        }
-        item = item->next;
+    ass_hashcode hash = desc->hash_func(key, ASS_HASH_INIT);
+    CacheShard *shard = hash_to_shard(cache, hash);
+
+    ass_mutex_lock(&shard->lock);
+    CacheItem *item = find_item(cache, shard, hash, key);
+    if (item) {
+        touch_item(shard, item);
+        shard->hits++;
+        ass_mutex_unlock(&shard->lock);
+        desc->key_move_func(NULL, key);
+        return (char *) item + CACHE_ITEM_SIZE;
     }
+    ass_mutex_unlock(&shard->lock);
 
     item = malloc(key_offs + desc->key_size);
     if (!item) {
         desc->key_move_func(NULL, key);
         return NULL;
     }
-    item->cache = cache;
+    item->shard = shard;
     item->desc = desc;
+    item->hash = hash;
     void *new_key = (char *) item + key_offs;
     if (!desc->key_move_func(new_key, key)) {
         free(item);
         return NULL;
     }
     void *value = (char *) item + CACHE_ITEM_SIZE;
+    int64_t start = ass_time_ns();
     item->size = desc->construct_func(new_key, value, priv);
     assert(item->size);
+    item->cost = FFMAX(ass_time_ns() - start, 1);
+    item->chances = 0;
+
+    ass_mutex_lock(&shard->lock);
+    shard->misses++;
+    shard->construct_ns += item->cost;
+    CacheItem *other = find_item(cache, shard, hash, new_key);
+    if (other) {
+        // another thread has constructed the same value meanwhile
+        touch_item(shard, other);
+        ass_mutex_unlock(&shard->lock);
+        destroy_item(desc, item);
+        return (char *) other + CACHE_ITEM_SIZE;
+    }
 
-    CacheItem **bucketptr = &cache->map[bucket];
-    if (*bucketptr)
-        (*bucketptr)->prev = &item->next;
-    item->prev = bucketptr;
-    item->next = *bucketptr;
-    *bucketptr = item;
+    if (!insert_item(shard, item)) {
+        ass_mutex_unlock(&shard->lock);
+        destroy_item(desc, item);
+        return NULL;
+    }
+    item->listed = true;
 
-    *cache->queue_last = item;
-    item->queue_prev = cache->queue_last;
-    cache->queue_last = &item->queue_next;
+    *shard->queue_last = item;
+    item->queue_prev = shard->queue_last;
+    shard->queue_last = &item->queue_next;
     item->queue_next = NULL;
     item->ref_count = 1;
 
-    cache->cache_size += item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+    shard->cache_size += item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+    shard->cache_cost += item->cost;
+    ass_mutex_unlock(&shard->lock);
     return value;
 }
 
@@ -447,21 +718,18 @@ void *ass_cache_key(void *value)
     return (char *) value + align_cache(item->desc->value_size);
 }
 
-static inline void destroy_item(const CacheDesc *desc, CacheItem *item)
-{
-    assert(item->desc == desc);
-    char *value = (char *) item + CACHE_ITEM_SIZE;
-    desc->destruct_func(value + align_cache(desc->value_size), value);
-    free(item);
-}
-
 void ass_cache_inc_ref(void *value)
 {
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
+    CacheShard *shard = item->shard;
+    if (shard)
+        ass_mutex_lock(&shard->lock);
     assert(item->size && item->ref_count);
     item->ref_count++;
+    if (shard)
+        ass_mutex_unlock(&shard->lock);
 }
 
 void ass_cache_dec_ref(void *value)
@@ -469,78 +737,292 @@ void ass_cache_dec_ref(void *value)
     if (!value)
         return;
     CacheItem *item = value_to_item(value);
+    CacheShard *shard = item->shard;
+    if (shard)
+        ass_mutex_lock(&shard->lock);
     assert(item->size && item->ref_count);
-    if (--item->ref_count)
+    if (--item->ref_count) {
+        if (shard)
+            ass_mutex_unlock(&shard->lock);
         return;
+    }
 
-    Cache *cache = item->cache;
-    if (cache) {
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
-
-        cache->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+    if (shard) {
+        if (item->listed) {
+            remove_item(shard, item);
+            shard->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+            shard->cache_cost -= item->cost;
+        }
+        ass_mutex_unlock(&shard->lock);
     }
+    // destruction may release items of this cache, so it's done unlocked
     destroy_item(item->desc, item);
 }
 
-void ass_cache_cut(Cache *cache, size_t max_size)
+// Items that are expensive to rebuild for their size survive a few passes
+// of the LRU queue: one if they cost as much per byte as the average item
+// of the shard, up to CACHE_MAX_CHANCES for much more expensive ones.
+#define CACHE_MAX_CHANCES 3
+
+static unsigned eviction_chances(const CacheShard *shard, const CacheItem *item)
+{
+    if (!shard->cache_cost)
+        return 0;
+    // relative cost per byte, as a multiple of the shard's average
+    double ratio = (double) item->cost * shard->cache_size /
+                   ((double) item->size * shard->cache_cost);
+    unsigned chances = 0;
+    while (chances < CACHE_MAX_CHANCES && ratio >= (2u << chances) - 1)
+        chances++;
+    return chances;
+}
+
+// Items are destroyed after the shard lock is released,
+// as destruction may release items of this cache.
+static void destroy_items(const CacheDesc *desc, CacheItem *item)
+{
+    while (item) {
+        CacheItem *next = item->queue_next;
+        destroy_item(desc, item);
+        item = next;
+    }
+}
+
+static void cut_shard(Cache *cache, CacheShard *shard, size_t max_size)
 {
-    if (cache->cache_size <= max_size)
+    CacheItem *dead = NULL;
+    ass_mutex_lock(&shard->lock);
+    if (shard->cache_size <= max_size) {
+        ass_mutex_unlock(&shard->lock);
         return;
+    }
 
     do {
-        CacheItem *item = cache->queue_first;
+        CacheItem *item = shard->queue_first;
         if (!item)
             break;
         assert(item->size);
 
-        cache->queue_first = item->queue_next;
+        shard->queue_first = item->queue_next;
+        if (item->chances < eviction_chances(shard, item)) {
+            // give it another pass at the end of the queue
+            item->chances++;
+            if (shard->queue_first) {
+                *shard->queue_last = item;
+                item->queue_prev = shard->queue_last;
+                shard->queue_last = &item->queue_next;
+                item->queue_next = NULL;
+            } else {
+                shard->queue_first = item;
+            }
+            continue;
+        }
+        shard->evictions++;
         if (--item->ref_count) {
             item->queue_prev = NULL;
             continue;
         }
 
-        if (item->next)
-            item->next->prev = item->prev;
-        *item->prev = item->next;
-
-        cache->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
-        destroy_item(cache->desc, item);
-    } while (cache->cache_size > max_size);
-    if (cache->queue_first)
-        cache->queue_first->queue_prev = &cache->queue_first;
+        remove_item(shard, item);
+        shard->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+        shard->cache_cost -= item->cost;
+        item->queue_next = dead;
+        dead = item;
+    } while (shard->cache_size > max_size);
+    if (shard->queue_first)
+        shard->queue_first->queue_prev = &shard->queue_first;
     else
-        cache->queue_last = &cache->queue_first;
+        shard->queue_last = &shard->queue_first;
+    ass_mutex_unlock(&shard->lock);
+
+    destroy_items(cache->desc, dead);
+}
+
+// Evict least recently used items until the cache fits into max_size,
+// keeping items that are expensive to rebuild for a few more passes.
+// Every shard keeps its own LRU order, so each is cut to an equal share.
+void ass_cache_cut(Cache *cache, size_t max_size)
+{
+    if (ass_cache_size(cache) <= max_size)
+        return;
+
+    for (int i = 0; i < CACHE_SHARDS; i++)
+        cut_shard(cache, &cache->shards[i], max_size / CACHE_SHARDS);
+}
+
+static uint64_t cache_cost(Cache *cache)
+{
+    uint64_t cost = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        ass_mutex_lock(&shard->lock);
+        cost += shard->cache_cost;
+        ass_mutex_unlock(&shard->lock);
+    }
+    return cost;
+}
+
+// Cut several caches measured in bytes to fit into one budget.
+// The budget is split in proportion to the construction time of what each
+// cache holds, so the caches with costlier bytes keep more of them;
+// a share larger than what a cache holds goes to the others.
+void ass_cache_cut_shared(Cache **caches, int n_caches, size_t budget)
+{
+    size_t size[CACHE_MAX_SHARED] = {0}, total_size = 0;
+    double weight[CACHE_MAX_SHARED] = {0}, total_weight = 0;
+    bool done[CACHE_MAX_SHARED] = {0};
+    assert(n_caches <= CACHE_MAX_SHARED);
+
+    for (int i = 0; i < n_caches; i++) {
+        size[i] = ass_cache_size(caches[i]);
+        weight[i] = cache_cost(caches[i]);
+        total_size += size[i];
+        total_weight += weight[i];
+    }
+    if (total_size <= budget)
+        return;
+    if (!total_weight) {
+        // nothing measured yet, split by size
+        for (int i = 0; i < n_caches; i++)
+            weight[i] = size[i];
+        total_weight = total_size;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        for (int i = 0; i < n_caches; i++) {
+            if (done[i] || weight[i] * budget < size[i] * total_weight)
+                continue;
+            // fits into its share, the rest goes to the others
+            done[i] = true;
+            budget -= FFMIN(size[i], budget);
+            total_weight -= weight[i];
+            changed = true;
+        }
+    }
+    for (int i = 0; i < n_caches; i++)
+        if (!done[i])
+            ass_cache_cut(caches[i], total_weight > 0 ?
+                          (size_t) (weight[i] * budget / total_weight) : 0);
+}
+
+void ass_cache_stats(Cache *cache, ASS_CacheStats *stats, bool reset)
+{
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        ass_mutex_lock(&shard->lock);
+        stats->hits += shard->hits;
+        stats->misses += shard->misses;
+        stats->evictions += shard->evictions;
+        stats->construct_ns += shard->construct_ns;
+        stats->size += shard->cache_size;
+        stats->items += shard->n_items;
+        if (reset)
+            shard->hits = shard->misses = shard->evictions =
+                shard->construct_ns = 0;
+        ass_mutex_unlock(&shard->lock);
+    }
+    stats->lookups = stats->hits + stats->misses;
+}
+
+size_t ass_cache_size(Cache *cache)
+{
+    size_t size = 0;
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        ass_mutex_lock(&shard->lock);
+        size += shard->cache_size;
+        ass_mutex_unlock(&shard->lock);
+    }
+    return size;
 }
 
 void ass_cache_empty(Cache *cache)
 {
-    for (int i = 0; i < cache->buckets; i++) {
-        CacheItem *item = cache->map[i];
-        while (item) {
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        CacheItem *dead = NULL;
+        ass_mutex_lock(&shard->lock);
+        for (size_t j = 0; j < shard->n_slots; j++) {
+            CacheItem *item = shard->slots[j].item;
+            if (!item)
+                continue;
             assert(item->size);
-            CacheItem *next = item->next;
             if (item->queue_prev)
                 item->ref_count--;
-            if (item->ref_count)
-                item->cache = NULL;
-            else
-                destroy_item(cache->desc, item);
-            item = next;
+            if (item->ref_count) {
+                item->shard = NULL;
+            } else {
+                item->queue_next = dead;
+                dead = item;
+            }
         }
-        cache->map[i] = NULL;
+        free(shard->slots);
+        shard->slots = NULL;
+        shard->n_slots = 0;
+        shard->n_items = 0;
+        shard->queue_first = NULL;
+        shard->queue_last = &shard->queue_first;
+        shard->cache_size = 0;
+        shard->cache_cost = 0;
+        ass_mutex_unlock(&shard->lock);
+
+        destroy_items(cache->desc, dead);
     }
+}
+
+// Remove the items selected by filter, e.g. those depending on a font
+// selector that goes away. Items still referenced elsewhere stay alive
+// until released, but can no longer be found.
+void ass_cache_evict(Cache *cache, CacheItemFilter filter, void *priv)
+{
+    size_t key_offs = align_cache(cache->desc->value_size);
+    for (int i = 0; i < CACHE_SHARDS; i++) {
+        CacheShard *shard = &cache->shards[i];
+        CacheItem *dead = NULL;
+        ass_mutex_lock(&shard->lock);
+        for (size_t j = 0; j < shard->n_slots;) {
+            CacheItem *item = shard->slots[j].item;
+            char *value = item ? (char *) item + CACHE_ITEM_SIZE : NULL;
+            if (!item || !filter(value + key_offs, value, priv)) {
+                j++;
+                continue;
+            }
+            // backward shift moves the next item into slot j
+            remove_item(shard, item);
+            item->listed = false;
+            shard->cache_size -= item->size + (item->size == 1 ? 0 : CACHE_ITEM_SIZE);
+            shard->cache_cost -= item->cost;
+            shard->evictions++;
+            if (item->queue_prev) {
+                if (item->queue_next)
+                    item->queue_next->queue_prev = item->queue_prev;
+                else
+                    shard->queue_last = item->queue_prev;
+                *item->queue_prev = item->queue_next;
+                item->queue_prev = NULL;
+                item->ref_count--;
+            }
+            if (!item->ref_count) {
+                item->queue_next = dead;
+                dead = item;
+            }
+        }
+        ass_mutex_unlock(&shard->lock);
 
-    cache->queue_first = NULL;
-    cache->queue_last = &cache->queue_first;
-    cache->cache_size = 0;
+        destroy_items(cache->desc, dead);
+    }
 }
 
 void ass_cache_done(Cache *cache)
 {
+    if (!cache)
+        return;
     ass_cache_empty(cache);
-    free(cache->map);
+    for (int i = 0; i < CACHE_SHARDS; i++)
+        ass_mutex_destroy(&cache->shards[i].lock);
     free(cache);
 }
 
@@ -560,6 +1042,11 @@ Cache *ass_glyph_metrics_cache_create(void)
     return ass_cache_create(&glyph_metrics_cache_desc);
 }
 
+Cache *ass_shaped_run_cache_create(void)
+{
+    return ass_cache_create(&shaped_run_cache_desc);
+}
+
 Cache *ass_face_size_metrics_cache_create(void)
 {
     return ass_cache_create(&face_size_metrics_cache_desc);
@@ -574,3 +1061,8 @@ Cache *ass_composite_cache_create(void)
 {
     return ass_cache_create(&composite_cache_desc);
 }
+
+Cache *ass_rgba_cache_create(void)
+{
+    return ass_cache_create(&rgba_cache_desc);
+}
@@ -20,6 +20,8 @@
 #ifndef LIBASS_CACHE_H
 #define LIBASS_CACHE_H
 
+#include <hb.h>
+
 #include "ass.h"
 #include "ass_font.h"
 #include "ass_outline.h"
@@ -42,6 +44,25 @@ typedef struct {
     int asc, desc;  // ascender/descender
 } OutlineHashValue;
 
+typedef struct {
+    FT_Size_Metrics metrics;
+    FT_Size ft_size;     // face size object set to this size, or NULL
+    hb_font_t *hb_font;  // sub-font with cached metrics access, or NULL
+} FaceSizeMetricsHashValue;
+
+// glyph of a shaped run in HarfBuzz units,
+// cluster is relative to the start of the shaping context
+typedef struct {
+    uint32_t glyph_index, cluster;
+    int32_t x_advance, y_advance, x_offset, y_offset;
+} ShapedGlyph;
+
+typedef struct {
+    bool valid;
+    unsigned n_glyphs;
+    ShapedGlyph *glyphs;
+} ShapedRunHashValue;
+
 // Create definitions for bitmap, outline and composite hash keys
 #define CREATE_STRUCT_DEFINITIONS
 #include "ass_cache_template.h"
@@ -52,6 +73,7 @@ typedef bool (*HashCompare)(void *a, void *b);
 typedef bool (*CacheKeyMove)(void *dst, void *src);
 typedef size_t (*CacheValueConstructor)(void *key, void *value, void *priv);
 typedef void (*CacheItemDestructor)(void *key, void *value);
+typedef bool (*CacheItemFilter)(void *key, void *value, void *priv);
 
 // cache hash keys
 
@@ -87,6 +109,20 @@ typedef struct {
     BitmapRef *bitmaps;
 } CompositeHashKey;
 
+// describes a premultiplied RGBA rendering of an area of a composite bitmap;
+// source is refed when inserted and unrefed when dropped
+typedef struct {
+    CompositeHashValue *source;
+    const uint8_t *mask;        // first pixel of the area in one of the source bitmaps
+    int32_t w, h, stride;
+    GradientRGBAParams param;   // colors with fade and gradient state applied
+} RGBAHashKey;
+
+typedef struct {
+    uint8_t *rgba;
+    int stride;
+} RGBAHashValue;
+
 typedef struct
 {
     HashFunction hash_func;
@@ -103,14 +139,24 @@ void *ass_cache_get(Cache *cache, void *key, void *priv);
 void *ass_cache_key(void *value);
 void ass_cache_inc_ref(void *value);
 void ass_cache_dec_ref(void *value);
+// ass_cache_get and reference counting can be used from several render threads
+// at once; cut, empty, evict and done must only be called while no rendering
+// is in progress, but references may still be released meanwhile
 void ass_cache_cut(Cache *cache, size_t max_size);
+#define CACHE_MAX_SHARED 8
+void ass_cache_cut_shared(Cache **caches, int n_caches, size_t budget);
+void ass_cache_stats(Cache *cache, ASS_CacheStats *stats, bool reset);
+size_t ass_cache_size(Cache *cache);
 void ass_cache_empty(Cache *cache);
+void ass_cache_evict(Cache *cache, CacheItemFilter filter, void *priv);
 void ass_cache_done(Cache *cache);
 Cache *ass_font_cache_create(void);
 Cache *ass_outline_cache_create(void);
 Cache *ass_face_size_metrics_cache_create(void);
 Cache *ass_glyph_metrics_cache_create(void);
+Cache *ass_shaped_run_cache_create(void);
 Cache *ass_bitmap_cache_create(void);
 Cache *ass_composite_cache_create(void);
+Cache *ass_rgba_cache_create(void);
 
 #endif                          /* LIBASS_CACHE_H */
@@ -66,6 +66,8 @@ START(bitmap, bitmap_hash_key)
     VECTOR(matrix_x)
     VECTOR(matrix_y)
     VECTOR(matrix_z)
+    // border radii in 1/64 pixel to dilate the bitmap by, see ass_dilate_bitmap()
+    VECTOR(border)
 END(BitmapHashKey)
 
 // font is refed when inserted and unrefed when dropped
@@ -83,6 +85,23 @@ START(glyph_metrics, glyph_metrics_hash_key)
     GENERIC(int, glyph_index)
 END(GlyphMetricsHashKey)
 
+// describes a run of text shaped with HarfBuzz
+// font is refed when inserted and unrefed when dropped;
+// on call to ass_cache_get(), text is a non-owning view of the UTF-32
+// shaping context; its content is duplicated when inserted; the copy is freed when dropped
+START(shaped_run, shaped_run_hash_key)
+    GENERIC(ASS_Font *, font)
+    GENERIC(double, size)
+    GENERIC(int, face_index)
+    STRING(text)
+    GENERIC(int, item_offset)  // run inside the context, in code points
+    GENERIC(int, item_length)
+    GENERIC(hb_direction_t, direction)
+    GENERIC(hb_script_t, script)
+    GENERIC(hb_language_t, language)
+    GENERIC(unsigned, features)  // bitmask of enabled optional features
+END(ShapedRunHashKey)
+
 // describes an outline glyph
 // font is refed when inserted and unrefed when dropped
 START(glyph, glyph_hash_key)
@@ -93,6 +112,7 @@ START(glyph, glyph_hash_key)
     GENERIC(int, bold)
     GENERIC(int, italic)
     GENERIC(unsigned, flags) // glyph decoration flags
+    GENERIC(ASS_Hinting, hinting)
 END(GlyphHashKey)
 
 // describes an outline drawing
@@ -0,0 +1,289 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "ass_utils.h"
+#include "ass_bitmap.h"
+
+
+/*
+ * Border Dilation by Euclidean Distance Transform
+ *
+ * Stroking an outline with a large border produces a lot of segments
+ * and is slow, while the result is just the glyph grown by the border radius.
+ * Here the border is made from the rasterized glyph instead: pixels
+ * covered by the glyph are seeds, and the coverage of an output pixel
+ * is given by its distance to the nearest seed.
+ *
+ * The exact distance transform is separable:
+ * 1) for every pixel, the nearest seed in its column is found with
+ *    a forward and a backward sweep over whole rows;
+ * 2) within a row, the nearest seed overall is the minimum over columns
+ *    of the parabolas (x - x')^2 + dy(x')^2, found as their lower envelope
+ *    (P. Felzenszwalb, D. Huttenlocher, "Distance Transforms of Sampled
+ *    Functions", 2012).
+ * Elliptical borders are handled by scaling y by rx / ry beforehand.
+ *
+ * The first pass is a straight row-wise loop that compilers vectorize,
+ * the second one is linear in the row width.
+ *
+ * Antialiasing: far from the border edge, output pixels are either fully
+ * covered or empty. Within a pixel of it, the seeds around the nearest one
+ * are taken as straight edges crossing their pixels, perpendicular to
+ * the direction to the output pixel and placed to cover their coverage
+ * (S. Gustavson, R. Strand, "Anti-aliased Euclidean distance transform",
+ * 2011). The output coverage is then r + 1/2 minus the distance to
+ * the closest of those edges, clamped to [0, 1].
+ * The glyph itself is always kept under the border.
+ */
+
+#define NO_SEED_ABOVE (INT32_MIN / 2)
+#define NO_SEED_BELOW (INT32_MAX / 2)
+#define REFINE_RADIUS 2     // neighborhood of the nearest seed for antialiasing
+
+/**
+ * \brief Mark the seeds of source row y: pixels covered at least by half,
+ * and partly covered pixels with no such neighbor (thin lines).
+ * Faint pixels along an edge are left to refine_coverage().
+ */
+static void find_row_seeds(uint8_t *seed, const Bitmap *src, int32_t y)
+{
+    const uint8_t *s = src->buffer + y * src->stride;
+    const uint8_t *up = y > 0 ? s - src->stride : s;
+    const uint8_t *down = y < src->h - 1 ? s + src->stride : s;
+    int32_t last = src->w - 1;
+    for (int32_t x = 0; x < src->w; x++) {
+        uint8_t left = s[x > 0 ? x - 1 : x], right = s[x < last ? x + 1 : x];
+        uint8_t n = FFMAX(FFMAX(left, right), FFMAX(up[x], down[x]));
+        seed[x] = s[x] >= 128 || (s[x] && n < 128);
+    }
+}
+
+/**
+ * \brief For every pixel of the padded output, find the row of the nearest
+ * seed in its column.
+ */
+static void find_column_seeds(int32_t *near, int32_t *below, uint8_t *seed,
+                              const Bitmap *src, int pad_x, int pad_y,
+                              int32_t w, int32_t h)
+{
+    const int32_t *prev = NULL;
+    for (int32_t y = 0; y < h; y++) {
+        int32_t *cur = near + (ptrdiff_t) y * w;
+        if (!prev) {
+            for (int32_t x = 0; x < w; x++)
+                cur[x] = NO_SEED_ABOVE;
+        } else
+            memcpy(cur, prev, w * sizeof(int32_t));
+
+        if (y >= pad_y && y < pad_y + src->h) {
+            find_row_seeds(seed, src, y - pad_y);
+            int32_t *c = cur + pad_x;
+            for (int32_t x = 0; x < src->w; x++)
+                c[x] = seed[x] ? y : c[x];
+        }
+        prev = cur;
+    }
+
+    for (int32_t x = 0; x < w; x++)
+        below[x] = NO_SEED_BELOW;
+    for (int32_t y = h - 1; y >= 0; y--) {
+        int32_t *cur = near + (ptrdiff_t) y * w;
+        if (y >= pad_y && y < pad_y + src->h) {
+            find_row_seeds(seed, src, y - pad_y);
+            int32_t *b = below + pad_x;
+            for (int32_t x = 0; x < src->w; x++)
+                b[x] = seed[x] ? y : b[x];
+        }
+        for (int32_t x = 0; x < w; x++)
+            cur[x] = below[x] - y < y - cur[x] ? below[x] : cur[x];
+    }
+}
+
+/**
+ * \brief Signed distance from the center of a pixel with coverage a
+ * to its edge, seen from direction (dx, dy).
+ */
+static double edge_offset(double dx, double dy, double a)
+{
+    dx = fabs(dx);
+    dy = fabs(dy);
+    if (!dx || !dy)
+        return 0.5 - a;
+
+    double len = sqrt(dx * dx + dy * dy);
+    dx /= len;
+    dy /= len;
+    if (dx < dy) {
+        double t = dx;
+        dx = dy;
+        dy = t;
+    }
+    double a1 = 0.5 * dy / dx;
+    if (a < a1)
+        return 0.5 * (dx + dy) - sqrt(2 * dx * dy * a);
+    if (a < 1 - a1)
+        return (0.5 - a) * dx;
+    return -0.5 * (dx + dy) + sqrt(2 * dx * dy * (1 - a));
+}
+
+/**
+ * \brief Best border coverage (in pixels) of output pixel (x, y) given by
+ * the seeds around the nearest one (sx, sy) in source coordinates.
+ */
+static double refine_coverage(const Bitmap *src, int32_t sx, int32_t sy,
+                              double x, double y, double scale_y, double r)
+{
+    double best = -1;
+    for (int32_t j = FFMAX(sy - REFINE_RADIUS, 0); j <= FFMIN(sy + REFINE_RADIUS, src->h - 1); j++) {
+        const uint8_t *s = src->buffer + j * src->stride;
+        double dy = (y - j) * scale_y;
+        for (int32_t i = FFMAX(sx - REFINE_RADIUS, 0); i <= FFMIN(sx + REFINE_RADIUS, src->w - 1); i++) {
+            if (!s[i])
+                continue;
+            double dx = x - i;
+            double d = sqrt(dx * dx + dy * dy);
+            // back from scaled space to pixels along the edge normal
+            double k = d ? sqrt(dx * dx + dy * dy * scale_y * scale_y) / d : 1;
+            double c = 0.5 - (d - r) / k -
+                       edge_offset(dx, dy * scale_y, s[i] / 255.0);
+            best = FFMAX(best, c);
+        }
+    }
+    return best;
+}
+
+/**
+ * \brief Dilate the coverage of src by an ellipse with radii rx and ry
+ * (in pixels), the way stroking its outline would.
+ * \param dst receives a new bitmap, larger than src by the border size
+ * \return false on allocation failure
+ */
+bool ass_dilate_bitmap(const BitmapEngine *engine, Bitmap *dst,
+                       const Bitmap *src, double rx, double ry)
+{
+    if (!(rx > 0 && ry > 0) || !src->buffer)
+        return false;
+
+    // distances are measured with y scaled by sy, in units of x pixels
+    double sy = rx / ry;
+    // Covered pixels near the output one are at most a diagonal away from
+    // a seed and their edges up to half a diagonal away from their centers,
+    // so no seed further than reach can make the output covered.
+    double slack = 3 * FFMAX(sy, 1);
+    double reach = rx + slack;
+    int pad_x = (int) ceil(reach);
+    int pad_y = (int) ceil(reach / sy);
+    int64_t w = (int64_t) src->w + 2 * pad_x;
+    int64_t h = (int64_t) src->h + 2 * pad_y;
+    if (w * h > INT_MAX / 4)
+        return false;
+
+    if (!ass_alloc_bitmap(engine, dst, w, h, true))
+        return false;
+    dst->left = src->left - pad_x;
+    dst->top = src->top - pad_y;
+
+    int32_t *near = ass_aligned_alloc(32, w * h * sizeof(int32_t), false);
+    int32_t *tmp = ass_aligned_alloc(32, w * (2 * sizeof(int32_t) +
+                                              2 * sizeof(double) + 1) +
+                                         sizeof(double), false);
+    if (!near || !tmp) {
+        ass_aligned_free(near);
+        ass_aligned_free(tmp);
+        ass_free_bitmap(dst);
+        return false;
+    }
+    double *f = (double *) tmp;     // squared distance to the column seed
+    double *z = f + w;              // envelope boundaries, w + 1
+    int32_t *v = (int32_t *) (z + w + 1);  // envelope parabolas
+    int32_t *below = v + w;
+    uint8_t *seed = (uint8_t *) (below + w);
+
+    find_column_seeds(near, below, seed, src, pad_x, pad_y, w, h);
+
+    const double max_dy = reach / sy;
+    for (int32_t y = 0; y < h; y++) {
+        const int32_t *ny = near + (ptrdiff_t) y * w;
+        uint8_t *out = dst->buffer + y * dst->stride;
+
+        // lower envelope of the parabolas (x - q)^2 + f[q]
+        int k = -1;
+        for (int32_t q = 0; q < w; q++) {
+            int32_t dy = abs(y - ny[q]);
+            if (!(dy < max_dy))
+                continue;
+            f[q] = (dy * sy) * (dy * sy);
+            double s = -INFINITY;
+            while (k >= 0) {
+                int32_t p = v[k];
+                s = ((f[q] + (double) q * q) - (f[p] + (double) p * p)) /
+                    (2.0 * (q - p));
+                if (s > z[k])
+                    break;
+                k--;
+            }
+            if (k < 0)
+                s = -INFINITY;
+            k++;
+            v[k] = q;
+            z[k] = s;
+            z[k + 1] = INFINITY;
+        }
+        if (k < 0)
+            continue;
+
+        int n = k;
+        k = 0;
+        for (int32_t x = 0; x < w; x++) {
+            while (k < n && z[k + 1] < x)
+                k++;
+            int32_t p = v[k];
+            double c = rx - sqrt((double) (x - p) * (x - p) + f[p]);
+            if (c >= slack / 2) {
+                out[x] = 255;
+                continue;
+            }
+            if (c <= -slack)
+                continue;
+            c = refine_coverage(src, p - pad_x, ny[p] - pad_y,
+                                x - pad_x, y - pad_y, sy, rx);
+            if (c > 0)
+                out[x] = c < 1 ? (uint8_t) (255 * c + 0.5) : 255;
+        }
+    }
+
+    for (int32_t y = 0; y < src->h; y++) {
+        const uint8_t *s = src->buffer + y * src->stride;
+        uint8_t *out = dst->buffer + (y + pad_y) * dst->stride + pad_x;
+        for (int32_t x = 0; x < src->w; x++)
+            out[x] = FFMAX(out[x], s[x]);
+    }
+
+    ass_aligned_free(near);
+    ass_aligned_free(tmp);
+    return true;
+}
@@ -53,12 +53,89 @@ static bool alloc_path(ASS_Dir *dir, size_t size)
 #if !defined(_WIN32) || defined(__CYGWIN__)
 
 #include <dirent.h>
+#include <unistd.h>
+
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 FILE *ass_open_file(const char *filename, FileNameSource hint)
 {
     return fopen(filename, "rb");
 }
 
+bool ass_map_file(ASS_MappedFile *map, const char *filename, FileNameSource hint)
+{
+    map->data = NULL;
+    map->size = 0;
+    map->mtime = 0;
+    map->handle = NULL;
+
+#ifdef HAVE_MMAP
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) || !S_ISREG(st.st_mode) || st.st_size <= 0 ||
+            (uintmax_t) st.st_size > SIZE_MAX) {
+        close(fd);
+        return false;
+    }
+
+    // the mapping stays valid after the descriptor is closed
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    map->data = data;
+    map->size = st.st_size;
+    map->mtime = st.st_mtime;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ass_unmap_file(ASS_MappedFile *map)
+{
+#ifdef HAVE_MMAP
+    if (map->data)
+        munmap((void *) map->data, map->size);
+#endif
+    map->data = NULL;
+    map->size = 0;
+}
+
+FILE *ass_create_temp_file(const char *path, char **name)
+{
+    static const char suffix[] = ".XXXXXX";
+    size_t len = strlen(path);
+    char *tmp = malloc(len + sizeof(suffix));
+    if (!tmp)
+        return NULL;
+    memcpy(tmp, path, len);
+    memcpy(tmp + len, suffix, sizeof(suffix));
+
+    int fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return NULL;
+    }
+    FILE *fp = fdopen(fd, "wb");
+    if (!fp) {
+        close(fd);
+        remove(tmp);
+        free(tmp);
+        return NULL;
+    }
+    *name = tmp;
+    return fp;
+}
+
 bool ass_open_dir(ASS_Dir *dir, const char *path)
 {
     dir->handle = NULL;
@@ -118,6 +195,10 @@ void ass_close_dir(ASS_Dir *dir)
 #else  // Windows
 
 #include <windows.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
 
 
 static const uint8_t wtf8_len_table[256] = {
@@ -276,6 +357,137 @@ FILE *ass_open_file(const char *filename, FileNameSource hint)
     return fopen(filename, "rb");
 }
 
+#if ASS_WINAPI_DESKTOP
+
+static HANDLE open_handle_wtf8(const char *filename)
+{
+    size_t size = sizeof(WCHAR);
+    ASS_StringView name = { filename, strlen(filename) };
+    if (!check_add_size_wtf8to16(&size, name.len))
+        return INVALID_HANDLE_VALUE;
+    WCHAR *wname = malloc(size);
+    if (!wname)
+        return INVALID_HANDLE_VALUE;
+    WCHAR *end = convert_wtf8to16(wname, name);
+    HANDLE file = INVALID_HANDLE_VALUE;
+    if (end) {
+        *end = L'\0';
+        file = CreateFileW(wname, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    }
+    free(wname);
+    return file;
+}
+
+bool ass_map_file(ASS_MappedFile *map, const char *filename, FileNameSource hint)
+{
+    map->data = NULL;
+    map->size = 0;
+    map->mtime = 0;
+    map->handle = NULL;
+
+    HANDLE file = open_handle_wtf8(filename);
+    if (file == INVALID_HANDLE_VALUE && hint != FN_DIR_LIST)
+        file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+            (uint64_t) size.QuadPart > SIZE_MAX) {
+        CloseHandle(file);
+        return false;
+    }
+
+    FILETIME mtime;
+    if (!GetFileTime(file, NULL, NULL, &mtime)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // the view keeps the mapping object alive, but not the file handle
+    HANDLE mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mapping)
+        return false;
+
+    const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!data) {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    map->data = data;
+    map->size = size.QuadPart;
+    map->mtime = (int64_t) mtime.dwHighDateTime << 32 | mtime.dwLowDateTime;
+    map->handle = mapping;
+    return true;
+}
+
+void ass_unmap_file(ASS_MappedFile *map)
+{
+    if (map->data)
+        UnmapViewOfFile(map->data);
+    if (map->handle)
+        CloseHandle(map->handle);
+    map->data = NULL;
+    map->size = 0;
+    map->mtime = 0;
+    map->handle = NULL;
+}
+
+#else
+
+bool ass_map_file(ASS_MappedFile *map, const char *filename, FileNameSource hint)
+{
+    map->data = NULL;
+    map->size = 0;
+    map->mtime = 0;
+    map->handle = NULL;
+    return false;
+}
+
+void ass_unmap_file(ASS_MappedFile *map)
+{
+}
+
+#endif
+
+FILE *ass_create_temp_file(const char *path, char **name)
+{
+    static volatile LONG counter;
+    size_t len = strlen(path), size = len + 18;  // ".pppppppp.cccccccc"
+    char *tmp = malloc(size);
+    if (!tmp)
+        return NULL;
+    memcpy(tmp, path, len);
+
+    // the same narrow names as remove() and rename() of the callers
+    for (int i = 0; i < 100; i++) {
+        snprintf(tmp + len, size - len, ".%08lx.%08lx",
+                 (unsigned long) GetCurrentProcessId(),
+                 (unsigned long) InterlockedIncrement(&counter));
+        int fd = _open(tmp, _O_CREAT | _O_EXCL | _O_WRONLY | _O_BINARY,
+                       _S_IREAD | _S_IWRITE);
+        if (fd < 0) {
+            if (errno == EEXIST)
+                continue;
+            break;
+        }
+        FILE *fp = _fdopen(fd, "wb");
+        if (!fp) {
+            _close(fd);
+            remove(tmp);
+            break;
+        }
+        *name = tmp;
+        return fp;
+    }
+    free(tmp);
+    return NULL;
+}
+
 
 static const WCHAR dir_tail[] = L"\\*";
 
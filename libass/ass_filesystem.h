@@ -18,6 +18,7 @@
 
 #include <stdio.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 #ifndef LIBASS_FILESYSTEM_H
 #define LIBASS_FILESYSTEM_H
@@ -29,6 +30,22 @@ typedef enum {
 
 FILE *ass_open_file(const char *filename, FileNameSource hint);
 
+// Read-only view of a whole file.
+// If mapping is not supported or fails, ass_map_file returns false.
+typedef struct {
+    const char *data;
+    size_t size;
+    int64_t mtime;  // modification time in platform units
+    void *handle;
+} ASS_MappedFile;
+
+bool ass_map_file(ASS_MappedFile *map, const char *filename, FileNameSource hint);
+void ass_unmap_file(ASS_MappedFile *map);
+
+// Create and open for writing a new file with a unique name next to path.
+// On success, *name receives the allocated name of the file.
+FILE *ass_create_temp_file(const char *path, char **name);
+
 typedef struct {
     void *handle;
     char *path;
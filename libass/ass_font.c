@@ -28,6 +28,7 @@
 #include FT_OUTLINE_H
 #include FT_TRUETYPE_IDS_H
 #include FT_TYPE1_TABLES_H
+#include FT_SIZES_H
 #include <limits.h>
 
 #include "ass.h"
@@ -437,7 +438,7 @@ static int add_face(ASS_FontSelector *fontsel, ASS_Font *font, uint32_t ch)
         return -1;
 
     for (i = 0; i < font->n_faces; i++) {
-        if (font->faces_uid[i] == uid) {
+        if (font->faces_uid[i] == uid && font->faces_fontsel[i] == fontsel) {
             ass_msg(font->library, MSGL_INFO,
                     "Got a font face that already is available! Skipping.");
             return i;
@@ -460,6 +461,8 @@ static int add_face(ASS_FontSelector *fontsel, ASS_Font *font, uint32_t ch)
 
     font->faces[font->n_faces] = face;
     font->faces_uid[font->n_faces] = uid;
+    font->faces_fontsel[font->n_faces] = fontsel;
+    font->sizes[font->n_faces] = face->size;
     if (!ass_create_hb_font(font, font->n_faces)) {
         FT_Done_Face(face);
         goto fail;
@@ -476,7 +479,7 @@ fail:
  */
 ASS_Font *ass_font_new(ASS_Renderer *render_priv, ASS_FontDesc *desc)
 {
-    ASS_Font *font = ass_cache_get(render_priv->cache.font_cache, desc, render_priv);
+    ASS_Font *font = ass_cache_get(render_priv->cache->font_cache, desc, render_priv);
     if (!font)
         return NULL;
     if (font->library)
@@ -491,7 +494,9 @@ size_t ass_font_construct(void *key, void *value, void *priv)
     ASS_Font *font = value;
 
     font->library = render_priv->library;
-    font->ftlibrary = render_priv->ftlibrary;
+    // faces in a shared store must not depend on the renderer's FreeType library
+    font->ftlibrary = render_priv->cache->ftlibrary ?
+        render_priv->cache->ftlibrary : render_priv->ftlibrary;
     font->n_faces = 0;
     font->desc.family = desc->family;
     font->desc.bold = desc->bold;
@@ -504,6 +509,18 @@ size_t ass_font_construct(void *key, void *value, void *priv)
     return 1;
 }
 
+/**
+ * \brief Check whether any face of the font has been found by fontsel
+ */
+bool ass_font_uses_selector(const ASS_Font *font,
+                            const ASS_FontSelector *fontsel)
+{
+    for (int i = 0; i < font->n_faces; i++)
+        if (font->faces_fontsel[i] == fontsel)
+            return true;
+    return false;
+}
+
 void ass_face_set_size(FT_Face face, double size)
 {
     FT_Size_RequestRec rq;
@@ -515,6 +532,22 @@ void ass_face_set_size(FT_Face face, double size)
     FT_Request_Size(face, &rq);
 }
 
+/**
+ * \brief Switch a face of the font to the given size.
+ * \param ft_size size object already set to this size, or NULL
+ * to rescale the face's own size object
+ */
+void ass_font_set_size(ASS_Font *font, int face_index, double size,
+                       FT_Size ft_size)
+{
+    if (ft_size) {
+        FT_Activate_Size(ft_size);
+        return;
+    }
+    FT_Activate_Size(font->sizes[face_index]);
+    ass_face_set_size(font->faces[face_index], size);
+}
+
 bool ass_face_is_postscript(FT_Face face)
 {
     PS_FontInfoRec postscript_info;
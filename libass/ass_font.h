@@ -43,14 +43,20 @@ struct ass_font {
     ASS_Library *library;
     FT_Library ftlibrary;
     int faces_uid[ASS_FONT_MAX_FACES];
+    // selector each face was found by; its uid is only unique within it,
+    // and the face may read its data through the selector's providers
+    const ASS_FontSelector *faces_fontsel[ASS_FONT_MAX_FACES];
     FT_Face faces[ASS_FONT_MAX_FACES];
     struct hb_font_t *hb_fonts[ASS_FONT_MAX_FACES];
+    FT_Size sizes[ASS_FONT_MAX_FACES];  // own size objects of the faces
     int n_faces;
 };
 
 void ass_charmap_magic(ASS_Library *library, FT_Face face);
 ASS_Font *ass_font_new(ASS_Renderer *render_priv, ASS_FontDesc *desc);
 void ass_face_set_size(FT_Face face, double size);
+void ass_font_set_size(ASS_Font *font, int face_index, double size,
+                       FT_Size ft_size);
 int ass_face_get_weight(FT_Face face);
 FT_Long ass_face_get_style_flags(FT_Face face);
 bool ass_face_is_postscript(FT_Face face);
@@ -59,6 +65,8 @@ void ass_font_get_asc_desc(ASS_Font *font, int face_index,
 int ass_font_get_index(ASS_FontSelector *fontsel, ASS_Font *font,
                        uint32_t symbol, int *face_index, int *glyph_index);
 uint32_t ass_font_index_magic(FT_Face face, uint32_t symbol);
+bool ass_font_uses_selector(const ASS_Font *font,
+                            const ASS_FontSelector *fontsel);
 bool ass_font_get_glyph(ASS_Font *font, int face_index, int index,
                         ASS_Hinting hinting);
 void ass_font_clear(ASS_Font *font);
@@ -0,0 +1,484 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_fontindex.h"
+#include "ass_utils.h"
+
+#define WYHASH_LITTLE_ENDIAN 1
+#include "wyhash.h"
+
+/*
+ * File layout, in native byte order:
+ *
+ *   IndexHeader
+ *   IndexEntry[n_entries], sorted by key
+ *   records, addressed by the entries
+ *
+ * A record is a u32 face count followed by, for each face,
+ * u32 face_index, weight, style_flags, is_postscript,
+ * n_family, n_fullname, has_postscript_name
+ * and then all names as NUL-terminated strings.
+ *
+ * Files with a foreign byte order or version are ignored and rewritten.
+ */
+
+#define INDEX_MAGIC "ASSFIDX1"
+#define INDEX_BYTE_ORDER 0x01020304
+#define INDEX_KEY_SEED 0x6a09e667f3bcc909ULL
+
+typedef struct {
+    char magic[8];
+    uint32_t byte_order;
+    uint32_t n_entries;
+} IndexHeader;
+
+typedef struct {
+    uint64_t key;
+    uint64_t offset, length;
+} IndexEntry;
+
+typedef struct {
+    uint64_t key;
+    char *data;
+    size_t length;
+} IndexRecord;
+
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    bool ok;
+} Writer;
+
+typedef struct {
+    const char *ptr, *end;
+} Reader;
+
+struct font_index {
+    ASS_Library *library;
+    char *path;
+
+    ASS_MappedFile map;
+    const IndexEntry *entries;
+    uint32_t n_entries;
+
+    IndexRecord *added;
+    size_t n_added, max_added;
+
+    Writer record;
+    uint32_t record_faces;
+    uint64_t record_key;
+};
+
+
+uint64_t ass_font_index_data_key(const void *data, size_t size)
+{
+    uint64_t hash = wyhash(data, size, INDEX_KEY_SEED, _wyp);
+    return wyhash64(hash, size);
+}
+
+uint64_t ass_font_index_file_key(const char *path, size_t size, int64_t mtime)
+{
+    uint64_t hash = wyhash(path, strlen(path), ~INDEX_KEY_SEED, _wyp);
+    return wyhash64(wyhash64(hash, size), mtime);
+}
+
+
+static void write_bytes(Writer *w, const void *data, size_t len)
+{
+    if (!w->ok)
+        return;
+    if (w->cap - w->len < len) {
+        size_t cap = FFMAX(2 * w->cap, 256);
+        while (cap - w->len < len)
+            cap *= 2;
+        char *buf = realloc(w->buf, cap);
+        if (!buf) {
+            w->ok = false;
+            return;
+        }
+        w->buf = buf;
+        w->cap = cap;
+    }
+    memcpy(w->buf + w->len, data, len);
+    w->len += len;
+}
+
+static void write_u32(Writer *w, uint32_t value)
+{
+    write_bytes(w, &value, sizeof(value));
+}
+
+static void write_str(Writer *w, const char *str)
+{
+    write_bytes(w, str, strlen(str) + 1);
+}
+
+static bool read_u32(Reader *r, uint32_t *value)
+{
+    if ((size_t) (r->end - r->ptr) < sizeof(*value))
+        return false;
+    memcpy(value, r->ptr, sizeof(*value));
+    r->ptr += sizeof(*value);
+    return true;
+}
+
+static const char *read_str(Reader *r)
+{
+    const char *str = r->ptr;
+    const char *nul = memchr(str, '\0', r->end - str);
+    if (!nul)
+        return NULL;
+    r->ptr = nul + 1;
+    return str;
+}
+
+
+ASS_FontIndex *ass_font_index_open(ASS_Library *library, const char *path)
+{
+    ASS_FontIndex *index = calloc(1, sizeof(*index));
+    if (!index)
+        return NULL;
+    index->library = library;
+    index->path = strdup(path);
+    if (!index->path) {
+        free(index);
+        return NULL;
+    }
+
+    if (!ass_map_file(&index->map, path, FN_EXTERNAL))
+        return index;
+
+    IndexHeader header;
+    if (index->map.size < sizeof(header))
+        goto invalid;
+    memcpy(&header, index->map.data, sizeof(header));
+    if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) ||
+            header.byte_order != INDEX_BYTE_ORDER ||
+            header.n_entries > (index->map.size - sizeof(header)) / sizeof(IndexEntry))
+        goto invalid;
+
+    index->entries = (const IndexEntry *) (index->map.data + sizeof(header));
+    index->n_entries = header.n_entries;
+    ass_msg(library, MSGL_V, "Font index '%s': %u entries",
+            path, header.n_entries);
+    return index;
+
+invalid:
+    ass_msg(library, MSGL_INFO, "Ignoring invalid font index '%s'", path);
+    ass_unmap_file(&index->map);
+    return index;
+}
+
+static bool parse_record(const char *data, size_t length,
+                         ASS_IndexedFace **faces, int *n_faces)
+{
+    Reader r = { data, data + length };
+    uint32_t n;
+    if (!read_u32(&r, &n) || n > length / 28)
+        return false;
+
+    *faces = NULL;
+    *n_faces = 0;
+    if (!n)
+        return true;
+
+    ASS_IndexedFace *res = calloc(n, sizeof(*res));
+    if (!res)
+        return false;
+
+    for (uint32_t i = 0; i < n; i++) {
+        ASS_IndexedFace *face = res + i;
+        ASS_FontProviderMetaData *meta = &face->meta;
+        uint32_t face_index, weight, style_flags, is_postscript;
+        uint32_t n_family, n_fullname, has_postscript_name;
+        if (!read_u32(&r, &face_index) || !read_u32(&r, &weight) ||
+                !read_u32(&r, &style_flags) || !read_u32(&r, &is_postscript) ||
+                !read_u32(&r, &n_family) || !read_u32(&r, &n_fullname) ||
+                !read_u32(&r, &has_postscript_name))
+            goto fail;
+        // every name takes at least one byte
+        size_t left = r.end - r.ptr;
+        if (face_index > INT_MAX || !n_family ||
+                n_family > left || n_fullname > left - n_family)
+            goto fail;
+
+        face->face_index = face_index;
+        meta->weight = weight;
+        meta->style_flags = style_flags;
+        meta->is_postscript = is_postscript;
+        meta->n_family = n_family;
+        meta->n_fullname = n_fullname;
+        meta->families = calloc(n_family, sizeof(char *));
+        if (!meta->families)
+            goto fail;
+        for (uint32_t j = 0; j < n_family; j++)
+            if (!(meta->families[j] = (char *) read_str(&r)))
+                goto fail;
+        if (n_fullname) {
+            meta->fullnames = calloc(n_fullname, sizeof(char *));
+            if (!meta->fullnames)
+                goto fail;
+        }
+        for (uint32_t j = 0; j < n_fullname; j++)
+            if (!(meta->fullnames[j] = (char *) read_str(&r)))
+                goto fail;
+        if (has_postscript_name &&
+                !(meta->postscript_name = (char *) read_str(&r)))
+            goto fail;
+    }
+
+    *faces = res;
+    *n_faces = n;
+    return true;
+
+fail:
+    ass_font_index_free_faces(res, n);
+    return false;
+}
+
+int ass_font_index_lookup(ASS_FontIndex *index, uint64_t key,
+                          ASS_IndexedFace **faces)
+{
+    int n_faces;
+    for (size_t i = 0; i < index->n_added; i++) {
+        IndexRecord *rec = index->added + i;
+        if (rec->key == key &&
+                parse_record(rec->data, rec->length, faces, &n_faces))
+            return n_faces;
+    }
+
+    size_t lo = 0, hi = index->n_entries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == index->n_entries)
+        return -1;
+
+    IndexEntry entry;
+    memcpy(&entry, index->entries + lo, sizeof(entry));
+    if (entry.key != key || entry.offset > index->map.size ||
+            entry.length > index->map.size - entry.offset)
+        return -1;
+    if (!parse_record(index->map.data + entry.offset, entry.length,
+                      faces, &n_faces)) {
+        ass_msg(index->library, MSGL_V, "Corrupted font index record");
+        return -1;
+    }
+    return n_faces;
+}
+
+void ass_font_index_free_faces(ASS_IndexedFace *faces, int n_faces)
+{
+    if (!faces)
+        return;
+    for (int i = 0; i < n_faces; i++) {
+        free(faces[i].meta.families);
+        free(faces[i].meta.fullnames);
+    }
+    free(faces);
+}
+
+
+void ass_font_index_begin(ASS_FontIndex *index, uint64_t key)
+{
+    index->record.len = 0;
+    index->record.ok = true;
+    index->record_faces = 0;
+    index->record_key = key;
+    write_u32(&index->record, 0);
+}
+
+void ass_font_index_add_face(ASS_FontIndex *index, int face_index,
+                             const ASS_FontProviderMetaData *meta)
+{
+    Writer *w = &index->record;
+    write_u32(w, face_index);
+    write_u32(w, meta->weight);
+    write_u32(w, meta->style_flags);
+    write_u32(w, meta->is_postscript);
+    write_u32(w, meta->n_family);
+    write_u32(w, meta->n_fullname);
+    write_u32(w, !!meta->postscript_name);
+    for (int i = 0; i < meta->n_family; i++)
+        write_str(w, meta->families[i]);
+    for (int i = 0; i < meta->n_fullname; i++)
+        write_str(w, meta->fullnames[i]);
+    if (meta->postscript_name)
+        write_str(w, meta->postscript_name);
+    index->record_faces++;
+}
+
+void ass_font_index_end(ASS_FontIndex *index)
+{
+    Writer *w = &index->record;
+    if (!w->ok)
+        return;
+    memcpy(w->buf, &index->record_faces, sizeof(index->record_faces));
+
+    if (index->n_added >= index->max_added) {
+        size_t max = FFMAX(2 * index->max_added, 16);
+        if (!ASS_REALLOC_ARRAY(index->added, max))
+            return;
+        index->max_added = max;
+    }
+    char *data = malloc(w->len);
+    if (!data)
+        return;
+    memcpy(data, w->buf, w->len);
+
+    IndexRecord *rec = index->added + index->n_added++;
+    rec->key = index->record_key;
+    rec->data = data;
+    rec->length = w->len;
+}
+
+
+typedef struct {
+    uint64_t key;
+    const char *data;
+    size_t length;
+} SaveEntry;
+
+static int cmp_save_entry(const void *a, const void *b)
+{
+    const SaveEntry *ea = a, *eb = b;
+    return ea->key < eb->key ? -1 : ea->key > eb->key;
+}
+
+static bool is_added(ASS_FontIndex *index, uint64_t key)
+{
+    for (size_t i = 0; i < index->n_added; i++)
+        if (index->added[i].key == key)
+            return true;
+    return false;
+}
+
+static bool write_file(FILE *fp, SaveEntry *entries, uint32_t n)
+{
+    IndexHeader header = { .byte_order = INDEX_BYTE_ORDER, .n_entries = n };
+    memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+    if (fwrite(&header, sizeof(header), 1, fp) != 1)
+        return false;
+
+    uint64_t offset = sizeof(header) + (uint64_t) n * sizeof(IndexEntry);
+    for (uint32_t i = 0; i < n; i++) {
+        IndexEntry entry = {
+            .key = entries[i].key,
+            .offset = offset,
+            .length = entries[i].length,
+        };
+        if (fwrite(&entry, sizeof(entry), 1, fp) != 1)
+            return false;
+        offset += entries[i].length;
+    }
+    for (uint32_t i = 0; i < n; i++)
+        if (fwrite(entries[i].data, 1, entries[i].length, fp) != entries[i].length)
+            return false;
+    return true;
+}
+
+/**
+ * \brief Merge the new records into the index file.
+ * The file is written under a temporary name and then renamed,
+ * so concurrent readers always see a complete index.
+ */
+static void save_index(ASS_FontIndex *index)
+{
+    size_t n = 0, max = (size_t) index->n_entries + index->n_added;
+    if (max > UINT32_MAX)
+        return;
+    SaveEntry *entries = NULL;
+    if (!ASS_REALLOC_ARRAY(entries, max))
+        return;
+
+    // entries of the old file are carried over without validation,
+    // a broken one simply stays a lookup miss
+    for (uint32_t i = 0; i < index->n_entries; i++) {
+        IndexEntry entry;
+        memcpy(&entry, index->entries + i, sizeof(entry));
+        if (entry.offset > index->map.size ||
+                entry.length > index->map.size - entry.offset ||
+                is_added(index, entry.key))
+            continue;
+        entries[n++] = (SaveEntry) {
+            entry.key, index->map.data + entry.offset, entry.length
+        };
+    }
+    for (size_t i = 0; i < index->n_added; i++) {
+        IndexRecord *rec = index->added + i;
+        entries[n++] = (SaveEntry) { rec->key, rec->data, rec->length };
+    }
+    qsort(entries, n, sizeof(SaveEntry), cmp_save_entry);
+
+    // every writer has its own file, the last rename wins
+    char *tmp;
+    FILE *fp = ass_create_temp_file(index->path, &tmp);
+    if (!fp) {
+        ass_msg(index->library, MSGL_WARN,
+                "Failed to save font index '%s'", index->path);
+        free(entries);
+        return;
+    }
+    bool ok = write_file(fp, entries, n);
+    ok = !fclose(fp) && ok;
+    free(entries);
+
+    // the mapping has to go before the file can be replaced on Windows
+    ass_unmap_file(&index->map);
+    index->entries = NULL;
+    index->n_entries = 0;
+
+#ifdef _WIN32
+    if (ok)
+        remove(index->path);
+#endif
+    if (!ok || rename(tmp, index->path)) {
+        ass_msg(index->library, MSGL_WARN,
+                "Failed to save font index '%s'", index->path);
+        remove(tmp);
+    }
+    free(tmp);
+}
+
+void ass_font_index_close(ASS_FontIndex *index)
+{
+    if (!index)
+        return;
+    if (index->n_added)
+        save_index(index);
+
+    for (size_t i = 0; i < index->n_added; i++)
+        free(index->added[i].data);
+    free(index->added);
+    free(index->record.buf);
+    ass_unmap_file(&index->map);
+    free(index->path);
+    free(index);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_FONTINDEX_H
+#define LIBASS_FONTINDEX_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "ass_library.h"
+#include "ass_fontselect.h"
+
+// Persistent index of font metadata, so that fonts seen in a previous
+// session can be registered without being opened with FreeType.
+// The index file is mapped once on open, and its records are only
+// validated when looked up. New records are written out on close.
+typedef struct font_index ASS_FontIndex;
+
+typedef struct {
+    int face_index;
+    ASS_FontProviderMetaData meta;
+} ASS_IndexedFace;
+
+uint64_t ass_font_index_data_key(const void *data, size_t size);
+uint64_t ass_font_index_file_key(const char *path, size_t size, int64_t mtime);
+
+ASS_FontIndex *ass_font_index_open(ASS_Library *library, const char *path);
+void ass_font_index_close(ASS_FontIndex *index);
+
+/**
+ * \brief Find the faces recorded for a font.
+ * Names in the returned metadata point into the index
+ * and stay valid until the index is closed.
+ * \param faces array of faces, returned here;
+ * free with ass_font_index_free_faces()
+ * \return number of faces, or -1 if the font is not indexed
+ */
+int ass_font_index_lookup(ASS_FontIndex *index, uint64_t key,
+                          ASS_IndexedFace **faces);
+void ass_font_index_free_faces(ASS_IndexedFace *faces, int n_faces);
+
+// Record the faces of a font: begin, add each usable face, then end.
+void ass_font_index_begin(ASS_FontIndex *index, uint64_t key);
+void ass_font_index_add_face(ASS_FontIndex *index, int face_index,
+                             const ASS_FontProviderMetaData *meta);
+void ass_font_index_end(ASS_FontIndex *index);
+
+#endif /* LIBASS_FONTINDEX_H */
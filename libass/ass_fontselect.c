@@ -41,6 +41,7 @@
 #include "ass_library.h"
 #include "ass_filesystem.h"
 #include "ass_fontselect.h"
+#include "ass_fontindex.h"
 #include "ass_fontconfig.h"
 #include "ass_coretext.h"
 #include "ass_directwrite.h"
@@ -82,6 +83,26 @@ struct font_info {
     bool is_postscript;
 };
 
+// Entry of the case-insensitive index of all names a font can be
+// requested by. Entries are keyed by hash only and candidates are
+// checked against the requested name, so collisions are harmless.
+typedef struct {
+    uint32_t hash;
+    int font;   // index into font_infos
+    int next;   // next entry in the same bucket, or -1
+} NameIndexEntry;
+
+#define FONT_MEMO_SIZE 256
+
+// Memoized select_font() result
+typedef struct {
+    char *family;   // NULL for an unused slot
+    uint32_t code;
+    unsigned bold, italic;
+    bool match_extended_family;
+    int font;       // index into font_infos, or -1 if nothing matched
+} FontMemo;
+
 struct font_selector {
     ASS_Library *library;
     FT_Library ftlibrary;
@@ -99,6 +120,20 @@ struct font_selector {
     int alloc_font;
     ASS_FontInfo *font_infos;
 
+    // name lookup, rebuilt whenever fonts are removed;
+    // if building it fails, every font is considered a candidate
+    bool name_index_valid;
+    int *name_buckets;
+    int n_name_buckets;     // power of two, or 0
+    NameIndexEntry *name_entries;
+    int n_name_entries, alloc_name_entries;
+    int *candidates;
+    int alloc_candidates;
+
+    // recent lookups, cleared whenever the font list changes
+    FontMemo memo[FONT_MEMO_SIZE];
+    int n_memo;
+
     ASS_FontProvider *default_provider;
     ASS_FontProvider *embedded_provider;
 };
@@ -112,10 +147,35 @@ struct font_provider {
 typedef struct font_data_ft FontDataFT;
 struct font_data_ft {
     ASS_Library *lib;
-    FT_Face face;
+    FT_Library ftlibrary;
+    FT_Face face;       // NULL until needed if registered from the font index
     int idx;
+    int face_index;
 };
 
+/**
+ * \brief Get the face of an embedded font, opening it on first use.
+ */
+static FT_Face get_face_ft(FontDataFT *fd)
+{
+    if (fd->face)
+        return fd->face;
+
+    ASS_Fontdata *data = fd->lib->fontdata + fd->idx;
+    if (!ass_decode_font(fd->lib, data))
+        return NULL;
+
+    FT_Face face;
+    if (FT_New_Memory_Face(fd->ftlibrary, (const unsigned char *) data->data,
+                           data->size, fd->face_index, &face)) {
+        ass_msg(fd->lib, MSGL_WARN, "Error opening memory font '%s'",
+                data->name);
+        return NULL;
+    }
+    ass_charmap_magic(fd->lib, face);
+    return fd->face = face;
+}
+
 static bool check_glyph_ft(void *data, uint32_t codepoint)
 {
     FontDataFT *fd = (FontDataFT *)data;
@@ -123,14 +183,16 @@ static bool check_glyph_ft(void *data, uint32_t codepoint)
     if (!codepoint)
         return true;
 
-    return !!FT_Get_Char_Index(fd->face, codepoint);
+    FT_Face face = get_face_ft(fd);
+    return face && FT_Get_Char_Index(face, codepoint);
 }
 
 static void destroy_font_ft(void *data)
 {
     FontDataFT *fd = (FontDataFT *)data;
 
-    FT_Done_Face(fd->face);
+    if (fd->face)
+        FT_Done_Face(fd->face);
     free(fd);
 }
 
@@ -141,6 +203,9 @@ get_data_embedded(void *data, unsigned char *buf, size_t offset, size_t len)
     ASS_Fontdata *fd = ft->lib->fontdata;
     int i = ft->idx;
 
+    if (!ass_decode_font(ft->lib, fd + i))
+        return 0;
+
     if (buf == NULL)
         return fd[i].size;
 
@@ -175,6 +240,16 @@ static void load_fonts_from_dir(ASS_Library *library, const char *dir)
         if (!path)
             continue;
         ass_msg(library, MSGL_INFO, "Loading font file '%s'", path);
+
+        // only the pages FreeType actually reads get loaded
+        ASS_MappedFile map;
+        if (ass_map_file(&map, path, FN_DIR_LIST)) {
+            uint64_t key = ass_font_index_file_key(path, map.size, map.mtime);
+            if (!ass_add_font_mapped(library, name, &map, key))
+                ass_unmap_file(&map);
+            continue;
+        }
+
         size_t size = 0;
         void *data = ass_load_file(library, path, FN_DIR_LIST, &size);
         if (data) {
@@ -370,6 +445,143 @@ static void free_font_info(ASS_FontProviderMetaData *meta)
     }
 }
 
+static void clear_memo(ASS_FontSelector *selector)
+{
+    if (!selector->n_memo)
+        return;
+    for (int i = 0; i < FONT_MEMO_SIZE; i++) {
+        free(selector->memo[i].family);
+        selector->memo[i].family = NULL;
+    }
+    selector->n_memo = 0;
+}
+
+static bool add_name_entry(ASS_FontSelector *selector, const char *name,
+                           int font)
+{
+    if (selector->n_name_entries >= selector->alloc_name_entries) {
+        int alloc = FFMAX(2 * selector->alloc_name_entries, 64);
+        if (!ASS_REALLOC_ARRAY(selector->name_entries, alloc))
+            return false;
+        selector->alloc_name_entries = alloc;
+    }
+
+    // keep at most one entry per bucket on average
+    if (selector->n_name_entries >= selector->n_name_buckets) {
+        int n_buckets = FFMAX(2 * selector->n_name_buckets, 64);
+        if (!ASS_REALLOC_ARRAY(selector->name_buckets, n_buckets))
+            return false;
+        selector->n_name_buckets = n_buckets;
+        for (int i = 0; i < n_buckets; i++)
+            selector->name_buckets[i] = -1;
+        for (int i = 0; i < selector->n_name_entries; i++) {
+            NameIndexEntry *entry = selector->name_entries + i;
+            int *head = &selector->name_buckets[entry->hash & (n_buckets - 1)];
+            entry->next = *head;
+            *head = i;
+        }
+    }
+
+    int idx = selector->n_name_entries++;
+    NameIndexEntry *entry = selector->name_entries + idx;
+    entry->hash = ass_strcasehash(name);
+    entry->font = font;
+    int *head = &selector->name_buckets[entry->hash & (selector->n_name_buckets - 1)];
+    entry->next = *head;
+    *head = idx;
+    return true;
+}
+
+/**
+ * \brief Add all names of a font to the name index.
+ */
+static void index_font_names(ASS_FontSelector *selector, int font)
+{
+    if (!selector->name_index_valid)
+        return;
+
+    ASS_FontInfo *info = selector->font_infos + font;
+    bool ok = true;
+    for (int i = 0; i < info->n_family; i++)
+        ok = ok && add_name_entry(selector, info->families[i], font);
+    for (int i = 0; i < info->n_fullname; i++)
+        ok = ok && add_name_entry(selector, info->fullnames[i], font);
+    if (info->postscript_name)
+        ok = ok && add_name_entry(selector, info->postscript_name, font);
+    if (info->extended_family)
+        ok = ok && add_name_entry(selector, info->extended_family, font);
+    selector->name_index_valid = ok;
+}
+
+static void rebuild_name_index(ASS_FontSelector *selector)
+{
+    selector->name_index_valid = true;
+    selector->n_name_entries = 0;
+    for (int i = 0; i < selector->n_name_buckets; i++)
+        selector->name_buckets[i] = -1;
+    for (int i = 0; i < selector->n_font; i++)
+        index_font_names(selector, i);
+}
+
+static void free_name_index(ASS_FontSelector *selector)
+{
+    clear_memo(selector);
+    free(selector->name_buckets);
+    free(selector->name_entries);
+    free(selector->candidates);
+}
+
+static int cmp_int(const void *a, const void *b)
+{
+    int ia = *(const int *) a, ib = *(const int *) b;
+    return (ia > ib) - (ia < ib);
+}
+
+/**
+ * \brief Collect the fonts that may have the given name,
+ * in font list order, into selector->candidates.
+ * \return number of candidates
+ */
+static int find_name_candidates(ASS_FontSelector *selector, const char *name)
+{
+    int n = 0;
+    if (!selector->name_index_valid) {
+        if (selector->alloc_candidates < selector->n_font) {
+            if (!ASS_REALLOC_ARRAY(selector->candidates, selector->n_font))
+                return 0;
+            selector->alloc_candidates = selector->n_font;
+        }
+        for (int i = 0; i < selector->n_font; i++)
+            selector->candidates[n++] = i;
+        return n;
+    }
+    if (!selector->n_name_buckets)
+        return 0;
+
+    uint32_t hash = ass_strcasehash(name);
+    int idx = selector->name_buckets[hash & (selector->n_name_buckets - 1)];
+    for (; idx >= 0; idx = selector->name_entries[idx].next) {
+        NameIndexEntry *entry = selector->name_entries + idx;
+        if (entry->hash != hash)
+            continue;
+        if (n >= selector->alloc_candidates) {
+            int alloc = FFMAX(2 * selector->alloc_candidates, 16);
+            if (!ASS_REALLOC_ARRAY(selector->candidates, alloc))
+                break;
+            selector->alloc_candidates = alloc;
+        }
+        selector->candidates[n++] = entry->font;
+    }
+
+    // restore the order of a linear scan so ties resolve the same way
+    qsort(selector->candidates, n, sizeof(int), cmp_int);
+    int w = 0;
+    for (int i = 0; i < n; i++)
+        if (!w || selector->candidates[w - 1] != selector->candidates[i])
+            selector->candidates[w++] = selector->candidates[i];
+    return w;
+}
+
 /**
  * \brief Add a font to a font provider.
  * \param provider the font provider
@@ -511,6 +723,8 @@ ass_font_provider_add_font(ASS_FontProvider *provider,
     info->provider = provider;
 
     selector->n_font++;
+    index_font_names(selector, selector->n_font - 1);
+    clear_memo(selector);
 
     free_font_info(&implicit_meta);
     free(implicit_meta.postscript_name);
@@ -552,6 +766,8 @@ static void ass_fontselect_cleanup(ASS_FontSelector *selector)
     }
 
     selector->n_font = w;
+    rebuild_name_index(selector);
+    clear_memo(selector);
 }
 
 void ass_font_provider_free(ASS_FontProvider *provider)
@@ -705,19 +921,21 @@ static bool check_glyph(ASS_FontInfo *fi, uint32_t code)
     return provider->funcs.check_glyph(fi->priv, code);
 }
 
-static char *
+/**
+ * \brief Find the best font for a list of names.
+ * \return index of the font in font_infos, or -1
+ */
+static int
 find_font(ASS_FontSelector *priv,
           ASS_FontProviderMetaData meta, bool match_extended_family,
-          unsigned bold, unsigned italic,
-          int *index, char **postscript_name, int *uid, ASS_FontStream *stream,
-          uint32_t code, bool *name_match)
+          unsigned bold, unsigned italic, uint32_t code, bool *name_match)
 {
     ASS_FontInfo req = {0};
     ASS_FontInfo *selected = NULL;
 
     // do we actually have any fonts?
     if (!priv->n_font)
-        return NULL;
+        return -1;
 
     // fill font request
     req.style_flags = (italic ? FT_STYLE_FLAG_ITALIC : 0);
@@ -728,8 +946,10 @@ find_font(ASS_FontSelector *priv,
     for (int i = 0; i < meta.n_fullname; i++) {
         const char *fullname = meta.fullnames[i];
 
-        for (int x = 0; x < priv->n_font; x++) {
-            ASS_FontInfo *font = &priv->font_infos[x];
+        // only fonts with a matching name can score
+        int n_candidates = find_name_candidates(priv, fullname);
+        for (int c = 0; c < n_candidates; c++) {
+            ASS_FontInfo *font = &priv->font_infos[priv->candidates[c]];
             unsigned score = UINT_MAX;
 
             if (matches_family_name(font, fullname, match_extended_family)) {
@@ -775,38 +995,54 @@ find_font(ASS_FontSelector *priv,
             break;
     }
 
-    // found anything?
-    char *result = NULL;
-    if (selected) {
-        ASS_FontProvider *provider = selected->provider;
-
-        // successfully matched, set up return values
-        *postscript_name = selected->postscript_name;
-        *uid   = selected->uid;
-
-        // use lazy evaluation for index if applicable
-        if (provider->funcs.get_font_index) {
-            *index = provider->funcs.get_font_index(selected->priv);
-        } else
-            *index = selected->index;
-
-        // set up memory stream if there is no path
-        if (selected->path == NULL) {
-            stream->func = provider->funcs.get_data;
-            stream->priv = selected->priv;
-            // Prefer PostScript name because it is unique. This is only
-            // used for display purposes so it doesn't matter that much,
-            // though.
-            if (selected->postscript_name)
-                result = selected->postscript_name;
-            else
-                result = selected->families[0];
-        } else
-            result = selected->path;
+    return selected ? selected - priv->font_infos : -1;
+}
 
+/**
+ * \brief Set up the return values of ass_font_select for a font.
+ * \return font path or name
+ */
+static char *
+get_font_result(ASS_FontSelector *priv, int font,
+                int *index, char **postscript_name, int *uid,
+                ASS_FontStream *stream)
+{
+    ASS_FontInfo *selected = priv->font_infos + font;
+    ASS_FontProvider *provider = selected->provider;
+
+    // successfully matched, set up return values
+    *postscript_name = selected->postscript_name;
+    *uid   = selected->uid;
+
+    // use lazy evaluation for index if applicable
+    if (provider->funcs.get_font_index) {
+        *index = provider->funcs.get_font_index(selected->priv);
+    } else
+        *index = selected->index;
+
+    // set up memory stream if there is no path
+    if (selected->path == NULL) {
+        stream->func = provider->funcs.get_data;
+        stream->priv = selected->priv;
+        // Prefer PostScript name because it is unique. This is only
+        // used for display purposes so it doesn't matter that much,
+        // though.
+        if (selected->postscript_name)
+            return selected->postscript_name;
+        return selected->families[0];
     }
+    return selected->path;
+}
 
-    return result;
+static FontMemo *get_memo(ASS_FontSelector *priv, const char *family,
+                          bool match_extended_family,
+                          unsigned bold, unsigned italic, uint32_t code)
+{
+    uint32_t hash = ass_strcasehash(family);
+    hash = (hash ^ code) * 16777619u;
+    hash = (hash ^ bold) * 16777619u;
+    hash = (hash ^ (italic << 1 | match_extended_family)) * 16777619u;
+    return priv->memo + (hash >> 24) % FONT_MEMO_SIZE;
 }
 
 static char *select_font(ASS_FontSelector *priv,
@@ -817,12 +1053,24 @@ static char *select_font(ASS_FontSelector *priv,
 {
     ASS_FontProvider *default_provider = priv->default_provider;
     ASS_FontProviderMetaData meta = {0};
-    char *result = NULL;
+    int font;
     bool name_match = false;
 
     if (family == NULL)
         return NULL;
 
+    FontMemo *memo = get_memo(priv, family, match_extended_family,
+                              bold, italic, code);
+    if (memo->family && memo->code == code &&
+            memo->bold == bold && memo->italic == italic &&
+            memo->match_extended_family == match_extended_family &&
+            !strcmp(memo->family, family)) {
+        if (memo->font < 0)
+            return NULL;
+        return get_font_result(priv, memo->font, index, postscript_name,
+                               uid, stream);
+    }
+
     ASS_FontProviderMetaData default_meta = {
         .n_fullname = 1,
         .fullnames  = (char **)&family,
@@ -839,14 +1087,13 @@ static char *select_font(ASS_FontSelector *priv,
         meta = default_meta;
     }
 
-    result = find_font(priv, meta, match_extended_family,
-                       bold, italic, index, postscript_name, uid,
-                       stream, code, &name_match);
+    font = find_font(priv, meta, match_extended_family,
+                     bold, italic, code, &name_match);
 
     // If no matching font was found, it might not exist in the font list
     // yet. Call the match_fonts callback to fill in the missing fonts
     // on demand, and retry the search for a match.
-    if (result == NULL && name_match == false && default_provider &&
+    if (font < 0 && name_match == false && default_provider &&
             default_provider->funcs.match_fonts) {
         // TODO: consider changing the API to make more efficient
         // implementations possible.
@@ -855,9 +1102,8 @@ static char *select_font(ASS_FontSelector *priv,
                                                 priv->library, default_provider,
                                                 meta.fullnames[i]);
         }
-        result = find_font(priv, meta, match_extended_family,
-                           bold, italic, index, postscript_name, uid,
-                           stream, code, &name_match);
+        font = find_font(priv, meta, match_extended_family,
+                         bold, italic, code, &name_match);
     }
 
     // cleanup
@@ -867,7 +1113,26 @@ static char *select_font(ASS_FontSelector *priv,
         free(meta.fullnames);
     }
 
-    return result;
+    // match_fonts may have changed the font list, so store afterwards
+    char *family_copy = strdup(family);
+    if (family_copy) {
+        if (memo->family)
+            free(memo->family);
+        else
+            priv->n_memo++;
+        *memo = (FontMemo) {
+            .family = family_copy,
+            .code = code,
+            .bold = bold,
+            .italic = italic,
+            .match_extended_family = match_extended_family,
+            .font = font,
+        };
+    }
+
+    if (font < 0)
+        return NULL;
+    return get_font_result(priv, font, index, postscript_name, uid, stream);
 }
 
 
@@ -941,35 +1206,150 @@ char *ass_font_select(ASS_FontSelector *priv,
 }
 
 
+/**
+ * \brief Register a face of a memory font with the embedded provider.
+ * \param face opened face, or NULL to open it when first needed
+ */
+static void add_embedded_face(ASS_FontProvider *priv, int idx, int face_index,
+                              FT_Face face, ASS_FontProviderMetaData *info)
+{
+    ASS_FontSelector *selector = priv->parent;
+    ASS_Library *library = selector->library;
+
+    FontDataFT *ft = calloc(1, sizeof(FontDataFT));
+    if (ft == NULL) {
+        if (face)
+            FT_Done_Face(face);
+        return;
+    }
+
+    ft->lib  = library;
+    ft->ftlibrary = selector->ftlibrary;
+    ft->face = face;
+    ft->idx  = idx;
+    ft->face_index = face_index;
+
+    if (!ass_font_provider_add_font(priv, info, NULL, face_index, ft))
+        ass_msg(library, MSGL_WARN, "Failed to add embedded font '%s'",
+                library->fontdata[idx].name);
+}
+
+/**
+ * \brief Get the font index key of a memory font.
+ * Encoded embedded fonts are hashed before decoding.
+ */
+static uint64_t get_fontdata_key(ASS_Library *lib, ASS_Fontdata *fd)
+{
+    ass_mutex_lock(&lib->font_lock);
+    if (!fd->key) {
+        if (fd->encoded)
+            fd->key = ass_font_index_data_key(fd->encoded, fd->encoded_size);
+        else
+            fd->key = ass_font_index_data_key(fd->data, fd->size);
+        fd->key |= 1;
+    }
+    uint64_t key = fd->key;
+    ass_mutex_unlock(&lib->font_lock);
+    return key;
+}
+
+typedef struct {
+    FT_StreamRec stream;
+    ASS_Library *lib;
+    ASS_Fontdata *fd;
+} FontdataStream;
+
+static unsigned long read_fontdata(FT_Stream stream, unsigned long offset,
+                                   unsigned char *buffer, unsigned long count)
+{
+    FontdataStream *s = stream->descriptor.pointer;
+    if (!count)
+        return offset > stream->size;
+    return ass_read_font(s->lib, s->fd, offset, buffer, count);
+}
+
+/**
+ * \brief Open a face of a memory font. A font that is still encoded
+ * is read through a stream that decodes only the parts FreeType touches,
+ * so the face is only good for reading its metadata.
+ */
+static FT_Error open_fontdata_face(FT_Library ftlibrary, bool decoded,
+                                   FontdataStream *stream, int face_index,
+                                   FT_Face *face)
+{
+    ASS_Fontdata *fd = stream->fd;
+    if (decoded)
+        return FT_New_Memory_Face(ftlibrary, (const unsigned char *) fd->data,
+                                  fd->size, face_index, face);
+
+    memset(&stream->stream, 0, sizeof(stream->stream));
+    stream->stream.size = ass_font_size(stream->lib, fd);
+    stream->stream.descriptor.pointer = stream;
+    stream->stream.read = read_fontdata;
+    FT_Open_Args args = {
+        .flags = FT_OPEN_STREAM,
+        .stream = &stream->stream,
+    };
+    return FT_Open_Face(ftlibrary, &args, face_index, face);
+}
+
 /**
  * \brief Process memory font.
  * \param priv private data
  * \param idx index of the processed font in priv->library->fontdata
+ * \param index font index to consult and update, or NULL
  *
- * Builds a FontInfo with FreeType and some table reading.
+ * Builds a FontInfo with FreeType and some table reading,
+ * unless the font is already known to the font index.
+ * Embedded fonts are not decoded here, only when their faces are used.
 */
-static void process_fontdata(ASS_FontProvider *priv, int idx)
+static void process_fontdata(ASS_FontProvider *priv, int idx,
+                             ASS_FontIndex *index)
 {
     ASS_FontSelector *selector = priv->parent;
     ASS_Library *library = selector->library;
 
     int rc;
-    const char *name = library->fontdata[idx].name;
-    const char *data = library->fontdata[idx].data;
-    int data_size = library->fontdata[idx].size;
+    ASS_Fontdata *fd = library->fontdata + idx;
+    const char *name = fd->name;
+
+    uint64_t key = 0;
+    if (index) {
+        ASS_IndexedFace *faces;
+        key = get_fontdata_key(library, fd);
+        int n_faces = ass_font_index_lookup(index, key, &faces);
+        if (n_faces >= 0) {
+            for (int i = 0; i < n_faces; i++)
+                add_embedded_face(priv, idx, faces[i].face_index, NULL,
+                                  &faces[i].meta);
+            ass_font_index_free_faces(faces, n_faces);
+            return;
+        }
+    }
+
+    // decoded data stays in place, but faces read from the encoded data
+    // through the stream can't be kept
+    ass_mutex_lock(&library->font_lock);
+    bool keep_face = fd->data;
+    ass_mutex_unlock(&library->font_lock);
+    FontdataStream stream = { .lib = library, .fd = fd };
 
     FT_Face face;
     int face_index, num_faces = 1;
+    bool complete = true;
+
+    if (index)
+        ass_font_index_begin(index, key);
 
     for (face_index = 0; face_index < num_faces; ++face_index) {
         ASS_FontProviderMetaData info;
-        FontDataFT *ft;
 
-        rc = FT_New_Memory_Face(selector->ftlibrary, (unsigned char *) data,
-                                data_size, face_index, &face);
+        rc = open_fontdata_face(selector->ftlibrary, keep_face, &stream,
+                                face_index, &face);
         if (rc) {
             ass_msg(library, MSGL_WARN, "Error opening memory font '%s'",
                    name);
+            complete = false;
             continue;
         }
 
@@ -985,26 +1365,20 @@ static void process_fontdata(ASS_FontProvider *priv, int idx)
             continue;
         }
 
-        ft = calloc(1, sizeof(FontDataFT));
-
-        if (ft == NULL) {
-            free_font_info(&info);
+        if (index)
+            ass_font_index_add_face(index, face_index, &info);
+        if (!keep_face) {
             FT_Done_Face(face);
-            continue;
-        }
-
-        ft->lib  = library;
-        ft->face = face;
-        ft->idx  = idx;
-
-        if (!ass_font_provider_add_font(priv, &info, NULL, face_index, ft)) {
-            ass_msg(library, MSGL_WARN, "Failed to add embedded font '%s'",
-                    name);
-            free(ft);
+            face = NULL;
         }
+        add_embedded_face(priv, idx, face_index, face, &info);
 
         free_font_info(&info);
     }
+
+    // faces that failed to open are retried in the next session
+    if (index && complete)
+        ass_font_index_end(index);
 }
 
 /**
@@ -1026,10 +1400,16 @@ ass_embedded_fonts_add_provider(ASS_FontSelector *selector, size_t *num_emfonts)
         load_fonts_from_dir(lib, lib->fonts_dir);
     }
 
+    ASS_FontIndex *index = NULL;
+    if (lib->font_index_path && lib->font_index_path[0])
+        index = ass_font_index_open(lib, lib->font_index_path);
+
     for (size_t i = 0; i < lib->num_fontdata; i++)
-        process_fontdata(priv, i);
+        process_fontdata(priv, i, index);
     *num_emfonts = lib->num_fontdata;
 
+    ass_font_index_close(index);
+
     return priv;
 }
 
@@ -1079,6 +1459,7 @@ ass_fontselect_init(ASS_Library *library, FT_Library ftlibrary, size_t *num_emfo
     priv->library = library;
     priv->ftlibrary = ftlibrary;
     priv->uid = 1;
+    priv->name_index_valid = true;
     priv->family_default = family ? strdup(family) : NULL;
     priv->path_default = path ? strdup(path) : NULL;
     priv->index_default = 0;
@@ -1124,6 +1505,7 @@ fail:
 
     free(priv->family_default);
     free(priv->path_default);
+    free_name_index(priv);
 
     free(priv);
 
@@ -1168,6 +1550,7 @@ void ass_fontselect_free(ASS_FontSelector *priv)
     free(priv->font_infos);
     free(priv->path_default);
     free(priv->family_default);
+    free_name_index(priv);
 
     free(priv);
 }
@@ -1193,8 +1576,18 @@ size_t ass_update_embedded_fonts(ASS_FontSelector *selector, size_t num_loaded)
     if (!selector->embedded_provider)
         return num_loaded;
 
-    size_t num_fontdata = selector->library->num_fontdata;
+    ASS_Library *lib = selector->library;
+    size_t num_fontdata = lib->num_fontdata;
+    if (num_loaded >= num_fontdata)
+        return num_fontdata;
+
+    ASS_FontIndex *index = NULL;
+    if (lib->font_index_path && lib->font_index_path[0])
+        index = ass_font_index_open(lib, lib->font_index_path);
+
     for (size_t i = num_loaded; i < num_fontdata; i++)
-        process_fontdata(selector->embedded_provider, i);
+        process_fontdata(selector->embedded_provider, i, index);
+
+    ass_font_index_close(index);
     return num_fontdata;
 }
@@ -19,6 +19,7 @@
 #include "config.h"
 #include "ass_compat.h"
 
+#include <assert.h>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -45,8 +46,13 @@ static void ass_msg_handler(int level, const char *fmt, va_list va, void *data)
 ASS_Library *ass_library_init(void)
 {
     ASS_Library* lib = calloc(1, sizeof(*lib));
-    if (lib)
-        lib->msg_callback = ass_msg_handler;
+    if (!lib)
+        return NULL;
+    if (!ass_mutex_init(&lib->font_lock, false)) {
+        free(lib);
+        return NULL;
+    }
+    lib->msg_callback = ass_msg_handler;
     #ifdef CONFIG_UNIBREAK
     // libunibreak works without, but its docs suggest this improves performance
     init_linebreak();
@@ -58,8 +64,10 @@ void ass_library_done(ASS_Library *priv)
 {
     if (priv) {
         ass_set_fonts_dir(priv, NULL);
+        ass_set_font_index_file(priv, NULL);
         ass_set_style_overrides(priv, NULL);
         ass_clear_fonts(priv);
+        ass_mutex_destroy(&priv->font_lock);
         free(priv);
     }
 }
@@ -71,6 +79,13 @@ void ass_set_fonts_dir(ASS_Library *priv, const char *fonts_dir)
     priv->fonts_dir = fonts_dir ? strdup(fonts_dir) : 0;
 }
 
+void ass_set_font_index_file(ASS_Library *priv, const char *path)
+{
+    free(priv->font_index_path);
+
+    priv->font_index_path = path ? strdup(path) : NULL;
+}
+
 void ass_set_extract_fonts(ASS_Library *priv, int extract)
 {
     priv->extract_fonts = !!extract;
@@ -103,38 +118,249 @@ void ass_set_style_overrides(ASS_Library *priv, char **list)
         *q = strdup(*p);
 }
 
-void ass_add_font(ASS_Library *priv, const char *name, const char *data, int size)
+/**
+ * \brief Reserve a new fontdata slot with the given name.
+ * The slot is only counted once the caller has filled in its data.
+ */
+static ASS_Fontdata *new_fontdata(ASS_Library *priv, const char *name)
 {
     size_t idx = priv->num_fontdata;
-    if (!name || !data || !size)
-        return;
+    if (!name)
+        return NULL;
     if (!(idx & (idx - 32)) && // power of two >= 32, or zero --> time for realloc
             !ASS_REALLOC_ARRAY(priv->fontdata, FFMAX(2 * idx, 32)))
+        return NULL;
+
+    ASS_Fontdata *fd = priv->fontdata + idx;
+    memset(fd, 0, sizeof(*fd));
+    fd->name = strdup(name);
+    return fd->name ? fd : NULL;
+}
+
+void ass_add_font(ASS_Library *priv, const char *name, const char *data, int size)
+{
+    if (!data || size <= 0)
+        return;
+    ASS_Fontdata *fd = new_fontdata(priv, name);
+    if (!fd)
+        return;
+
+    char *copy = malloc(size);
+    if (!copy) {
+        free(fd->name);
         return;
+    }
+    memcpy(copy, data, size);
 
-    priv->fontdata[idx].name = strdup(name);
-    priv->fontdata[idx].data = malloc(size);
+    fd->data = copy;
+    fd->size = size;
+    priv->num_fontdata++;
+}
 
-    if (!priv->fontdata[idx].name || !priv->fontdata[idx].data)
-        goto error;
+/**
+ * \brief Add a font backed by a file mapping.
+ * On success, the library takes over the mapping.
+ */
+bool ass_add_font_mapped(ASS_Library *priv, const char *name,
+                         const ASS_MappedFile *map, uint64_t key)
+{
+    ASS_Fontdata *fd = new_fontdata(priv, name);
+    if (!fd)
+        return false;
 
-    memcpy(priv->fontdata[idx].data, data, size);
+    fd->map = *map;
+    fd->data = map->data;
+    fd->size = map->size;
+    fd->key = key;
+    priv->num_fontdata++;
+    return true;
+}
 
-    priv->fontdata[idx].size = size;
+/**
+ * \brief Add a font from the uuencoded data of a [Fonts] section.
+ * Decoding is deferred until ass_decode_font() is called.
+ * On success, the library takes over the encoded buffer.
+ */
+bool ass_add_font_encoded(ASS_Library *priv, const char *name,
+                          char *encoded, size_t size)
+{
+    if (!encoded || !size || size % 4 == 1)
+        return false;
+    ASS_Fontdata *fd = new_fontdata(priv, name);
+    if (!fd)
+        return false;
 
+    fd->encoded = encoded;
+    fd->encoded_size = size;
     priv->num_fontdata++;
-    return;
+    return true;
+}
+
+/**
+ * \brief Decode 3 or fewer bytes from their uuencoded form.
+ */
+static unsigned char *decode_chars(const unsigned char *src,
+                                   unsigned char *dst, size_t cnt_in)
+{
+    uint32_t value = 0;
+    for (size_t i = 0; i < cnt_in; i++)
+        value |= (uint32_t) ((src[i] - 33u) & 63) << 6 * (3 - i);
+
+    *dst++ = value >> 16;
+    if (cnt_in >= 3)
+        *dst++ = value >> 8 & 0xff;
+    if (cnt_in >= 4)
+        *dst++ = value & 0xff;
+    return dst;
+}
+
+/**
+ * \brief Decode 8 characters into 6 bytes at once,
+ * with the same results as decode_chars().
+ */
+static inline unsigned char *decode_chars8(const unsigned char *src,
+                                           unsigned char *dst)
+{
+    uint64_t x =
+        (uint64_t) src[0]       | (uint64_t) src[1] <<  8 |
+        (uint64_t) src[2] << 16 | (uint64_t) src[3] << 24 |
+        (uint64_t) src[4] << 32 | (uint64_t) src[5] << 40 |
+        (uint64_t) src[6] << 48 | (uint64_t) src[7] << 56;
+
+    // per-byte (c - 33) & 63, setting the top bit first prevents borrows
+    x = ((x | UINT64_C(0x8080808080808080)) - UINT64_C(0x2121212121212121)) &
+        UINT64_C(0x3F3F3F3F3F3F3F3F);
+    // pack digit pairs into 12 bits, then pairs of those into 24 bits
+    x = (x & UINT64_C(0x003F003F003F003F)) << 6 |
+        (x >> 8 & UINT64_C(0x003F003F003F003F));
+    x = (x & UINT64_C(0x00000FFF00000FFF)) << 12 |
+        (x >> 16 & UINT64_C(0x00000FFF00000FFF));
+
+    dst[0] = x >> 16;
+    dst[1] = x >> 8;
+    dst[2] = x;
+    dst[3] = x >> 48;
+    dst[4] = x >> 40;
+    dst[5] = x >> 32;
+    return dst + 6;
+}
+
+static size_t decoded_size(size_t size)
+{
+    return size / 4 * 3 + FFMAX(size % 4, 1) - 1;
+}
+
+static size_t font_size(const ASS_Fontdata *fd)
+{
+    return fd->data ? fd->size : decoded_size(fd->encoded_size);
+}
+
+/**
+ * \brief Size of the font file, whether it is decoded yet or not.
+ */
+size_t ass_font_size(ASS_Library *lib, const ASS_Fontdata *fd)
+{
+    ass_mutex_lock(&lib->font_lock);
+    size_t size = font_size(fd);
+    ass_mutex_unlock(&lib->font_lock);
+    return size;
+}
+
+/**
+ * \brief Read part of the font file. A font that is still encoded
+ * is decoded only around the requested bytes and stays encoded.
+ * \return number of bytes stored into buf
+ */
+size_t ass_read_font(ASS_Library *lib, const ASS_Fontdata *fd, size_t offset,
+                     unsigned char *buf, size_t len)
+{
+    ass_mutex_lock(&lib->font_lock);
+    size_t size = font_size(fd);
+    if (offset >= size) {
+        ass_mutex_unlock(&lib->font_lock);
+        return 0;
+    }
+    len = FFMIN(len, size - offset);
+    if (fd->data) {
+        ass_mutex_unlock(&lib->font_lock);
+        memcpy(buf, fd->data + offset, len);
+        return len;
+    }
+
+    // every 4 characters encode 3 bytes
+    const unsigned char *src = (const unsigned char *) fd->encoded;
+    size_t pos = offset / 3 * 3, end = offset + len;
+    for (; pos < end; pos += 3) {
+        unsigned char group[3];
+        size_t cnt = FFMIN(fd->encoded_size - pos / 3 * 4, 4);
+        decode_chars(src + pos / 3 * 4, group, cnt);
+        size_t from = FFMAX(pos, offset), to = FFMIN(pos + cnt - 1, end);
+        memcpy(buf + (from - offset), group + (from - pos), to - from);
+    }
+    ass_mutex_unlock(&lib->font_lock);
+    return len;
+}
+
+static bool decode_font(ASS_Fontdata *fd)
+{
+    if (fd->data)
+        return true;
+    if (!fd->encoded)
+        return false;
+
+    size_t size = fd->encoded_size;
+    size_t dsize = decoded_size(size);
+    unsigned char *buf = malloc(dsize);
+    if (!buf)
+        return false;
+
+    const unsigned char *p = (const unsigned char *) fd->encoded;
+    unsigned char *q = buf;
+    size_t i;
+    for (i = 0; i + 8 <= size; i += 8, p += 8)
+        q = decode_chars8(p, q);
+    for (; i + 4 <= size; i += 4, p += 4)
+        q = decode_chars(p, q, 4);
+    if (size % 4 == 2) {
+        q = decode_chars(p, q, 2);
+    } else if (size % 4 == 3) {
+        q = decode_chars(p, q, 3);
+    }
+    assert(q - buf == dsize);
 
-error:
-    free(priv->fontdata[idx].name);
-    free(priv->fontdata[idx].data);
+    free(fd->encoded);
+    fd->encoded = NULL;
+    fd->encoded_size = 0;
+    fd->data = (const char *) buf;
+    fd->size = dsize;
+    return true;
+}
+
+/**
+ * \brief Decode the font data of an embedded font if not done yet.
+ * The encoded buffer is released afterwards. Once this succeeds,
+ * data and size stay unchanged until the fonts are cleared.
+ * \return whether the font data is available
+ */
+bool ass_decode_font(ASS_Library *lib, ASS_Fontdata *fd)
+{
+    // renderers sharing the library may decode concurrently
+    ass_mutex_lock(&lib->font_lock);
+    bool ok = decode_font(fd);
+    ass_mutex_unlock(&lib->font_lock);
+    return ok;
 }
 
 void ass_clear_fonts(ASS_Library *priv)
 {
     for (size_t i = 0; i < priv->num_fontdata; i++) {
-        free(priv->fontdata[i].name);
-        free(priv->fontdata[i].data);
+        ASS_Fontdata *fd = priv->fontdata + i;
+        free(fd->name);
+        free(fd->encoded);
+        if (fd->map.data)
+            ass_unmap_file(&fd->map);
+        else
+            free((char *) fd->data);
     }
     free(priv->fontdata);
     priv->fontdata = NULL;
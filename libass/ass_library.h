@@ -22,24 +22,40 @@
 #include <stdarg.h>
 
 #include "ass_filesystem.h"
+#include "ass_threading.h"
 
 typedef struct {
     char *name;
-    char *data;
-    int size;
+    const char *data;   // font file, NULL while still encoded
+    size_t size;
+    char *encoded;      // uuencoded [Fonts] data, decoded on first use
+    size_t encoded_size;
+    ASS_MappedFile map; // backing file of data, if mapped
+    uint64_t key;       // font index key, 0 until computed
 } ASS_Fontdata;
 
 struct ass_library {
     char *fonts_dir;
+    char *font_index_path;
     int extract_fonts;
     char **style_overrides;
 
     ASS_Fontdata *fontdata;
     size_t num_fontdata;
+    ASS_Mutex font_lock;    // guards lazy decoding and keys of fontdata
     void (*msg_callback)(int, const char *, va_list, void *);
     void *msg_callback_data;
 };
 
 char *ass_load_file(struct ass_library *library, const char *fname, FileNameSource hint, size_t *bufsize);
 
+bool ass_add_font_mapped(struct ass_library *priv, const char *name,
+                         const ASS_MappedFile *map, uint64_t key);
+bool ass_add_font_encoded(struct ass_library *priv, const char *name,
+                          char *encoded, size_t size);
+bool ass_decode_font(struct ass_library *lib, ASS_Fontdata *fd);
+size_t ass_font_size(struct ass_library *lib, const ASS_Fontdata *fd);
+size_t ass_read_font(struct ass_library *lib, const ASS_Fontdata *fd,
+                     size_t offset, unsigned char *buf, size_t len);
+
 #endif                          /* LIBASS_LIBRARY_H */
@@ -32,22 +32,151 @@
 #define MAX_BE 127
 #define NBSP 0xa0   // unicode non-breaking space character
 
+typedef enum {
+    TAG_UNKNOWN,
+    TAG_XBORD,
+    TAG_YBORD,
+    TAG_XSHAD,
+    TAG_YSHAD,
+    TAG_FAX,
+    TAG_FAY,
+    TAG_ICLIP,
+    TAG_BLUR,
+    TAG_XBLUR,
+    TAG_YBLUR,
+    TAG_FSCX,
+    TAG_FSCY,
+    TAG_FSC,
+    TAG_FSP,
+    TAG_FSVP,
+    TAG_FSHP,
+    TAG_FS,
+    TAG_BORD,
+    TAG_MOVEVC,
+    TAG_MOVER,
+    TAG_MOVES3,
+    TAG_MOVES4,
+    TAG_MOVE,
+    TAG_FRX,
+    TAG_FRY,
+    TAG_FRS,
+    TAG_FRZ,
+    TAG_Z,
+    TAG_FN,
+    TAG_ALPHA,
+    TAG_AN,
+    TAG_A,
+    TAG_POS,
+    TAG_JITTER0,
+    TAG_JITTER,
+    TAG_FADE,
+    TAG_ORG,
+    TAG_T,
+    TAG_CLIP,
+    TAG_1VC,
+    TAG_2VC,
+    TAG_3VC,
+    TAG_4VC,
+    TAG_1VA,
+    TAG_2VA,
+    TAG_3VA,
+    TAG_4VA,
+    TAG_1C,
+    TAG_2C,
+    TAG_3C,
+    TAG_4C,
+    TAG_1A,
+    TAG_2A,
+    TAG_3A,
+    TAG_4A,
+    TAG_R,
+    TAG_BE,
+    TAG_B,
+    TAG_I,
+    TAG_KT,
+    TAG_KF,
+    TAG_KO,
+    TAG_K,
+    TAG_SHAD,
+    TAG_S,
+    TAG_U,
+    TAG_PBO,
+    TAG_P,
+    TAG_Q,
+    TAG_FE
+} TagId;
+
 struct arg {
     char *start, *end;
+    // numeric interpretations, filled in when the tag is compiled
+    int32_t ival;
+    int32_t hex;
+    double dval;
+};
+
+static const struct arg empty_arg = { "", "", 0, 0, 0. };
+
+struct parsed_tag {
+    TagId id;
+    int nargs;
+    int first_arg;              // index into ParsedEvent.args
+    int n_children;             // tags of a \t argument following the \t
+    bool tail;                  // \t argument extends to the end of the block
+};
+
+struct parsed_block {
+    size_t offset;              // position of '{' in the event text
+    size_t end;                 // position of the matching '}', 0 if none
+    int first_tag, n_tags;
+};
+
+struct parsed_event {
+    char *text;                 // private copy of the compiled event text
+    size_t text_len;
+    int hard_overrides;
+
+    ParsedBlock *blocks;        // sorted by offset
+    int n_blocks, max_blocks;
+    int cursor;                 // index of the block expected next
+    ParsedTag *tags;
+    int n_tags, max_tags;
+    struct arg *args;           // arguments of all tags
+    int n_args, max_args;
 };
 
+static void parse_arg_values(struct arg *arg)
+{
+    char *p = arg->start;
+    mystrtoi32(&p, 10, &arg->ival);
+    p = arg->start;
+    mystrtod(&p, &arg->dval);
+
+    // color and alpha values are hexadecimal with optional &H decoration
+    p = arg->start;
+    while (*p == '&' || *p == 'H')
+        ++p;
+    arg->hex = 0;
+    mystrtoi32(&p, 16, &arg->hex);
+}
+
 static inline int32_t argtoi32(struct arg arg)
 {
-    int32_t value;
-    mystrtoi32(&arg.start, 10, &value);
-    return value;
+    return arg.ival;
 }
 
 static inline double argtod(struct arg arg)
 {
-    double value;
-    mystrtod(&arg.start, &value);
-    return value;
+    return arg.dval;
+}
+
+static inline int32_t argtoalpha(struct arg arg)
+{
+    return arg.hex;
+}
+
+static inline uint32_t argtocolor(struct arg arg)
+{
+    return ass_bswap32((uint32_t) arg.hex);
 }
 
 static inline void push_arg(struct arg *args, int *nargs, char *start, char *end)
@@ -55,7 +184,7 @@ static inline void push_arg(struct arg *args, int *nargs, char *start, char *end
     if (*nargs <= MAX_VALID_NARGS) {
         rskip_spaces(&end, start);
         if (end > start) {
-            args[*nargs] = (struct arg) {start, end};
+            args[*nargs] = (struct arg) { .start = start, .end = end };
             ++*nargs;
         }
     }
@@ -283,7 +412,7 @@ interpolate_alpha(long long now, int32_t t1, int32_t t2, int32_t t3,
  * parameters.  Translate it to correct for screen borders, if needed.
  */
 static bool parse_vector_clip(RenderContext *state,
-                              struct arg *args, int nargs)
+                              const struct arg *args, int nargs)
 {
     if (nargs != 1 && nargs != 2)
         return false;
@@ -299,28 +428,6 @@ static bool parse_vector_clip(RenderContext *state,
     return true;
 }
 
-static int32_t parse_alpha_tag(char *str)
-{
-    int32_t alpha = 0;
-
-    while (*str == '&' || *str == 'H')
-        ++str;
-
-    mystrtoi32(&str, 16, &alpha);
-    return alpha;
-}
-
-static uint32_t parse_color_tag(char *str)
-{
-    int32_t color = 0;
-
-    while (*str == '&' || *str == 'H')
-        ++str;
-
-    mystrtoi32(&str, 16, &color);
-    return ass_bswap32((uint32_t) color);
-}
-
 /**
  * \brief find style by name as in \r
  * \param track track
@@ -343,17 +450,206 @@ static ASS_Style *lookup_style_strict(ASS_Track *track, char *name, size_t len)
     return NULL;
 }
 
+#define tag(name) (mystrcmp(p, (name)) && (push_arg(args, nargs, *p, name_end), 1))
+#define complex_tag(name) mystrcmp(p, (name))
+
 /**
- * \brief Parse style override tags.
+ * \brief Identify an override tag by its name.
+ * Tags without parenthesized arguments get the rest of the name
+ * appended to args.
+ */
+static TagId match_tag(char **p, char *name_end, struct arg *args, int *nargs)
+{
+    // New tags introduced in vsfilter 2.39
+    if (tag("xbord"))
+        return TAG_XBORD;
+    if (tag("ybord"))
+        return TAG_YBORD;
+    if (tag("xshad"))
+        return TAG_XSHAD;
+    if (tag("yshad"))
+        return TAG_YSHAD;
+    if (tag("fax"))
+        return TAG_FAX;
+    if (tag("fay"))
+        return TAG_FAY;
+    if (complex_tag("iclip"))
+        return TAG_ICLIP;
+    if (tag("blur"))
+        return TAG_BLUR;
+    if (tag("xblur"))
+        return TAG_XBLUR;
+    if (tag("yblur"))
+        return TAG_YBLUR;
+    // ASS standard tags
+    if (tag("fscx"))
+        return TAG_FSCX;
+    if (tag("fscy"))
+        return TAG_FSCY;
+    if (tag("fsc"))
+        return TAG_FSC;
+    if (tag("fsp"))
+        return TAG_FSP;
+    if (tag("fsvp"))
+        return TAG_FSVP;
+    if (tag("fshp"))
+        return TAG_FSHP;
+    if (tag("fs"))
+        return TAG_FS;
+    if (tag("bord"))
+        return TAG_BORD;
+    if (complex_tag("movevc"))
+        return TAG_MOVEVC;
+    if (complex_tag("mover"))
+        return TAG_MOVER;
+    if (complex_tag("moves3"))
+        return TAG_MOVES3;
+    if (complex_tag("moves4"))
+        return TAG_MOVES4;
+    if (complex_tag("move"))
+        return TAG_MOVE;
+    if (tag("frx"))
+        return TAG_FRX;
+    if (tag("fry"))
+        return TAG_FRY;
+    if (tag("frs"))
+        return TAG_FRS;
+    if (tag("frz") || tag("fr"))
+        return TAG_FRZ;
+    if (tag("z"))
+        return TAG_Z;
+    if (tag("fn"))
+        return TAG_FN;
+    if (tag("alpha"))
+        return TAG_ALPHA;
+    if (tag("an"))
+        return TAG_AN;
+    if (tag("a"))
+        return TAG_A;
+    if (complex_tag("pos"))
+        return TAG_POS;
+    if (tag("jitter0"))
+        return TAG_JITTER0;
+    if (complex_tag("jitter"))
+        return TAG_JITTER;
+    if (complex_tag("fade") || complex_tag("fad"))
+        return TAG_FADE;
+    if (complex_tag("org"))
+        return TAG_ORG;
+    if (complex_tag("t"))
+        return TAG_T;
+    if (complex_tag("clip"))
+        return TAG_CLIP;
+    if (tag("1vc"))
+        return TAG_1VC;
+    if (tag("2vc"))
+        return TAG_2VC;
+    if (tag("3vc"))
+        return TAG_3VC;
+    if (tag("4vc"))
+        return TAG_4VC;
+    if (tag("1va"))
+        return TAG_1VA;
+    if (tag("2va"))
+        return TAG_2VA;
+    if (tag("3va"))
+        return TAG_3VA;
+    if (tag("4va"))
+        return TAG_4VA;
+    if (tag("c") || tag("1c"))
+        return TAG_1C;
+    if (tag("2c"))
+        return TAG_2C;
+    if (tag("3c"))
+        return TAG_3C;
+    if (tag("4c"))
+        return TAG_4C;
+    if (tag("1a"))
+        return TAG_1A;
+    if (tag("2a"))
+        return TAG_2A;
+    if (tag("3a"))
+        return TAG_3A;
+    if (tag("4a"))
+        return TAG_4A;
+    if (tag("r"))
+        return TAG_R;
+    if (tag("be"))
+        return TAG_BE;
+    if (tag("b"))
+        return TAG_B;
+    if (tag("i"))
+        return TAG_I;
+    if (tag("kt"))
+        return TAG_KT;
+    if (tag("kf") || tag("K"))
+        return TAG_KF;
+    if (tag("ko"))
+        return TAG_KO;
+    if (tag("k"))
+        return TAG_K;
+    if (tag("shad"))
+        return TAG_SHAD;
+    if (tag("s"))
+        return TAG_S;
+    if (tag("u"))
+        return TAG_U;
+    if (tag("pbo"))
+        return TAG_PBO;
+    if (tag("p"))
+        return TAG_P;
+    if (tag("q"))
+        return TAG_Q;
+    if (tag("fe"))
+        return TAG_FE;
+    return TAG_UNKNOWN;
+}
+
+#undef tag
+#undef complex_tag
+
+static int add_tag(ParsedEvent *pe, TagId id, struct arg *args, int nargs)
+{
+    if (pe->n_tags >= pe->max_tags) {
+        int new_max = FFMAX(2 * pe->max_tags, 16);
+        if (!ASS_REALLOC_ARRAY(pe->tags, new_max))
+            return -1;
+        pe->max_tags = new_max;
+    }
+    if (nargs > pe->max_args - pe->n_args) {
+        int new_max = FFMAX(2 * pe->max_args, pe->n_args + nargs);
+        new_max = FFMAX(new_max, 16);
+        if (!ASS_REALLOC_ARRAY(pe->args, new_max))
+            return -1;
+        pe->max_args = new_max;
+    }
+
+    ParsedTag *tag = pe->tags + pe->n_tags;
+    tag->id = id;
+    tag->nargs = nargs;
+    tag->tail = false;
+    tag->first_arg = pe->n_args;
+    tag->n_children = 0;
+
+    for (int i = 0; i < nargs; i++) {
+        struct arg *arg = pe->args + pe->n_args++;
+        *arg = args[i];
+        parse_arg_values(arg);
+    }
+    return pe->n_tags++;
+}
+
+/**
+ * \brief Compile style override tags.
  * \param p string to parse
  * \param end end of string to parse, which must be '}', ')', or the first
  *            of a number of spaces immediately preceding '}' or ')'
- * \param pwr multiplier for some tag effects (comes from \t tags)
+ * Appends the recognized tags to pe->tags in order of appearance.
+ * The override tags in the last argument of \t follow the \t itself.
  */
-char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
-                     bool nested)
+static bool compile_tags(ParsedEvent *pe, char *p, char *end)
 {
-    ASS_Renderer *render_priv = state->renderer;
+
     for (char *q; p < end; p = q) {
         while (*p != '\\' && p != end)
             ++p;
@@ -447,11 +743,62 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             }
         }
 
-#define tag(name) (mystrcmp(&p, (name)) && (push_arg(args, &nargs, p, name_end), 1))
-#define complex_tag(name) mystrcmp(&p, (name))
+        TagId id = match_tag(&p, name_end, args, &nargs);
+        if (id == TAG_UNKNOWN)
+            continue;
+        int index = add_tag(pe, id, args, nargs);
+        if (index < 0)
+            return false;
+        if (id != TAG_T)
+            continue;
+
+        int cnt = nargs - 1;
+        if (cnt < 0 || cnt > 3)
+            continue;
+        // If there's no backslash in the arguments, there are no
+        // override tags, so it's pointless to try to parse them.
+        if (!has_backslash_arg)
+            continue;
+        p = args[cnt].start;
+        if (args[cnt].end < end) {
+            int first = pe->n_tags;
+            if (!compile_tags(pe, p, args[cnt].end))
+                return false;
+            pe->tags[index].n_children = pe->n_tags - first;
+        } else {
+            assert(q == end);
+            // The argument extends to the end of the block, so its tags
+            // are simply the rest of the current sequence.
+            pe->tags[index].tail = true;
+            q = p;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * \brief Apply compiled style override tags.
+ * \param tag first tag to apply
+ * \param end tag after the last one to apply
+ * \param pwr multiplier for some tag effects (comes from \t tags)
+ */
+static void apply_tags(RenderContext *state, const struct arg *arg_pool,
+                       const ParsedTag *tag, const ParsedTag *end,
+                       double pwr, bool nested)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    for (const ParsedTag *next; tag < end; tag = next) {
+        next = tag + 1 + tag->n_children;
+
+        int nargs = tag->nargs;
+        const struct arg *args =
+            nargs ? arg_pool + tag->first_arg : &empty_arg;
 
-        // New tags introduced in vsfilter 2.39
-        if (tag("xbord")) {
+        switch (tag->id) {
+        case TAG_UNKNOWN:
+            break;
+        case TAG_XBORD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -460,7 +807,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = state->style->Outline;
             state->border_x = val;
-        } else if (tag("ybord")) {
+            break;
+        }
+        case TAG_YBORD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -469,7 +818,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = state->style->Outline;
             state->border_y = val;
-        } else if (tag("xshad")) {
+            break;
+        }
+        case TAG_XSHAD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -477,7 +828,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = state->style->Shadow;
             state->shadow_x = val;
-        } else if (tag("yshad")) {
+            break;
+        }
+        case TAG_YSHAD: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -485,7 +838,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = state->style->Shadow;
             state->shadow_y = val;
-        } else if (tag("fax")) {
+            break;
+        }
+        case TAG_FAX: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -493,7 +848,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                     val * pwr + state->fax * (1 - pwr);
             } else
                 state->fax = 0.;
-        } else if (tag("fay")) {
+            break;
+        }
+        case TAG_FAY: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -501,7 +858,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                     val * pwr + state->fay * (1 - pwr);
             } else
                 state->fay = 0.;
-        } else if (complex_tag("iclip")) {
+            break;
+        }
+        case TAG_ICLIP: {
             if (nargs == 4) {
                 int32_t x0, y0, x1, y1;
                 x0 = argtoi32(args[0]);
@@ -521,7 +880,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 if (parse_vector_clip(state, args, nargs))
                     state->clip_drawing_mode = 1;
             }
-        } else if (tag("blur")) {
+            break;
+        }
+        case TAG_BLUR: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -532,7 +893,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 val = 0.0;
             state->blur_x = val;
             state->blur_y = val;
-        } else if (tag("xblur")) {
+            break;
+        }
+        case TAG_XBLUR: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -542,7 +905,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = 0.0;
             state->blur_x = val;
-        } else if (tag("yblur")) {
+            break;
+        }
+        case TAG_YBLUR: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -553,7 +918,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 val = 0.0;
             state->blur_y = val;
             // ASS standard tags
-        } else if (tag("fscx")) {
+            break;
+        }
+        case TAG_FSCX: {
             double val;
             if (nargs) {
                 val = argtod(*args) / 100;
@@ -562,7 +929,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = state->style->ScaleX;
             state->scale_x = val;
-        } else if (tag("fscy")) {
+            break;
+        }
+        case TAG_FSCY: {
             double val;
             if (nargs) {
                 val = argtod(*args) / 100;
@@ -571,7 +940,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = state->style->ScaleY;
             state->scale_y = val;
-        } else if (tag("fsc")) {
+            break;
+        }
+        case TAG_FSC: {
             if (nargs) {
                 double val = argtod(*args) / 100;
                 double x = state->scale_x * (1 - pwr) + val * pwr;
@@ -582,7 +953,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 state->scale_x = state->style->ScaleX;
                 state->scale_y = state->style->ScaleY;
             }
-        } else if (tag("fsp")) {
+            break;
+        }
+        case TAG_FSP: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -590,21 +963,27 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                     state->hspacing * (1 - pwr) + val * pwr;
             } else
                 state->hspacing = state->style->Spacing;
-        } else if (tag("fsvp")) {
+            break;
+        }
+        case TAG_FSVP: {
             double val;
             if (nargs)
                 val = state->fsvp * (1 - pwr) + argtod(*args) * pwr;
             else
                 val = 0;
             state->fsvp = val;
-        } else if (tag("fshp")) {
+            break;
+        }
+        case TAG_FSHP: {
             double val;
             if (nargs)
                 val = state->fshp * (1 - pwr) + argtod(*args) * pwr;
             else
                 val = 0;
             state->fshp = val;
-        } else if (tag("fs")) {
+            break;
+        }
+        case TAG_FS: {
             double val = 0;
             if (nargs) {
                 val = argtod(*args);
@@ -616,7 +995,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             if (val <= 0)
                 val = state->style->FontSize;
             state->font_size = val;
-        } else if (tag("bord")) {
+            break;
+        }
+        case TAG_BORD: {
             double val, xval, yval;
             if (nargs) {
                 val = argtod(*args);
@@ -628,7 +1009,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 xval = yval = state->style->Outline;
             state->border_x = xval;
             state->border_y = yval;
-        } else if (complex_tag("movevc")) {
+            break;
+        }
+        case TAG_MOVEVC: {
             if (nargs == 2 || nargs == 4 || nargs == 6) {
                 MoveVCState mv = { .active = true };
                 mv.x1 = argtod(args[0]);
@@ -656,7 +1039,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else if (!nargs) {
                 state->movevc = (MoveVCState) {0};
             }
-        } else if (complex_tag("mover")) {
+            break;
+        }
+        case TAG_MOVER: {
             MotionState mv = { .type = MOTION_MOVER };
             if (nargs == 4 || nargs == 6 || nargs == 8 || nargs == 10) {
                 mv.x1 = argtod(args[0]);
@@ -677,7 +1062,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 }
                 apply_motion(state, mv, pwr, true);
             }
-        } else if (complex_tag("moves3")) {
+            break;
+        }
+        case TAG_MOVES3: {
             MotionState mv = { .type = MOTION_MOVES3 };
             if (nargs == 6 || nargs == 8) {
                 mv.x1 = argtod(args[0]);
@@ -694,7 +1081,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 }
                 apply_motion(state, mv, pwr, true);
             }
-        } else if (complex_tag("moves4")) {
+            break;
+        }
+        case TAG_MOVES4: {
             MotionState mv = { .type = MOTION_MOVES4 };
             if (nargs == 8 || nargs == 10) {
                 mv.x1 = argtod(args[0]);
@@ -713,7 +1102,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 }
                 apply_motion(state, mv, pwr, true);
             }
-        } else if (complex_tag("move")) {
+            break;
+        }
+        case TAG_MOVE: {
             MotionState mv = { .type = MOTION_MOVE };
             if (nargs == 4 || nargs == 6) {
                 mv.x1 = argtod(args[0]);
@@ -728,7 +1119,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 }
                 apply_motion(state, mv, pwr, false);
             }
-        } else if (tag("frx")) {
+            break;
+        }
+        case TAG_FRX: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -736,7 +1129,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                     val * pwr + state->frx * (1 - pwr);
             } else
                 state->frx = 0.;
-        } else if (tag("fry")) {
+            break;
+        }
+        case TAG_FRY: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -744,14 +1139,18 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                     val * pwr + state->fry * (1 - pwr);
             } else
                 state->fry = 0.;
-        } else if (tag("frs")) {
+            break;
+        }
+        case TAG_FRS: {
             double val;
             if (nargs) {
                 val = argtod(*args);
                 state->frs = val * pwr + state->frs * (1 - pwr);
             } else
                 state->frs = 0.;
-        } else if (tag("frz") || tag("fr")) {
+            break;
+        }
+        case TAG_FRZ: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -760,7 +1159,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 state->frz =
                     state->style->Angle;
-        } else if (tag("z")) {
+            break;
+        }
+        case TAG_Z: {
             double val;
             if (nargs) {
                 val = argtod(*args);
@@ -770,7 +1171,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             } else
                 val = 0.0;
             state->z = val;
-        } else if (tag("fn")) {
+            break;
+        }
+        case TAG_FN: {
             char *start = args->start;
             if (nargs && strncmp(start, "0", args->end - start)) {
                 skip_spaces(&start);
@@ -781,10 +1184,12 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 state->family.len = strlen(state->style->FontName);
             }
             ass_update_font(state);
-        } else if (tag("alpha")) {
+            break;
+        }
+        case TAG_ALPHA: {
             int i;
             if (nargs) {
-                int32_t a = parse_alpha_tag(args->start);
+                int32_t a = argtoalpha(*args);
                 for (i = 0; i < 4; ++i)
                     change_alpha(&state->c[i], a, pwr);
             } else {
@@ -801,7 +1206,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 ass_gradient_disable_alpha(&state->gradient, i,
                                            _a(state->c[i]), pwr);
             // FIXME: simplify
-        } else if (tag("an")) {
+            break;
+        }
+        case TAG_AN: {
             int32_t val = argtoi32(*args);
             if ((state->parsed_tags & PARSED_A) == 0) {
                 if (val >= 1 && val <= 9)
@@ -811,7 +1218,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                         state->style->Alignment;
                 state->parsed_tags |= PARSED_A;
             }
-        } else if (tag("a")) {
+            break;
+        }
+        case TAG_A: {
             int32_t val = argtoi32(*args);
             if ((state->parsed_tags & PARSED_A) == 0) {
                 if (val >= 1 && val <= 11)
@@ -823,7 +1232,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                         state->style->Alignment;
                 state->parsed_tags |= PARSED_A;
             }
-        } else if (complex_tag("pos")) {
+            break;
+        }
+        case TAG_POS: {
             double v1, v2;
             if (nargs == 2) {
                 v1 = argtod(args[0]);
@@ -837,9 +1248,13 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 MotionState mv = { .type = MOTION_POS, .x1 = v1, .y1 = v2 };
                 apply_motion(state, mv, pwr, false);
             }
-        } else if (tag("jitter0")) {
+            break;
+        }
+        case TAG_JITTER0: {
             state->jitter = ass_jitter_default_state();
-        } else if (complex_tag("jitter")) {
+            break;
+        }
+        case TAG_JITTER: {
             if (!nargs) {
                 state->jitter = ass_jitter_default_state();
             } else if (nargs >= 4) {
@@ -860,7 +1275,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 }
                 apply_jitter(state, jit, pwr);
             }
-        } else if (complex_tag("fade") || complex_tag("fad")) {
+            break;
+        }
+        case TAG_FADE: {
             int32_t a1, a2, a3;
             int32_t t1, t2, t3, t4;
             if (nargs == 2) {
@@ -890,12 +1307,15 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             }
             if ((state->parsed_tags & PARSED_FADE) == 0) {
                 state->fade =
-                    interpolate_alpha(render_priv->time -
-                            state->event->Start, t1, t2,
+                    interpolate_alpha(ass_event_time(state), t1, t2,
                             t3, t4, a1, a2, a3);
+                ass_event_animate(state, t1, t2);
+                ass_event_animate(state, t3, t4);
                 state->parsed_tags |= PARSED_FADE;
             }
-        } else if (complex_tag("org")) {
+            break;
+        }
+        case TAG_ORG: {
             double v1, v2;
             if (nargs == 2) {
                 v1 = argtod(args[0]);
@@ -908,7 +1328,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 state->have_origin = 1;
                 state->detect_collisions = 0;
             }
-        } else if (complex_tag("t")) {
+            break;
+        }
+        case TAG_T: {
             double accel;
             int cnt = nargs - 1;
             int32_t t1, t2, t, delta_t;
@@ -936,7 +1358,8 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             if (t2 == 0)
                 t2 = state->event->Duration;
             delta_t = (uint32_t) t2 - t1;
-            t = render_priv->time - state->event->Start;        // FIXME: move to render_context
+            t = ass_event_time(state);
+            ass_event_animate(state, t1, t2);
             if (t < t1)
                 k = 0.;
             else if (t >= t2)
@@ -947,27 +1370,19 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             }
             if (nested)
                 pwr = k;
-            if (cnt < 0 || cnt > 3)
-                continue;
-            // If there's no backslash in the arguments, there are no
-            // override tags, so it's pointless to try to parse them.
-            if (!has_backslash_arg)
-                continue;
-            p = args[cnt].start;
-            if (args[cnt].end < end) {
-                assert(!nested);
-                p = ass_parse_tags(state, p, args[cnt].end, k, true);
-            } else {
-                assert(q == end);
+            if (tag->n_children) {
+                apply_tags(state, arg_pool, tag + 1, next, k, true);
+            } else if (tag->tail) {
                 // No other tags can possibly follow this \t tag,
-                // so we don't need to restore pwr after parsing \t.
-                // The recursive call is now essentially a tail call,
-                // so optimize it away.
+                // so we don't need to restore pwr after applying \t.
+                // The remaining tags of the sequence are the contents
+                // of the \t argument.
                 pwr = k;
                 nested = true;
-                q = p;
             }
-        } else if (complex_tag("clip")) {
+            break;
+        }
+        case TAG_CLIP: {
             if (nargs == 4) {
                 int32_t x0, y0, x1, y1;
                 x0 = argtoi32(args[0]);
@@ -987,60 +1402,70 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 if (parse_vector_clip(state, args, nargs))
                     state->clip_drawing_mode = 0;
             }
-        } else if (tag("1vc")) {
+            break;
+        }
+        case TAG_1VC: {
             if (nargs) {
                 uint32_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = parse_color_tag(args[i].start);
+                    vals[i] = argtocolor(args[i]);
                 ass_gradient_apply_color(&state->gradient, 0, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
             } else {
                 ass_gradient_disable_color(&state->gradient, 0, state->c[0], pwr);
             }
-        } else if (tag("2vc")) {
+            break;
+        }
+        case TAG_2VC: {
             if (nargs) {
                 uint32_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = parse_color_tag(args[i].start);
+                    vals[i] = argtocolor(args[i]);
                 ass_gradient_apply_color(&state->gradient, 1, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
             } else {
                 ass_gradient_disable_color(&state->gradient, 1, state->c[1], pwr);
             }
-        } else if (tag("3vc")) {
+            break;
+        }
+        case TAG_3VC: {
             if (nargs) {
                 uint32_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = parse_color_tag(args[i].start);
+                    vals[i] = argtocolor(args[i]);
                 ass_gradient_apply_color(&state->gradient, 2, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
             } else {
                 ass_gradient_disable_color(&state->gradient, 2, state->c[2], pwr);
             }
-        } else if (tag("4vc")) {
+            break;
+        }
+        case TAG_4VC: {
             if (nargs) {
                 uint32_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = parse_color_tag(args[i].start);
+                    vals[i] = argtocolor(args[i]);
                 ass_gradient_apply_color(&state->gradient, 3, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
             } else {
                 ass_gradient_disable_color(&state->gradient, 3, state->c[3], pwr);
             }
-        } else if (tag("1va")) {
+            break;
+        }
+        case TAG_1VA: {
             if (nargs) {
                 uint8_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = (uint8_t) parse_alpha_tag(args[i].start);
+                    vals[i] = (uint8_t) argtoalpha(args[i]);
                 ass_gradient_apply_alpha(&state->gradient, 0, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
@@ -1048,12 +1473,14 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 ass_gradient_disable_alpha(&state->gradient, 0,
                                            _a(state->c[0]), pwr);
             }
-        } else if (tag("2va")) {
+            break;
+        }
+        case TAG_2VA: {
             if (nargs) {
                 uint8_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = (uint8_t) parse_alpha_tag(args[i].start);
+                    vals[i] = (uint8_t) argtoalpha(args[i]);
                 ass_gradient_apply_alpha(&state->gradient, 1, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
@@ -1061,12 +1488,14 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 ass_gradient_disable_alpha(&state->gradient, 1,
                                            _a(state->c[1]), pwr);
             }
-        } else if (tag("3va")) {
+            break;
+        }
+        case TAG_3VA: {
             if (nargs) {
                 uint8_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = (uint8_t) parse_alpha_tag(args[i].start);
+                    vals[i] = (uint8_t) argtoalpha(args[i]);
                 ass_gradient_apply_alpha(&state->gradient, 2, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
@@ -1074,12 +1503,14 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 ass_gradient_disable_alpha(&state->gradient, 2,
                                            _a(state->c[2]), pwr);
             }
-        } else if (tag("4va")) {
+            break;
+        }
+        case TAG_4VA: {
             if (nargs) {
                 uint8_t vals[4];
                 int cnt = FFMIN(nargs, 4);
                 for (int i = 0; i < cnt; i++)
-                    vals[i] = (uint8_t) parse_alpha_tag(args[i].start);
+                    vals[i] = (uint8_t) argtoalpha(args[i]);
                 ass_gradient_apply_alpha(&state->gradient, 3, vals, cnt, pwr);
                 state->needs_rgba = true;
                 state->renderer->track->has_rgba = 1;
@@ -1087,82 +1518,102 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 ass_gradient_disable_alpha(&state->gradient, 3,
                                            _a(state->c[3]), pwr);
             }
-        } else if (tag("c") || tag("1c")) {
+            break;
+        }
+        case TAG_1C: {
             if (nargs) {
-                uint32_t val = parse_color_tag(args->start);
+                uint32_t val = argtocolor(*args);
                 change_color(&state->c[0], val, pwr);
             } else
                 change_color(&state->c[0],
                              state->style->PrimaryColour, 1);
             ass_gradient_disable_color(&state->gradient, 0, state->c[0], pwr);
-        } else if (tag("2c")) {
+            break;
+        }
+        case TAG_2C: {
             if (nargs) {
-                uint32_t val = parse_color_tag(args->start);
+                uint32_t val = argtocolor(*args);
                 change_color(&state->c[1], val, pwr);
             } else
                 change_color(&state->c[1],
                              state->style->SecondaryColour, 1);
             ass_gradient_disable_color(&state->gradient, 1, state->c[1], pwr);
-        } else if (tag("3c")) {
+            break;
+        }
+        case TAG_3C: {
             if (nargs) {
-                uint32_t val = parse_color_tag(args->start);
+                uint32_t val = argtocolor(*args);
                 change_color(&state->c[2], val, pwr);
             } else
                 change_color(&state->c[2],
                              state->style->OutlineColour, 1);
             ass_gradient_disable_color(&state->gradient, 2, state->c[2], pwr);
-        } else if (tag("4c")) {
+            break;
+        }
+        case TAG_4C: {
             if (nargs) {
-                uint32_t val = parse_color_tag(args->start);
+                uint32_t val = argtocolor(*args);
                 change_color(&state->c[3], val, pwr);
             } else
                 change_color(&state->c[3],
                              state->style->BackColour, 1);
             ass_gradient_disable_color(&state->gradient, 3, state->c[3], pwr);
-        } else if (tag("1a")) {
+            break;
+        }
+        case TAG_1A: {
             if (nargs) {
-                uint32_t val = parse_alpha_tag(args->start);
+                uint32_t val = argtoalpha(*args);
                 change_alpha(&state->c[0], val, pwr);
             } else
                 change_alpha(&state->c[0],
                              _a(state->style->PrimaryColour), 1);
             ass_gradient_disable_alpha(&state->gradient, 0,
                                        _a(state->c[0]), pwr);
-        } else if (tag("2a")) {
+            break;
+        }
+        case TAG_2A: {
             if (nargs) {
-                uint32_t val = parse_alpha_tag(args->start);
+                uint32_t val = argtoalpha(*args);
                 change_alpha(&state->c[1], val, pwr);
             } else
                 change_alpha(&state->c[1],
                              _a(state->style->SecondaryColour), 1);
             ass_gradient_disable_alpha(&state->gradient, 1,
                                        _a(state->c[1]), pwr);
-        } else if (tag("3a")) {
+            break;
+        }
+        case TAG_3A: {
             if (nargs) {
-                uint32_t val = parse_alpha_tag(args->start);
+                uint32_t val = argtoalpha(*args);
                 change_alpha(&state->c[2], val, pwr);
             } else
                 change_alpha(&state->c[2],
                              _a(state->style->OutlineColour), 1);
             ass_gradient_disable_alpha(&state->gradient, 2,
                                        _a(state->c[2]), pwr);
-        } else if (tag("4a")) {
+            break;
+        }
+        case TAG_4A: {
             if (nargs) {
-                uint32_t val = parse_alpha_tag(args->start);
+                uint32_t val = argtoalpha(*args);
                 change_alpha(&state->c[3], val, pwr);
             } else
                 change_alpha(&state->c[3],
                              _a(state->style->BackColour), 1);
             ass_gradient_disable_alpha(&state->gradient, 3,
                                        _a(state->c[3]), pwr);
-        } else if (tag("r")) {
+            break;
+        }
+        case TAG_R: {
             if (nargs) {
                 int len = args->end - args->start;
                 ass_reset_render_context(state,
                         lookup_style_strict(render_priv->track, args->start, len));
             } else
                 ass_reset_render_context(state, NULL);
-        } else if (tag("be")) {
+            break;
+        }
+        case TAG_BE: {
             double dval;
             if (nargs) {
                 int32_t val;
@@ -1175,19 +1626,25 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 state->be = val;
             } else
                 state->be = 0;
-        } else if (tag("b")) {
+            break;
+        }
+        case TAG_B: {
             int32_t val = argtoi32(*args);
             if (!nargs || !(val == 0 || val == 1 || val >= 100))
                 val = state->style->Bold;
             state->bold = val;
             ass_update_font(state);
-        } else if (tag("i")) {
+            break;
+        }
+        case TAG_I: {
             int32_t val = argtoi32(*args);
             if (!nargs || !(val == 0 || val == 1))
                 val = state->style->Italic;
             state->italic = val;
             ass_update_font(state);
-        } else if (tag("kt")) {
+            break;
+        }
+        case TAG_KT: {
             // v4++
             double val = 0;
             if (nargs)
@@ -1195,7 +1652,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             state->effect_skip_timing = dtoi32(val);
             state->effect_timing = 0;
             state->reset_effect = true;
-        } else if (tag("kf") || tag("K")) {
+            break;
+        }
+        case TAG_KF: {
             double val = 100;
             if (nargs)
                 val = argtod(*args);
@@ -1203,7 +1662,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             state->effect_skip_timing +=
                     (uint32_t) state->effect_timing;
             state->effect_timing = dtoi32(val * 10);
-        } else if (tag("ko")) {
+            break;
+        }
+        case TAG_KO: {
             double val = 100;
             if (nargs)
                 val = argtod(*args);
@@ -1211,7 +1672,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             state->effect_skip_timing +=
                     (uint32_t) state->effect_timing;
             state->effect_timing = dtoi32(val * 10);
-        } else if (tag("k")) {
+            break;
+        }
+        case TAG_K: {
             double val = 100;
             if (nargs)
                 val = argtod(*args);
@@ -1219,7 +1682,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
             state->effect_skip_timing +=
                     (uint32_t) state->effect_timing;
             state->effect_timing = dtoi32(val * 10);
-        } else if (tag("shad")) {
+            break;
+        }
+        case TAG_SHAD: {
             double val, xval, yval;
             if (nargs) {
                 val = argtod(*args);
@@ -1232,7 +1697,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 xval = yval = state->style->Shadow;
             state->shadow_x = xval;
             state->shadow_y = yval;
-        } else if (tag("s")) {
+            break;
+        }
+        case TAG_S: {
             int32_t val = argtoi32(*args);
             if (!nargs || !(val == 0 || val == 1))
                 val = state->style->StrikeOut;
@@ -1240,7 +1707,9 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 state->flags |= DECO_STRIKETHROUGH;
             else
                 state->flags &= ~DECO_STRIKETHROUGH;
-        } else if (tag("u")) {
+            break;
+        }
+        case TAG_U: {
             int32_t val = argtoi32(*args);
             if (!nargs || !(val == 0 || val == 1))
                 val = state->style->Underline;
@@ -1248,29 +1717,151 @@ char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
                 state->flags |= DECO_UNDERLINE;
             else
                 state->flags &= ~DECO_UNDERLINE;
-        } else if (tag("pbo")) {
+            break;
+        }
+        case TAG_PBO: {
             double val = argtod(*args);
             state->pbo = val;
-        } else if (tag("p")) {
+            break;
+        }
+        case TAG_P: {
             int32_t val = argtoi32(*args);
             val = (val < 0) ? 0 : val;
             state->drawing_scale = val;
-        } else if (tag("q")) {
+            break;
+        }
+        case TAG_Q: {
             int32_t val = argtoi32(*args);
             if (!nargs || !(val >= 0 && val <= 3))
                 val = render_priv->track->WrapStyle;
             state->wrap_style = val;
-        } else if (tag("fe")) {
+            break;
+        }
+        case TAG_FE: {
             int32_t val;
             if (nargs)
                 val = argtoi32(*args);
             else
                 val = state->style->Encoding;
             state->font_encoding = val;
+            break;
+        }
         }
     }
+}
 
-    return p;
+static int find_block(const ParsedEvent *pe, size_t offset)
+{
+    if (pe->cursor < pe->n_blocks && pe->blocks[pe->cursor].offset == offset)
+        return pe->cursor;
+
+    int lo = 0, hi = pe->n_blocks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (pe->blocks[mid].offset < offset)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+static bool compile_block(ParsedEvent *pe, int index, size_t offset)
+{
+    if (pe->n_blocks >= pe->max_blocks) {
+        int new_max = FFMAX(2 * pe->max_blocks, 8);
+        if (!ASS_REALLOC_ARRAY(pe->blocks, new_max))
+            return false;
+        pe->max_blocks = new_max;
+    }
+
+    ParsedBlock block = { .offset = offset, .first_tag = pe->n_tags };
+    char *p = pe->text + offset;
+    char *q = strchr(p, '}');
+    if (q) {
+        if (!compile_tags(pe, p, q))
+            return false;
+        block.end = q - pe->text;
+    }
+    block.n_tags = pe->n_tags - block.first_tag;
+
+    memmove(pe->blocks + index + 1, pe->blocks + index,
+            (pe->n_blocks - index) * sizeof(ParsedBlock));
+    pe->blocks[index] = block;
+    pe->n_blocks++;
+    return true;
+}
+
+/**
+ * \brief Apply the override block starting at p.
+ * \param p position of '{' in the text of the current event
+ * \param next out: position of the closing '}'
+ * \return 1 if the block was applied, 0 if p does not start a complete
+ *         block, -1 on allocation failure
+ * Blocks are compiled on first use and reused on subsequent frames.
+ */
+int ass_parse_tag_block(RenderContext *state, char *p, char **next)
+{
+    ParsedEvent *pe = state->parsed;
+    size_t offset = p - state->event->Text;
+    assert(offset < pe->text_len && pe->text[offset] == '{');
+
+    int index = find_block(pe, offset);
+    if (index == pe->n_blocks || pe->blocks[index].offset != offset) {
+        if (!compile_block(pe, index, offset))
+            return -1;
+    }
+    pe->cursor = index + 1;
+
+    ParsedBlock *block = pe->blocks + index;
+    if (!block->end)
+        return 0;
+    apply_tags(state, pe->args, pe->tags + block->first_tag,
+               pe->tags + block->first_tag + block->n_tags, 1., false);
+    *next = state->event->Text + block->end;
+    return 1;
+}
+
+static int scan_hard_overrides(char *str);
+
+/**
+ * \brief Make parsed hold the compiled form of text.
+ * Previously compiled tags are kept as long as the text is unchanged.
+ */
+bool ass_parsed_event_prepare(ParsedEvent **parsed, const char *text)
+{
+    ParsedEvent *pe = *parsed;
+    size_t len = strlen(text);
+    if (pe && pe->text_len == len && !memcmp(pe->text, text, len)) {
+        pe->cursor = 0;
+        return true;
+    }
+
+    ass_parsed_event_free(pe);
+    *parsed = pe = calloc(1, sizeof(ParsedEvent));
+    if (!pe)
+        return false;
+    pe->text = malloc(len + 1);
+    if (!pe->text) {
+        free(pe);
+        *parsed = NULL;
+        return false;
+    }
+    memcpy(pe->text, text, len + 1);
+    pe->text_len = len;
+    pe->hard_overrides = scan_hard_overrides(pe->text);
+    return true;
+}
+
+void ass_parsed_event_free(ParsedEvent *parsed)
+{
+    if (!parsed)
+        return;
+    free(parsed->text);
+    free(parsed->blocks);
+    free(parsed->tags);
+    free(parsed->args);
+    free(parsed);
 }
 
 void ass_apply_transition_effects(RenderContext *state)
@@ -1317,8 +1908,8 @@ void ass_apply_transition_effects(RenderContext *state)
         // maxuimum there, before converting back.
         double scale_x = ((double) layout_res.x) / render_priv->track->PlayResX;
         delay = ((int) FFMAX(delay / scale_x, 1)) * scale_x;
-        state->scroll_shift =
-            (render_priv->time - event->Start) / delay;
+        state->scroll_shift = ass_event_time(state) / delay;
+        ass_event_animate(state, 0, event->Duration);
         state->evt_type |= EVENT_HSCROLL;
         state->detect_collisions = 0;
         state->wrap_style = 2;
@@ -1348,7 +1939,8 @@ void ass_apply_transition_effects(RenderContext *state)
         double scale_y = ((double) layout_res.y) / render_priv->track->PlayResY;
         delay = ((int) FFMAX(delay / scale_y, 1)) * scale_y;
         state->scroll_shift =
-            (render_priv->time - event->Start) / delay;
+            ass_event_time(state) / delay;
+        ass_event_animate(state, 0, event->Duration);
         if (v[0] < v[1]) {
             y0 = v[0];
             y1 = v[1];
@@ -1378,7 +1970,6 @@ void ass_apply_transition_effects(RenderContext *state)
 void ass_process_karaoke_effects(RenderContext *state)
 {
     TextInfo *text_info = &state->text_info;
-    long long tm_current = state->renderer->time - state->event->Start;
 
     int32_t timing = 0, skip_timing = 0;
     Effect effect_type = EF_NONE;
@@ -1424,6 +2015,8 @@ void ass_process_karaoke_effects(RenderContext *state)
         if (effect_type != EF_KARAOKE_KF)
             tm_end = tm_start;
 
+        long long tm_current = ass_event_time(state);
+        ass_event_animate(state, tm_start, tm_end);
         int x;
         if (tm_current < tm_start)
             x = -100000000;
@@ -1506,7 +2099,12 @@ unsigned ass_get_next_char(RenderContext *state, char **str)
 
 // Return 1 if the event contains tags that will apply overrides the selective
 // style override code should not touch. Return 0 otherwise.
-int ass_event_has_hard_overrides(char *str)
+int ass_event_has_hard_overrides(const ParsedEvent *parsed)
+{
+    return parsed->hard_overrides;
+}
+
+static int scan_hard_overrides(char *str)
 {
     // look for \pos and \move tags inside {...}
     // mirrors ass_get_next_char, but is faster and doesn't change any global state
@@ -37,9 +37,10 @@ void ass_update_font(RenderContext *state);
 void ass_apply_transition_effects(RenderContext *state);
 void ass_process_karaoke_effects(RenderContext *state);
 unsigned ass_get_next_char(RenderContext *state, char **str);
-char *ass_parse_tags(RenderContext *state, char *p, char *end, double pwr,
-                     bool nested);
-int ass_event_has_hard_overrides(char *str);
+int ass_parse_tag_block(RenderContext *state, char *p, char **next);
+bool ass_parsed_event_prepare(ParsedEvent **parsed, const char *text);
+void ass_parsed_event_free(ParsedEvent *parsed);
+int ass_event_has_hard_overrides(const ParsedEvent *parsed);
 void ass_apply_fade(uint32_t *clr, int fade);
 
 
@@ -23,6 +23,7 @@
 #include <stdint.h>
 
 #include "ass_shaper.h"
+#include "ass_strpool.h"
 
 typedef enum {
     PST_UNKNOWN = 0,
@@ -49,6 +50,33 @@ typedef enum {
     // max 32 enumerators
 } ScriptInfo;
 
+typedef struct {
+    long long start, end;
+    int id;
+} EventSpan;
+
+// Time index of track->events, answers active-event queries
+// in O(log N + k). Covers event ids [0, n_spans), events appended later
+// are merged in on the next query.
+typedef struct {
+    EventSpan *spans;   // sorted by start, then id
+    long long *max_end; // max end of each subtree, leaves at [size, 2 * size)
+    int n_spans;
+    int size;           // leaf capacity, power of two
+    int *active;        // query result buffer, size entries
+} EventIndex;
+
+// Input of a track read with ass_read_stream()
+typedef struct {
+    ASS_ReadCallback read;
+    void (*close)(void *priv);
+    void *priv;
+    char *buf;          // unparsed tail of the data read so far
+    size_t len, size;
+    int read_order;     // ReadOrder of the next event
+    long long max_start;  // latest start of the events read so far
+} ParserStream;
+
 struct parser_priv {
     ParserState state;
     char *fontname;
@@ -68,6 +96,17 @@ struct parser_priv {
 
     long long prune_delay;
     long long prune_next_ts;
+
+    EventIndex event_index;
+
+    ParserStream *stream;   // NULL unless the track is still being streamed
+
+    bool pool_strings;      // see ass_set_pooled_event_strings()
+    ASS_StringPool strings; // Name, Effect and Text of parsed events if pooled
 };
 
+int ass_find_active_events(ASS_Track *track, long long now,
+                           int *buf, const int **ids);
+long long ass_find_next_event_start(ASS_Track *track, long long now);
+
 #endif /* LIBASS_PRIV_H */
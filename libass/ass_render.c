@@ -49,6 +49,8 @@ static GradientRect gradient_rect_for_layer(RenderContext *state, int line, int
 #define MAX_PERSP_SCALE 16.0
 #define SUBPIXEL_ORDER 3  // ~ log2(64 / POSITION_PRECISION)
 #define BLUR_PRECISION (1.0 / 256)  // blur error as fraction of full input range
+#define DISTANCE_BORDER_MIN 12.0  // smallest border in pixels dilated by ASS_BORDER_AUTO instead of stroked
+#define DISTANCE_BORDER_MAX 4096.0
 
 
 static bool text_info_init(TextInfo* text_info)
@@ -79,20 +81,24 @@ static void text_info_done(TextInfo* text_info)
     free(text_info->combined_bitmaps);
 }
 
-static bool render_context_init(RenderContext *state, ASS_Renderer *priv)
+bool ass_render_context_init(RenderContext *state, ASS_Renderer *priv)
 {
     state->renderer = priv;
+    state->arena = NULL;
+    state->stage = STAGE_NONE;
 
     if (!text_info_init(&state->text_info))
         return false;
 
-    if (!(state->shaper = ass_shaper_new(priv->cache.metrics_cache, priv->cache.face_size_metrics_cache)))
+    if (!(state->shaper = ass_shaper_new(priv->cache->metrics_cache,
+                                         priv->cache->face_size_metrics_cache,
+                                         priv->cache->shaped_run_cache)))
         return false;
 
     return ass_rasterizer_init(&priv->engine, &state->rasterizer, RASTERIZER_PRECISION);
 }
 
-static void render_context_done(RenderContext *state)
+void ass_render_context_done(RenderContext *state)
 {
     ass_rasterizer_done(&state->rasterizer);
 
@@ -102,6 +108,176 @@ static void render_context_done(RenderContext *state)
     text_info_done(&state->text_info);
 }
 
+/**
+ * \brief Create a cache store with default limits, holding one reference.
+ */
+CacheStore *ass_cache_store_create(void)
+{
+    CacheStore *store = calloc(1, sizeof(CacheStore));
+    if (!store)
+        return NULL;
+    if (!ass_mutex_init(&store->lock, false)) {
+        free(store);
+        return NULL;
+    }
+    if (!ass_mutex_init(&store->font_lock, false)) {
+        ass_mutex_destroy(&store->lock);
+        free(store);
+        return NULL;
+    }
+    if (!ass_cond_init(&store->idle)) {
+        ass_mutex_destroy(&store->font_lock);
+        ass_mutex_destroy(&store->lock);
+        free(store);
+        return NULL;
+    }
+    store->ref_count = 1;
+
+    store->font_cache = ass_font_cache_create();
+    store->bitmap_cache = ass_bitmap_cache_create();
+    store->composite_cache = ass_composite_cache_create();
+    store->rgba_cache = ass_rgba_cache_create();
+    store->outline_cache = ass_outline_cache_create();
+    store->face_size_metrics_cache = ass_face_size_metrics_cache_create();
+    store->metrics_cache = ass_glyph_metrics_cache_create();
+    store->shaped_run_cache = ass_shaped_run_cache_create();
+    if (!store->font_cache || !store->bitmap_cache ||
+        !store->composite_cache || !store->rgba_cache ||
+        !store->outline_cache || !store->shaped_run_cache ||
+        !store->face_size_metrics_cache || !store->metrics_cache) {
+        ass_cache_store_release(store);
+        return NULL;
+    }
+
+    store->glyph_max = GLYPH_CACHE_MAX;
+    store->bitmap_max_size = BITMAP_CACHE_MAX_SIZE;
+    store->composite_max_size = COMPOSITE_CACHE_MAX_SIZE;
+    store->rgba_max_size = RGBA_CACHE_MAX_SIZE;
+    return store;
+}
+
+void ass_cache_store_ref(CacheStore *store)
+{
+    ass_mutex_lock(&store->lock);
+    store->ref_count++;
+    ass_mutex_unlock(&store->lock);
+}
+
+void ass_cache_store_release(CacheStore *store)
+{
+    if (!store)
+        return;
+    ass_mutex_lock(&store->lock);
+    int refs = --store->ref_count;
+    ass_mutex_unlock(&store->lock);
+    if (refs)
+        return;
+
+    ass_cache_done(store->rgba_cache);
+    ass_cache_done(store->composite_cache);
+    ass_cache_done(store->bitmap_cache);
+    ass_cache_done(store->outline_cache);
+    ass_cache_done(store->shaped_run_cache);
+    ass_cache_done(store->face_size_metrics_cache);
+    ass_cache_done(store->metrics_cache);
+    ass_cache_done(store->font_cache);
+
+    if (store->ftlibrary)
+        FT_Done_FreeType(store->ftlibrary);
+    ass_cond_destroy(&store->idle);
+    ass_mutex_destroy(&store->font_lock);
+    ass_mutex_destroy(&store->lock);
+    free(store);
+}
+
+static bool font_uses_selector(void *key, void *value, void *priv)
+{
+    return ass_font_uses_selector(value, priv);
+}
+
+static bool face_size_metrics_uses_selector(void *key, void *value, void *priv)
+{
+    return ass_font_uses_selector(((FaceSizeMetricsHashKey *) key)->font, priv);
+}
+
+static bool glyph_metrics_uses_selector(void *key, void *value, void *priv)
+{
+    return ass_font_uses_selector(((GlyphMetricsHashKey *) key)->font, priv);
+}
+
+static bool shaped_run_uses_selector(void *key, void *value, void *priv)
+{
+    return ass_font_uses_selector(((ShapedRunHashKey *) key)->font, priv);
+}
+
+/**
+ * \brief Flush the fonts found through the renderer's font selector,
+ * along with the entries keyed by them, before the selector is freed.
+ * A shared store keeps the fonts of the other renderers. Their frames
+ * may be reading glyphs of the flushed fonts, so they are waited for.
+ */
+void ass_cache_store_flush_fonts(ASS_Renderer *priv)
+{
+    CacheStore *store = priv->cache;
+    if (!store->shared) {
+        ass_cache_empty(store->font_cache);
+        ass_cache_empty(store->metrics_cache);
+        ass_cache_empty(store->shaped_run_cache);
+        return;
+    }
+    if (!priv->fontselect)
+        return;
+
+    ass_mutex_lock(&store->lock);
+    // holds off new frames like an overdue cut, see ass_start_frame()
+    while (store->active_frames) {
+        store->cut_pending = true;
+        ass_cond_wait(&store->idle, &store->lock);
+    }
+    ASS_FontSelector *fontsel = priv->fontselect;
+    ass_cache_evict(store->shaped_run_cache, shaped_run_uses_selector, fontsel);
+    ass_cache_evict(store->metrics_cache, glyph_metrics_uses_selector, fontsel);
+    ass_cache_evict(store->face_size_metrics_cache,
+                    face_size_metrics_uses_selector, fontsel);
+    ass_cache_evict(store->font_cache, font_uses_selector, fontsel);
+    ass_mutex_unlock(&store->lock);
+}
+
+/**
+ * \brief Drop the renderer's reference to its cache store.
+ * Fonts in a shared store may have been selected through this renderer's
+ * font providers, so they are flushed before the providers go away.
+ */
+void ass_cache_store_detach(ASS_Renderer *priv)
+{
+    CacheStore *store = priv->cache;
+    if (!store)
+        return;
+    if (store->shared)
+        ass_cache_store_flush_fonts(priv);
+    ass_cache_store_release(store);
+    priv->cache = NULL;
+}
+
+ASS_CacheStore *ass_cache_store_init(void)
+{
+    CacheStore *store = ass_cache_store_create();
+    if (!store)
+        return NULL;
+    store->shared = true;
+    if (FT_Init_FreeType(&store->ftlibrary)) {
+        store->ftlibrary = NULL;
+        ass_cache_store_release(store);
+        return NULL;
+    }
+    return store;
+}
+
+void ass_cache_store_done(ASS_CacheStore *store)
+{
+    ass_cache_store_release(store);
+}
+
 ASS_Renderer *ass_renderer_init(ASS_Library *library)
 {
     int error;
@@ -130,6 +306,7 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
 
     priv->library = library;
     priv->ftlibrary = ft;
+    priv->n_threads = 1;
     // images_root and related stuff is zero-filled in calloc
 
     unsigned flags = ASS_CPU_FLAG_ALL;
@@ -138,22 +315,11 @@ ASS_Renderer *ass_renderer_init(ASS_Library *library)
 #endif
     priv->engine = ass_bitmap_engine_init(flags);
 
-    priv->cache.font_cache = ass_font_cache_create();
-    priv->cache.bitmap_cache = ass_bitmap_cache_create();
-    priv->cache.composite_cache = ass_composite_cache_create();
-    priv->cache.outline_cache = ass_outline_cache_create();
-    priv->cache.face_size_metrics_cache = ass_face_size_metrics_cache_create();
-    priv->cache.metrics_cache = ass_glyph_metrics_cache_create();
-    if (!priv->cache.font_cache || !priv->cache.bitmap_cache ||
-        !priv->cache.composite_cache || !priv->cache.outline_cache ||
-        !priv->cache.face_size_metrics_cache || !priv->cache.metrics_cache)
+    priv->cache = ass_cache_store_create();
+    if (!priv->cache)
         goto fail;
 
-    priv->cache.glyph_max = GLYPH_CACHE_MAX;
-    priv->cache.bitmap_max_size = BITMAP_CACHE_MAX_SIZE;
-    priv->cache.composite_max_size = COMPOSITE_CACHE_MAX_SIZE;
-
-    if (!render_context_init(&priv->state, priv))
+    if (!ass_render_context_init(&priv->state, priv))
         goto fail;
 
     priv->user_override_style.Name = "OverrideStyle"; // name insignificant
@@ -182,21 +348,28 @@ void ass_renderer_done(ASS_Renderer *render_priv)
 
     ass_frame_unref(render_priv->images_root);
     ass_frame_unref(render_priv->prev_images_root);
+    ass_reset_event_memos(render_priv);
+    free(render_priv->memos);
+    ass_atlas_free(render_priv->atlas);
+    free(render_priv->diff_buf);
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < MAX_RENDER_THREADS; j++)
+            ass_arena_done(&render_priv->frame_arenas[i][j]);
 
-    ass_cache_done(render_priv->cache.composite_cache);
-    ass_cache_done(render_priv->cache.bitmap_cache);
-    ass_cache_done(render_priv->cache.outline_cache);
-    ass_cache_done(render_priv->cache.face_size_metrics_cache);
-    ass_cache_done(render_priv->cache.metrics_cache);
-    ass_cache_done(render_priv->cache.font_cache);
+    ass_cache_store_detach(render_priv);
 
     if (render_priv->fontselect)
         ass_fontselect_free(render_priv->fontselect);
     if (render_priv->ftlibrary)
         FT_Done_FreeType(render_priv->ftlibrary);
     free(render_priv->eimg);
+    free(render_priv->active_ids);
 
-    render_context_done(&render_priv->state);
+    ass_thread_pool_free(render_priv->thread_pool);
+    ass_render_context_done(&render_priv->state);
+    for (int i = 0; i < render_priv->n_threads - 1; i++)
+        ass_render_context_done(&render_priv->thread_states[i]);
+    free(render_priv->thread_states);
 
     free(render_priv->settings.default_font);
     free(render_priv->settings.default_family);
@@ -206,19 +379,68 @@ void ass_renderer_done(ASS_Renderer *render_priv)
     free(render_priv);
 }
 
+/*
+ * Pixel buffers owned by images are reference counted, so that images
+ * reused from event memos share them with the memo instead of copying
+ * the pixels every frame. The count is kept in a header in front of
+ * the pixels. Images and memos belong to one renderer, and counts are
+ * only updated by the thread driving it.
+ */
+typedef struct {
+    size_t ref_count;
+    size_t offset;      // from the start of the allocation to the pixels
+} ImageBufferHeader;
+
+/**
+ * \brief Allocate an image buffer holding one reference.
+ */
+void *ass_image_buffer_alloc(size_t align, size_t size)
+{
+    align = FFMAX(align, sizeof(ImageBufferHeader));
+    size_t offset = ass_align(align, sizeof(ImageBufferHeader));
+    if (size > SIZE_MAX - offset)
+        return NULL;
+    uint8_t *base = ass_aligned_alloc(align, offset + size, false);
+    if (!base)
+        return NULL;
+    ImageBufferHeader *header = (ImageBufferHeader *) (base + offset) - 1;
+    header->ref_count = 1;
+    header->offset = offset;
+    return base + offset;
+}
+
+void *ass_image_buffer_ref(void *buffer)
+{
+    if (buffer)
+        ((ImageBufferHeader *) buffer - 1)->ref_count++;
+    return buffer;
+}
+
+void ass_image_buffer_unref(void *buffer)
+{
+    if (!buffer)
+        return;
+    ImageBufferHeader *header = (ImageBufferHeader *) buffer - 1;
+    if (!--header->ref_count)
+        ass_aligned_free((uint8_t *) buffer - header->offset);
+}
+
 /**
  * \brief Create a new ASS_Image
  * Parameters are the same as ASS_Image fields.
+ * The image node is taken from the frame arena of state, if there is one.
  */
-static ASS_Image *my_draw_bitmap(unsigned char *bitmap, int bitmap_w,
-                                 int bitmap_h, int stride, int dst_x,
-                                 int dst_y, uint32_t color,
+static ASS_Image *my_draw_bitmap(RenderContext *state, unsigned char *bitmap,
+                                 int bitmap_w, int bitmap_h, int stride,
+                                 int dst_x, int dst_y, uint32_t color,
                                  CompositeHashValue *source)
 {
-    ASS_ImagePriv *img = malloc(sizeof(ASS_ImagePriv));
+    ASS_ImagePriv *img = state->arena ?
+        ass_arena_alloc(state->arena, sizeof(ASS_ImagePriv), ASS_ARENA_ALIGN) :
+        malloc(sizeof(ASS_ImagePriv));
     if (!img) {
         if (!source)
-            ass_aligned_free(bitmap);
+            ass_image_buffer_unref(bitmap);
         return NULL;
     }
 
@@ -234,6 +456,8 @@ static ASS_Image *my_draw_bitmap(unsigned char *bitmap, int bitmap_w,
     ass_cache_inc_ref(source);
     img->buffer = source ? NULL : bitmap;
     img->ref_count = 0;
+    img->rgba_hash = 0;
+    img->in_arena = state->arena;
 
     return &img->result;
 }
@@ -334,75 +558,208 @@ static void append_rgba_tail(ASS_ImageRGBA ***tail, ASS_ImageRGBA *img)
     *tail = &img->next;
 }
 
+/**
+ * \brief Set up incremental stepping of one bilinear gradient channel
+ * \param c channel values at the top-left, top-right,
+ *          bottom-left and bottom-right corners
+ * \param u0, v0 gradient coordinates of the first pixel
+ * \param du, dv gradient coordinate steps per pixel
+ */
+static void set_gradient_params(GradientRGBAParams *param, int k,
+                                const int c[4], double u0, double v0,
+                                double du, double dv)
+{
+    double a = c[0];
+    double b = c[1] - c[0];
+    double e = c[2] - c[0];
+    double d = c[0] - c[1] - c[2] + c[3];
+    // bias by half a unit so that the kernels round to nearest
+    param->start[k] = double_to_d22(a + b * u0 + e * v0 + d * u0 * v0) +
+                      (1 << 21);
+    param->dx[k] = double_to_d22((b + d * v0) * du);
+    param->dy[k] = double_to_d22((e + d * u0) * dv);
+    param->dxy[k] = double_to_d22(d * du * dv);
+}
+
+/**
+ * \brief Set up gradient parameters for a single premultiplied color
+ */
+void ass_solid_rgba_params(GradientRGBAParams *param, uint32_t color)
+{
+    int c[4] = { _r(color), _g(color), _b(color), _a(color) };
+    for (int k = 0; k < 4; k++) {
+        int corner[4] = { c[k], c[k], c[k], c[k] };
+        set_gradient_params(param, k, corner, 0, 0, 0, 0);
+    }
+}
+
+size_t ass_rgba_construct(void *key, void *value, void *priv)
+{
+    ASS_Renderer *render_priv = priv;
+    RGBAHashKey *k = key;
+    RGBAHashValue *v = value;
+
+    unsigned align = 1 << render_priv->engine.align_order;
+    v->stride = ass_align(align, k->w * 4);
+    v->rgba = ass_aligned_alloc(align, (size_t) v->stride * k->h + align, false);
+    if (v->rgba)
+        render_priv->engine.gradient_rgba(v->rgba, v->stride, k->mask, k->stride,
+                                          k->w, k->h, &k->param);
+    else
+        v->stride = 0;
+
+    return sizeof(RGBAHashKey) + sizeof(RGBAHashValue) +
+        (size_t) v->stride * k->h;
+}
+
+/**
+ * \brief Allocate pixels for an RGBA image of the current frame.
+ * \param owned set to true if the memory is an image buffer the caller
+ * must release with ass_image_buffer_unref, false if it belongs
+ * to the frame arena
+ */
+uint8_t *ass_image_rgba_alloc(RenderContext *state, size_t size, bool *owned)
+{
+    unsigned align = 1 << state->renderer->engine.align_order;
+    *owned = !state->arena;
+    if (state->arena)
+        return ass_arena_alloc(state->arena, size + align, align);
+    return ass_image_buffer_alloc(align, size + align);
+}
+
+/**
+ * \brief Create a premultiplied RGBA image from a coverage mask.
+ * Areas of cached composite bitmaps are looked up in the RGBA cache,
+ * so unchanged images cost no pixel work; other masks are converted
+ * into a buffer of the image.
+ * \param source composite bitmap the mask belongs to, or NULL
+ */
+ASS_ImageRGBA *ass_image_rgba_new(RenderContext *state, CompositeHashValue *source,
+                                  const uint8_t *mask, int w, int h, int stride,
+                                  const GradientRGBAParams *param,
+                                  int dst_x, int dst_y, int type)
+{
+    ASS_Renderer *priv = state->renderer;
+    RGBAHashValue *val = NULL;
+    uint8_t *rgba;
+    bool owned = false;
+    int rgba_stride;
+    if (source) {
+        RGBAHashKey key = {
+            .source = source,
+            .mask = mask,
+            .w = w,
+            .h = h,
+            .stride = stride,
+            .param = *param,
+        };
+        int stage = ass_enter_stage(state, ASS_STAGE_RGBA);
+        val = ass_cache_get(priv->cache->rgba_cache, &key, priv);
+        ass_enter_stage(state, stage);
+        if (!val || !val->rgba)
+            return NULL;
+        rgba = val->rgba;
+        rgba_stride = val->stride;
+    } else {
+        rgba_stride = ass_align(1 << priv->engine.align_order, w * 4);
+        rgba = ass_image_rgba_alloc(state, (size_t) rgba_stride * h, &owned);
+        if (!rgba)
+            return NULL;
+        int stage = ass_enter_stage(state, ASS_STAGE_RGBA);
+        priv->engine.gradient_rgba(rgba, rgba_stride, mask, stride,
+                                   w, h, param);
+        ass_enter_stage(state, stage);
+    }
+
+    ASS_ImageRGBAPriv *img = state->arena ?
+        ass_arena_alloc(state->arena, sizeof(ASS_ImageRGBAPriv), ASS_ARENA_ALIGN) :
+        malloc(sizeof(ASS_ImageRGBAPriv));
+    if (!img) {
+        if (owned)
+            ass_image_buffer_unref(rgba);
+        return NULL;
+    }
+    ass_cache_inc_ref(val);
+    img->source = val;
+    img->buffer = owned ? rgba : NULL;
+    img->in_arena = state->arena;
+
+    img->result.w = w;
+    img->result.h = h;
+    img->result.stride = rgba_stride;
+    img->result.rgba = rgba;
+    img->result.dst_x = dst_x;
+    img->result.dst_y = dst_y;
+    img->result.type = type;
+    img->result.next = NULL;
+    return &img->result;
+}
+
+/**
+ * \brief Replace the pixels of an RGBA image
+ * \param owned the image takes ownership of rgba,
+ * see ass_image_rgba_alloc()
+ */
+void ass_image_rgba_set_buffer(ASS_ImageRGBA *img, uint8_t *rgba, bool owned)
+{
+    ASS_ImageRGBAPriv *priv = (ASS_ImageRGBAPriv *) img;
+    ass_cache_dec_ref(priv->source);
+    ass_image_buffer_unref(priv->buffer);
+    priv->source = NULL;
+    priv->buffer = owned ? rgba : NULL;
+    img->rgba = rgba;
+}
+
+/**
+ * \brief Render RGBA counterpart of an ASS_Image
+ * Tags the image with a hash of the gradient, so that change detection
+ * notices gradients changing under identical coverage and color.
+ */
 static ASS_ImageRGBA *render_bitmap_rgba(RenderContext *state,
                                          CombinedBitmapInfo *info,
+                                         CompositeHashValue *source,
+                                         ASS_Image *img,
                                          const uint8_t *mask, int w, int h,
                                          int stride, int dst_x, int dst_y,
                                          int src_x, int src_y,
                                          int full_w, int full_h,
                                          int layer, unsigned type)
 {
-    ASS_Renderer *render_priv = state->renderer;
-    unsigned align = 1 << render_priv->engine.align_order;
-    int rgba_stride = ass_align(align, w * 4);
-    uint8_t *rgba = ass_aligned_alloc(align, rgba_stride * h + align, false);
-    if (!rgba)
-        return NULL;
-
     if (full_w <= 0)
         full_w = w;
     if (full_h <= 0)
         full_h = h;
-    double inv_w = full_w ? 1.0 / full_w : 0.0;
-    double inv_h = full_h ? 1.0 / full_h : 0.0;
 
     const GradientValues *vals = &info->gradient.layer[layer];
     uint32_t base_color = info->base_c[layer];
-    uint8_t base_alpha = _a(base_color);
-    uint8_t fade = info->fade;
-
-    for (int y = 0; y < h; y++) {
-        double v = (src_y + y) * inv_h;
-        uint8_t *row = rgba + y * rgba_stride;
-        const uint8_t *src = mask + y * stride;
-        for (int x = 0; x < w; x++) {
-            uint8_t cov = src[x];
-            if (!cov) {
-                row[4 * x + 0] = 0;
-                row[4 * x + 1] = 0;
-                row[4 * x + 2] = 0;
-                row[4 * x + 3] = 0;
-                continue;
-            }
-            double u = (src_x + x) * inv_w;
-            uint32_t color = (vals->color_enabled) ?
-                ass_gradient_sample_color(vals, u, v) : base_color;
-            uint8_t alpha = (vals->alpha_enabled) ?
-                ass_gradient_sample_alpha(vals, u, v) : base_alpha;
-            if (fade > 0)
-                alpha = mult_alpha(alpha, fade);
-            uint8_t A = (uint8_t) ((cov * (255 - alpha)) / 255);
-            row[4 * x + 0] = (uint8_t) ((_r(color) * A) / 255);
-            row[4 * x + 1] = (uint8_t) ((_g(color) * A) / 255);
-            row[4 * x + 2] = (uint8_t) ((_b(color) * A) / 255);
-            row[4 * x + 3] = A;
-        }
+    int corner[4][4];  // R, G, B and transparency for each gradient corner
+    for (int i = 0; i < 4; i++) {
+        uint32_t color = vals->color_enabled ? vals->color[i] : base_color;
+        uint8_t alpha = vals->alpha_enabled ? vals->alpha[i] : _a(base_color);
+        // fade is affine in alpha, so it commutes with the interpolation
+        if (info->fade > 0)
+            alpha = mult_alpha(alpha, info->fade);
+        corner[0][i] = _r(color);
+        corner[1][i] = _g(color);
+        corner[2][i] = _b(color);
+        corner[3][i] = alpha;
     }
 
-    ASS_ImageRGBA *img = malloc(sizeof(*img));
-    if (!img) {
-        ass_aligned_free(rgba);
-        return NULL;
-    }
-    img->w = w;
-    img->h = h;
-    img->stride = rgba_stride;
-    img->rgba = rgba;
-    img->dst_x = dst_x;
-    img->dst_y = dst_y;
-    img->type = type;
-    img->next = NULL;
-    return img;
+    GradientRGBAParams param;
+    double du = 1.0 / full_w, dv = 1.0 / full_h;
+    for (int k = 0; k < 4; k++)
+        set_gradient_params(&param, k, corner[k],
+                            src_x * du, src_y * dv, du, dv);
+
+    // FNV-1a over the parameter words
+    const int32_t *words = (const int32_t *) &param;
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < sizeof(param) / sizeof(int32_t); i++)
+        hash = (hash ^ (uint32_t) words[i]) * 16777619u;
+    ((ASS_ImagePriv *) img)->rgba_hash = hash | 1;
+
+    return ass_image_rgba_new(state, source, mask, w, h, stride,
+                              &param, dst_x, dst_y, type);
 }
 
 /*
@@ -491,7 +848,7 @@ static ASS_Image **render_glyph_i(RenderContext *state,
         // split up into left and right for karaoke, if needed
         if (lbrk > r[j].x0) {
             if (lbrk > r[j].x1) lbrk = r[j].x1;
-            img = my_draw_bitmap(bm->buffer + r[j].y0 * bm->stride + r[j].x0,
+            img = my_draw_bitmap(state, bm->buffer + r[j].y0 * bm->stride + r[j].x0,
                                  lbrk - r[j].x0, r[j].y1 - r[j].y0, bm->stride,
                                  dst_x + r[j].x0, dst_y + r[j].y0, color, source);
             if (!img) break;
@@ -500,7 +857,7 @@ static ASS_Image **render_glyph_i(RenderContext *state,
             tail = &img->next;
             if (rgba_tail) {
                 append_rgba_tail(rgba_tail,
-                                 render_bitmap_rgba(state, combined,
+                                 render_bitmap_rgba(state, combined, source, img,
                                      bm->buffer + r[j].y0 * bm->stride + r[j].x0,
                                      lbrk - r[j].x0, r[j].y1 - r[j].y0, bm->stride,
                                      dst_x + r[j].x0, dst_y + r[j].y0,
@@ -510,7 +867,7 @@ static ASS_Image **render_glyph_i(RenderContext *state,
         }
         if (lbrk < r[j].x1) {
             if (lbrk < r[j].x0) lbrk = r[j].x0;
-            img = my_draw_bitmap(bm->buffer + r[j].y0 * bm->stride + lbrk,
+            img = my_draw_bitmap(state, bm->buffer + r[j].y0 * bm->stride + lbrk,
                                  r[j].x1 - lbrk, r[j].y1 - r[j].y0, bm->stride,
                                  dst_x + lbrk, dst_y + r[j].y0, color2, source);
             if (!img) break;
@@ -519,7 +876,7 @@ static ASS_Image **render_glyph_i(RenderContext *state,
             tail = &img->next;
             if (rgba_tail) {
                 append_rgba_tail(rgba_tail,
-                                 render_bitmap_rgba(state, combined,
+                                 render_bitmap_rgba(state, combined, source, img,
                                      bm->buffer + r[j].y0 * bm->stride + lbrk,
                                      r[j].x1 - lbrk, r[j].y1 - r[j].y0, bm->stride,
                                      dst_x + lbrk, dst_y + r[j].y0,
@@ -599,7 +956,7 @@ render_glyph(RenderContext *state, CombinedBitmapInfo *combined,
     if (brk > b_x0) {           // draw left part
         if (brk > b_x1)
             brk = b_x1;
-        img = my_draw_bitmap(bm->buffer + bm->stride * b_y0 + b_x0,
+        img = my_draw_bitmap(state, bm->buffer + bm->stride * b_y0 + b_x0,
                              brk - b_x0, b_y1 - b_y0, bm->stride,
                              dst_x + b_x0, dst_y + b_y0, color, source);
         if (!img) return tail;
@@ -608,7 +965,7 @@ render_glyph(RenderContext *state, CombinedBitmapInfo *combined,
         tail = &img->next;
         if (rgba_tail) {
             append_rgba_tail(rgba_tail,
-                             render_bitmap_rgba(state, combined,
+                             render_bitmap_rgba(state, combined, source, img,
                                  bm->buffer + bm->stride * b_y0 + b_x0,
                                  brk - b_x0, b_y1 - b_y0, bm->stride,
                                  dst_x + b_x0, dst_y + b_y0,
@@ -619,7 +976,7 @@ render_glyph(RenderContext *state, CombinedBitmapInfo *combined,
     if (brk < b_x1) {           // draw right part
         if (brk < b_x0)
             brk = b_x0;
-        img = my_draw_bitmap(bm->buffer + bm->stride * b_y0 + brk,
+        img = my_draw_bitmap(state, bm->buffer + bm->stride * b_y0 + brk,
                              b_x1 - brk, b_y1 - b_y0, bm->stride,
                              dst_x + brk, dst_y + b_y0, color2, source);
         if (!img) return tail;
@@ -628,7 +985,7 @@ render_glyph(RenderContext *state, CombinedBitmapInfo *combined,
         tail = &img->next;
         if (rgba_tail) {
             append_rgba_tail(rgba_tail,
-                             render_bitmap_rgba(state, combined,
+                             render_bitmap_rgba(state, combined, source, img,
                                  bm->buffer + bm->stride * b_y0 + brk,
                                  b_x1 - brk, b_y1 - b_y0, bm->stride,
                                  dst_x + brk, dst_y + b_y0,
@@ -865,7 +1222,8 @@ static double motion_progress(RenderContext *state, const MotionState *motion)
     int32_t t1, t2;
     motion_timing(motion, state, &t1, &t2);
 
-    int t = state->renderer->time - state->event->Start;
+    int t = ass_event_time(state);
+    ass_event_animate(state, t1, t2);
     if (t <= t1)
         return 0.;
     if (t >= t2)
@@ -1036,9 +1394,18 @@ static void jitter_run_debug_tests(void)
 }
 #endif
 
+// Event time in ms at which the offset of time_100ns may change
+static long long jitter_bucket_end(const JitterState *j, long long time_100ns)
+{
+    double period = FFMAX(j->period, 1.0);
+    double bucket = floor((double) FFMAX(time_100ns, 0) / period);
+    double end = ceil((bucket + 1) * period / 10000);
+    return end >= (double) LLONG_MAX ? LLONG_MAX : (long long) end;
+}
+
 static long long jitter_current_time(RenderContext *state)
 {
-    long long now = state->renderer->time - state->event->Start;
+    long long now = ass_event_time(state);
     if (now <= 0)
         return 0;
     long long limit = LLONG_MAX / 10000;
@@ -1051,14 +1418,18 @@ static void update_glyph_jitter_offsets(RenderContext *state)
     jitter_run_debug_tests();
 #endif
     TextInfo *text_info = &state->text_info;
-    long long time_100ns = jitter_current_time(state);
+    long long time_100ns = -1;
 
     for (int i = 0; i < text_info->length; i++) {
         for (GlyphInfo *info = text_info->glyphs + i; info; info = info->next) {
             double dx = 0.0;
             double dy = 0.0;
             if (info->has_jitter) {
+                if (time_100ns < 0)
+                    time_100ns = jitter_current_time(state);
                 ASS_DVector offset = jitter_compute_offset(&info->jitter, time_100ns);
+                ass_event_change_at(state,
+                                    jitter_bucket_end(&info->jitter, time_100ns));
                 dx = x2scr_offset(state, offset.x);
                 dy = y2scr_offset(state, offset.y);
             }
@@ -1079,7 +1450,8 @@ static ASS_DVector movevc_offset(RenderContext *state)
         int32_t t1 = mv->has_timing ? mv->t1 : 0;
         int32_t t2 = mv->has_timing ? mv->t2 : state->event->Duration;
         int32_t delta_t = (uint32_t) t2 - t1;
-        int t = state->renderer->time - state->event->Start;
+        int t = ass_event_time(state);
+        ass_event_animate(state, t1, t2);
         double k;
         if (t <= t1)
             k = 0.;
@@ -1128,13 +1500,13 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
     }
 
     ASS_Vector pos;
-    BitmapHashKey key;
-    key.outline = ass_cache_get(render_priv->cache.outline_cache, &ol_key, render_priv);
+    BitmapHashKey key = {0};
+    key.outline = ass_cache_get(render_priv->cache->outline_cache, &ol_key, render_priv);
     if (!key.outline || !key.outline->valid ||
             !quantize_transform(m, &pos, NULL, true, &key))
         return;
 
-    Bitmap *clip_bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    Bitmap *clip_bm = ass_cache_get(render_priv->cache->bitmap_cache, &key, state);
     if (!clip_bm)
         return;
 
@@ -1180,7 +1552,7 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
             }
 
             // Allocate new buffer and add to free list
-            nbuffer = ass_aligned_alloc(align, as * ah + align, false);
+            nbuffer = ass_image_buffer_alloc(align, as * ah + align);
             if (!nbuffer)
                 break;
 
@@ -1199,7 +1571,7 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
 
             // Allocate new buffer and add to free list
             unsigned ns = ass_align(align, w);
-            nbuffer = ass_aligned_alloc(align, ns * h + align, false);
+            nbuffer = ass_image_buffer_alloc(align, ns * h + align);
             if (!nbuffer)
                 break;
 
@@ -1216,6 +1588,7 @@ static void blend_vector_clip(RenderContext *state, ASS_Image *head)
         }
 
         ASS_ImagePriv *priv = (ASS_ImagePriv *) cur;
+        ass_image_buffer_unref(priv->buffer);
         priv->buffer = cur->bitmap = nbuffer;
         ass_cache_dec_ref(priv->source);
         priv->source = NULL;
@@ -1249,13 +1622,13 @@ static void blend_vector_clip_rgba(RenderContext *state, ASS_ImageRGBA *head)
     }
 
     ASS_Vector pos;
-    BitmapHashKey key;
-    key.outline = ass_cache_get(render_priv->cache.outline_cache, &ol_key, render_priv);
+    BitmapHashKey key = {0};
+    key.outline = ass_cache_get(render_priv->cache->outline_cache, &ol_key, render_priv);
     if (!key.outline || !key.outline->valid ||
             !quantize_transform(m, &pos, NULL, true, &key))
         return;
 
-    Bitmap *clip_bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    Bitmap *clip_bm = ass_cache_get(render_priv->cache->bitmap_cache, &key, state);
     if (!clip_bm)
         return;
 
@@ -1295,7 +1668,8 @@ static void blend_vector_clip_rgba(RenderContext *state, ASS_ImageRGBA *head)
                 continue;
             }
 
-            uint8_t *nbuffer = ass_aligned_alloc(align, as * ah + align, false);
+            bool owned;
+            uint8_t *nbuffer = ass_image_rgba_alloc(state, (size_t) as * ah, &owned);
             if (!nbuffer)
                 break;
             memcpy(nbuffer, abuffer, as * ah);
@@ -1310,8 +1684,7 @@ static void blend_vector_clip_rgba(RenderContext *state, ASS_ImageRGBA *head)
                     }
                 }
             }
-            ass_aligned_free(cur->rgba);
-            cur->rgba = nbuffer;
+            ass_image_rgba_set_buffer(cur, nbuffer, owned);
         } else {
             if (ax + aw < bx || ay + ah < by || ax > bx + bw ||
                 ay > by + bh || !hclip || !wclip) {
@@ -1320,7 +1693,8 @@ static void blend_vector_clip_rgba(RenderContext *state, ASS_ImageRGBA *head)
             }
 
             int ns = ass_align(align, wclip * 4);
-            uint8_t *nbuffer = ass_aligned_alloc(align, ns * hclip + align, false);
+            bool owned;
+            uint8_t *nbuffer = ass_image_rgba_alloc(state, (size_t) ns * hclip, &owned);
             if (!nbuffer)
                 break;
             for (int y = 0; y < hclip; y++) {
@@ -1335,8 +1709,7 @@ static void blend_vector_clip_rgba(RenderContext *state, ASS_ImageRGBA *head)
                     }
                 }
             }
-            ass_aligned_free(cur->rgba);
-            cur->rgba = nbuffer;
+            ass_image_rgba_set_buffer(cur, nbuffer, owned);
             cur->dst_x += aleft;
             cur->dst_y += atop;
             cur->w = wclip;
@@ -1419,11 +1792,13 @@ static ASS_Image *render_text(RenderContext *state, ASS_ImageRGBA **out_rgba)
     }
 
     *tail = 0;
+    int stage = ass_enter_stage(state, ASS_STAGE_CLIP);
     blend_vector_clip(state, head);
     if (out_rgba) {
         blend_vector_clip_rgba(state, rgba_head);
         *out_rgba = rgba_head;
     }
+    ass_enter_stage(state, stage);
     return head;
 }
 
@@ -1701,7 +2076,7 @@ init_render_context(RenderContext *state, ASS_Event *event)
 
     ass_apply_transition_effects(state);
     state->explicit = state->evt_type != EVENT_NORMAL ||
-                      ass_event_has_hard_overrides(event->Text);
+                      ass_event_has_hard_overrides(state->parsed);
 
     ass_reset_render_context(state, NULL);
     state->alignment = state->style->Alignment;
@@ -1710,6 +2085,7 @@ init_render_context(RenderContext *state, ASS_Event *event)
 
 static void free_render_context(RenderContext *state)
 {
+    state->parsed = NULL;
     state->font = NULL;
     state->family.str = NULL;
     state->family.len = 0;
@@ -1737,7 +2113,7 @@ get_outline_glyph(RenderContext *state, GlyphInfo *info)
     if (info->drawing_text.str) {
         key.type = OUTLINE_DRAWING;
         key.u.drawing.text = info->drawing_text;
-        val = ass_cache_get(priv->cache.outline_cache, &key, priv);
+        val = ass_cache_get(priv->cache->outline_cache, &key, priv);
         if (!val || !val->valid)
             return;
 
@@ -1759,8 +2135,9 @@ get_outline_glyph(RenderContext *state, GlyphInfo *info)
         k->bold = info->bold;
         k->italic = info->italic;
         k->flags = info->flags;
+        k->hinting = priv->settings.hinting;
 
-        val = ass_cache_get(priv->cache.outline_cache, &key, priv);
+        val = ass_cache_get(priv->cache->outline_cache, &key, priv);
         if (!val || !val->valid)
             return;
 
@@ -1798,9 +2175,10 @@ size_t ass_outline_construct(void *key, void *value, void *priv)
     case OUTLINE_GLYPH:
         {
             GlyphHashKey *k = &outline_key->u.glyph;
-            ass_face_set_size(k->font->faces[k->face_index], k->size);
+            ass_shaper_set_face_size(render_priv->state.shaper, k->font,
+                                     k->face_index, k->size);
             if (!ass_font_get_glyph(k->font, k->face_index, k->glyph_index,
-                                    render_priv->settings.hinting))
+                                    k->hinting))
                 return 1;
             if (!ass_get_glyph_outline(&v->outline[0], &v->advance,
                                        k->font->faces[k->face_index],
@@ -1940,6 +2318,53 @@ static void calc_transform_matrix(RenderContext *state,
     }
 }
 
+/**
+ * \brief Check whether the border of a glyph can be made by dilating
+ * its bitmap with ass_dilate_bitmap() instead of stroking its outline.
+ * This needs the border ellipse to stay axis-aligned or circular on screen.
+ * \param m glyph transform
+ * \param bord_x, bord_y border radii in outline units
+ * \param radius receives the screen border radii in 1/64 pixel
+ */
+static bool use_distance_border(ASS_Renderer *render_priv, double m[3][3],
+                                double bord_x, double bord_y,
+                                ASS_Vector *radius)
+{
+    ASS_BorderEngine engine = render_priv->settings.border_engine;
+    if (engine == ASS_BORDER_STROKER || m[2][0] || m[2][1] || !(m[2][2] > 0))
+        return false;
+
+    // screen images of the border ellipse semi-axes, in pixels
+    double scale = 1 / (64 * m[2][2]);
+    double ax = m[0][0] * bord_x * scale, ay = m[1][0] * bord_x * scale;
+    double bx = m[0][1] * bord_y * scale, by = m[1][1] * bord_y * scale;
+    double eps = 1e-3 * (fabs(ax) + fabs(ay) + fabs(bx) + fabs(by));
+
+    double rx, ry;
+    if (fabs(ay) <= eps && fabs(bx) <= eps) {
+        rx = fabs(ax);
+        ry = fabs(by);
+    } else if (fabs(ax) <= eps && fabs(by) <= eps) {
+        rx = fabs(bx);
+        ry = fabs(ay);
+    } else {
+        // rotated, only a circle is still an axis-aligned ellipse
+        rx = sqrt(ax * ax + ay * ay);
+        ry = sqrt(bx * bx + by * by);
+        if (fabs(rx - ry) > eps || fabs(ax * bx + ay * by) > eps * (rx + ry))
+            return false;
+    }
+
+    if (!(rx >= 1 && ry >= 1) ||
+            !(rx < DISTANCE_BORDER_MAX && ry < DISTANCE_BORDER_MAX))
+        return false;
+    if (engine == ASS_BORDER_AUTO && FFMAX(rx, ry) < DISTANCE_BORDER_MIN)
+        return false;
+    radius->x = ass_lrint(64 * rx);
+    radius->y = ass_lrint(64 * ry);
+    return true;
+}
+
 /**
  * \brief Get bitmaps for a glyph
  * \param info glyph info
@@ -1972,12 +2397,14 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
     if (info->effect_type == EF_KARAOKE_KF)
         ass_outline_update_min_transformed_x(&info->outline->outline[0], m, leftmost_x);
 
-    BitmapHashKey key;
+    BitmapHashKey key = {0};
     key.outline = info->outline;
     if (!quantize_transform(m, pos, offset, first, &key))
         return;
 
-    info->bm = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    int stage = ass_enter_stage(state, ASS_STAGE_RASTERIZE);
+    info->bm = ass_cache_get(render_priv->cache->bitmap_cache, &key, state);
+    ass_enter_stage(state, stage);
     if (!info->bm || !info->bm->buffer)
         info->bm = NULL;
 
@@ -2037,6 +2464,18 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
         double bord_y =
             64 * state->border_scale_y * info->border_y / tr->scale.y;
 
+        ASS_Vector radius;
+        if (info->bm &&
+                use_distance_border(render_priv, m2, bord_x, bord_y, &radius)) {
+            key.border = radius;
+            ass_enter_stage(state, ASS_STAGE_STROKE);
+            info->bm_o = ass_cache_get(render_priv->cache->bitmap_cache, &key, state);
+            ass_enter_stage(state, stage);
+            if (!info->bm_o || !info->bm_o->buffer)
+                info->bm_o = NULL;
+            return;
+        }
+
         const ASS_Rect *bbox = &info->outline->cbox;
         // Estimate bounding box half size after stroking
         double dx = (bbox->x_max - bbox->x_min) / 2.0 + (bord_x + 64);
@@ -2096,12 +2535,16 @@ get_bitmap_glyph(RenderContext *state, GlyphInfo *info,
         }
     }
 
-    key.outline = ass_cache_get(render_priv->cache.outline_cache, &ol_key, render_priv);
+    ass_enter_stage(state, ASS_STAGE_STROKE);
+    key.outline = ass_cache_get(render_priv->cache->outline_cache, &ol_key, render_priv);
+    ass_enter_stage(state, stage);
     if (!key.outline || !key.outline->valid ||
             !quantize_transform(m, pos_o, offset, false, &key))
         return;
 
-    info->bm_o = ass_cache_get(render_priv->cache.bitmap_cache, &key, state);
+    ass_enter_stage(state, ASS_STAGE_RASTERIZE);
+    info->bm_o = ass_cache_get(render_priv->cache->bitmap_cache, &key, state);
+    ass_enter_stage(state, stage);
     if (!info->bm_o || !info->bm_o->buffer) {
         info->bm_o = NULL;
         *pos_o = *pos;
@@ -2120,6 +2563,20 @@ size_t ass_bitmap_construct(void *key, void *value, void *priv)
     BitmapHashKey *k = key;
     Bitmap *bm = value;
 
+    if (k->border.x || k->border.y) {
+        // dilate the plain rasterization of the same outline,
+        // which stays valid until the next cache cut
+        BitmapHashKey fill_key = *k;
+        fill_key.border.x = fill_key.border.y = 0;
+        Bitmap *fill = ass_cache_get(state->renderer->cache->bitmap_cache,
+                                     &fill_key, state);
+        if (!fill || !fill->buffer ||
+                !ass_dilate_bitmap(&state->renderer->engine, bm, fill,
+                                   k->border.x / 64.0, k->border.y / 64.0))
+            memset(bm, 0, sizeof(*bm));
+        return sizeof(BitmapHashKey) + sizeof(Bitmap) + bitmap_size(bm);
+    }
+
     double m[3][3];
     restore_transform(m, k);
 
@@ -2666,10 +3123,12 @@ static bool parse_events(RenderContext *state, ASS_Event *event)
         // this affects render_context
         unsigned code = 0;
         while (*p) {
-            if ((*p == '{') && (q = strchr(p, '}'))) {
-                p = ass_parse_tags(state, p, q, 1., false);
-                assert(*p == '}');
-                p++;
+            int block = 0;
+            if (*p == '{' && (block = ass_parse_tag_block(state, p, &q)) > 0) {
+                assert(*q == '}');
+                p = q + 1;
+            } else if (block < 0) {
+                goto fail;
             } else if (state->drawing_scale) {
                 q = p;
                 if (*p == '{')
@@ -3374,7 +3833,9 @@ static void render_and_combine_glyphs(RenderContext *state,
         key.filter = info->filter;
         key.bitmap_count = info->bitmap_count;
         key.bitmaps = info->bitmaps;
-        CompositeHashValue *val = ass_cache_get(render_priv->cache.composite_cache, &key, render_priv);
+        int stage = ass_enter_stage(state, ASS_STAGE_BLUR);
+        CompositeHashValue *val = ass_cache_get(render_priv->cache->composite_cache, &key, render_priv);
+        ass_enter_stage(state, stage);
         if (!val)
             continue;
 
@@ -3562,77 +4023,62 @@ static void add_background(RenderContext *state, EventImages *event_images,
     int h = bottom - top;
     if (w < 1 || h < 1)
         return;
-    void *nbuffer = ass_aligned_alloc(1, w * h, false);
+    void *nbuffer = ass_image_buffer_alloc(1, w * h);
     if (!nbuffer)
         return;
     memset(nbuffer, 0xFF, w * h);
     uint32_t clr = state->c[3];
     ass_apply_fade(&clr, state->fade);
-    ASS_Image *img = my_draw_bitmap(nbuffer, w, h, w, left, top,
+    if (rgba_head) {
+        GradientRGBAParams param;
+        ass_solid_rgba_params(&param, clr);
+        ASS_ImageRGBA *rimg = ass_image_rgba_new(state, NULL, nbuffer,
+                                                 w, h, w, &param, left, top,
+                                                 IMAGE_TYPE_SHADOW);
+        if (rimg) {
+            rimg->next = *rgba_head;
+            *rgba_head = rimg;
+        }
+    }
+    ASS_Image *img = my_draw_bitmap(state, nbuffer, w, h, w, left, top,
                                     clr, NULL);
     if (img) {
         img->next = event_images->imgs;
         event_images->imgs = img;
     }
-    if (rgba_head) {
-        uint8_t alpha = 255 - _a(clr);
-        int stride = ass_align(1 << render_priv->engine.align_order, w * 4);
-        uint8_t *rgba = ass_aligned_alloc(1 << render_priv->engine.align_order,
-                                          stride * h + (1 << render_priv->engine.align_order),
-                                          false);
-        if (rgba) {
-            uint8_t pr = (uint8_t) ((_r(clr) * alpha + 127) / 255);
-            uint8_t pg = (uint8_t) ((_g(clr) * alpha + 127) / 255);
-            uint8_t pb = (uint8_t) ((_b(clr) * alpha + 127) / 255);
-            for (int y = 0; y < h; y++) {
-                uint8_t *row = rgba + y * stride;
-                for (int x = 0; x < w; x++) {
-                    row[4 * x + 0] = pr;
-                    row[4 * x + 1] = pg;
-                    row[4 * x + 2] = pb;
-                    row[4 * x + 3] = alpha;
-                }
-            }
-            ASS_ImageRGBA *rimg = malloc(sizeof(*rimg));
-            if (rimg) {
-                rimg->w = w;
-                rimg->h = h;
-                rimg->stride = stride;
-                rimg->rgba = rgba;
-                rimg->dst_x = left;
-                rimg->dst_y = top;
-                rimg->type = IMAGE_TYPE_SHADOW;
-                rimg->next = *rgba_head;
-                *rgba_head = rimg;
-                event_images->imgs_rgba = rimg;
-            } else {
-                ass_aligned_free(rgba);
-            }
-        }
-    }
 }
 
+static ASS_RenderPriv *get_render_priv(ASS_Renderer *render_priv,
+                                       ASS_Event *event);
+
 /**
- * \brief Main ass rendering function, glues everything together
- * \param event event to render
- * \param event_images struct containing resulting images, will also be initialized
- * Process event, appending resulting ASS_Image's to images_root.
+ * \brief Fetch the compiled override tags of the event,
+ * compiling them if the event is new or its text has changed.
  */
-bool
-ass_render_event(RenderContext *state, ASS_Event *event,
-                 EventImages *event_images, ASS_ImageRGBA **rgba_out)
+static bool get_parsed_event(RenderContext *state, ASS_Event *event)
 {
-    ASS_Renderer *render_priv = state->renderer;
-    if (event->Style >= render_priv->track->n_styles) {
-        ass_msg(render_priv->library, MSGL_WARN, "No style found");
-        return false;
-    }
-    if (!event->Text) {
-        ass_msg(render_priv->library, MSGL_WARN, "Empty event");
+    ASS_RenderPriv *priv = get_render_priv(state->renderer, event);
+    if (!priv || !ass_parsed_event_prepare(&priv->parsed, event->Text)) {
+        ass_msg(state->renderer->library, MSGL_WARN,
+                "Failed to compile event tags");
         return false;
     }
+    state->parsed = priv->parsed;
+    return true;
+}
+
+/**
+ * \brief Parse, shape and load glyphs of an event.
+ * This is the part of event rendering that touches FreeType, font selection
+ * and HarfBuzz fonts, so it must be called with font_lock held.
+ */
+static bool shape_event(RenderContext *state, ASS_Event *event)
+{
+    ASS_Renderer *render_priv = state->renderer;
 
     free_render_context(state);
+    if (!get_parsed_event(state, event))
+        return false;
     init_render_context(state, event);
 
     if (!parse_events(state, event))
@@ -3651,6 +4097,7 @@ ass_render_event(RenderContext *state, ASS_Event *event,
         state->pos_y = pos.y;
     }
 
+    ass_enter_stage(state, ASS_STAGE_SHAPE);
     split_style_runs(state);
 
     // Find shape runs and shape text
@@ -3664,8 +4111,44 @@ ass_render_event(RenderContext *state, ASS_Event *event,
         return false;
     }
 
+    ass_enter_stage(state, ASS_STAGE_OUTLINE);
     retrieve_glyphs(state);
+    return true;
+}
+
+/**
+ * \brief Main ass rendering function, glues everything together
+ * \param event event to render
+ * \param event_images struct containing resulting images, will also be initialized
+ * Process event, appending resulting ASS_Image's to images_root.
+ * May run concurrently for different events, each with its own RenderContext.
+ */
+bool
+ass_render_event(RenderContext *state, ASS_Event *event,
+                 EventImages *event_images, ASS_ImageRGBA **rgba_out)
+{
+    ASS_Renderer *render_priv = state->renderer;
+    state->time_dependent = false;
+    state->next_change = LLONG_MAX;
+    if (event->Style >= render_priv->track->n_styles) {
+        ass_msg(render_priv->library, MSGL_WARN, "No style found");
+        return false;
+    }
+    if (!event->Text) {
+        ass_msg(render_priv->library, MSGL_WARN, "Empty event");
+        return false;
+    }
 
+    ass_mutex_lock(&render_priv->cache->font_lock);
+    ass_enter_stage(state, ASS_STAGE_PARSE);
+    bool shaped = shape_event(state, event);
+    ass_enter_stage(state, STAGE_NONE);
+    ass_mutex_unlock(&render_priv->cache->font_lock);
+    if (!shaped)
+        return false;
+
+    ass_enter_stage(state, ASS_STAGE_LAYOUT);
+    TextInfo *text_info = &state->text_info;
     preliminary_layout(state);
 
     int valign = state->alignment & 12;
@@ -3837,6 +4320,7 @@ ass_render_event(RenderContext *state, ASS_Event *event,
 
     calculate_rotation_params(state, bbox_for_origin, device_x, device_y);
 
+    ass_enter_stage(state, ASS_STAGE_COMPOSITE);
     render_and_combine_glyphs(state, device_x, device_y);
     compute_line_gradient_rects(state);
     state->needs_rgba = text_has_gradients(text_info);
@@ -3867,21 +4351,85 @@ ass_render_event(RenderContext *state, ASS_Event *event,
 
     if (rgba_out)
         *rgba_out = event_images->imgs_rgba;
+    event_images->is_static = !state->time_dependent;
 
     ass_shaper_cleanup(state->shaper, text_info);
     free_render_context(state);
 
+    ass_enter_stage(state, STAGE_NONE);
+    state->events_rendered++;
     return true;
 }
 
+static size_t pressure_limit(size_t limit, int pressure)
+{
+    switch (pressure) {
+    case ASS_MEMORY_PRESSURE_MODERATE:
+        return limit / 2;
+    case ASS_MEMORY_PRESSURE_CRITICAL:
+        return 0;
+    default:
+        return limit;
+    }
+}
+
 /**
  * \brief Check cache limits and reset cache if they are exceeded
+ * Pending memory pressure cuts the caches further, once.
+ * Must be called with cache->lock held while no frame is being rendered.
+ */
+void ass_check_cache_limits(CacheStore *cache)
+{
+    int pressure = cache->pressure;
+    cache->pressure = 0;
+
+    if (cache->budget) {
+        Cache *images[] = {
+            cache->rgba_cache, cache->composite_cache, cache->bitmap_cache
+        };
+        ass_cache_cut_shared(images, sizeof(images) / sizeof(images[0]),
+                             pressure_limit(cache->budget, pressure));
+    } else {
+        ass_cache_cut(cache->rgba_cache,
+                      pressure_limit(cache->rgba_max_size, pressure));
+        ass_cache_cut(cache->composite_cache,
+                      pressure_limit(cache->composite_max_size, pressure));
+        ass_cache_cut(cache->bitmap_cache,
+                      pressure_limit(cache->bitmap_max_size, pressure));
+    }
+    ass_cache_cut(cache->outline_cache,
+                  pressure_limit(cache->glyph_max, pressure));
+    ass_cache_cut(cache->shaped_run_cache,
+                  pressure_limit(SHAPED_RUN_CACHE_MAX_SIZE, pressure));
+}
+
+static bool cache_overgrown(Cache *cache, size_t limit)
+{
+    return ass_cache_size(cache) > limit + limit / 4;
+}
+
+/**
+ * \brief Check whether the caches have outgrown their limits by more than
+ * a quarter or memory pressure is pending, so that cutting them
+ * cannot wait for the store to become idle by itself.
  */
-static void check_cache_limits(ASS_Renderer *priv, CacheStore *cache)
+static bool cache_cut_overdue(CacheStore *cache)
 {
-    ass_cache_cut(cache->composite_cache, cache->composite_max_size);
-    ass_cache_cut(cache->bitmap_cache, cache->bitmap_max_size);
-    ass_cache_cut(cache->outline_cache, cache->glyph_max);
+    if (cache->pressure)
+        return true;
+
+    if (cache->budget) {
+        size_t size = ass_cache_size(cache->rgba_cache) +
+                      ass_cache_size(cache->composite_cache) +
+                      ass_cache_size(cache->bitmap_cache);
+        if (size > cache->budget + cache->budget / 4)
+            return true;
+    } else if (cache_overgrown(cache->rgba_cache, cache->rgba_max_size) ||
+               cache_overgrown(cache->composite_cache, cache->composite_max_size) ||
+               cache_overgrown(cache->bitmap_cache, cache->bitmap_max_size))
+        return true;
+    return cache_overgrown(cache->outline_cache, cache->glyph_max) ||
+           cache_overgrown(cache->shaped_run_cache, SHAPED_RUN_CACHE_MAX_SIZE);
 }
 
 static void setup_shaper(ASS_Shaper *shaper, ASS_Renderer *render_priv)
@@ -3897,14 +4445,39 @@ static void setup_shaper(ASS_Shaper *shaper, ASS_Renderer *render_priv)
 #endif
     ass_shaper_set_whole_text_layout(shaper,
             track->parser_priv->feature_flags & FEATURE_MASK(ASS_FEATURE_WHOLE_TEXT_LAYOUT));
+    ass_shaper_set_caches(shaper, render_priv->cache->metrics_cache,
+                          render_priv->cache->face_size_metrics_cache,
+                          render_priv->cache->shaped_run_cache);
 }
 
 /**
- * \brief Start a new frame
+ * \brief Switch to the other set of frame arenas.
+ * They hold the images of the frame before the previous one,
+ * which are not referenced anymore.
  */
-bool
-ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
-                long long now)
+static void rotate_frame_arenas(ASS_Renderer *render_priv)
+{
+    render_priv->frame_arena ^= 1;
+    ASS_Arena *arenas = render_priv->frame_arenas[render_priv->frame_arena];
+    for (int i = 0; i < MAX_RENDER_THREADS; i++) {
+        if (render_priv->arena_block_size)
+            ass_arena_reset(&arenas[i]);
+        else
+            ass_arena_done(&arenas[i]);
+    }
+
+    bool enabled = render_priv->arena_block_size;
+    render_priv->state.arena = enabled ? &arenas[0] : NULL;
+    for (int i = 0; i < render_priv->n_threads - 1; i++)
+        render_priv->thread_states[i].arena = enabled ? &arenas[i + 1] : NULL;
+}
+
+/**
+ * \brief Bring the track and the fonts up to date for rendering at now
+ * \return false if there is nothing to render
+ */
+bool ass_prepare_track(ASS_Renderer *render_priv, ASS_Track *track,
+                       long long now)
 {
     if (!render_priv->settings.frame_width
         && !render_priv->settings.frame_height)
@@ -3916,22 +4489,38 @@ ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
     if (render_priv->library != track->library)
         return false;
 
+    ass_read_stream_until(track, now);
+
     if (track->n_events == 0)
         return false;               // nothing to do
 
-    render_priv->track = track;
-    render_priv->time = now;
-    render_priv->frame_needs_rgba = false;
-
-    ass_lazy_track_init(render_priv->library, render_priv->track);
+    ass_lazy_track_init(render_priv->library, track);
 
     if (render_priv->library->num_fontdata != render_priv->num_emfonts) {
         assert(render_priv->library->num_fontdata > render_priv->num_emfonts);
         render_priv->num_emfonts = ass_update_embedded_fonts(
             render_priv->fontselect, render_priv->num_emfonts);
     }
+    return true;
+}
+
+/**
+ * \brief Start a new frame
+ */
+bool
+ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
+                long long now)
+{
+    if (!ass_prepare_track(render_priv, track, now))
+        return false;
+
+    render_priv->track = track;
+    render_priv->time = now;
+    render_priv->frame_needs_rgba = false;
 
     setup_shaper(render_priv->state.shaper, render_priv);
+    for (int i = 0; i < render_priv->n_threads - 1; i++)
+        setup_shaper(render_priv->thread_states[i].shaper, render_priv);
 
     // PAR correction
     double par = render_priv->settings.par;
@@ -3951,12 +4540,39 @@ ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track,
 
     render_priv->prev_images_root = render_priv->images_root;
     render_priv->images_root = NULL;
-
-    check_cache_limits(render_priv, &render_priv->cache);
+    rotate_frame_arenas(render_priv);
+
+    // items looked up during a frame must stay valid until it ends,
+    // so a shared store is only cut while none of its renderers is rendering.
+    // Renderers taking turns could keep it busy forever; once the caches
+    // have overgrown, new frames wait for the running ones to end instead.
+    CacheStore *store = render_priv->cache;
+    ass_mutex_lock(&store->lock);
+    if (store->active_frames && cache_cut_overdue(store))
+        store->cut_pending = true;
+    while (store->cut_pending && store->active_frames)
+        ass_cond_wait(&store->idle, &store->lock);
+    if (!store->active_frames++) {
+        ass_check_cache_limits(store);
+        store->cut_pending = false;
+    }
+    ass_mutex_unlock(&store->lock);
 
     return true;
 }
 
+/**
+ * \brief Finish the cache lookups of a frame started with ass_start_frame
+ */
+void ass_end_frame(ASS_Renderer *render_priv)
+{
+    CacheStore *store = render_priv->cache;
+    ass_mutex_lock(&store->lock);
+    if (!--store->active_frames)
+        ass_cond_broadcast(&store->idle);
+    ass_mutex_unlock(&store->lock);
+}
+
 int ass_cmp_event_layer(const void *p1, const void *p2)
 {
     ASS_Event *e1 = ((EventImages *) p1)->event;
@@ -3981,13 +4597,38 @@ static ASS_RenderPriv *get_render_priv(ASS_Renderer *render_priv,
             return NULL;
     }
     if (render_priv->render_id != event->render_priv->render_id) {
+        // compiled tags don't depend on the renderer, keep them
+        ParsedEvent *parsed = event->render_priv->parsed;
         memset(event->render_priv, 0, sizeof(ASS_RenderPriv));
         event->render_priv->render_id = render_priv->render_id;
+        event->render_priv->parsed = parsed;
     }
 
     return event->render_priv;
 }
 
+/**
+ * \brief Set up the render state of an event before renderers on other
+ * threads use it, so that they only need to read it.
+ */
+bool ass_prepare_shared_event(ASS_Renderer *render_priv, ASS_Event *event)
+{
+    ASS_RenderPriv *priv = get_render_priv(render_priv, event);
+    if (!priv)
+        return false;
+    if (!priv->memo_id)
+        priv->memo_id = ++render_priv->memo_next_id;
+    return true;
+}
+
+void ass_free_render_priv(ASS_RenderPriv *priv)
+{
+    if (!priv)
+        return;
+    ass_parsed_event_free(priv->parsed);
+    free(priv);
+}
+
 static int overlap(Rect *s1, Rect *s2)
 {
     if (s1->y0 >= s2->y1 || s2->y0 >= s1->y1 ||
@@ -4174,6 +4815,8 @@ static int ass_image_compare(ASS_Image *i1, ASS_Image *i2)
         return 2;
     if (i1->bitmap != i2->bitmap)
         return 2;
+    if (((ASS_ImagePriv *) i1)->rgba_hash != ((ASS_ImagePriv *) i2)->rgba_hash)
+        return 2;
     if (i1->dst_x != i2->dst_x)
         return 1;
     if (i1->dst_y != i2->dst_y)
@@ -4191,6 +4834,9 @@ int ass_detect_change(ASS_Renderer *priv)
     ASS_Image *img, *img2;
     int diff;
 
+    if (priv->frame_unchanged)
+        return 0;
+
     img = priv->prev_images_root;
     img2 = priv->images_root;
     diff = 0;
@@ -4218,62 +4864,603 @@ int ass_detect_change(ASS_Renderer *priv)
     return diff;
 }
 
+typedef struct {
+    ASS_Image *img;
+    int index;
+} ImageDiffEntry;
+
+static int cmp_image_identity(const ASS_Image *i1, const ASS_Image *i2)
+{
+    if (i1->bitmap != i2->bitmap)
+        return (uintptr_t) i1->bitmap < (uintptr_t) i2->bitmap ? -1 : 1;
+    uint32_t h1 = ((const ASS_ImagePriv *) i1)->rgba_hash;
+    uint32_t h2 = ((const ASS_ImagePriv *) i2)->rgba_hash;
+    int32_t v1[] = { i1->dst_x, i1->dst_y, i1->w, i1->h, i1->stride };
+    int32_t v2[] = { i2->dst_x, i2->dst_y, i2->w, i2->h, i2->stride };
+    for (int k = 0; k < sizeof(v1) / sizeof(v1[0]); k++)
+        if (v1[k] != v2[k])
+            return v1[k] < v2[k] ? -1 : 1;
+    if (i1->color != i2->color)
+        return i1->color < i2->color ? -1 : 1;
+    if (h1 != h2)
+        return h1 < h2 ? -1 : 1;
+    return 0;
+}
+
+static int cmp_diff_entry(const void *p1, const void *p2)
+{
+    const ImageDiffEntry *e1 = p1, *e2 = p2;
+    int cmp = cmp_image_identity(e1->img, e2->img);
+    if (cmp)
+        return cmp;
+    return e1->index - e2->index;
+}
+
+static void add_image_rect(ASS_Renderer *priv, const ASS_Image *img)
+{
+    ASS_DirtyRect rect = {
+        img->dst_x, img->dst_y, img->dst_x + img->w, img->dst_y + img->h
+    };
+    ass_add_dirty_rect(priv->dirty_rects, &priv->n_dirty_rects,
+                       MAX_DIRTY_RECTS, &rect);
+}
+
+static void add_list_rects(ASS_Renderer *priv, const ASS_Image *img)
+{
+    for (; img; img = img->next)
+        add_image_rect(priv, img);
+}
+
+static size_t fill_diff_entries(ImageDiffEntry *entries, ASS_Image *img)
+{
+    size_t n = 0;
+    for (; img; img = img->next, n++) {
+        entries[n].img = img;
+        entries[n].index = n;
+    }
+    return n;
+}
+
 /**
- * \brief render a frame
- * \param priv library handle
- * \param track track
- * \param now current video timestamp (ms)
- * \param detect_change a value describing how the new images differ from the previous ones will be written here:
- *        0 if identical, 1 if different positions, 2 if different content.
- *        Can be NULL, in that case no detection is performed.
+ * \brief Find the areas that changed between prev_images_root and images_root
+ * Images are matched by identity (bitmap, gradient, color and placement).
+ * Outside of the bounds of unmatched images and of matched images whose
+ * stacking order changed, both frames composite to the same pixels.
+ * \param failed the current frame could not be rendered
  */
-ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
-                            long long now, int *detect_change)
+void ass_update_dirty_rects(ASS_Renderer *priv, bool failed)
 {
-    // init frame
-    if (!ass_start_frame(priv, track, now)) {
-        if (detect_change)
-            *detect_change = 2;
-        return NULL;
+    // a failed frame is empty and leaves images_root untouched
+    priv->n_dirty_rects = 0;
+    bool prev_failed = priv->prev_frame_failed;
+    priv->prev_frame_failed = failed;
+    // nobody asked for the rects yet, don't sort the lists every frame
+    if (!priv->track_dirty_rects)
+        return;
+    if (failed || prev_failed) {
+        if (failed != prev_failed)
+            add_list_rects(priv, priv->images_root);
+        return;
     }
+    if (priv->frame_unchanged)
+        return;
 
-    // render events separately
-    int cnt = 0;
-    for (int i = 0; i < track->n_events; i++) {
-        ASS_Event *event = track->events + i;
-        if ((event->Start <= now)
-            && (now < (event->Start + event->Duration))) {
-            if (cnt >= priv->eimg_size) {
-                priv->eimg_size += 100;
-                priv->eimg =
-                    realloc(priv->eimg,
-                            priv->eimg_size * sizeof(EventImages));
-            }
-            if (ass_render_event(&priv->state, event, priv->eimg + cnt, NULL)) {
-                priv->frame_needs_rgba |= priv->eimg[cnt].needs_rgba;
-                cnt++;
+    size_t n_prev = 0, n_cur = 0;
+    for (ASS_Image *img = priv->prev_images_root; img; img = img->next)
+        n_prev++;
+    for (ASS_Image *img = priv->images_root; img; img = img->next)
+        n_cur++;
+
+    size_t size = (n_prev + n_cur) * sizeof(ImageDiffEntry) + n_cur * sizeof(int);
+    if (size > priv->diff_buf_size) {
+        void *buf = realloc(priv->diff_buf, size);
+        if (!buf) {
+            add_list_rects(priv, priv->prev_images_root);
+            add_list_rects(priv, priv->images_root);
+            return;
+        }
+        priv->diff_buf = buf;
+        priv->diff_buf_size = size;
+    }
+    ImageDiffEntry *prev = priv->diff_buf, *cur = prev + n_prev;
+    int *match = (int *) (cur + n_cur);
+
+    fill_diff_entries(prev, priv->prev_images_root);
+    fill_diff_entries(cur, priv->images_root);
+    qsort(prev, n_prev, sizeof(ImageDiffEntry), cmp_diff_entry);
+    qsort(cur, n_cur, sizeof(ImageDiffEntry), cmp_diff_entry);
+
+    // pair up equal images, in list order among duplicates
+    size_t i = 0, j = 0;
+    while (i < n_prev || j < n_cur) {
+        int cmp = i == n_prev ? 1 : j == n_cur ? -1 :
+            cmp_image_identity(prev[i].img, cur[j].img);
+        if (cmp < 0) {
+            add_image_rect(priv, prev[i++].img);
+        } else if (cmp > 0) {
+            match[cur[j].index] = -1;
+            j++;
+        } else {
+            match[cur[j++].index] = prev[i++].index;
+        }
+    }
+
+    // new images and images moved below others they were above
+    int max_index = -1, k = 0;
+    for (ASS_Image *img = priv->images_root; img; img = img->next, k++) {
+        if (match[k] < 0 || match[k] < max_index)
+            add_image_rect(priv, img);
+        else
+            max_index = match[k];
+    }
+}
+
+typedef struct {
+    ASS_Renderer *priv;
+    bool rgba;
+    bool threaded;  // lock is initialized and may be contended
+    int n_events;
+    int next;       // index of the next slot to render, guarded by lock
+    ASS_Mutex lock;
+} RenderJob;
+
+/**
+ * \brief Remember the frame times over which the event looks as it was
+ * just rendered, see ass_next_change().
+ */
+static void record_event_change(RenderContext *state, ASS_Event *event)
+{
+    ASS_RenderPriv *rp = get_render_priv(state->renderer, event);
+    if (!rp)
+        return;
+    rp->same_since = state->time_dependent ? state->renderer->time : event->Start;
+    rp->same_until = state->next_change == LLONG_MAX ? LLONG_MAX :
+                     event->Start + state->next_change;
+}
+
+// Render queued events into their eimg slots until the queue is drained.
+// Slots reused from event memos are skipped, slots of events that
+// produced nothing get their event reset to NULL.
+static void render_worker(RenderJob *job, RenderContext *state)
+{
+    while (true) {
+        if (job->threaded)
+            ass_mutex_lock(&job->lock);
+        int i = job->next++;
+        if (job->threaded)
+            ass_mutex_unlock(&job->lock);
+        if (i >= job->n_events)
+            break;
+
+        EventImages *slot = job->priv->eimg + i;
+        if (slot->reused)
+            continue;
+        ASS_Event *event = slot->event;
+        if (!ass_render_event(state, event, slot,
+                              job->rgba ? &slot->imgs_rgba : NULL))
+            slot->event = NULL;
+        // events are shared between batch workers, see ass_render_frames_batch()
+        if (!job->priv->batch_worker)
+            record_event_change(state, event);
+    }
+}
+
+static void render_worker_thread(void *arg, int index)
+{
+    RenderJob *job = arg;
+    render_worker(job, &job->priv->thread_states[index - 1]);
+}
+
+/**
+ * \brief Render the events queued in priv->eimg.
+ * With more than one thread, the calling thread works on the queue
+ * alongside the threads of the renderer's pool. Every event keeps its slot,
+ * so the result matches serial rendering.
+ * \param n_pending number of queued events that are not reused
+ */
+static void render_queued_events(ASS_Renderer *priv, int n_events,
+                                 int n_pending, bool rgba)
+{
+    RenderJob job = {
+        .priv = priv,
+        .rgba = rgba,
+        .n_events = n_events,
+    };
+
+    int n_helpers = FFMIN(priv->n_threads, n_pending) - 1;
+    if (n_helpers > 0)
+        job.threaded = ass_mutex_init(&job.lock, false);
+    if (job.threaded)
+        ass_thread_pool_start(priv->thread_pool, render_worker_thread,
+                              &job, n_helpers);
+
+    render_worker(&job, &priv->state);
+
+    if (job.threaded) {
+        ass_thread_pool_wait(priv->thread_pool);
+        ass_mutex_destroy(&job.lock);
+    }
+}
+
+/**
+ * \brief Copy an image list, taking new references to its cached bitmaps
+ * and to the buffers owned by the images themselves.
+ * \param state context whose frame arena receives the copies,
+ * NULL to allocate them with malloc
+ */
+static bool clone_images(ASS_Renderer *priv, RenderContext *state,
+                         ASS_Image *src, ASS_Image **dst)
+{
+    ASS_Arena *arena = state ? state->arena : NULL;
+    ASS_Image *head = NULL, **tail = &head;
+    for (; src; src = src->next) {
+        ASS_ImagePriv *src_priv = (ASS_ImagePriv *) src;
+        ASS_ImagePriv *img = arena ?
+            ass_arena_alloc(arena, sizeof(ASS_ImagePriv), ASS_ARENA_ALIGN) :
+            malloc(sizeof(ASS_ImagePriv));
+        if (!img)
+            goto fail;
+        *img = *src_priv;
+        img->result.next = NULL;
+        img->ref_count = 0;
+        img->in_arena = arena;
+        ass_image_buffer_ref(img->buffer);
+        ass_cache_inc_ref(img->source);
+        *tail = &img->result;
+        tail = &img->result.next;
+    }
+    *dst = head;
+    return true;
+
+fail:
+    if (head) {
+        ((ASS_ImagePriv *) head)->ref_count = 1;
+        ass_frame_unref(head);
+    }
+    return false;
+}
+
+/**
+ * \brief Copy an RGBA image list like clone_images().
+ * Pixels in a frame arena are copied into a buffer of the copy,
+ * since the arena is reset two frames later.
+ */
+static bool clone_images_rgba(ASS_Renderer *priv, RenderContext *state,
+                              ASS_ImageRGBA *src, ASS_ImageRGBA **dst)
+{
+    ASS_Arena *arena = state ? state->arena : NULL;
+    size_t align = 1 << priv->engine.align_order;
+    ASS_ImageRGBA *head = NULL, **tail = &head;
+    for (; src; src = src->next) {
+        ASS_ImageRGBAPriv *src_priv = (ASS_ImageRGBAPriv *) src;
+        ASS_ImageRGBAPriv *img = arena ?
+            ass_arena_alloc(arena, sizeof(ASS_ImageRGBAPriv), ASS_ARENA_ALIGN) :
+            malloc(sizeof(ASS_ImageRGBAPriv));
+        if (!img)
+            goto fail;
+        *img = *src_priv;
+        img->result.next = NULL;
+        img->in_arena = arena;
+        if (!src_priv->source && !src_priv->buffer) {
+            size_t size = (size_t) src->stride * src->h;
+            uint8_t *rgba = ass_image_buffer_alloc(align, size + align);
+            if (!rgba) {
+                if (!arena)
+                    free(img);
+                goto fail;
             }
+            memcpy(rgba, src->rgba, size);
+            img->result.rgba = rgba;
+            img->buffer = rgba;
+        } else
+            ass_image_buffer_ref(img->buffer);
+        ass_cache_inc_ref(img->source);
+        *tail = &img->result;
+        tail = &img->result.next;
+    }
+    *dst = head;
+    return true;
+
+fail:
+    ass_free_images_rgba(head);
+    return false;
+}
+
+static bool clone_event_images(ASS_Renderer *priv, RenderContext *state,
+                               const EventImages *src, EventImages *dst)
+{
+    *dst = *src;
+    if (!clone_images(priv, state, src->imgs, &dst->imgs))
+        return false;
+    if (!clone_images_rgba(priv, state, src->imgs_rgba, &dst->imgs_rgba)) {
+        if (dst->imgs) {
+            ((ASS_ImagePriv *) dst->imgs)->ref_count = 1;
+            ass_frame_unref(dst->imgs);
+        }
+        return false;
+    }
+    return true;
+}
+
+static void free_event_memo(EventMemo *memo)
+{
+    free(memo->text);
+    if (memo->images.imgs) {
+        ((ASS_ImagePriv *) memo->images.imgs)->ref_count = 1;
+        ass_frame_unref(memo->images.imgs);
+    }
+    ass_free_images_rgba(memo->images.imgs_rgba);
+}
+
+/**
+ * \brief Drop all event memos.
+ * Must be called before the cache store holding their bitmaps goes away.
+ */
+void ass_reset_event_memos(ASS_Renderer *priv)
+{
+    for (int i = 0; i < priv->n_memos; i++)
+        free_event_memo(&priv->memos[i]);
+    priv->n_memos = 0;
+    priv->prev_frame_events = -1;
+    priv->prev_frame_memoized = false;
+}
+
+static EventMemo *find_event_memo(ASS_Renderer *priv, ASS_RenderPriv *rp)
+{
+    if (rp->memo_slot < priv->n_memos &&
+            priv->memos[rp->memo_slot].id == rp->memo_id)
+        return &priv->memos[rp->memo_slot];
+    for (int i = 0; i < priv->n_memos; i++) {
+        if (priv->memos[i].id == rp->memo_id) {
+            if (!priv->batch_worker)
+                rp->memo_slot = i;
+            return &priv->memos[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * \brief Start a new frame of event memos.
+ * Memos are dropped whenever any frame-global render input has changed.
+ */
+static void begin_event_memos(ASS_Renderer *priv, ASS_Track *track, bool rgba)
+{
+    EventMemoKey key;
+    memset(&key, 0, sizeof(key));
+    key.settings = priv->settings;
+    key.track = track;
+    key.render_id = priv->render_id;
+    key.feature_flags = track->parser_priv->feature_flags;
+    key.num_emfonts = priv->num_emfonts;
+    key.par_scale_x = priv->par_scale_x;
+    key.rgba = rgba;
+    if (memcmp(&key, &priv->memo_key, sizeof(key))) {
+        ass_reset_event_memos(priv);
+        priv->memo_key = key;
+    }
+    priv->frame_serial++;
+    priv->frame_unchanged = false;
+}
+
+/**
+ * \brief Fill the slot with the memoized images of the event, if any.
+ */
+static bool reuse_event_memo(ASS_Renderer *priv, ASS_Event *event,
+                             EventImages *slot)
+{
+    ASS_RenderPriv *rp = get_render_priv(priv, event);
+    if (!rp)
+        return false;
+    if (!rp->memo_id)
+        rp->memo_id = ++priv->memo_next_id;
+
+    EventMemo *memo = find_event_memo(priv, rp);
+    if (!memo || !event->Text || strcmp(memo->text, event->Text))
+        return false;
+    if (!clone_event_images(priv, &priv->state, &memo->images, slot))
+        return false;
+    slot->event = event;
+    slot->reused = true;
+    memo->frame = priv->frame_serial;
+    return true;
+}
+
+/**
+ * \brief Remember the images of a freshly rendered static event.
+ */
+static bool add_event_memo(ASS_Renderer *priv, const EventImages *slot)
+{
+    ASS_RenderPriv *rp = slot->event->render_priv;
+    if (!rp || !rp->memo_id || !slot->event->Text)
+        return false;
+
+    EventMemo memo = {
+        .id = rp->memo_id,
+        .frame = priv->frame_serial,
+    };
+    memo.text = strdup(slot->event->Text);
+    if (!memo.text)
+        return false;
+    if (!clone_event_images(priv, NULL, slot, &memo.images)) {
+        free(memo.text);
+        return false;
+    }
+    memo.images.event = NULL;
+
+    EventMemo *old = find_event_memo(priv, rp);
+    if (old) {
+        free_event_memo(old);
+        *old = memo;
+        return true;
+    }
+    if (priv->n_memos >= priv->max_memos) {
+        int max_memos = FFMAX(2 * priv->max_memos, 16);
+        if (!ASS_REALLOC_ARRAY(priv->memos, max_memos)) {
+            free_event_memo(&memo);
+            return false;
         }
+        priv->max_memos = max_memos;
     }
+    if (!priv->batch_worker)
+        rp->memo_slot = priv->n_memos;
+    priv->memos[priv->n_memos++] = memo;
+    return true;
+}
 
-    // sort by layer
-    if (cnt > 0)
-        qsort(priv->eimg, cnt, sizeof(EventImages), ass_cmp_event_layer);
+/**
+ * \brief Drop memos of events that were not displayed in this frame
+ * and record whether the frame repeats the previous one.
+ */
+static void end_event_memos(ASS_Renderer *priv, int n_events,
+                            bool all_reused, bool all_memoized)
+{
+    int n = 0;
+    for (int i = 0; i < priv->n_memos; i++) {
+        if (priv->memos[i].frame == priv->frame_serial)
+            priv->memos[n++] = priv->memos[i];
+        else
+            free_event_memo(&priv->memos[i]);
+    }
+    priv->n_memos = n;
+
+    // Every memo was created or used in the previous frame. If that frame
+    // had all of its events memoized and this one reused as many memos,
+    // both frames consist of exactly the same images.
+    priv->frame_unchanged = all_reused && priv->prev_frame_memoized &&
+                            n_events == priv->prev_frame_events;
+    priv->prev_frame_events = n_events;
+    priv->prev_frame_memoized = all_memoized;
+}
+
+static int find_active_events(ASS_Renderer *priv, ASS_Track *track,
+                              long long now, const int **ids)
+{
+    if (track->n_events > priv->max_active_ids) {
+        int max_ids = FFMAX(track->n_events, 2 * priv->max_active_ids);
+        if (!ASS_REALLOC_ARRAY(priv->active_ids, max_ids))
+            return -1;
+        priv->max_active_ids = max_ids;
+    }
+    return ass_find_active_events(track, now, priv->active_ids, ids);
+}
+
+/**
+ * \brief Render all events active at the given time into priv->eimg
+ * Static events whose images are memoized from the previous frame
+ * are copied instead of being rendered again.
+ * \param rgba also produce RGBA image lists
+ * \return number of rendered events
+ */
+int ass_render_active_events(ASS_Renderer *priv, ASS_Track *track,
+                             long long now, bool rgba)
+{
+    const int *ids;
+    int n_active = find_active_events(priv, track, now, &ids);
+    // fall back to a full scan if the time index is unavailable
+    bool scan = n_active < 0;
+    int n = scan ? track->n_events : n_active;
+
+    begin_event_memos(priv, track, rgba);
+
+    int queued = 0, pending = 0;
+    for (int i = 0; i < n; i++) {
+        ASS_Event *event = track->events + (scan ? i : ids[i]);
+        if (scan && !(event->Start <= now &&
+                      now < event->Start + event->Duration))
+            continue;
+        if (queued >= priv->eimg_size) {
+            EventImages *eimg = realloc(priv->eimg,
+                (priv->eimg_size + 100) * sizeof(EventImages));
+            if (!eimg)
+                break;
+            priv->eimg = eimg;
+            priv->eimg_size += 100;
+        }
+        EventImages *slot = priv->eimg + queued++;
+        if (reuse_event_memo(priv, event, slot)) {
+            priv->stats.events_reused++;
+            continue;
+        }
+        slot->event = event;
+        slot->reused = false;
+        pending++;
+    }
+
+    if (pending)
+        render_queued_events(priv, queued, pending, rgba);
+
+    int cnt = 0;
+    bool all_reused = !pending, all_memoized = true;
+    for (int i = 0; i < queued; i++) {
+        EventImages *slot = priv->eimg + i;
+        if (!slot->event)
+            continue;
+        if (!slot->reused &&
+                !(slot->is_static && add_event_memo(priv, slot)))
+            all_memoized = false;
+        priv->frame_needs_rgba |= slot->needs_rgba;
+        priv->eimg[cnt++] = *slot;
+    }
+    end_event_memos(priv, cnt, all_reused, all_memoized);
+    priv->stats.frames++;
+    return cnt;
+}
+
+static void collect_context_stats(ASS_Renderer *priv, RenderContext *state)
+{
+    for (int i = 0; i < ASS_STAGE_COUNT; i++)
+        priv->stats.stage_ns[i] += state->stage_ns[i];
+    memset(state->stage_ns, 0, sizeof(state->stage_ns));
+    priv->stats.events_rendered += state->events_rendered;
+    state->events_rendered = 0;
+}
+
+/**
+ * \brief Move the counters of all render contexts into priv->stats
+ */
+void ass_collect_stats(ASS_Renderer *priv)
+{
+    collect_context_stats(priv, &priv->state);
+    for (int i = 0; i < priv->n_threads - 1; i++)
+        collect_context_stats(priv, &priv->thread_states[i]);
+}
+
+/**
+ * \brief Sort rendered events by layer and resolve collisions
+ * within each layer
+ */
+void ass_layout_events(ASS_Renderer *render_priv, EventImages *imgs, int cnt)
+{
+    if (cnt <= 0)
+        return;
+    qsort(imgs, cnt, sizeof(EventImages), ass_cmp_event_layer);
 
     // call fix_collisions for each group of events with the same layer
-    EventImages *last = priv->eimg;
+    EventImages *last = imgs;
     for (int i = 1; i < cnt; i++)
-        if (last->event->Layer != priv->eimg[i].event->Layer) {
-            ass_fix_collisions(priv, last, priv->eimg + i - last);
-            last = priv->eimg + i;
+        if (last->event->Layer != imgs[i].event->Layer) {
+            ass_fix_collisions(render_priv, last, imgs + i - last);
+            last = imgs + i;
         }
-    if (cnt > 0)
-        ass_fix_collisions(priv, last, priv->eimg + cnt - last);
+    ass_fix_collisions(render_priv, last, imgs + cnt - last);
+}
+
+/**
+ * \brief Lay out rendered events and make their images the current frame,
+ * releasing the previous one
+ * \param imgs rendered events, their image lists are taken over
+ * \return images_root
+ */
+ASS_Image *ass_compose_frame(ASS_Renderer *priv, EventImages *imgs, int cnt,
+                             int *detect_change)
+{
+    ass_layout_events(priv, imgs, cnt);
 
     // concat lists
     ASS_Image **tail = &priv->images_root;
     for (int i = 0; i < cnt; i++) {
-        ASS_Image *cur = priv->eimg[i].imgs;
+        ASS_Image *cur = imgs[i].imgs;
         while (cur) {
             *tail = cur;
             tail = &cur->next;
@@ -4284,17 +5471,70 @@ ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
 
     if (detect_change)
         *detect_change = ass_detect_change(priv);
+    ass_update_dirty_rects(priv, false);
 
     // free the previous image list
     ass_frame_unref(priv->prev_images_root);
     priv->prev_images_root = NULL;
 
+    return priv->images_root;
+}
+
+/**
+ * \brief render a frame
+ * \param priv library handle
+ * \param track track
+ * \param now current video timestamp (ms)
+ * \param detect_change a value describing how the new images differ from the previous ones will be written here:
+ *        0 if identical, 1 if different positions, 2 if different content.
+ *        Can be NULL, in that case no detection is performed.
+ */
+ASS_Image *ass_render_frame(ASS_Renderer *priv, ASS_Track *track,
+                            long long now, int *detect_change)
+{
+    // init frame
+    if (!ass_start_frame(priv, track, now)) {
+        if (detect_change)
+            *detect_change = 2;
+        ass_update_dirty_rects(priv, true);
+        return NULL;
+    }
+
+    // render events separately
+    int cnt = ass_render_active_events(priv, track, now, false);
+    ass_end_frame(priv);
+
+    ass_compose_frame(priv, priv->eimg, cnt, detect_change);
+
     if (track->parser_priv->prune_delay >= 0)
         ass_prune_events(track, now - track->parser_priv->prune_delay);
 
     return priv->images_root;
 }
 
+long long ass_next_change(ASS_Renderer *priv, ASS_Track *track, long long now)
+{
+    if (priv->library != track->library)
+        return now + 1;
+    ass_read_stream_until(track, now);
+
+    long long next = ass_find_next_event_start(track, now);
+    const int *ids;
+    int n_active = find_active_events(priv, track, now, &ids);
+    if (n_active < 0)
+        return now + 1;
+    for (int i = 0; i < n_active; i++) {
+        ASS_Event *event = track->events + ids[i];
+        ASS_RenderPriv *rp = event->render_priv;
+        if (!rp || rp->render_id != priv->render_id ||
+                now < rp->same_since || now >= rp->same_until)
+            return now + 1;     // not rendered with the look it has at now
+        next = FFMIN(next, rp->same_until);
+        next = FFMIN(next, event->Start + event->Duration);
+    }
+    return next;
+}
+
 /**
  * \brief Add reference to a frame image list.
  * \param image_list image list returned by ass_render_frame()
@@ -4318,7 +5558,8 @@ void ass_frame_unref(ASS_Image *img)
         ASS_ImagePriv *priv = (ASS_ImagePriv *) img;
         img = img->next;
         ass_cache_dec_ref(priv->source);
-        ass_aligned_free(priv->buffer);
-        free(priv);
+        ass_image_buffer_unref(priv->buffer);
+        if (!priv->in_arena)
+            free(priv);
     } while (img);
 }
@@ -32,6 +32,7 @@
 #include "ass.h"
 #include "ass_font.h"
 #include "ass_bitmap.h"
+#include "ass_arena.h"
 #include "ass_cache.h"
 #include "ass_utils.h"
 #include "ass_fontselect.h"
@@ -40,15 +41,21 @@
 #include "ass_bitmap.h"
 #include "ass_rasterizer.h"
 #include "gradient.h"
+#include "ass_threading.h"
+#include "ass_threadpool.h"
 
 #define cmp_event_layer ass_cmp_event_layer
 #define fix_collisions ass_fix_collisions
 
 #define GLYPH_CACHE_MAX 10000
 #define MEGABYTE (1024 * 1024)
+#define SHAPED_RUN_CACHE_MAX_SIZE (4 * MEGABYTE)
 #define BITMAP_CACHE_MAX_SIZE (128 * MEGABYTE)
 #define COMPOSITE_CACHE_RATIO 2
 #define COMPOSITE_CACHE_MAX_SIZE (BITMAP_CACHE_MAX_SIZE / COMPOSITE_CACHE_RATIO)
+#define RGBA_CACHE_MAX_SIZE COMPOSITE_CACHE_MAX_SIZE
+#define MAX_RENDER_THREADS 64
+#define MAX_DIRTY_RECTS 64
 
 #define PARSED_FADE (1<<0)
 #define PARSED_A    (1<<1)
@@ -56,10 +63,19 @@
 typedef struct {
     ASS_Image result;
     CompositeHashValue *source;
-    unsigned char *buffer;
+    unsigned char *buffer;      // pixels owned by the image, see ass_image_buffer_alloc()
     size_t ref_count;
+    uint32_t rgba_hash;         // gradient of the matching RGBA image, 0 if none
+    bool in_arena;              // allocated from a frame arena
 } ASS_ImagePriv;
 
+typedef struct {
+    ASS_ImageRGBA result;
+    RGBAHashValue *source;      // cached pixels, NULL if the image owns buffer
+    uint8_t *buffer;            // image buffer, NULL for cached pixels and arena memory
+    bool in_arena;              // allocated from a frame arena
+} ASS_ImageRGBAPriv;
+
 typedef struct {
     int frame_width;
     int frame_height;
@@ -77,6 +93,7 @@ typedef struct {
     double par;                 // user defined pixel aspect ratio (0 = unset)
     ASS_Hinting hinting;
     ASS_ShapingLevel shaper;
+    ASS_BorderEngine border_engine;
     int selective_style_overrides; // ASS_OVERRIDE_* flags
 
     char *default_font;
@@ -92,6 +109,8 @@ typedef struct {
     int shift_direction;
     ASS_Event *event;
     bool needs_rgba;
+    bool is_static;             // images do not depend on the frame time
+    bool reused;                // images were copied from an event memo
 } EventImages;
 
 typedef enum {
@@ -282,15 +301,22 @@ typedef struct {
 
 #include "ass_shaper.h"
 
+// Compiled override tags of an event, see ass_parse.c
+typedef struct parsed_tag ParsedTag;
+typedef struct parsed_block ParsedBlock;
+typedef struct parsed_event ParsedEvent;
+
 // Renderer state.
 // Values like current font face, color, screen position, clipping and so on are stored here.
 struct render_context {
     ASS_Renderer *renderer;
+    ASS_Arena *arena;           // frame output allocations, NULL to use malloc
     TextInfo text_info;
     ASS_Shaper *shaper;
     RasterizerData rasterizer;
 
     ASS_Event *event;
+    ParsedEvent *parsed;
     ASS_Style *style;
 
     ASS_Font *font;
@@ -321,6 +347,9 @@ struct render_context {
     uint32_t c[4];              // colors(Primary, Secondary, so on) in RGBA
     GradientState gradient;
     bool needs_rgba;
+    bool time_dependent;        // the frame time was used, see ass_event_time()
+    long long next_change;      // event time from which it may look different,
+                                // see ass_event_change_at()
     int clip_x0, clip_y0, clip_x1, clip_y1;
     char have_origin;           // origin is explicitly defined; if 0, get_base_point() is used
     char clip_mode;             // 1 = iclip
@@ -380,22 +409,66 @@ struct render_context {
     double border_scale_y;
     double blur_scale_x;
     double blur_scale_y;
+
+    // time spent per ASS_RenderStage since the end of the last frame,
+    // see ass_enter_stage()
+    int64_t stage_ns[ASS_STAGE_COUNT];
+    int stage;                  // current stage, STAGE_NONE outside events
+    int64_t stage_start;
+    unsigned events_rendered;
 };
 
 typedef struct render_context RenderContext;
+typedef struct atlas ASS_Atlas;
 
-typedef struct {
+typedef struct ass_cache_store {
     Cache *font_cache;
     Cache *outline_cache;
     Cache *bitmap_cache;
     Cache *composite_cache;
+    Cache *rgba_cache;
     Cache *face_size_metrics_cache;
     Cache *metrics_cache;
+    Cache *shaped_run_cache;
     size_t glyph_max;
     size_t bitmap_max_size;
     size_t composite_max_size;
+    size_t rgba_max_size;
+    size_t budget;          // shared by the image caches, 0 to use the limits above
+    int pressure;           // pending ASS_MemoryPressure level, 0 if none
+
+    // A store is either private to one renderer or shared between several,
+    // see ass_cache_store_init(). Shared stores open all font faces with
+    // their own FreeType library, so fonts outlive the renderer that loaded them.
+    bool shared;
+    FT_Library ftlibrary;   // NULL for private stores
+    ASS_Mutex font_lock;    // serializes FreeType, font selection and shaping
+    ASS_Mutex lock;         // guards ref_count, active_frames and cut_pending
+    ASS_Cond idle;          // signaled when active_frames drops to 0
+    int ref_count;
+    int active_frames;      // renderers between ass_start_frame and ass_end_frame
+    bool cut_pending;       // new frames wait for a cut of overgrown caches
 } CacheStore;
 
+// Frame-global render inputs; event memos stay valid while these are unchanged
+typedef struct {
+    ASS_Settings settings;
+    ASS_Track *track;
+    int render_id;
+    uint32_t feature_flags;
+    size_t num_emfonts;
+    double par_scale_x;
+    bool rgba;
+} EventMemoKey;
+
+// Images of a static event, reused in the following frames
+typedef struct {
+    uint64_t id;                // RenderPriv.memo_id of the event
+    char *text;                 // event text the images were rendered from
+    EventImages images;         // placement before collision handling
+    unsigned frame;             // serial of the last frame that used the memo
+} EventMemo;
+
 struct ass_renderer {
     ASS_Library *library;
     FT_Library ftlibrary;
@@ -408,8 +481,18 @@ struct ass_renderer {
     ASS_Image *images_root;     // rendering result is stored here
     ASS_Image *prev_images_root;
 
+    // areas that differ between the two last frames
+    ASS_DirtyRect dirty_rects[MAX_DIRTY_RECTS];
+    int n_dirty_rects;
+    bool prev_frame_failed;     // last frame was empty due to failure
+    bool track_dirty_rects;     // set by the first ass_get_changed_rects()
+    void *diff_buf;             // scratch space for image list comparison
+    size_t diff_buf_size;
+
     EventImages *eimg;          // temporary buffer for sorting rendered events
     int eimg_size;              // allocated buffer size
+    int *active_ids;            // events active in the current frame
+    int max_active_ids;
 
     // frame-global data
     int width, height;          // screen dimensions (the whole frame from ass_set_frame_size)
@@ -422,16 +505,109 @@ struct ass_renderer {
     double par_scale_x;        // x scale applied to all glyphs to preserve text aspect ratio
 
     RenderContext state;
-    CacheStore cache;
+    CacheStore *cache;
+
+    // parallel event rendering, see ass_set_threads()
+    int n_threads;
+    ASS_ThreadPool *thread_pool;    // n_threads - 1 worker threads
+    RenderContext *thread_states;   // their contexts
+
+    // frame output arenas, see ass_set_frame_arena(); one set is in use
+    // by the current frame, the other one holds the previous frame
+    size_t arena_block_size;    // 0 if arenas are disabled
+    int frame_arena;
+    ASS_Arena frame_arenas[2][MAX_RENDER_THREADS];
+
+    // reuse of static event images between frames
+    EventMemoKey memo_key;
+    EventMemo *memos;
+    int n_memos, max_memos;
+    uint64_t memo_next_id;
+    unsigned frame_serial;
+    int prev_frame_events;      // events rendered in the previous frame, -1 if unknown
+    bool prev_frame_memoized;   // all of them have memos
+    bool frame_unchanged;       // current frame reused all events of the previous one
 
     BitmapEngine engine;
 
+    ASS_Atlas *atlas;           // see ass_render_frame_atlas(), NULL until used
+    ASS_RendererStats stats;    // pipeline counters, see ass_renderer_get_stats()
+    bool time_stages;           // set by the first ass_renderer_get_stats()
+    bool batch_worker;          // renders in parallel with other renderers
+                                // sharing its track, see ass_render_frames_batch()
+
     ASS_Style user_override_style;
 };
 
+#define STAGE_NONE ASS_STAGE_COUNT
+
+/**
+ * \brief Charge the time since the last stage change to the current stage
+ * and switch to another one, see ass_renderer_get_stats().
+ * The clock is only read once stage timing has been requested.
+ * \return previous stage, to be restored after nested work
+ */
+static inline int ass_enter_stage(RenderContext *state, int stage)
+{
+    int prev = state->stage;
+    state->stage = stage;
+    if (!state->renderer->time_stages)
+        return prev;
+
+    int64_t now = ass_time_ns();
+    if (prev != STAGE_NONE)
+        state->stage_ns[prev] += now - state->stage_start;
+    state->stage_start = now;
+    return prev;
+}
+
+/**
+ * \brief Time elapsed since the start of the event being rendered.
+ * Marks the event as time-dependent, so its images are not reused
+ * in later frames.
+ */
+static inline long long ass_event_time(RenderContext *state)
+{
+    state->time_dependent = true;
+    return state->renderer->time - state->event->Start;
+}
+
+/**
+ * \brief Note that the event may look different from time t on,
+ * relative to its start. Every value derived from ass_event_time()
+ * must be accounted for, see ass_next_change().
+ */
+static inline void ass_event_change_at(RenderContext *state, long long t)
+{
+    long long now = state->renderer->time - state->event->Start;
+    if (t <= now)
+        t = now + 1;
+    if (t < state->event->Duration && t < state->next_change)
+        state->next_change = t;
+}
+
+/**
+ * \brief Note that a value of the event is animated from t1 to t2,
+ * relative to its start, and constant before and after.
+ */
+static inline void ass_event_animate(RenderContext *state,
+                                     long long t1, long long t2)
+{
+    long long now = state->renderer->time - state->event->Start;
+    if (now < t1)
+        ass_event_change_at(state, t1);
+    else if (now < t2)
+        ass_event_change_at(state, now + 1);
+}
+
 typedef struct render_priv {
     int top, height, left, width;
     int render_id;
+    ParsedEvent *parsed;
+    uint64_t memo_id;           // 0 until the event is looked up in the memos
+    int memo_slot;              // last known index in ASS_Renderer.memos
+    // frame times over which the event looks as in its last rendering
+    long long same_since, same_until;
 } RenderPriv;
 
 typedef struct {
@@ -441,16 +617,47 @@ typedef struct {
     int y1;
 } Rect;
 
+bool ass_render_context_init(RenderContext *state, ASS_Renderer *priv);
+void ass_render_context_done(RenderContext *state);
 void ass_reset_render_context(RenderContext *state, ASS_Style *style);
 void ass_frame_ref(ASS_Image *img);
 void ass_frame_unref(ASS_Image *img);
+void ass_solid_rgba_params(GradientRGBAParams *param, uint32_t color);
+ASS_ImageRGBA *ass_image_rgba_new(RenderContext *state, CompositeHashValue *source,
+                                  const uint8_t *mask, int w, int h, int stride,
+                                  const GradientRGBAParams *param,
+                                  int dst_x, int dst_y, int type);
+void *ass_image_buffer_alloc(size_t align, size_t size);
+void *ass_image_buffer_ref(void *buffer);
+void ass_image_buffer_unref(void *buffer);
+uint8_t *ass_image_rgba_alloc(RenderContext *state, size_t size, bool *owned);
+void ass_image_rgba_set_buffer(ASS_ImageRGBA *img, uint8_t *rgba, bool owned);
 ASS_Vector ass_layout_res(ASS_Renderer *render_priv);
 bool ass_render_event(RenderContext *state, ASS_Event *event,
                       EventImages *event_images, ASS_ImageRGBA **rgba_out);
+bool ass_prepare_track(ASS_Renderer *render_priv, ASS_Track *track, long long now);
 bool ass_start_frame(ASS_Renderer *render_priv, ASS_Track *track, long long now);
+void ass_end_frame(ASS_Renderer *render_priv);
+CacheStore *ass_cache_store_create(void);
+void ass_check_cache_limits(CacheStore *cache);
+void ass_cache_store_ref(CacheStore *store);
+void ass_cache_store_release(CacheStore *store);
+void ass_cache_store_flush_fonts(ASS_Renderer *priv);
+void ass_cache_store_detach(ASS_Renderer *priv);
+int ass_render_active_events(ASS_Renderer *priv, ASS_Track *track,
+                             long long now, bool rgba);
 int ass_cmp_event_layer(const void *p1, const void *p2);
+bool ass_prepare_shared_event(ASS_Renderer *render_priv, ASS_Event *event);
 void ass_fix_collisions(ASS_Renderer *render_priv, EventImages *imgs, int cnt);
+void ass_layout_events(ASS_Renderer *render_priv, EventImages *imgs, int cnt);
+ASS_Image *ass_compose_frame(ASS_Renderer *priv, EventImages *imgs, int cnt,
+                             int *detect_change);
 int ass_detect_change(ASS_Renderer *priv);
+void ass_update_dirty_rects(ASS_Renderer *priv, bool failed);
+void ass_reset_event_memos(ASS_Renderer *priv);
+void ass_collect_stats(ASS_Renderer *priv);
+void ass_atlas_free(ASS_Atlas *atlas);
+void ass_free_render_priv(ASS_RenderPriv *priv);
 
 // XXX: this is actually in ass.c, includes should be fixed later on
 void ass_lazy_track_init(ASS_Library *lib, ASS_Track *track);
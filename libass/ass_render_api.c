@@ -31,9 +31,16 @@ static void ass_reconfigure(ASS_Renderer *priv)
     ASS_Settings *settings = &priv->settings;
 
     priv->render_id++;
-    ass_cache_empty(priv->cache.composite_cache);
-    ass_cache_empty(priv->cache.bitmap_cache);
-    ass_cache_empty(priv->cache.outline_cache);
+    // Entries of a shared store may still be useful to other renderers.
+    // Their keys hold every setting their construction depends on
+    // (e.g. hinting for glyph outlines), so stale ones are just never hit
+    // again and age out of the caches.
+    if (!priv->cache->shared) {
+        ass_cache_empty(priv->cache->rgba_cache);
+        ass_cache_empty(priv->cache->composite_cache);
+        ass_cache_empty(priv->cache->bitmap_cache);
+        ass_cache_empty(priv->cache->outline_cache);
+    }
 
     priv->width = settings->frame_width;
     priv->height = settings->frame_height;
@@ -85,6 +92,14 @@ void ass_set_shaper(ASS_Renderer *priv, ASS_ShapingLevel level)
         priv->settings.shaper = ASS_SHAPING_COMPLEX;
 }
 
+void ass_set_border_engine(ASS_Renderer *priv, ASS_BorderEngine engine)
+{
+    if (engine == ASS_BORDER_AUTO || engine == ASS_BORDER_DISTANCE)
+        priv->settings.border_engine = engine;
+    else
+        priv->settings.border_engine = ASS_BORDER_STROKER;
+}
+
 void ass_set_margins(ASS_Renderer *priv, int t, int b, int l, int r)
 {
     if (priv->settings.left_margin != l || priv->settings.right_margin != r ||
@@ -156,9 +171,7 @@ void ass_set_fonts(ASS_Renderer *priv, const char *default_font,
         default_family ? strdup(default_family) : 0;
 
     ass_reconfigure(priv);
-
-    ass_cache_empty(priv->cache.font_cache);
-    ass_cache_empty(priv->cache.metrics_cache);
+    ass_cache_store_flush_fonts(priv);
 
     if (priv->fontselect)
         ass_fontselect_free(priv->fontselect);
@@ -213,6 +226,24 @@ int ass_frame_needs_rgba(ASS_Renderer *priv)
     return priv && priv->frame_needs_rgba;
 }
 
+int ass_get_changed_rects(ASS_Renderer *priv, ASS_DirtyRect *rects,
+                          int max_rects)
+{
+    int n = 0;
+    if (!priv->track_dirty_rects) {
+        // the frames were not compared so far, start with the next one
+        priv->track_dirty_rects = true;
+        ASS_DirtyRect frame = {
+            0, 0, priv->settings.frame_width, priv->settings.frame_height
+        };
+        ass_add_dirty_rect(rects, &n, max_rects, &frame);
+        return n;
+    }
+    for (int i = 0; i < priv->n_dirty_rects; i++)
+        ass_add_dirty_rect(rects, &n, max_rects, &priv->dirty_rects[i]);
+    return n;
+}
+
 int ass_fonts_update(ASS_Renderer *render_priv)
 {
     // This is just a stub now!
@@ -222,7 +253,7 @@ int ass_fonts_update(ASS_Renderer *render_priv)
 void ass_set_cache_limits(ASS_Renderer *render_priv, int glyph_max,
                           int bitmap_max)
 {
-    render_priv->cache.glyph_max = glyph_max ? glyph_max : GLYPH_CACHE_MAX;
+    render_priv->cache->glyph_max = glyph_max ? glyph_max : GLYPH_CACHE_MAX;
 
     size_t bitmap_cache, composite_cache;
     if (bitmap_max) {
@@ -233,8 +264,145 @@ void ass_set_cache_limits(ASS_Renderer *render_priv, int glyph_max,
         bitmap_cache = BITMAP_CACHE_MAX_SIZE;
         composite_cache = COMPOSITE_CACHE_MAX_SIZE;
     }
-    render_priv->cache.bitmap_max_size = bitmap_cache;
-    render_priv->cache.composite_max_size = composite_cache;
+    render_priv->cache->bitmap_max_size = bitmap_cache;
+    render_priv->cache->composite_max_size = composite_cache;
+    render_priv->cache->rgba_max_size = composite_cache;
+}
+
+void ass_set_cache_budget(ASS_Renderer *priv, int budget_mb)
+{
+    priv->cache->budget = MEGABYTE * (size_t) FFMAX(budget_mb, 0);
+}
+
+void ass_set_memory_pressure(ASS_Renderer *priv, ASS_MemoryPressure level)
+{
+    if (level == ASS_MEMORY_PRESSURE_CRITICAL) {
+        ass_reset_event_memos(priv);
+        ass_atlas_free(priv->atlas);
+        priv->atlas = NULL;
+    }
+
+    CacheStore *store = priv->cache;
+    ass_mutex_lock(&store->lock);
+    store->pressure = FFMAX(store->pressure, (int) level);
+    if (!store->active_frames)
+        ass_check_cache_limits(store);
+    ass_mutex_unlock(&store->lock);
+}
+
+void ass_renderer_get_stats(ASS_Renderer *priv, ASS_RendererStats *stats,
+                            int reset)
+{
+    priv->time_stages = true;
+    ass_collect_stats(priv);
+    *stats = priv->stats;
+    if (reset)
+        memset(&priv->stats, 0, sizeof(priv->stats));
+
+    CacheStore *store = priv->cache;
+    Cache *caches[ASS_CACHE_COUNT] = {
+        [ASS_CACHE_FONT] = store->font_cache,
+        [ASS_CACHE_OUTLINE] = store->outline_cache,
+        [ASS_CACHE_BITMAP] = store->bitmap_cache,
+        [ASS_CACHE_COMPOSITE] = store->composite_cache,
+        [ASS_CACHE_RGBA] = store->rgba_cache,
+        [ASS_CACHE_FACE_SIZE_METRICS] = store->face_size_metrics_cache,
+        [ASS_CACHE_GLYPH_METRICS] = store->metrics_cache,
+        [ASS_CACHE_SHAPED_RUN] = store->shaped_run_cache,
+    };
+    for (int i = 0; i < ASS_CACHE_COUNT; i++)
+        ass_cache_stats(caches[i], &stats->caches[i], reset);
+}
+
+void ass_set_threads(ASS_Renderer *priv, int threads)
+{
+#if !CONFIG_PTHREAD
+    threads = 1;
+#endif
+    threads = FFMINMAX(threads, 1, MAX_RENDER_THREADS);
+    if (threads == priv->n_threads)
+        return;
+
+    ass_collect_stats(priv);
+    ass_thread_pool_free(priv->thread_pool);
+    priv->thread_pool = NULL;
+    for (int i = 0; i < priv->n_threads - 1; i++)
+        ass_render_context_done(&priv->thread_states[i]);
+    free(priv->thread_states);
+    priv->thread_states = NULL;
+    priv->n_threads = 1;
+    if (threads == 1)
+        return;
+
+    // the worker threads are kept until the thread count changes
+    ASS_ThreadPool *pool = ass_thread_pool_new(threads - 1);
+    if (!pool)
+        goto fail;
+    int n_workers = ass_thread_pool_size(pool);
+    priv->thread_states = calloc(n_workers, sizeof(RenderContext));
+    if (!priv->thread_states) {
+        ass_thread_pool_free(pool);
+        goto fail;
+    }
+    for (int i = 0; i < n_workers; i++) {
+        if (!ass_render_context_init(&priv->thread_states[i], priv)) {
+            ass_render_context_done(&priv->thread_states[i]);
+            for (int j = 0; j < i; j++)
+                ass_render_context_done(&priv->thread_states[j]);
+            free(priv->thread_states);
+            priv->thread_states = NULL;
+            ass_thread_pool_free(pool);
+            goto fail;
+        }
+    }
+    priv->thread_pool = pool;
+    priv->n_threads = n_workers + 1;
+    if (priv->n_threads < threads)
+        ass_msg(priv->library, MSGL_WARN,
+                "Only %d of %d render threads could be started",
+                priv->n_threads, threads);
+    return;
+
+fail:
+    ass_msg(priv->library, MSGL_WARN,
+            "Failed to set up %d render threads, rendering serially", threads);
+}
+
+void ass_set_frame_arena(ASS_Renderer *priv, size_t block_size)
+{
+    // arenas in use keep their memory until they are recycled
+    priv->arena_block_size = block_size;
+    for (int i = 0; i < 2; i++)
+        for (int j = 0; j < MAX_RENDER_THREADS; j++)
+            priv->frame_arenas[i][j].block_size = block_size;
+}
+
+void ass_set_cache_store(ASS_Renderer *priv, ASS_CacheStore *store)
+{
+    if (store == priv->cache || (!store && !priv->cache->shared))
+        return;
+
+    CacheStore *cache = store;
+    if (cache) {
+        ass_cache_store_ref(cache);
+    } else {
+        cache = ass_cache_store_create();
+        if (!cache) {
+            ass_msg(priv->library, MSGL_WARN,
+                    "Failed to create a private cache store");
+            return;
+        }
+        cache->glyph_max = priv->cache->glyph_max;
+        cache->bitmap_max_size = priv->cache->bitmap_max_size;
+        cache->composite_max_size = priv->cache->composite_max_size;
+        cache->rgba_max_size = priv->cache->rgba_max_size;
+        cache->budget = priv->cache->budget;
+    }
+    ass_reset_event_memos(priv);
+    ass_atlas_free(priv->atlas);
+    priv->atlas = NULL;
+    ass_cache_store_detach(priv);
+    priv->cache = cache;
 }
 
 ASS_FontProvider *
@@ -0,0 +1,334 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_render.h"
+#include "ass_utils.h"
+#include "ass_priv.h"
+
+// Frames are rendered in parallel by one renderer per thread, all sharing
+// the caches and fonts of the main renderer. The threads are those of the
+// main renderer's pool, see ass_set_threads(). Workers only render events;
+// collisions depend on the previous frames, so they are resolved on the
+// calling thread when frames are delivered in order.
+//
+// Timestamps are processed in windows. Before a window is started, the
+// calling thread sets up the render state of every event shown in it,
+// so that the workers only read the track. While the pool renders a window,
+// the calling thread delivers the previous one, then helps with the rest.
+// Rendered frames point into the track's events, so the track is read up
+// to the last timestamp beforehand and only pruned once all are delivered.
+// Within a window, each worker takes chunks of consecutive frames to make
+// good use of its event memos.
+
+#define BATCH_CHUNK 4           // consecutive frames taken by a worker at once
+#define BATCH_WINDOW_CHUNKS 4   // chunks per worker in a window
+
+typedef struct {
+    EventImages *eimg;          // rendered events before layout
+    int cnt, max;
+    bool rendered;
+} BatchFrame;
+
+typedef struct {
+    ASS_Track *track;
+    ASS_Renderer **renderers;   // one per thread, [0] for the calling thread
+    const long long *times;
+    BatchFrame *frames;
+    int first;                  // index of times[0] in the whole batch
+    int n_frames;
+    int next;                   // first frame of the next chunk, guarded by lock
+    ASS_Mutex lock;
+} BatchJob;
+
+/**
+ * \brief Create a worker renderer borrowing the fonts, caches and
+ * settings of priv.
+ */
+static ASS_Renderer *batch_renderer_new(ASS_Renderer *priv)
+{
+    ASS_Renderer *renderer = calloc(1, sizeof(ASS_Renderer));
+    if (!renderer)
+        return NULL;
+
+    renderer->library = priv->library;
+    renderer->ftlibrary = priv->ftlibrary;
+    renderer->fontselect = priv->fontselect;
+    renderer->num_emfonts = priv->num_emfonts;
+    renderer->settings = priv->settings;
+    renderer->render_id = priv->render_id;
+    renderer->width = priv->width;
+    renderer->height = priv->height;
+    renderer->frame_content_width = priv->frame_content_width;
+    renderer->frame_content_height = priv->frame_content_height;
+    renderer->fit_width = priv->fit_width;
+    renderer->fit_height = priv->fit_height;
+    renderer->cache = priv->cache;
+    renderer->n_threads = 1;
+    renderer->prev_frame_events = -1;
+    renderer->engine = priv->engine;
+    renderer->user_override_style = priv->user_override_style;
+    renderer->batch_worker = true;
+    renderer->time_stages = priv->time_stages;
+
+    if (!ass_render_context_init(&renderer->state, renderer)) {
+        ass_render_context_done(&renderer->state);
+        free(renderer);
+        return NULL;
+    }
+    return renderer;
+}
+
+// counters of the worker are added to those of priv
+static void batch_renderer_free(ASS_Renderer *priv, ASS_Renderer *renderer)
+{
+    if (!renderer)
+        return;
+    ass_collect_stats(renderer);
+    priv->stats.frames += renderer->stats.frames;
+    priv->stats.events_rendered += renderer->stats.events_rendered;
+    priv->stats.events_reused += renderer->stats.events_reused;
+    for (int i = 0; i < ASS_STAGE_COUNT; i++)
+        priv->stats.stage_ns[i] += renderer->stats.stage_ns[i];
+    ass_reset_event_memos(renderer);
+    free(renderer->memos);
+    free(renderer->eimg);
+    free(renderer->active_ids);
+    ass_render_context_done(&renderer->state);
+    free(renderer);
+}
+
+static void free_event_images(EventImages *imgs, int cnt)
+{
+    for (int i = 0; i < cnt; i++) {
+        if (imgs[i].imgs) {
+            ((ASS_ImagePriv *) imgs[i].imgs)->ref_count = 1;
+            ass_frame_unref(imgs[i].imgs);
+        }
+        ass_free_images_rgba(imgs[i].imgs_rgba);
+    }
+}
+
+static void render_batch_frame(ASS_Renderer *renderer, BatchJob *job, int i)
+{
+    BatchFrame *frame = job->frames + i;
+    long long now = job->times[i];
+    frame->cnt = 0;
+    frame->rendered = false;
+    if (!ass_start_frame(renderer, job->track, now))
+        return;
+
+    int cnt = ass_render_active_events(renderer, job->track, now, false);
+    ass_end_frame(renderer);
+
+    if (cnt > frame->max) {
+        EventImages *eimg = realloc(frame->eimg, cnt * sizeof(EventImages));
+        if (!eimg) {
+            free_event_images(renderer->eimg, cnt);
+            return;
+        }
+        frame->eimg = eimg;
+        frame->max = cnt;
+    }
+    if (cnt > 0)
+        memcpy(frame->eimg, renderer->eimg, cnt * sizeof(EventImages));
+    frame->cnt = cnt;
+    frame->rendered = true;
+}
+
+static void batch_worker(BatchJob *job, ASS_Renderer *renderer)
+{
+    while (true) {
+        ass_mutex_lock(&job->lock);
+        int first = job->next;
+        job->next += BATCH_CHUNK;
+        ass_mutex_unlock(&job->lock);
+        if (first >= job->n_frames)
+            break;
+
+        int end = FFMIN(first + BATCH_CHUNK, job->n_frames);
+        for (int i = first; i < end; i++)
+            render_batch_frame(renderer, job, i);
+    }
+}
+
+static void batch_worker_thread(void *arg, int index)
+{
+    BatchJob *job = arg;
+    batch_worker(job, job->renderers[index]);
+}
+
+/**
+ * \brief Make the track read-only for the workers rendering the given
+ * timestamps: read it up to the last one, sync the time index and set up
+ * the render state of all events shown.
+ */
+static bool prepare_window(ASS_Renderer *priv, ASS_Track *track,
+                           const long long *times, int n)
+{
+    long long last = times[0];
+    for (int i = 1; i < n; i++)
+        last = FFMAX(last, times[i]);
+    if (!ass_prepare_track(priv, track, last))
+        return false;
+
+    for (int i = 0; i < n; i++) {
+        const int *ids;
+        int n_active = ass_find_active_events(track, times[i], NULL, &ids);
+        if (n_active < 0)
+            return false;
+        for (int j = 0; j < n_active; j++)
+            if (!ass_prepare_shared_event(priv, track->events + ids[j]))
+                return false;
+    }
+    return true;
+}
+
+static bool deliver_frame(ASS_Renderer *priv, BatchFrame *frame, int index,
+                          ASS_FrameCallback callback, void *cb_priv)
+{
+    if (!frame->rendered) {
+        ass_update_dirty_rects(priv, true);
+        callback(cb_priv, index, NULL, 2);
+        return false;
+    }
+
+    int change;
+    priv->prev_images_root = priv->images_root;
+    priv->images_root = NULL;
+    ASS_Image *images = ass_compose_frame(priv, frame->eimg, frame->cnt,
+                                          &change);
+    frame->cnt = 0;
+    callback(cb_priv, index, images, change);
+    return true;
+}
+
+static int render_serial(ASS_Renderer *priv, ASS_Track *track,
+                         const long long *times, int first, int n_times,
+                         ASS_FrameCallback callback, void *cb_priv)
+{
+    int rendered = 0;
+    for (int i = first; i < n_times; i++) {
+        int change;
+        ASS_Image *images = ass_render_frame(priv, track, times[i], &change);
+        if (!priv->prev_frame_failed)
+            rendered++;
+        callback(cb_priv, i, images, change);
+    }
+    return rendered;
+}
+
+/**
+ * \brief Prepare the n frames from first on and start the pool on them.
+ * \return false if the events could not be prepared
+ */
+static bool start_window(ASS_Renderer *priv, BatchJob *job, BatchFrame *frames,
+                         const long long *times, int first, int n,
+                         int n_helpers)
+{
+    if (!prepare_window(priv, job->track, times + first, n))
+        return false;
+    for (int i = 0; i <= n_helpers; i++)
+        job->renderers[i]->num_emfonts = priv->num_emfonts;
+    job->times = times + first;
+    job->frames = frames;
+    job->first = first;
+    job->n_frames = n;
+    job->next = 0;
+    ass_thread_pool_start(priv->thread_pool, batch_worker_thread,
+                          job, n_helpers);
+    return true;
+}
+
+int ass_render_frames_batch(ASS_Renderer *priv, ASS_Track *track,
+                            const long long *times, int n_times,
+                            ASS_FrameCallback callback, void *cb_priv)
+{
+    if (n_times <= 0)
+        return 0;
+
+    int n_helpers = FFMIN(priv->n_threads,
+                          (n_times + BATCH_CHUNK - 1) / BATCH_CHUNK) - 1;
+    long long last = times[0];
+    for (int i = 1; i < n_times; i++)
+        last = FFMAX(last, times[i]);
+    BatchJob job;
+    if (n_helpers < 1 || !ass_prepare_track(priv, track, last) ||
+            !ass_mutex_init(&job.lock, false))
+        return render_serial(priv, track, times, 0, n_times,
+                             callback, cb_priv);
+
+    ASS_Renderer *renderers[MAX_RENDER_THREADS] = { 0 };
+    int n_renderers = 0;
+    for (; n_renderers <= n_helpers; n_renderers++)
+        if (!(renderers[n_renderers] = batch_renderer_new(priv)))
+            break;
+    n_helpers = n_renderers - 1;
+
+    // two windows: one being delivered, the next one being rendered
+    int window = (n_helpers + 1) * BATCH_CHUNK * BATCH_WINDOW_CHUNKS;
+    BatchFrame *frames = calloc(2 * window, sizeof(BatchFrame));
+
+    // the memos of priv do not describe the previous delivered frame
+    priv->prev_frame_events = -1;
+    priv->frame_unchanged = false;
+
+    job.track = track;
+    job.renderers = renderers;
+    int rendered = 0, first = 0, cur = 0;
+    bool running = frames && n_helpers > 0 &&
+        start_window(priv, &job, frames, times, 0,
+                     FFMIN(window, n_times), n_helpers);
+    while (running) {
+        batch_worker(&job, renderers[0]);
+        ass_thread_pool_wait(priv->thread_pool);
+
+        BatchFrame *done = job.frames;
+        int n = job.n_frames;
+        first = job.first + n;
+        cur = !cur;
+        running = first < n_times &&
+            start_window(priv, &job, frames + cur * window, times, first,
+                         FFMIN(window, n_times - first), n_helpers);
+
+        for (int i = 0; i < n; i++)
+            rendered += deliver_frame(priv, done + i, first - n + i,
+                                      callback, cb_priv);
+    }
+
+    for (int i = 0; i < MAX_RENDER_THREADS; i++)
+        batch_renderer_free(priv, renderers[i]);
+    if (frames)
+        for (int i = 0; i < 2 * window; i++)
+            free(frames[i].eimg);
+    free(frames);
+    ass_mutex_destroy(&job.lock);
+
+    if (first && track->parser_priv->prune_delay >= 0)
+        ass_prune_events(track, times[first - 1] -
+                                track->parser_priv->prune_delay);
+
+    // whatever could not be rendered in parallel is rendered as usual
+    return rendered + render_serial(priv, track, times, first, n_times,
+                                    callback, cb_priv);
+}
@@ -30,6 +30,7 @@
 #include <ft2build.h>
 #include FT_FREETYPE_H
 #include FT_TRUETYPE_TABLES_H
+#include FT_SIZES_H
 enum {
     VERT = 0,
     VKNA,
@@ -65,6 +66,7 @@ struct ass_shaper {
     // Glyph and face-size metrics caches, to speed up shaping
     Cache *face_size_metrics_cache;
     Cache *metrics_cache;
+    Cache *shaped_run_cache;
 
     hb_font_funcs_t *font_funcs;
     hb_buffer_t *buf;
@@ -80,6 +82,13 @@ struct ass_shaper {
 struct ass_shaper_metrics_data {
     Cache *metrics_cache;
     FaceSizeMetricsHashKey hash_key;
+    FT_Size ft_size;
+};
+
+// construction parameters of glyph metrics
+struct glyph_metrics_priv {
+    FT_Size ft_size;
+    bool rotate;
 };
 
 /**
@@ -170,21 +179,25 @@ static bool init_features(ASS_Shaper *shaper)
 }
 
 /**
- * \brief Set features depending on properties of the run
+ * \brief Determine features depending on properties of the run
+ * \return bitmask of enabled features, indexed like shaper->features
  */
-static void set_run_features(ASS_Shaper *shaper, GlyphInfo *info)
+static unsigned get_run_features(ASS_Shaper *shaper, GlyphInfo *info)
 {
+    unsigned mask = 0;
+
     // enable vertical substitutions for @font runs
     if (info->font->desc.vertical)
-        shaper->features[VERT].value = shaper->features[VKNA].value = 1;
-    else
-        shaper->features[VERT].value = shaper->features[VKNA].value = 0;
+        mask |= (1 << VERT) | (1 << VKNA);
+
+    if (shaper->features[KERN].value)
+        mask |= 1 << KERN;
 
     // disable ligatures if horizontal spacing is non-standard
-    if (info->hspacing)
-        shaper->features[LIGA].value = shaper->features[CLIG].value = 0;
-    else
-        shaper->features[LIGA].value = shaper->features[CLIG].value = 1;
+    if (!info->hspacing)
+        mask |= (1 << LIGA) | (1 << CLIG);
+
+    return mask;
 }
 
 /**
@@ -226,8 +239,11 @@ get_cached_metrics(struct ass_shaper_metrics_data *metrics,
         .size = metrics->hash_key.size,
         .glyph_index = glyph,
     };
-    FT_Glyph_Metrics *val = ass_cache_get(metrics->metrics_cache, &key,
-                                          rotate ? metrics : NULL);
+    struct glyph_metrics_priv priv = {
+        .ft_size = metrics->ft_size,
+        .rotate = rotate,
+    };
+    FT_Glyph_Metrics *val = ass_cache_get(metrics->metrics_cache, &key, &priv);
     if (!val || val->width < 0)
         return NULL;
 
@@ -237,14 +253,46 @@ get_cached_metrics(struct ass_shaper_metrics_data *metrics,
 size_t ass_face_size_metrics_construct(void *key, void *value, void *priv)
 {
     FaceSizeMetricsHashKey *k = key;
-    FT_Size_Metrics *v = value;
+    FaceSizeMetricsHashValue *v = value;
+    ASS_Shaper *shaper = priv;
 
     FT_Face face = k->font->faces[k->face_index];
 
-    ass_face_set_size(face, k->size);
+    // give every cached size its own size object,
+    // so switching between sizes does not rescale the face
+    FT_Size ft_size;
+    if (!FT_New_Size(face, &ft_size)) {
+        v->ft_size = ft_size;
+        FT_Activate_Size(ft_size);
+        ass_face_set_size(face, k->size);
+    } else {
+        v->ft_size = NULL;
+        ass_font_set_size(k->font, k->face_index, k->size, NULL);
+    }
+
+    memcpy(&v->metrics, &face->size->metrics, sizeof(FT_Size_Metrics));
+    v->hb_font = NULL;
 
-    memcpy(v, &face->size->metrics, sizeof(FT_Size_Metrics));
+    // the size-specific HarfBuzz font lives as long as this entry
+    hb_font_t *hb_font = hb_font_create_sub_font(k->font->hb_fonts[k->face_index]);
+    if (hb_font_is_immutable(hb_font))
+        return 1;
+
+    // set up cached metrics access
+    struct ass_shaper_metrics_data *metrics = calloc(1, sizeof(struct ass_shaper_metrics_data));
+    if (!metrics) {
+        hb_font_destroy(hb_font);
+        return 1;
+    }
+    metrics->metrics_cache = shaper->metrics_cache;
+    metrics->hash_key = *k;
+    metrics->ft_size = v->ft_size;
 
+    hb_font_set_funcs(hb_font, shaper->font_funcs, metrics, free);
+    update_hb_size(hb_font, face, &v->metrics);
+    hb_font_make_immutable(hb_font);
+
+    v->hb_font = hb_font;
     return 1;
 }
 
@@ -252,13 +300,14 @@ size_t ass_glyph_metrics_construct(void *key, void *value, void *priv)
 {
     GlyphMetricsHashKey *k = key;
     FT_Glyph_Metrics *v = value;
+    struct glyph_metrics_priv *p = priv;
 
     int load_flags = FT_LOAD_DEFAULT | FT_LOAD_IGNORE_GLOBAL_ADVANCE_WIDTH
         | FT_LOAD_IGNORE_TRANSFORM;
 
     FT_Face face = k->font->faces[k->face_index];
 
-    ass_face_set_size(face, k->size);
+    ass_font_set_size(k->font, k->face_index, k->size, p->ft_size);
 
     if (FT_Load_Glyph(face, k->glyph_index, load_flags)) {
         v->width = -1;
@@ -267,7 +316,7 @@ size_t ass_glyph_metrics_construct(void *key, void *value, void *priv)
 
     memcpy(v, &face->glyph->metrics, sizeof(FT_Glyph_Metrics));
 
-    if (priv)  // rotate
+    if (p->rotate)
         v->horiAdvance = v->vertAdvance;
 
     return 1;
@@ -458,41 +507,37 @@ bool ass_create_hb_font(ASS_Font *font, int index)
 }
 
 /**
- * \brief Create HarfBuzz sub-font for current face and size.
- * \param info glyph cluster
+ * \brief Get the cached HarfBuzz sub-font for a face and size.
+ * The returned font is owned by the face size cache.
  * \return HarfBuzz font
  */
-static hb_font_t *get_hb_font(ASS_Shaper *shaper, GlyphInfo *info)
+static hb_font_t *get_hb_font(ASS_Shaper *shaper, ASS_Font *font,
+                              int face_index, double size)
 {
-    ASS_Font *font = info->font;
-
     FaceSizeMetricsHashKey key = {
-        .font = info->font,
-        .face_index = info->face_index,
-        .size = info->font_size,
+        .font = font,
+        .face_index = face_index,
+        .size = size,
     };
-    FT_Size_Metrics *m = ass_cache_get(shaper->face_size_metrics_cache, &key, NULL);
-    if (!m)
-        return NULL;
-
-    hb_font_t *hb_font = hb_font_create_sub_font(font->hb_fonts[info->face_index]);
-    if (hb_font_is_immutable(hb_font))
-        return NULL;
-
-    // set up cached metrics access
-    struct ass_shaper_metrics_data *metrics = calloc(1, sizeof(struct ass_shaper_metrics_data));
-    if (!metrics) {
-        hb_font_destroy(hb_font);
-        return NULL;
-    }
-    metrics->metrics_cache = shaper->metrics_cache;
-    metrics->hash_key = key;
-
-    hb_font_set_funcs(hb_font, shaper->font_funcs, metrics, free);
-
-    update_hb_size(hb_font, font->faces[info->face_index], m);
+    FaceSizeMetricsHashValue *val =
+        ass_cache_get(shaper->face_size_metrics_cache, &key, shaper);
+    return val ? val->hb_font : NULL;
+}
 
-    return hb_font;
+/**
+ * \brief Switch a face to the given size using its cached size object.
+ */
+void ass_shaper_set_face_size(ASS_Shaper *shaper, ASS_Font *font,
+                              int face_index, double size)
+{
+    FaceSizeMetricsHashKey key = {
+        .font = font,
+        .face_index = face_index,
+        .size = size,
+    };
+    FaceSizeMetricsHashValue *val =
+        ass_cache_get(shaper->face_size_metrics_cache, &key, shaper);
+    ass_font_set_size(font, face_index, size, val ? val->ft_size : NULL);
 }
 
 /**
@@ -605,23 +650,78 @@ hb_shaper_get_run_language(ASS_Shaper *shaper, hb_script_t script)
     return lang;
 }
 
+size_t ass_shaped_run_construct(void *key, void *value, void *priv)
+{
+    ShapedRunHashKey *k = key;
+    ShapedRunHashValue *v = value;
+    ASS_Shaper *shaper = priv;
+    hb_buffer_t *buf = shaper->buf;
+
+    // the key holds a copy of the whole text the run was cut from
+    size_t size = sizeof(*k) + sizeof(*v) + k->text.len;
+    v->valid = false;
+    v->n_glyphs = 0;
+    v->glyphs = NULL;
+
+    hb_font_t *font = get_hb_font(shaper, k->font, k->face_index, k->size);
+    if (!font)
+        return size;
+
+    hb_feature_t features[NUM_FEATURES];
+    memcpy(features, shaper->features, sizeof(features));
+    for (int i = 0; i < NUM_FEATURES; i++)
+        features[i].value = (k->features >> i) & 1;
+
+    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
+    props.direction = k->direction;
+    props.script = k->script;
+    props.language = k->language;
+
+    hb_buffer_pre_allocate(buf, k->item_length);
+    hb_buffer_add_utf32(buf, (const uint32_t *) k->text.str,
+                        k->text.len / sizeof(uint32_t),
+                        k->item_offset, k->item_length);
+    hb_buffer_set_segment_properties(buf, &props);
+    hb_shape(font, buf, features, NUM_FEATURES);
+
+    unsigned n = hb_buffer_get_length(buf);
+    hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buf, NULL);
+    hb_glyph_position_t *pos    = hb_buffer_get_glyph_positions(buf, NULL);
+
+    if (n && !ASS_REALLOC_ARRAY(v->glyphs, n)) {
+        hb_buffer_reset(buf);
+        return size;
+    }
+    for (unsigned i = 0; i < n; i++) {
+        ShapedGlyph *g = v->glyphs + i;
+        g->glyph_index = glyph_info[i].codepoint;
+        g->cluster     = glyph_info[i].cluster;
+        g->x_advance   = pos[i].x_advance;
+        g->y_advance   = pos[i].y_advance;
+        g->x_offset    = pos[i].x_offset;
+        g->y_offset    = pos[i].y_offset;
+    }
+    hb_buffer_reset(buf);
+
+    v->n_glyphs = n;
+    v->valid = true;
+    return size + n * sizeof(ShapedGlyph);
+}
+
 /**
  * \brief Feed a run of shaped characters into the GlyphInfo array.
  *
  * \param glyphs GlyphInfo array
- * \param buf buffer of shaped run
+ * \param run shaped run
  * \param offset offset into GlyphInfo array
  */
 static void
-shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
+shape_harfbuzz_process_run(GlyphInfo *glyphs, ShapedRunHashValue *run,
+                           int offset)
 {
-    int j;
-    int num_glyphs = hb_buffer_get_length(buf);
-    hb_glyph_info_t *glyph_info = hb_buffer_get_glyph_infos(buf, NULL);
-    hb_glyph_position_t *pos    = hb_buffer_get_glyph_positions(buf, NULL);
-
-    for (j = 0; j < num_glyphs; j++) {
-        unsigned idx = glyph_info[j].cluster + offset;
+    for (unsigned j = 0; j < run->n_glyphs; j++) {
+        ShapedGlyph *g = run->glyphs + j;
+        unsigned idx = g->cluster + offset;
         GlyphInfo *info = glyphs + idx;
         GlyphInfo *root = info;
 
@@ -640,11 +740,11 @@ shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
 
         // set position and advance
         info->skip = false;
-        info->glyph_index = glyph_info[j].codepoint;
-        info->offset.x    = ass_lrint(pos[j].x_offset * info->scale_x);
-        info->offset.y    = ass_lrint(-pos[j].y_offset * info->scale_y);
-        info->advance.x   = ass_lrint(pos[j].x_advance * info->scale_x);
-        info->advance.y   = ass_lrint(-pos[j].y_advance * info->scale_y);
+        info->glyph_index = g->glyph_index;
+        info->offset.x    = ass_lrint(g->x_offset * info->scale_x);
+        info->offset.y    = ass_lrint(-g->y_offset * info->scale_y);
+        info->advance.x   = ass_lrint(g->x_advance * info->scale_x);
+        info->advance.y   = ass_lrint(-g->y_advance * info->scale_y);
 
         // accumulate advance in the root glyph
         root->cluster_advance.x += info->advance.x;
@@ -660,8 +760,6 @@ shape_harfbuzz_process_run(GlyphInfo *glyphs, hb_buffer_t *buf, int offset)
 static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
 {
     int i;
-    hb_buffer_t *buf = shaper->buf;
-    hb_segment_properties_t props = HB_SEGMENT_PROPERTIES_DEFAULT;
 
     // Initialize: skip all glyphs, this is undone later as needed
     for (i = 0; i < len; i++)
@@ -674,9 +772,6 @@ static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
         }
 
         int offset = i;
-        hb_font_t *font = get_hb_font(shaper, glyphs + offset);
-        if (!font)
-            return false;
         int run_id = glyphs[offset].shape_run_id;
         int level = shaper->emblevels[offset];
 
@@ -685,13 +780,26 @@ static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
                 level == shaper->emblevels[i + 1])
             i++;
 
-        hb_buffer_pre_allocate(buf, i - offset + 1);
-
-        int lead_context = 0, trail_context = 0;
+        GlyphInfo *info = glyphs + offset;
+        ShapedRunHashKey key = {
+            .font = info->font,
+            .size = info->font_size,
+            .face_index = info->face_index,
+            .item_length = i - offset + 1,
+            .direction = FRIBIDI_LEVEL_IS_RTL(level) ?
+                HB_DIRECTION_RTL : HB_DIRECTION_LTR,
+            .script = info->script,
+            .language = hb_shaper_get_run_language(shaper, info->script),
+            .features = get_run_features(shaper, info),
+        };
+
+        // the shaping context is part of the key, so identical runs
+        // in different events share a single HarfBuzz call
+        int context_start = 0, context_len = len;
         if (shaper->whole_text_layout) {
-            hb_buffer_add_utf32(buf, shaper->event_text, len,
-                    offset, i - offset + 1);
+            key.item_offset = offset;
         } else {
+            int lead_context = 0, trail_context = 0;
             if (offset > 0 && !glyphs[offset].starts_new_run &&
                     is_shaping_control(glyphs[offset - 1].symbol))
                 lead_context = 1;
@@ -699,26 +807,19 @@ static bool shape_harfbuzz(ASS_Shaper *shaper, GlyphInfo *glyphs, size_t len)
                     is_shaping_control(glyphs[i + 1].symbol))
                 trail_context = 1;
 
-            hb_buffer_add_utf32(buf,
-                    shaper->event_text + offset - lead_context,
-                    i - offset + 1 + lead_context + trail_context,
-                    lead_context, i - offset + 1);
+            context_start = offset - lead_context;
+            context_len = key.item_length + lead_context + trail_context;
+            key.item_offset = lead_context;
         }
+        key.text.str = (const char *) (shaper->event_text + context_start);
+        key.text.len = context_len * sizeof(*shaper->event_text);
 
-        props.direction = FRIBIDI_LEVEL_IS_RTL(level) ?
-            HB_DIRECTION_RTL : HB_DIRECTION_LTR;
-        props.script = glyphs[offset].script;
-        props.language  = hb_shaper_get_run_language(shaper, props.script);
-        hb_buffer_set_segment_properties(buf, &props);
-
-        set_run_features(shaper, glyphs + offset);
-        hb_shape(font, buf, shaper->features, shaper->n_features);
-
-        shape_harfbuzz_process_run(glyphs, buf,
-                shaper->whole_text_layout ? 0 : offset - lead_context);
-        hb_buffer_reset(buf);
+        ShapedRunHashValue *run =
+            ass_cache_get(shaper->shaped_run_cache, &key, shaper);
+        if (!run || !run->valid)
+            return false;
 
-        hb_font_destroy(font);
+        shape_harfbuzz_process_run(glyphs, run, context_start);
     }
 
     return true;
@@ -924,6 +1025,19 @@ void ass_shaper_set_level(ASS_Shaper *shaper, ASS_ShapingLevel level)
     shaper->shaping_level = level;
 }
 
+/**
+ * \brief Set the caches used for glyph and face size metrics
+ * and for shaped runs
+ */
+void ass_shaper_set_caches(ASS_Shaper *shaper, Cache *metrics_cache,
+                           Cache *face_size_metrics_cache,
+                           Cache *shaped_run_cache)
+{
+    shaper->metrics_cache = metrics_cache;
+    shaper->face_size_metrics_cache = face_size_metrics_cache;
+    shaper->shaped_run_cache = shaped_run_cache;
+}
+
 #ifdef USE_FRIBIDI_EX_API
 void ass_shaper_set_bidi_brackets(ASS_Shaper *shaper, bool match_brackets)
 {
@@ -1017,9 +1131,10 @@ bool ass_shaper_shape(ASS_Shaper *shaper, TextInfo *text_info)
 /**
  * \brief Create a new shaper instance
  */
-ASS_Shaper *ass_shaper_new(Cache *metrics_cache, Cache *face_size_metrics_cache)
+ASS_Shaper *ass_shaper_new(Cache *metrics_cache, Cache *face_size_metrics_cache,
+                           Cache *shaped_run_cache)
 {
-    assert(metrics_cache);
+    assert(metrics_cache && face_size_metrics_cache && shaped_run_cache);
 
     ASS_Shaper *shaper = calloc(1, sizeof(*shaper));
     if (!shaper)
@@ -1031,6 +1146,7 @@ ASS_Shaper *ass_shaper_new(Cache *metrics_cache, Cache *face_size_metrics_cache)
         goto error;
     shaper->face_size_metrics_cache = face_size_metrics_cache;
     shaper->metrics_cache = metrics_cache;
+    shaper->shaped_run_cache = shaped_run_cache;
 
     hb_font_funcs_t *funcs = shaper->font_funcs = hb_font_funcs_create();
     if (hb_font_funcs_is_immutable(funcs))
@@ -31,15 +31,21 @@ typedef struct ass_shaper ASS_Shaper;
 #endif
 
 void ass_shaper_info(ASS_Library *lib);
-ASS_Shaper *ass_shaper_new(Cache *metrics_cache, Cache *face_size_metrics_cache);
+ASS_Shaper *ass_shaper_new(Cache *metrics_cache, Cache *face_size_metrics_cache,
+                           Cache *shaped_run_cache);
 void ass_shaper_free(ASS_Shaper *shaper);
 bool ass_create_hb_font(ASS_Font *font, int index);
 void ass_shaper_set_kerning(ASS_Shaper *shaper, bool kern);
+void ass_shaper_set_face_size(ASS_Shaper *shaper, ASS_Font *font,
+                              int face_index, double size);
 void ass_shaper_find_runs(ASS_Shaper *shaper, ASS_Renderer *render_priv,
                           GlyphInfo *glyphs, size_t len);
 void ass_shaper_set_base_direction(ASS_Shaper *shaper, FriBidiParType dir);
 void ass_shaper_set_language(ASS_Shaper *shaper, const char *code);
 void ass_shaper_set_level(ASS_Shaper *shaper, ASS_ShapingLevel level);
+void ass_shaper_set_caches(ASS_Shaper *shaper, Cache *metrics_cache,
+                           Cache *face_size_metrics_cache,
+                           Cache *shaped_run_cache);
 #ifdef USE_FRIBIDI_EX_API
 void ass_shaper_set_bidi_brackets(ASS_Shaper *shaper, bool match_brackets);
 #endif
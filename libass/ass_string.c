@@ -73,3 +73,16 @@ int ass_strncasecmp(const char *s1, const char *s2, size_t n)
     return a - b;
 }
 
+/**
+ * \brief Hash a string so that strings that are equal
+ * according to ass_strcasecmp() get the same hash.
+ */
+uint32_t ass_strcasehash(const char *str)
+{
+    uint32_t hash = 2166136261u;  // FNV-1a
+    for (; *str; str++) {
+        hash ^= lowertab[(unsigned char) *str];
+        hash *= 16777619u;
+    }
+    return hash;
+}
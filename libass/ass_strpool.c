@@ -0,0 +1,295 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <string.h>
+
+#include "ass_utils.h"
+#include "ass_strpool.h"
+
+#define STRPOOL_MIN_CHUNK (16 * 1024)
+#define STRPOOL_MAX_CHUNK (1024 * 1024)
+
+struct strpool_chunk {
+    size_t size;
+    size_t used;
+    size_t live;            // strings of the chunk still in use
+    // followed by size bytes of data
+};
+
+struct strpool_entry {
+    char *str;              // NULL for a free slot
+    size_t len;
+    uint32_t hash;
+    unsigned refs;
+};
+
+// every string is preceded by a tag byte telling how it was allocated
+enum {
+    TAG_PLAIN,
+    TAG_INTERNED,
+};
+
+static inline char *chunk_data(StrPoolChunk *chunk)
+{
+    return (char *) (chunk + 1);
+}
+
+/**
+ * \brief Find the chunk a string was allocated from.
+ * \return index into pool->chunks or -1
+ */
+static int find_chunk(const ASS_StringPool *pool, const char *str)
+{
+    uintptr_t ptr = (uintptr_t) str;
+    int lo = 0, hi = pool->n_chunks;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if ((uintptr_t) pool->chunks[mid] < ptr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (!lo)
+        return -1;
+    StrPoolChunk *chunk = pool->chunks[lo - 1];
+    uintptr_t data = (uintptr_t) chunk_data(chunk);
+    if (ptr <= data || ptr >= data + chunk->used)
+        return -1;
+    return lo - 1;
+}
+
+static StrPoolChunk *add_chunk(ASS_StringPool *pool, size_t size)
+{
+    if (pool->n_chunks == pool->max_chunks) {
+        int max_chunks = FFMAX(2 * pool->max_chunks, 16);
+        if (!ASS_REALLOC_ARRAY(pool->chunks, max_chunks))
+            return NULL;
+        pool->max_chunks = max_chunks;
+    }
+    StrPoolChunk *chunk = malloc(sizeof(StrPoolChunk) + size);
+    if (!chunk)
+        return NULL;
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->live = 0;
+
+    int pos = pool->n_chunks++;
+    for (; pos && (uintptr_t) pool->chunks[pos - 1] > (uintptr_t) chunk; pos--)
+        pool->chunks[pos] = pool->chunks[pos - 1];
+    pool->chunks[pos] = chunk;
+    return chunk;
+}
+
+static void remove_chunk(ASS_StringPool *pool, int index)
+{
+    if (pool->chunks[index] == pool->cur)
+        pool->cur = NULL;
+    free(pool->chunks[index]);
+    pool->n_chunks--;
+    memmove(pool->chunks + index, pool->chunks + index + 1,
+            (pool->n_chunks - index) * sizeof(StrPoolChunk *));
+}
+
+static char *alloc_string(ASS_StringPool *pool, const char *str, size_t len,
+                          char tag)
+{
+    if (len > SIZE_MAX - sizeof(StrPoolChunk) - 2)
+        return NULL;
+    size_t need = len + 2;      // tag and terminator
+
+    StrPoolChunk *chunk = pool->cur;
+    if (!chunk || chunk->size - chunk->used < need) {
+        size_t size = FFMAX(pool->chunk_size, STRPOOL_MIN_CHUNK);
+        if (need > size / 4) {
+            // large strings get a chunk of their own
+            chunk = add_chunk(pool, need);
+        } else {
+            StrPoolChunk *old = pool->cur;
+            chunk = add_chunk(pool, size);
+            if (chunk) {
+                if (old && !old->live) {
+                    int i = 0;
+                    while (pool->chunks[i] != old)
+                        i++;
+                    remove_chunk(pool, i);
+                }
+                pool->cur = chunk;
+                pool->chunk_size = FFMIN(2 * size, STRPOOL_MAX_CHUNK);
+            }
+        }
+        if (!chunk)
+            return NULL;
+    }
+
+    char *p = chunk_data(chunk) + chunk->used;
+    p[0] = tag;
+    memcpy(p + 1, str, len);
+    p[len + 1] = '\0';
+    chunk->used += need;
+    chunk->live++;
+    return p + 1;
+}
+
+static void free_string(ASS_StringPool *pool, int index)
+{
+    StrPoolChunk *chunk = pool->chunks[index];
+    if (--chunk->live)
+        return;
+    if (chunk == pool->cur)
+        chunk->used = 0;
+    else
+        remove_chunk(pool, index);
+}
+
+/**
+ * \brief Copy a string into the pool.
+ * \return zero-terminated copy of the first len bytes of str,
+ * released with ass_strpool_release()
+ */
+char *ass_strpool_add(ASS_StringPool *pool, const char *str, size_t len)
+{
+    return alloc_string(pool, str, len, TAG_PLAIN);
+}
+
+static uint32_t hash_string(const char *str, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (uint8_t) str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static StrPoolEntry *find_entry(const ASS_StringPool *pool,
+                                const char *str, size_t len, uint32_t hash)
+{
+    size_t mask = pool->max_entries - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        StrPoolEntry *entry = pool->entries + i;
+        if (!entry->str || (entry->hash == hash && entry->len == len &&
+                            !memcmp(entry->str, str, len)))
+            return entry;
+    }
+}
+
+static bool grow_entries(ASS_StringPool *pool)
+{
+    size_t max_entries = FFMAX(2 * pool->max_entries, 64);
+    StrPoolEntry *entries = calloc(max_entries, sizeof(StrPoolEntry));
+    if (!entries)
+        return false;
+
+    StrPoolEntry *old = pool->entries;
+    size_t old_max = pool->max_entries;
+    pool->entries = entries;
+    pool->max_entries = max_entries;
+    for (size_t i = 0; i < old_max; i++)
+        if (old[i].str)
+            *find_entry(pool, old[i].str, old[i].len, old[i].hash) = old[i];
+    free(old);
+    return true;
+}
+
+/**
+ * \brief Get a shared copy of a string.
+ * Equal strings interned into the same pool share their storage,
+ * which is released once every copy has been released.
+ */
+char *ass_strpool_intern(ASS_StringPool *pool, const char *str, size_t len)
+{
+    if (4 * (pool->n_entries + 1) > 3 * pool->max_entries &&
+            !grow_entries(pool))
+        return NULL;
+
+    uint32_t hash = hash_string(str, len);
+    StrPoolEntry *entry = find_entry(pool, str, len, hash);
+    if (entry->str) {
+        entry->refs++;
+        return entry->str;
+    }
+
+    char *copy = alloc_string(pool, str, len, TAG_INTERNED);
+    if (!copy)
+        return NULL;
+    entry->str = copy;
+    entry->len = len;
+    entry->hash = hash;
+    entry->refs = 1;
+    pool->n_entries++;
+    return copy;
+}
+
+static void remove_entry(ASS_StringPool *pool, StrPoolEntry *entry)
+{
+    // backward shift deletion keeps every probe sequence unbroken
+    size_t mask = pool->max_entries - 1;
+    size_t i = entry - pool->entries;
+    for (size_t j = (i + 1) & mask; pool->entries[j].str; j = (j + 1) & mask) {
+        size_t k = pool->entries[j].hash & mask;
+        if (i <= j ? i < k && k <= j : i < k || k <= j)
+            continue;
+        pool->entries[i] = pool->entries[j];
+        i = j;
+    }
+    pool->entries[i].str = NULL;
+    pool->n_entries--;
+}
+
+bool ass_strpool_owns(const ASS_StringPool *pool, const char *str)
+{
+    return str && find_chunk(pool, str) >= 0;
+}
+
+/**
+ * \brief Release a string of the pool.
+ * \return false if the string does not belong to the pool
+ */
+bool ass_strpool_release(ASS_StringPool *pool, char *str)
+{
+    int index = str ? find_chunk(pool, str) : -1;
+    if (index < 0)
+        return false;
+
+    if (str[-1] == TAG_INTERNED) {
+        size_t len = strlen(str);
+        StrPoolEntry *entry = find_entry(pool, str, len, hash_string(str, len));
+        if (entry->str == str) {
+            if (--entry->refs)
+                return true;
+            remove_entry(pool, entry);
+        }
+    }
+    free_string(pool, index);
+    return true;
+}
+
+/**
+ * \brief Free all strings of the pool at once.
+ */
+void ass_strpool_done(ASS_StringPool *pool)
+{
+    for (int i = 0; i < pool->n_chunks; i++)
+        free(pool->chunks[i]);
+    free(pool->chunks);
+    free(pool->entries);
+    memset(pool, 0, sizeof(*pool));
+}
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_STRPOOL_H
+#define LIBASS_STRPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct strpool_chunk StrPoolChunk;
+typedef struct strpool_entry StrPoolEntry;
+
+// Storage for the strings of a track's events.
+// Strings are packed into chunks, a chunk is freed once none of its
+// strings is in use anymore. Interned strings are shared between all
+// users of an equal string and counted by reference.
+// A zeroed pool is empty and ready for use.
+typedef struct {
+    StrPoolChunk **chunks;  // sorted by address
+    int n_chunks, max_chunks;
+    StrPoolChunk *cur;      // chunk new strings are taken from
+    size_t chunk_size;      // size of the next regular chunk
+
+    StrPoolEntry *entries;  // open addressing table of interned strings
+    size_t n_entries, max_entries;
+} ASS_StringPool;
+
+char *ass_strpool_add(ASS_StringPool *pool, const char *str, size_t len);
+char *ass_strpool_intern(ASS_StringPool *pool, const char *str, size_t len);
+bool ass_strpool_owns(const ASS_StringPool *pool, const char *str);
+bool ass_strpool_release(ASS_StringPool *pool, char *str);
+void ass_strpool_done(ASS_StringPool *pool);
+
+#endif /* LIBASS_STRPOOL_H */
@@ -0,0 +1,505 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ass_render.h"
+#include "ass_parse.h"
+#include "ass_utils.h"
+
+// width granularity of the surface blend functions of the bitmap engine
+#define SURFACE_BLOCK 32
+
+BlendColorFunc ass_blend_plane_c, ass_blend_color_c;
+BlendPremulFunc ass_blend_premul_c, ass_blend_premul_swap_c;
+
+// RGB to YCbCr conversion in 16.16 fixed point on the output sample scale,
+// lanes are the factors of R, G, B and the offset at full opacity
+typedef struct {
+    int32_t y[4], u[4], v[4];
+} YUVCoeffs;
+
+typedef struct {
+    int x, y, w, h;         // visible part in surface pixels
+    int src_x, src_y;       // its offset inside the image
+} BlendRect;
+
+typedef struct {
+    ASS_Renderer *priv;
+    const ASS_Surface *surface;
+    bool yuv, wide;
+    unsigned max_sample;
+    YUVCoeffs coeffs;
+
+    // chroma planes of YUV formats, step is the distance between samples
+    uint8_t *cb, *cr;
+    ptrdiff_t cb_stride, cr_stride;
+    int step;
+
+    uint8_t *scratch;
+    size_t scratch_size;
+    ASS_DirtyRect *rects;
+    int n_rects, max_rects;
+} Compositor;
+
+static bool check_surface(const ASS_Surface *s)
+{
+    if (!s || s->w <= 0 || s->h <= 0 || !s->planes[0])
+        return false;
+    ptrdiff_t chroma_w = (s->w + 1) / 2;
+    switch (s->format) {
+    case ASS_SURFACE_RGBA:
+    case ASS_SURFACE_BGRA:
+        return s->strides[0] >= 4 * (ptrdiff_t) s->w;
+    case ASS_SURFACE_NV12:
+    case ASS_SURFACE_P010: {
+        ptrdiff_t size = s->format == ASS_SURFACE_P010 ? 2 : 1;
+        return s->planes[1] && s->strides[0] >= size * s->w &&
+            s->strides[1] >= size * 2 * chroma_w;
+    }
+    case ASS_SURFACE_I420:
+        return s->planes[1] && s->planes[2] && s->strides[0] >= s->w &&
+            s->strides[1] >= chroma_w && s->strides[2] >= chroma_w;
+    default:
+        return false;
+    }
+}
+
+static void init_yuv_coeffs(YUVCoeffs *c, ASS_YCbCrMatrix matrix, int depth)
+{
+    double kr, kb;
+    switch (matrix) {
+    case YCBCR_BT709_TV:
+    case YCBCR_BT709_PC:
+        kr = 0.2126, kb = 0.0722;
+        break;
+    case YCBCR_SMPTE240M_TV:
+    case YCBCR_SMPTE240M_PC:
+        kr = 0.212, kb = 0.087;
+        break;
+    case YCBCR_FCC_TV:
+    case YCBCR_FCC_PC:
+        kr = 0.30, kb = 0.11;
+        break;
+    default:
+        kr = 0.299, kb = 0.114;
+    }
+    bool full_range =
+        matrix == YCBCR_BT601_PC || matrix == YCBCR_BT709_PC ||
+        matrix == YCBCR_SMPTE240M_PC || matrix == YCBCR_FCC_PC;
+
+    double kg = 1 - kr - kb, unit = 1 << (depth - 8);
+    double max = (1 << depth) - 1;
+    double y_scale = (full_range ? max : 219 * unit) / 255;
+    double c_scale = (full_range ? max : 224 * unit) / 255;
+    double y[4] = {
+        kr * y_scale, kg * y_scale, kb * y_scale,
+        full_range ? 0 : 16 * unit
+    };
+    double u[4] = {
+        -kr / (2 * (1 - kb)) * c_scale, -kg / (2 * (1 - kb)) * c_scale,
+        c_scale / 2, 128 * unit
+    };
+    double v[4] = {
+        c_scale / 2, -kg / (2 * (1 - kr)) * c_scale,
+        -kb / (2 * (1 - kr)) * c_scale, 128 * unit
+    };
+    for (int k = 0; k < 4; k++) {
+        c->y[k] = lrint(y[k] * 65536);
+        c->u[k] = lrint(u[k] * 65536);
+        c->v[k] = lrint(v[k] * 65536);
+    }
+}
+
+/**
+ * \brief Convert premultiplied color to a sample premultiplied by a
+ * \return sample value times a, in [0, 255 * max_sample]
+ */
+static inline unsigned convert_premul(const Compositor *c, const int32_t k[4],
+                                      unsigned r, unsigned g, unsigned b,
+                                      unsigned a)
+{
+    int64_t val = (int64_t) k[0] * r + (int64_t) k[1] * g + (int64_t) k[2] * b;
+    val = (255 * val + (int64_t) k[3] * a + (1 << 15)) >> 16;
+    return FFMINMAX(val, 0, (int64_t) c->max_sample * a);
+}
+
+/**
+ * \brief Blend a sample premultiplied by a over sample dst
+ * 8-bit samples are rounded like the blend functions of the bitmap engine,
+ * so that all planes of a surface agree. 10-bit samples need a closer
+ * approximation of the division by 255 to stay unchanged where a is 0.
+ */
+static inline unsigned blend_value(unsigned dst, unsigned premul_value,
+                                   unsigned a, bool wide)
+{
+    unsigned x = dst * (255 - a) + premul_value;
+    return wide ? (x + 128 + ((x + 128) >> 8)) >> 8 : (x + 255) >> 8;
+}
+
+static bool clip_to_surface(const ASS_Surface *s, int dst_x, int dst_y,
+                            int w, int h, BlendRect *r)
+{
+    int x0 = FFMAX(dst_x, 0), y0 = FFMAX(dst_y, 0);
+    int x1 = FFMIN(dst_x + w, s->w), y1 = FFMIN(dst_y + h, s->h);
+    if (x0 >= x1 || y0 >= y1)
+        return false;
+    r->x = x0;
+    r->y = y0;
+    r->w = x1 - x0;
+    r->h = y1 - y0;
+    r->src_x = x0 - dst_x;
+    r->src_y = y0 - dst_y;
+    return true;
+}
+
+static void add_dirty_rect(Compositor *c, const BlendRect *r)
+{
+    if (!c->rects)
+        return;
+
+    ASS_DirtyRect rect = { r->x, r->y, r->x + r->w, r->y + r->h };
+    if (c->yuv) {
+        // chroma samples cover 2x2 pixels
+        rect.x0 &= ~1;
+        rect.y0 &= ~1;
+        rect.x1 = FFMIN(rect.x1 + (rect.x1 & 1), c->surface->w);
+        rect.y1 = FFMIN(rect.y1 + (rect.y1 & 1), c->surface->h);
+    }
+    ass_add_dirty_rect(c->rects, &c->n_rects, c->max_rects, &rect);
+}
+
+static void blend_color_rows(BlendColorFunc *func, BlendColorFunc *fallback,
+                             int bpp, uint8_t *dst, ptrdiff_t dst_stride,
+                             const uint8_t *src, ptrdiff_t src_stride,
+                             int w, int h, uint32_t color)
+{
+    int body = w & ~(SURFACE_BLOCK - 1);
+    if (body)
+        func(dst, dst_stride, src, src_stride, body, h, color);
+    if (body < w)
+        fallback(dst + bpp * body, dst_stride, src + body, src_stride,
+                 w - body, h, color);
+}
+
+static void blend_premul_rows(BlendPremulFunc *func,
+                              uint8_t *dst, ptrdiff_t dst_stride,
+                              const uint8_t *src, ptrdiff_t src_stride,
+                              int w, int h)
+{
+    int body = w & ~(SURFACE_BLOCK - 1);
+    if (body)
+        func(dst, dst_stride, src, src_stride, body, h);
+    if (body < w)
+        ass_blend_premul_c(dst + 4 * body, dst_stride, src + 4 * body, src_stride,
+                           w - body, h);
+}
+
+static uint8_t *get_scratch(Compositor *c, size_t size)
+{
+    if (size <= c->scratch_size)
+        return c->scratch;
+    uint8_t *buf = realloc(c->scratch, size);
+    if (!buf)
+        return NULL;
+    c->scratch = buf;
+    c->scratch_size = size;
+    return buf;
+}
+
+/**
+ * \brief Chroma extents of a blend rectangle
+ * The first chroma column is r->x / 2, the first row r->y / 2.
+ */
+static inline void chroma_size(const BlendRect *r, int *cw, int *ch)
+{
+    *cw = ((r->x + r->w + 1) >> 1) - (r->x >> 1);
+    *ch = ((r->y + r->h + 1) >> 1) - (r->y >> 1);
+}
+
+/**
+ * \brief Sum 4-byte pixels (or single coverage bytes, n_ch = 1) of src
+ * over the luma pixels of every chroma sample; uncovered pixels outside
+ * of the rectangle add nothing.
+ * \param sum receives cw * ch * n_ch sums of up to 4 values
+ */
+static void sum_chroma_blocks(uint16_t *sum, int n_ch,
+                              const uint8_t *src, ptrdiff_t src_stride,
+                              const BlendRect *r, int cw, int ch)
+{
+    memset(sum, 0, sizeof(uint16_t) * cw * ch * n_ch);
+    int lead_x = r->x & 1, lead_y = r->y & 1;
+    for (int j = 0; j < r->h; j++) {
+        const uint8_t *row = src + j * src_stride;
+        uint16_t *dst = sum + ((lead_y + j) >> 1) * cw * n_ch;
+        for (int i = 0; i < r->w; i++) {
+            int k = ((lead_x + i) >> 1) * n_ch;
+            for (int m = 0; m < n_ch; m++)
+                dst[k + m] += row[n_ch * i + m];
+        }
+    }
+}
+
+static void blend_wide_plane(uint8_t *dst, ptrdiff_t dst_stride,
+                             const uint8_t *src, ptrdiff_t src_stride,
+                             int w, int h, unsigned value, unsigned opacity)
+{
+    for (int j = 0; j < h; j++) {
+        uint16_t *row = (uint16_t *) (dst + j * dst_stride);
+        const uint8_t *cov = src + j * src_stride;
+        for (int i = 0; i < w; i++) {
+            unsigned a = (cov[i] * opacity + 255) >> 8;
+            row[i] = blend_value(row[i] >> 6, value * a, a, true) << 6;
+        }
+    }
+}
+
+/**
+ * \brief Blend a solid color into interleaved chroma through coverage
+ */
+static void blend_interleaved_chroma(uint8_t *dst, ptrdiff_t dst_stride,
+                                     const uint8_t *src, ptrdiff_t src_stride,
+                                     int w, int h, unsigned u, unsigned v,
+                                     unsigned opacity, bool wide)
+{
+    for (int j = 0; j < h; j++) {
+        uint8_t *row = dst + j * dst_stride;
+        uint16_t *row16 = (uint16_t *) row;
+        const uint8_t *cov = src + j * src_stride;
+        for (int i = 0; i < w; i++) {
+            unsigned a = (cov[i] * opacity + 255) >> 8;
+            if (wide) {
+                row16[2 * i]     = blend_value(row16[2 * i]     >> 6, u * a, a, true) << 6;
+                row16[2 * i + 1] = blend_value(row16[2 * i + 1] >> 6, v * a, a, true) << 6;
+            } else {
+                row[2 * i]     = blend_value(row[2 * i],     u * a, a, false);
+                row[2 * i + 1] = blend_value(row[2 * i + 1], v * a, a, false);
+            }
+        }
+    }
+}
+
+static void blend_packed_solid(Compositor *c, const ASS_Image *img,
+                               const BlendRect *r, unsigned opacity)
+{
+    const ASS_Surface *s = c->surface;
+    uint32_t color = img->color;
+    uint32_t value = s->format == ASS_SURFACE_BGRA ?
+        _b(color) | _g(color) << 8 | _r(color) << 16 :
+        _r(color) | _g(color) << 8 | _b(color) << 16;
+    blend_color_rows(c->priv->engine.blend_color, ass_blend_color_c, 4,
+                     s->planes[0] + r->y * s->strides[0] + 4 * r->x, s->strides[0],
+                     img->bitmap + r->src_y * img->stride + r->src_x, img->stride,
+                     r->w, r->h, value | opacity << 24);
+}
+
+static void blend_yuv_solid(Compositor *c, const ASS_Image *img,
+                            const BlendRect *r, unsigned opacity)
+{
+    const ASS_Surface *s = c->surface;
+    uint32_t color = img->color;
+    unsigned red = _r(color), green = _g(color), blue = _b(color);
+    unsigned y = (convert_premul(c, c->coeffs.y, red, green, blue, 255) + 127) / 255;
+    unsigned u = (convert_premul(c, c->coeffs.u, red, green, blue, 255) + 127) / 255;
+    unsigned v = (convert_premul(c, c->coeffs.v, red, green, blue, 255) + 127) / 255;
+    const uint8_t *src = img->bitmap + r->src_y * img->stride + r->src_x;
+    ptrdiff_t src_stride = img->stride;
+
+    uint8_t *luma = s->planes[0] + r->y * s->strides[0];
+    if (c->wide)
+        blend_wide_plane(luma + 2 * r->x, s->strides[0], src, src_stride,
+                         r->w, r->h, y, opacity);
+    else
+        blend_color_rows(c->priv->engine.blend_plane, ass_blend_plane_c, 1,
+                         luma + r->x, s->strides[0], src, src_stride,
+                         r->w, r->h, y | opacity << 24);
+
+    // chroma through coverage averaged over each 2x2 block
+    int cw, ch;
+    chroma_size(r, &cw, &ch);
+    size_t n = (size_t) cw * ch;
+    uint8_t *buf = get_scratch(c, n * (sizeof(uint16_t) + 1));
+    if (!buf)
+        return;
+    uint16_t *sum = (uint16_t *) buf;
+    uint8_t *cov = buf + n * sizeof(uint16_t);
+    sum_chroma_blocks(sum, 1, src, src_stride, r, cw, ch);
+    for (size_t i = 0; i < n; i++)
+        cov[i] = (sum[i] + 2) >> 2;
+
+    int sample = c->wide ? 2 : 1;
+    uint8_t *cb = c->cb + (r->y >> 1) * c->cb_stride + c->step * sample * (r->x >> 1);
+    uint8_t *cr = c->cr + (r->y >> 1) * c->cr_stride + c->step * sample * (r->x >> 1);
+    if (c->step == 1) {
+        blend_color_rows(c->priv->engine.blend_plane, ass_blend_plane_c, 1,
+                         cb, c->cb_stride, cov, cw, cw, ch, u | opacity << 24);
+        blend_color_rows(c->priv->engine.blend_plane, ass_blend_plane_c, 1,
+                         cr, c->cr_stride, cov, cw, cw, ch, v | opacity << 24);
+    } else
+        blend_interleaved_chroma(cb, c->cb_stride, cov, cw, cw, ch,
+                                 u, v, opacity, c->wide);
+}
+
+static void blend_yuv_rgba(Compositor *c, const ASS_ImageRGBA *img,
+                           const BlendRect *r)
+{
+    const ASS_Surface *s = c->surface;
+    const uint8_t *src = img->rgba + r->src_y * img->stride + 4 * r->src_x;
+    ptrdiff_t src_stride = img->stride;
+    bool wide = c->wide;
+
+    uint8_t *luma = s->planes[0] + r->y * s->strides[0];
+    for (int j = 0; j < r->h; j++) {
+        const uint8_t *p = src + j * src_stride;
+        uint8_t *row = luma + j * s->strides[0];
+        uint16_t *row16 = (uint16_t *) row;
+        for (int i = 0, x = r->x; i < r->w; i++, x++, p += 4) {
+            unsigned y = convert_premul(c, c->coeffs.y, p[0], p[1], p[2], p[3]);
+            if (wide)
+                row16[x] = blend_value(row16[x] >> 6, y, p[3], true) << 6;
+            else
+                row[x] = blend_value(row[x], y, p[3], false);
+        }
+    }
+
+    int cw, ch;
+    chroma_size(r, &cw, &ch);
+    uint16_t *sum = (uint16_t *) get_scratch(c, 4 * sizeof(uint16_t) * cw * ch);
+    if (!sum)
+        return;
+    sum_chroma_blocks(sum, 4, src, src_stride, r, cw, ch);
+
+    int sample = wide ? 2 : 1;
+    for (int j = 0; j < ch; j++) {
+        int cy = (r->y >> 1) + j;
+        uint8_t *cb = c->cb + cy * c->cb_stride;
+        uint8_t *cr = c->cr + cy * c->cr_stride;
+        const uint16_t *q = sum + 4 * j * cw;
+        for (int i = 0, cx = r->x >> 1; i < cw; i++, cx++, q += 4) {
+            unsigned rr = (q[0] + 2) >> 2, gg = (q[1] + 2) >> 2;
+            unsigned bb = (q[2] + 2) >> 2, a = (q[3] + 2) >> 2;
+            unsigned u = convert_premul(c, c->coeffs.u, rr, gg, bb, a);
+            unsigned v = convert_premul(c, c->coeffs.v, rr, gg, bb, a);
+            uint8_t *pu = cb + c->step * sample * cx;
+            uint8_t *pv = cr + c->step * sample * cx;
+            if (wide) {
+                uint16_t *pu16 = (uint16_t *) pu, *pv16 = (uint16_t *) pv;
+                *pu16 = blend_value(*pu16 >> 6, u, a, true) << 6;
+                *pv16 = blend_value(*pv16 >> 6, v, a, true) << 6;
+            } else {
+                *pu = blend_value(*pu, u, a, false);
+                *pv = blend_value(*pv, v, a, false);
+            }
+        }
+    }
+}
+
+static void blend_image(Compositor *c, const ASS_Image *img)
+{
+    unsigned opacity = 255 - _a(img->color);
+    BlendRect r;
+    if (!img->bitmap || !opacity ||
+            !clip_to_surface(c->surface, img->dst_x, img->dst_y, img->w, img->h, &r))
+        return;
+
+    if (c->yuv)
+        blend_yuv_solid(c, img, &r, opacity);
+    else
+        blend_packed_solid(c, img, &r, opacity);
+    add_dirty_rect(c, &r);
+}
+
+static void blend_image_rgba(Compositor *c, const ASS_ImageRGBA *img)
+{
+    BlendRect r;
+    if (!img->rgba ||
+            !clip_to_surface(c->surface, img->dst_x, img->dst_y, img->w, img->h, &r))
+        return;
+
+    const ASS_Surface *s = c->surface;
+    const uint8_t *src = img->rgba + r.src_y * img->stride + 4 * r.src_x;
+    uint8_t *dst = s->planes[0] + r.y * s->strides[0] + 4 * r.x;
+    if (c->yuv)
+        blend_yuv_rgba(c, img, &r);
+    else if (s->format == ASS_SURFACE_BGRA)
+        // the image may be shared, so red and blue are swapped on the fly
+        ass_blend_premul_swap_c(dst, s->strides[0], src, img->stride, r.w, r.h);
+    else
+        blend_premul_rows(c->priv->engine.blend_premul, dst, s->strides[0],
+                          src, img->stride, r.w, r.h);
+    add_dirty_rect(c, &r);
+}
+
+int ass_render_frame_into(ASS_Renderer *priv, ASS_Track *track, long long now,
+                          const ASS_Surface *surface, ASS_DirtyRect *rects,
+                          int max_rects, int *detect_change)
+{
+    if (!check_surface(surface)) {
+        ass_msg(priv->library, MSGL_ERR, "Invalid surface description");
+        return -1;
+    }
+
+    Compositor c = {
+        .priv = priv,
+        .surface = surface,
+        .yuv = surface->format == ASS_SURFACE_NV12 ||
+               surface->format == ASS_SURFACE_P010 ||
+               surface->format == ASS_SURFACE_I420,
+        .wide = surface->format == ASS_SURFACE_P010,
+        .rects = rects,
+        .max_rects = max_rects,
+    };
+    c.max_sample = c.wide ? 1023 : 255;
+    if (c.yuv) {
+        init_yuv_coeffs(&c.coeffs, surface->matrix, c.wide ? 10 : 8);
+        c.cb = surface->planes[1];
+        c.cb_stride = c.cr_stride = surface->strides[1];
+        if (surface->format == ASS_SURFACE_I420) {
+            c.cr = surface->planes[2];
+            c.cr_stride = surface->strides[2];
+            c.step = 1;
+        } else {
+            c.cr = c.cb + (c.wide ? 2 : 1);
+            c.step = 2;
+        }
+    }
+
+    if (ass_track_has_rgba(track)) {
+        ASS_ImageRGBA *rgba = ass_render_frame_rgba(priv, track, now, detect_change);
+        if (priv->frame_needs_rgba) {
+            for (ASS_ImageRGBA *cur = rgba; cur; cur = cur->next)
+                blend_image_rgba(&c, cur);
+        } else {
+            for (ASS_Image *cur = priv->images_root; cur; cur = cur->next)
+                blend_image(&c, cur);
+        }
+        ass_free_images_rgba(rgba);
+    } else {
+        ASS_Image *img = ass_render_frame(priv, track, now, detect_change);
+        for (ASS_Image *cur = img; cur; cur = cur->next)
+            blend_image(&c, cur);
+    }
+
+    free(c.scratch);
+    return c.n_rects;
+}
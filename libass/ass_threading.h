@@ -0,0 +1,150 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_THREADING_H
+#define LIBASS_THREADING_H
+
+#include <stdbool.h>
+
+// Minimal threading primitives used for parallel event rendering.
+// Without pthreads, mutexes are no-ops and thread creation always fails,
+// so callers fall back to doing the work on the calling thread.
+
+#if CONFIG_PTHREAD
+
+#include <pthread.h>
+
+typedef pthread_mutex_t ASS_Mutex;
+typedef pthread_cond_t ASS_Cond;
+typedef pthread_t ASS_Thread;
+
+static inline bool ass_mutex_init(ASS_Mutex *mutex, bool recursive)
+{
+    pthread_mutexattr_t attr;
+    if (pthread_mutexattr_init(&attr))
+        return false;
+    if (recursive &&
+            pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE)) {
+        pthread_mutexattr_destroy(&attr);
+        return false;
+    }
+    bool ok = !pthread_mutex_init(mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+    return ok;
+}
+
+static inline void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+static inline void ass_mutex_lock(ASS_Mutex *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+static inline void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+static inline bool ass_cond_init(ASS_Cond *cond)
+{
+    return !pthread_cond_init(cond, NULL);
+}
+
+static inline void ass_cond_destroy(ASS_Cond *cond)
+{
+    pthread_cond_destroy(cond);
+}
+
+static inline void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+    pthread_cond_wait(cond, mutex);
+}
+
+static inline void ass_cond_broadcast(ASS_Cond *cond)
+{
+    pthread_cond_broadcast(cond);
+}
+
+static inline bool ass_thread_create(ASS_Thread *thread,
+                                     void *(*func)(void *), void *arg)
+{
+    return !pthread_create(thread, NULL, func, arg);
+}
+
+static inline void ass_thread_join(ASS_Thread thread)
+{
+    pthread_join(thread, NULL);
+}
+
+#else
+
+typedef char ASS_Mutex;
+typedef char ASS_Cond;
+typedef char ASS_Thread;
+
+static inline bool ass_mutex_init(ASS_Mutex *mutex, bool recursive)
+{
+    return true;
+}
+
+static inline void ass_mutex_destroy(ASS_Mutex *mutex)
+{
+}
+
+static inline void ass_mutex_lock(ASS_Mutex *mutex)
+{
+}
+
+static inline void ass_mutex_unlock(ASS_Mutex *mutex)
+{
+}
+
+// There is never another thread to wait for
+static inline bool ass_cond_init(ASS_Cond *cond)
+{
+    return true;
+}
+
+static inline void ass_cond_destroy(ASS_Cond *cond)
+{
+}
+
+static inline void ass_cond_wait(ASS_Cond *cond, ASS_Mutex *mutex)
+{
+}
+
+static inline void ass_cond_broadcast(ASS_Cond *cond)
+{
+}
+
+static inline bool ass_thread_create(ASS_Thread *thread,
+                                     void *(*func)(void *), void *arg)
+{
+    return false;
+}
+
+static inline void ass_thread_join(ASS_Thread thread)
+{
+}
+
+#endif
+
+#endif /* LIBASS_THREADING_H */
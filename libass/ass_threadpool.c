@@ -0,0 +1,177 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+#include "ass_compat.h"
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "ass_threading.h"
+#include "ass_threadpool.h"
+
+typedef struct {
+    ASS_ThreadPool *pool;
+    int index;
+} PoolThread;
+
+struct ass_thread_pool {
+    ASS_Mutex lock;
+    ASS_Cond wake;          // a job has been started or the pool is freed
+    ASS_Cond done;          // the last thread of a job has finished it
+
+    // guarded by lock
+    unsigned job_id;        // incremented for every job
+    ASS_ThreadFunc func;
+    void *arg;
+    int n_active;           // threads taking part in the current job
+    int running;            // of those, threads still working on it
+    bool quit;
+
+    int n_threads;
+    ASS_Thread *threads;
+    PoolThread *args;
+};
+
+static void *pool_thread(void *arg)
+{
+    PoolThread *thread = arg;
+    ASS_ThreadPool *pool = thread->pool;
+    unsigned seen = 0;
+
+    ass_mutex_lock(&pool->lock);
+    while (true) {
+        while (!pool->quit && pool->job_id == seen)
+            ass_cond_wait(&pool->wake, &pool->lock);
+        if (pool->quit)
+            break;
+        seen = pool->job_id;
+        if (thread->index > pool->n_active)
+            continue;
+
+        ASS_ThreadFunc func = pool->func;
+        void *func_arg = pool->arg;
+        ass_mutex_unlock(&pool->lock);
+        func(func_arg, thread->index);
+        ass_mutex_lock(&pool->lock);
+        if (!--pool->running)
+            ass_cond_broadcast(&pool->done);
+    }
+    ass_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+/**
+ * \brief Start up to n_threads worker threads.
+ * \return NULL if not even one could be started
+ */
+ASS_ThreadPool *ass_thread_pool_new(int n_threads)
+{
+    if (n_threads < 1)
+        return NULL;
+    ASS_ThreadPool *pool = calloc(1, sizeof(ASS_ThreadPool));
+    if (!pool)
+        return NULL;
+    if (!ass_mutex_init(&pool->lock, false))
+        goto fail_lock;
+    if (!ass_cond_init(&pool->wake))
+        goto fail_wake;
+    if (!ass_cond_init(&pool->done))
+        goto fail_done;
+    pool->threads = calloc(n_threads, sizeof(ASS_Thread));
+    pool->args = calloc(n_threads, sizeof(PoolThread));
+    if (!pool->threads || !pool->args)
+        goto fail;
+
+    for (; pool->n_threads < n_threads; pool->n_threads++) {
+        PoolThread *thread = &pool->args[pool->n_threads];
+        thread->pool = pool;
+        thread->index = pool->n_threads + 1;
+        if (!ass_thread_create(&pool->threads[pool->n_threads],
+                               pool_thread, thread))
+            break;
+    }
+    if (pool->n_threads)
+        return pool;
+
+fail:
+    free(pool->threads);
+    free(pool->args);
+    ass_cond_destroy(&pool->done);
+fail_done:
+    ass_cond_destroy(&pool->wake);
+fail_wake:
+    ass_mutex_destroy(&pool->lock);
+fail_lock:
+    free(pool);
+    return NULL;
+}
+
+void ass_thread_pool_free(ASS_ThreadPool *pool)
+{
+    if (!pool)
+        return;
+    ass_mutex_lock(&pool->lock);
+    assert(!pool->running);
+    pool->quit = true;
+    ass_cond_broadcast(&pool->wake);
+    ass_mutex_unlock(&pool->lock);
+    for (int i = 0; i < pool->n_threads; i++)
+        ass_thread_join(pool->threads[i]);
+
+    free(pool->threads);
+    free(pool->args);
+    ass_cond_destroy(&pool->done);
+    ass_cond_destroy(&pool->wake);
+    ass_mutex_destroy(&pool->lock);
+    free(pool);
+}
+
+int ass_thread_pool_size(const ASS_ThreadPool *pool)
+{
+    return pool ? pool->n_threads : 0;
+}
+
+/**
+ * \brief Wake the first n threads of the pool to run func(arg, index),
+ * index being 1 to n. The previous job must have been waited for.
+ */
+void ass_thread_pool_start(ASS_ThreadPool *pool, ASS_ThreadFunc func,
+                           void *arg, int n)
+{
+    ass_mutex_lock(&pool->lock);
+    assert(!pool->running && n <= pool->n_threads);
+    pool->func = func;
+    pool->arg = arg;
+    pool->n_active = n;
+    pool->running = n;
+    pool->job_id++;
+    ass_cond_broadcast(&pool->wake);
+    ass_mutex_unlock(&pool->lock);
+}
+
+/**
+ * \brief Wait for all threads of the current job to finish it
+ */
+void ass_thread_pool_wait(ASS_ThreadPool *pool)
+{
+    ass_mutex_lock(&pool->lock);
+    while (pool->running)
+        ass_cond_wait(&pool->done, &pool->lock);
+    ass_mutex_unlock(&pool->lock);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright (C) 2026 libass contributors
+ *
+ * This file is part of libass.
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef LIBASS_THREADPOOL_H
+#define LIBASS_THREADPOOL_H
+
+#include <stdbool.h>
+
+// Persistent worker threads, started once and woken for every job.
+// A job runs func(arg, index) once on each of the first n threads,
+// with index counting from 1, so that the calling thread can take part
+// in the job as index 0 before waiting for it to end.
+// One job at a time; the pool is used from a single thread.
+
+typedef struct ass_thread_pool ASS_ThreadPool;
+typedef void (*ASS_ThreadFunc)(void *arg, int index);
+
+ASS_ThreadPool *ass_thread_pool_new(int n_threads);
+void ass_thread_pool_free(ASS_ThreadPool *pool);
+int ass_thread_pool_size(const ASS_ThreadPool *pool);
+void ass_thread_pool_start(ASS_ThreadPool *pool, ASS_ThreadFunc func,
+                           void *arg, int n);
+void ass_thread_pool_wait(ASS_ThreadPool *pool);
+
+#endif /* LIBASS_THREADPOOL_H */
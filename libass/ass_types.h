@@ -101,6 +101,7 @@ typedef struct ass_renderer ASS_Renderer;
 typedef struct render_priv ASS_RenderPriv;
 typedef struct parser_priv ASS_ParserPriv;
 typedef struct ass_library ASS_Library;
+typedef struct ass_cache_store ASS_CacheStore;
 
 /* ASS Style: line */
 typedef struct ass_style {
@@ -136,6 +137,8 @@ typedef struct ass_style {
 /*
  * ASS_Event corresponds to a single Dialogue line;
  * text is stored as-is, style overrides will be parsed later.
+ * Strings are allocated with malloc(), unless the track pools them,
+ * see ass_set_pooled_event_strings().
  */
 typedef struct ass_event {
     long long Start;            // ms
@@ -24,6 +24,10 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <inttypes.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
 #include "ass_library.h"
 #include "ass.h"
@@ -56,6 +60,27 @@ char *ass_strndup_fallback(const char *s, size_t n)
 }
 #endif
 
+/**
+ * \brief Monotonic clock in nanoseconds, only meaningful for differences
+ */
+int64_t ass_time_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;  // fixed at boot, so racing stores are benign
+    LARGE_INTEGER count;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (int64_t) ((double) count.QuadPart * 1e9 / freq.QuadPart);
+#elif defined(CLOCK_MONOTONIC)
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+    return (int64_t) ((double) clock() * 1e9 / CLOCKS_PER_SEC);
+#endif
+}
+
 void *ass_aligned_alloc(size_t alignment, size_t size, bool zero)
 {
     assert(!(alignment & (alignment - 1))); // alignment must be power of 2
@@ -271,3 +296,55 @@ int ass_lookup_style(ASS_Track *track, char *name)
             track, name, track->styles[i].Name);
     return i;
 }
+
+static int64_t rect_area(const ASS_DirtyRect *r)
+{
+    return (int64_t) (r->x1 - r->x0) * (r->y1 - r->y0);
+}
+
+static void merge_rect(ASS_DirtyRect *dst, const ASS_DirtyRect *src)
+{
+    dst->x0 = FFMIN(dst->x0, src->x0);
+    dst->y0 = FFMIN(dst->y0, src->y0);
+    dst->x1 = FFMAX(dst->x1, src->x1);
+    dst->y1 = FFMAX(dst->y1, src->y1);
+}
+
+/**
+ * \brief Add area to a bounded set of rectangles
+ * Grows the first rectangle that overlaps or touches the new one,
+ * otherwise appends it or, when out of space, grows the rectangle
+ * whose area increases the least.
+ */
+void ass_add_dirty_rect(ASS_DirtyRect *rects, int *n_rects, int max_rects,
+                        const ASS_DirtyRect *rect)
+{
+    if (max_rects <= 0 || rect->x0 >= rect->x1 || rect->y0 >= rect->y1)
+        return;
+
+    for (int i = 0; i < *n_rects; i++) {
+        ASS_DirtyRect *cur = &rects[i];
+        if (rect->x0 <= cur->x1 && cur->x0 <= rect->x1 &&
+                rect->y0 <= cur->y1 && cur->y0 <= rect->y1) {
+            merge_rect(cur, rect);
+            return;
+        }
+    }
+    if (*n_rects < max_rects) {
+        rects[(*n_rects)++] = *rect;
+        return;
+    }
+
+    int best = 0;
+    int64_t best_growth = INT64_MAX;
+    for (int i = 0; i < *n_rects; i++) {
+        ASS_DirtyRect merged = rects[i];
+        merge_rect(&merged, rect);
+        int64_t growth = rect_area(&merged) - rect_area(&rects[i]);
+        if (growth < best_growth) {
+            best_growth = growth;
+            best = i;
+        }
+    }
+    merge_rect(&rects[best], rect);
+}
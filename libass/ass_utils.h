@@ -87,6 +87,8 @@ static inline bool ass_string_equal(ASS_StringView str1, ASS_StringView str2)
     return str1.len == str2.len && !memcmp(str1.str, str2.str, str1.len);
 }
 
+int64_t ass_time_ns(void);
+
 void *ass_aligned_alloc(size_t alignment, size_t size, bool zero);
 void ass_aligned_free(void *ptr);
 
@@ -116,6 +118,8 @@ void ass_utf16be_to_utf8(char *dst, size_t dst_size, uint8_t *src, size_t src_si
 #endif
 void ass_msg(ASS_Library *priv, int lvl, const char *fmt, ...);
 int ass_lookup_style(ASS_Track *track, char *name);
+void ass_add_dirty_rect(ASS_DirtyRect *rects, int *n_rects, int max_rects,
+                        const ASS_DirtyRect *rect);
 
 /* defined in ass_strtod.c */
 double ass_strtod(const char *string, char **endPtr);
@@ -23,6 +23,7 @@
 #include <stdint.h>
 
 #include "ass_utils.h"
+#include "ass_bitmap_engine.h"
 
 
 #define ALIGNMENT  16
@@ -88,3 +89,142 @@ void ass_mul_bitmaps_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
         src2 += src2_stride;
     }
 }
+
+/**
+ * \brief Convert coverage mask into premultiplied RGBA with gradient color
+ * Channel values are stepped incrementally along the rows,
+ * the row start and step are in turn stepped between the rows.
+ */
+void ass_gradient_rgba_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                         const uint8_t *restrict src, ptrdiff_t src_stride,
+                         size_t width, size_t height,
+                         const GradientRGBAParams *param)
+{
+    ASSUME(!((uintptr_t) dst % ALIGNMENT) && !(dst_stride % ALIGNMENT));
+    ASSUME(!(src_stride % ALIGNMENT));
+    ASSUME(width > 0 && height > 0);
+
+    int32_t start[4], step[4];
+    for (int k = 0; k < 4; k++) {
+        start[k] = param->start[k];
+        step[k] = param->dx[k];
+    }
+
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        int32_t acc[4] = { start[0], start[1], start[2], start[3] };
+        for (size_t x = 0; x < width; x++) {
+            int16_t val[4];
+            for (int k = 0; k < 4; k++) {
+                val[k] = FFMINMAX(acc[k] >> 22, 0, 255);
+                acc[k] += step[k];
+            }
+            unsigned a = (src[x] * (255 - val[3]) + 255) >> 8;
+            for (int k = 0; k < 3; k++)
+                dst[4 * x + k] = (val[k] * a + 255) >> 8;
+            dst[4 * x + 3] = a;
+        }
+        for (int k = 0; k < 4; k++) {
+            start[k] += param->dy[k];
+            step[k] += param->dxy[k];
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Blend solid color into 8-bit plane through coverage mask
+ * The low byte of color is the plane value, the top byte is the opacity.
+ */
+void ass_blend_plane_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                       const uint8_t *restrict src, ptrdiff_t src_stride,
+                       size_t width, size_t height, uint32_t color)
+{
+    ASSUME(width > 0 && height > 0);
+
+    unsigned value = color & 0xFF, opacity = color >> 24;
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < width; x++) {
+            unsigned a = (src[x] * opacity + 255) >> 8;
+            dst[x] = (dst[x] * (255 - a) + value * a + 255) >> 8;
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Blend solid color into packed 4-byte pixels through coverage mask
+ * Bytes 0-2 of color are channel values in destination order,
+ * byte 3 is the opacity. The fourth channel accumulates coverage.
+ */
+void ass_blend_color_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                       const uint8_t *restrict src, ptrdiff_t src_stride,
+                       size_t width, size_t height, uint32_t color)
+{
+    ASSUME(width > 0 && height > 0);
+
+    unsigned val[4] = { color & 0xFF, (color >> 8) & 0xFF, (color >> 16) & 0xFF, 255 };
+    unsigned opacity = color >> 24;
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < width; x++) {
+            unsigned a = (src[x] * opacity + 255) >> 8;
+            for (int k = 0; k < 4; k++)
+                dst[4 * x + k] = (dst[4 * x + k] * (255 - a) + val[k] * a + 255) >> 8;
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Composite premultiplied 4-byte pixels over destination
+ * Both buffers have the same channel order, alpha is the fourth byte.
+ */
+void ass_blend_premul_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                        const uint8_t *restrict src, ptrdiff_t src_stride,
+                        size_t width, size_t height)
+{
+    ASSUME(width > 0 && height > 0);
+
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < 4 * width; x += 4) {
+            unsigned inv = 255 - src[x + 3];
+            for (int k = 0; k < 4; k++) {
+                unsigned v = src[x + k] + ((dst[x + k] * inv + 255) >> 8);
+                dst[x + k] = FFMIN(v, 255);
+            }
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
+
+/**
+ * \brief Composite premultiplied 4-byte pixels over destination
+ * with the first and third channels swapped, e.g. RGBA over BGRA.
+ */
+void ass_blend_premul_swap_c(uint8_t *restrict dst, ptrdiff_t dst_stride,
+                             const uint8_t *restrict src, ptrdiff_t src_stride,
+                             size_t width, size_t height)
+{
+    ASSUME(width > 0 && height > 0);
+
+    static const int order[4] = { 2, 1, 0, 3 };
+    uint8_t *end = dst + dst_stride * height;
+    while (dst < end) {
+        for (size_t x = 0; x < 4 * width; x += 4) {
+            unsigned inv = 255 - src[x + 3];
+            for (int k = 0; k < 4; k++) {
+                unsigned v = src[x + order[k]] + ((dst[x + k] * inv + 255) >> 8);
+                dst[x + k] = FFMIN(v, 255);
+            }
+        }
+        dst += dst_stride;
+        src += src_stride;
+    }
+}
@@ -29,15 +29,6 @@
 #define CB(c)   ((uint8_t) ((c) >> 8))
 #define CA(c)   ((uint8_t) (c))
 
-static inline double clamp01(double v)
-{
-    if (v < 0.0)
-        return 0.0;
-    if (v > 1.0)
-        return 1.0;
-    return v;
-}
-
 static inline uint8_t mix_byte(uint8_t oldv, uint8_t newv, double pwr)
 {
     if (pwr <= 0.0)
@@ -135,62 +126,3 @@ bool ass_gradient_equal(const GradientState *a, const GradientState *b)
 {
     return !memcmp(a, b, sizeof(*a));
 }
-
-static inline uint32_t sample_channel(uint8_t c0, uint8_t c1,
-                                      uint8_t c2, uint8_t c3,
-                                      int32_t uf, int32_t vf)
-{
-    // uf, vf in 0..65536
-    uint32_t w0 = (uint32_t) (65536 - uf);
-    uint32_t w1 = (uint32_t) uf;
-    uint32_t h0 = (uint32_t) (65536 - vf);
-    uint32_t h1 = (uint32_t) vf;
-
-    uint64_t w00 = (uint64_t) w0 * h0;
-    uint64_t w10 = (uint64_t) w1 * h0;
-    uint64_t w01 = (uint64_t) w0 * h1;
-    uint64_t w11 = (uint64_t) w1 * h1;
-
-    uint64_t acc = w00 * c0 + w10 * c1 + w01 * c2 + w11 * c3;
-    // divide by 65536*65536 with truncation
-    uint32_t res = (uint32_t) (acc >> 32);
-    return res > 255 ? 255 : res;
-}
-
-uint32_t ass_gradient_sample_color(const GradientValues *val, double u, double v)
-{
-    u = clamp01(u);
-    v = clamp01(v);
-    int32_t uf = (int32_t) (u * 65536.0);
-    int32_t vf = (int32_t) (v * 65536.0);
-    if (uf < 0) uf = 0; else if (uf > 65536) uf = 65536;
-    if (vf < 0) vf = 0; else if (vf > 65536) vf = 65536;
-
-    uint8_t r = (uint8_t) sample_channel(CR(val->color[0]), CR(val->color[1]),
-                                         CR(val->color[2]), CR(val->color[3]),
-                                         uf, vf);
-    uint8_t g = (uint8_t) sample_channel(CG(val->color[0]), CG(val->color[1]),
-                                         CG(val->color[2]), CG(val->color[3]),
-                                         uf, vf);
-    uint8_t b = (uint8_t) sample_channel(CB(val->color[0]), CB(val->color[1]),
-                                         CB(val->color[2]), CB(val->color[3]),
-                                         uf, vf);
-    uint8_t a = CA(val->color[0]);
-    return ((uint32_t) r << 24) | ((uint32_t) g << 16) |
-           ((uint32_t) b << 8) | a;
-}
-
-uint8_t ass_gradient_sample_alpha(const GradientValues *val, double u, double v)
-{
-    u = clamp01(u);
-    v = clamp01(v);
-    int32_t uf = (int32_t) (u * 65536.0);
-    int32_t vf = (int32_t) (v * 65536.0);
-    if (uf < 0) uf = 0; else if (uf > 65536) uf = 65536;
-    if (vf < 0) vf = 0; else if (vf > 65536) vf = 65536;
-
-    uint8_t a = (uint8_t) sample_channel(val->alpha[0], val->alpha[1],
-                                         val->alpha[2], val->alpha[3],
-                                         uf, vf);
-    return a;
-}
@@ -28,8 +28,6 @@
 #define gradient_disable_color ass_gradient_disable_color
 #define gradient_disable_alpha ass_gradient_disable_alpha
 #define gradient_equal ass_gradient_equal
-#define gradient_sample_color ass_gradient_sample_color
-#define gradient_sample_alpha ass_gradient_sample_alpha
 
 typedef struct {
     bool color_enabled;
@@ -58,7 +56,4 @@ void ass_gradient_disable_alpha(GradientState *state, int layer, uint8_t fallbac
                                 double pwr);
 bool ass_gradient_equal(const GradientState *a, const GradientState *b);
 
-uint32_t ass_gradient_sample_color(const GradientValues *val, double u, double v);
-uint8_t ass_gradient_sample_alpha(const GradientValues *val, double u, double v);
-
 #endif /* LIBASS_GRADIENT_H */
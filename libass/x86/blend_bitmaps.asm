@@ -273,3 +273,297 @@ INIT_XMM sse2
 MUL_BITMAPS
 INIT_YMM avx2
 MUL_BITMAPS
+
+;------------------------------------------------------------------------------
+; GRADIENT_RGBA
+; void gradient_rgba(uint8_t *dst, ptrdiff_t dst_stride,
+;                    const uint8_t *src, ptrdiff_t src_stride,
+;                    size_t width, size_t height,
+;                    const GradientRGBAParams *param);
+;------------------------------------------------------------------------------
+
+%macro GRADIENT_RGBA 0
+cglobal gradient_rgba, 7,7,8, -4 * 16
+    movu xm0, [r6 + 0 * 16]
+    movu xm1, [r6 + 1 * 16]
+    movu xm2, [r6 + 2 * 16]
+    movu xm3, [r6 + 3 * 16]
+    mova [rsp + 0 * 16], xm0
+    mova [rsp + 1 * 16], xm1
+    mova [rsp + 2 * 16], xm2
+    mova [rsp + 3 * 16], xm3
+    lea r0, [r0 + 4 * r4]
+    add r2, r4
+    neg r4
+    pcmpeqd m3, m3
+    pslld m3, 24
+    pcmpeqw m4, m4
+    psrlw m4, 8
+
+.row_loop:
+%if mmsize == 32
+    vbroadcasti128 m0, [rsp + 0 * 16]
+    vbroadcasti128 m2, [rsp + 1 * 16]
+    paddd m5, m2, m2
+    vperm2i128 m6, m5, m5, 0x08
+    paddd m0, m6
+    paddd m1, m0, m2
+    paddd m2, m5, m5
+%else
+    mova m0, [rsp + 0 * 16]
+    mova m2, [rsp + 1 * 16]
+    paddd m1, m0, m2
+    paddd m2, m2
+%endif
+    mov r6, r4
+
+.col_loop:
+    movd xm7, [r2 + r6]
+    psrad m5, m0, 22
+    psrad m6, m1, 22
+    packssdw m5, m6
+    packuswb m5, m5
+    pxor m6, m5, m3
+    por m5, m3
+    punpcklbw m5, m5
+    punpcklbw m6, m6
+    psrlw m5, 8
+    psrlw m6, 8
+    pshuflw m6, m6, q3333
+    pshufhw m6, m6, q3333
+    punpcklbw xm7, xm7
+    psrlw xm7, 8
+    punpcklwd xm7, xm7
+%if mmsize == 32
+    vpermq m7, m7, q1100
+%endif
+    punpckldq m7, m7
+    pmullw m6, m7
+    paddw m6, m4
+    psrlw m6, 8
+    pmullw m5, m6
+    paddw m5, m4
+    psrlw m5, 8
+    packuswb m5, m5
+%if mmsize == 32
+    vpermq m5, m5, q3120
+    movu [r0 + 4 * r6], xm5
+%else
+    movq [r0 + 4 * r6], m5
+%endif
+    paddd m0, m2
+    paddd m1, m2
+    add r6, mmsize / 8
+    jl .col_loop
+
+    mova xm5, [rsp + 0 * 16]
+    mova xm6, [rsp + 1 * 16]
+    paddd xm5, [rsp + 2 * 16]
+    paddd xm6, [rsp + 3 * 16]
+    mova [rsp + 0 * 16], xm5
+    mova [rsp + 1 * 16], xm6
+    add r0, r1
+    add r2, r3
+    dec r5
+    jnz .row_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+GRADIENT_RGBA
+INIT_YMM avx2
+GRADIENT_RGBA
+
+;------------------------------------------------------------------------------
+; BLEND_SAMPLES 1:m_alpha/result, 2:m_dst, 3:m_value, 4:m_tmp
+; Computes (255 * dst + alpha * (value - dst) + 255) >> 8 in words,
+; intermediate results are exact modulo 2^16; m3 must hold words_255
+;------------------------------------------------------------------------------
+
+%macro BLEND_SAMPLES 4
+    psubw m%4, m%3, m%2
+    pmullw m%1, m%4
+    psllw m%4, m%2, 8
+    psubw m%4, m%2
+    paddw m%1, m%4
+    paddw m%1, m3
+    psrlw m%1, 8
+%endmacro
+
+;------------------------------------------------------------------------------
+; BLEND_COVERAGE 1:m_cov_lo, 2:m_cov_hi, 3:m_dst_lo, 4:m_dst_hi, 5:dst
+; Unpacks coverage of m_cov_lo into alpha scaled by opacity (m6)
+; and loads unpacked destination
+;------------------------------------------------------------------------------
+
+%macro BLEND_COVERAGE 5
+    pxor m2, m2
+    punpckhbw m%2, m%1, m2
+    punpcklbw m%1, m2
+    movu m%3, %5
+    punpckhbw m%4, m%3, m2
+    punpcklbw m%3, m2
+    pmullw m%1, m6
+    pmullw m%2, m6
+    paddw m%1, m3
+    paddw m%2, m3
+    psrlw m%1, 8
+    psrlw m%2, 8
+%endmacro
+
+;------------------------------------------------------------------------------
+; BLEND_PLANE
+; void blend_plane(uint8_t *dst, ptrdiff_t dst_stride,
+;                  const uint8_t *src, ptrdiff_t src_stride,
+;                  size_t width, size_t height, uint32_t color);
+;------------------------------------------------------------------------------
+
+%macro BLEND_PLANE 0
+cglobal blend_plane, 7,7,8
+    BCASTD 5, r6d
+    psrld m6, m5, 24
+    pslld m4, m5, 24
+    psrld m4, 24
+    pslld m7, m6, 16
+    por m6, m7
+    pslld m7, m4, 16
+    por m4, m7
+    pcmpeqw m3, m3
+    psrlw m3, 8
+    add r0, r4
+    add r2, r4
+    neg r4
+
+.row_loop:
+    mov r6, r4
+.col_loop:
+    movu m0, [r2 + r6]
+    BLEND_COVERAGE 0, 5, 1, 7, [r0 + r6]
+    BLEND_SAMPLES 0, 1, 4, 2
+    BLEND_SAMPLES 5, 7, 4, 2
+    packuswb m0, m5
+    movu [r0 + r6], m0
+    add r6, mmsize
+    jl .col_loop
+    add r0, r1
+    add r2, r3
+    dec r5
+    jnz .row_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BLEND_PLANE
+INIT_YMM avx2
+BLEND_PLANE
+
+;------------------------------------------------------------------------------
+; BLEND_COLOR
+; void blend_color(uint8_t *dst, ptrdiff_t dst_stride,
+;                  const uint8_t *src, ptrdiff_t src_stride,
+;                  size_t width, size_t height, uint32_t color);
+;------------------------------------------------------------------------------
+
+%macro BLEND_COLOR 0
+cglobal blend_color, 7,7,8
+    BCASTD 5, r6d
+    psrld m6, m5, 24
+    pslld m7, m6, 16
+    por m6, m7
+    pcmpeqd m7, m7
+    pslld m7, 24
+    por m4, m5, m7
+    pxor m7, m7
+    punpcklbw m4, m7
+    pcmpeqw m3, m3
+    psrlw m3, 8
+    lea r0, [r0 + 4 * r4]
+    add r2, r4
+    neg r4
+
+.row_loop:
+    mov r6, r4
+.col_loop:
+%if mmsize == 32
+    movq xm0, [r2 + r6]
+    punpcklbw xm0, xm0
+    punpckhwd xm1, xm0, xm0
+    punpcklwd xm0, xm0
+    vinserti128 m0, m0, xm1, 1
+%else
+    movd m0, [r2 + r6]
+    punpcklbw m0, m0
+    punpcklwd m0, m0
+%endif
+    BLEND_COVERAGE 0, 5, 1, 7, [r0 + 4 * r6]
+    BLEND_SAMPLES 0, 1, 4, 2
+    BLEND_SAMPLES 5, 7, 4, 2
+    packuswb m0, m5
+    movu [r0 + 4 * r6], m0
+    add r6, mmsize / 4
+    jl .col_loop
+    add r0, r1
+    add r2, r3
+    dec r5
+    jnz .row_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BLEND_COLOR
+INIT_YMM avx2
+BLEND_COLOR
+
+;------------------------------------------------------------------------------
+; BLEND_PREMUL
+; void blend_premul(uint8_t *dst, ptrdiff_t dst_stride,
+;                   const uint8_t *src, ptrdiff_t src_stride,
+;                   size_t width, size_t height);
+;------------------------------------------------------------------------------
+
+%macro BLEND_PREMUL 0
+cglobal blend_premul, 6,7,8
+    pcmpeqw m3, m3
+    psrlw m3, 8
+    lea r0, [r0 + 4 * r4]
+    lea r2, [r2 + 4 * r4]
+    neg r4
+
+.row_loop:
+    mov r6, r4
+.col_loop:
+    movu m0, [r2 + 4 * r6]
+    movu m1, [r0 + 4 * r6]
+    pxor m2, m2
+    punpckhbw m5, m0, m2
+    punpcklbw m4, m0, m2
+    pshuflw m5, m5, q3333
+    pshufhw m5, m5, q3333
+    pshuflw m4, m4, q3333
+    pshufhw m4, m4, q3333
+    pxor m4, m3
+    pxor m5, m3
+    punpckhbw m7, m1, m2
+    punpcklbw m1, m2
+    pmullw m1, m4
+    pmullw m7, m5
+    paddw m1, m3
+    paddw m7, m3
+    psrlw m1, 8
+    psrlw m7, 8
+    packuswb m1, m7
+    paddusb m0, m1
+    movu [r0 + 4 * r6], m0
+    add r6, mmsize / 4
+    jl .col_loop
+    add r0, r1
+    add r2, r3
+    dec r5
+    jnz .row_loop
+    RET
+%endmacro
+
+INIT_XMM sse2
+BLEND_PREMUL
+INIT_YMM avx2
+BLEND_PREMUL
@@ -21,82 +21,607 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
 #include "../libass/ass.h"
+#include "../libass/ass_filesystem.h"
 
-typedef struct image_s {
-    int width, height, stride;
-    unsigned char *buffer;      // RGB24
-} image_t;
+#ifdef _WIN32
+#include <windows.h>
+#endif
 
-ASS_Library *ass_library;
-ASS_Renderer *ass_renderer;
+#define MAX_VALUES 16
 
-void msg_callback(int level, const char *fmt, va_list va, void *data)
+typedef enum {
+    MODE_FRAME,
+    MODE_RGBA,
+    MODE_AUTO,
+} Mode;
+
+static const char *const mode_names[] = { "frame", "rgba", "auto" };
+
+typedef struct {
+    int width, height;
+} Resolution;
+
+typedef struct {
+    char **scripts;
+    size_t n_scripts, max_scripts;
+
+    Resolution res[MAX_VALUES];
+    int n_res;
+    Mode modes[MAX_VALUES];
+    int n_modes;
+    int threads[MAX_VALUES];
+    int n_threads;
+
+    double start, end, fps;     // end < 0 means the end of the last event
+    bool cold, warm;
+    const char *fonts_dir;
+} Config;
+
+// Results of rendering every frame of a script once
+typedef struct {
+    int64_t *latency;           // per frame, ns
+    size_t n_frames;
+    uint64_t n_images;
+    int64_t total;              // ns
+    long peak_rss;              // KiB, -1 if unknown
+    ASS_RendererStats stats;
+} Run;
+
+static int64_t time_ns(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if (!freq.QuadPart)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    return (int64_t) ((double) count.QuadPart * 1e9 / freq.QuadPart);
+#else
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts))
+        return (int64_t) clock() * (1000000000 / CLOCKS_PER_SEC);
+    return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+}
+
+// Start measuring the peak resident memory anew from the current one,
+// so that each run reports its own peak rather than that of the process.
+// Only Linux allows resetting it.
+static bool reset_peak_rss(void)
+{
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+    if (!f)
+        return false;
+    bool ok = fputs("5", f) >= 0;
+    return !fclose(f) && ok;
+#else
+    return false;
+#endif
+}
+
+// peak resident memory since the last reset_peak_rss()
+static long peak_rss_kib(void)
+{
+#ifdef __linux__
+    FILE *f = fopen("/proc/self/status", "r");
+    if (!f)
+        return -1;
+    char line[256];
+    long peak = -1;
+    while (fgets(line, sizeof(line), f))
+        if (sscanf(line, "VmHWM: %ld kB", &peak) == 1)
+            break;
+    fclose(f);
+    return peak;
+#else
+    return -1;
+#endif
+}
+
+static void msg_callback(int level, const char *fmt, va_list va, void *data)
 {
-    if (level > 6)
+    if (level > 3)
         return;
-    printf("libass: ");
-    vprintf(fmt, va);
-    printf("\n");
+    fprintf(stderr, "libass: ");
+    vfprintf(stderr, fmt, va);
+    fprintf(stderr, "\n");
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr,
+        "usage: %s [options] <subtitle file or directory>...\n"
+        "  -r <w>x<h>  render at this frame size, can be repeated (default 1280x720)\n"
+        "  -m <mode>   frame, rgba or auto, can be repeated (default frame)\n"
+        "  -j <n>      number of rendering threads, can be repeated (default 1)\n"
+        "  -s <sec>    start time (default 0)\n"
+        "  -e <sec>    end time (default: end of the last event)\n"
+        "  -f <fps>    frame rate (default 24)\n"
+        "  -c          report only runs with cold caches\n"
+        "  -w          report only runs with warm caches\n"
+        "  -F <dir>    font directory\n"
+        "  -o <file>   write the report to a file instead of stdout\n",
+        name ? name : "profile");
+}
+
+static bool has_extension(const char *name, const char *ext)
+{
+    const char *dot = strrchr(name, '.');
+    if (!dot || dot == name)
+        return false;
+    dot++;
+    for (; *dot && *ext; dot++, ext++) {
+        char c = *dot;
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != *ext)
+            return false;
+    }
+    return !*dot && !*ext;
 }
 
-static void init(int frame_w, int frame_h)
+static bool add_script(Config *cfg, const char *path)
 {
-    ass_library = ass_library_init();
-    if (!ass_library) {
-        printf("ass_library_init failed!\n");
-        exit(1);
+    if (cfg->n_scripts == cfg->max_scripts) {
+        size_t max = cfg->max_scripts ? 2 * cfg->max_scripts : 16;
+        char **scripts = realloc(cfg->scripts, max * sizeof(char *));
+        if (!scripts)
+            return false;
+        cfg->scripts = scripts;
+        cfg->max_scripts = max;
     }
+    char *copy = strdup(path);
+    if (!copy)
+        return false;
+    cfg->scripts[cfg->n_scripts++] = copy;
+    return true;
+}
+
+static bool load_font(ASS_Library *lib, const char *path, const char *name)
+{
+    FILE *fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    bool ok = false;
+    char *buf = NULL;
+    if (fseek(fp, 0, SEEK_END) == -1)
+        goto end;
+    long size = ftell(fp);
+    if (size <= 0 || size > (1l << 30))
+        goto end;
+    rewind(fp);
+    buf = malloc(size);
+    if (!buf || fread(buf, 1, size, fp) != (size_t) size)
+        goto end;
+    ass_add_font(lib, name, buf, size);
+    ok = true;
 
-    ass_set_message_cb(ass_library, msg_callback, NULL);
-    ass_set_extract_fonts(ass_library, 1);
+end:
+    free(buf);
+    fclose(fp);
+    return ok;
+}
 
-    ass_renderer = ass_renderer_init(ass_library);
-    if (!ass_renderer) {
-        printf("ass_renderer_init failed!\n");
-        exit(1);
+// Scripts of a directory are benchmarked in the order they are listed,
+// fonts found next to them are made available to all scripts.
+static bool add_input(Config *cfg, ASS_Library *lib, const char *path)
+{
+    if (has_extension(path, "ass") || has_extension(path, "ssa"))
+        return add_script(cfg, path);
+
+    ASS_Dir dir;
+    if (!ass_open_dir(&dir, path)) {
+        fprintf(stderr, "Cannot open input '%s'!\n", path);
+        return false;
+    }
+    const char *name;
+    while ((name = ass_read_dir(&dir))) {
+        if (name[0] == '.')
+            continue;
+        const char *file = ass_current_file_path(&dir);
+        if (!file)
+            continue;
+        if (has_extension(name, "ass") || has_extension(name, "ssa")) {
+            if (!add_script(cfg, file)) {
+                ass_close_dir(&dir);
+                return false;
+            }
+        } else if (has_extension(name, "ttf") || has_extension(name, "otf") ||
+                   has_extension(name, "ttc") || has_extension(name, "pfb")) {
+            if (!load_font(lib, file, name))
+                fprintf(stderr, "Cannot load font '%s'!\n", file);
+        }
     }
+    ass_close_dir(&dir);
+    return true;
+}
 
-    ass_set_storage_size(ass_renderer, frame_w, frame_h);
-    ass_set_frame_size(ass_renderer, frame_w, frame_h);
-    ass_set_fonts(ass_renderer, NULL, "Sans", 1, NULL, 1);
+static bool parse_double(const char *arg, double *value)
+{
+    char *end;
+    *value = strtod(arg, &end);
+    return end != arg && !*end && isfinite(*value);
 }
 
-int main(int argc, char *argv[])
+static bool parse_option(Config *cfg, char opt, const char *arg)
 {
-    const int frame_w = 1280;
-    const int frame_h = 720;
+    double value;
+    switch (opt) {
+    case 'r': {
+        if (cfg->n_res == MAX_VALUES)
+            return false;
+        Resolution *res = &cfg->res[cfg->n_res];
+        char tail;
+        if (sscanf(arg, "%dx%d%c", &res->width, &res->height, &tail) != 2 ||
+                res->width <= 0 || res->height <= 0)
+            return false;
+        cfg->n_res++;
+        return true;
+    }
+    case 'm':
+        if (cfg->n_modes == MAX_VALUES)
+            return false;
+        for (int i = 0; i <= MODE_AUTO; i++) {
+            if (!strcmp(arg, mode_names[i])) {
+                cfg->modes[cfg->n_modes++] = i;
+                return true;
+            }
+        }
+        return false;
+    case 'j':
+        if (cfg->n_threads == MAX_VALUES || !parse_double(arg, &value) ||
+                value < 1 || value > 64 || value != (int) value)
+            return false;
+        cfg->threads[cfg->n_threads++] = value;
+        return true;
+    case 's':
+        return parse_double(arg, &cfg->start) && cfg->start >= 0;
+    case 'e':
+        return parse_double(arg, &cfg->end) && cfg->end >= 0;
+    case 'f':
+        return parse_double(arg, &cfg->fps) && cfg->fps > 0;
+    case 'F':
+        cfg->fonts_dir = arg;
+        return true;
+    }
+    return false;
+}
 
-    if (argc < 5) {
-        printf("usage: %s <subtitle file> <start time> <fps> <end time>\n",
-               argv[0] ? argv[0] : "profile");
-        exit(1);
+static double last_event_end(ASS_Track *track)
+{
+    long long end = 0;
+    for (int i = 0; i < track->n_events; i++) {
+        ASS_Event *event = &track->events[i];
+        if (event->Start + event->Duration > end)
+            end = event->Start + event->Duration;
     }
-    char *subfile = argv[1];
-    double tm = strtod(argv[2], 0);
-    double fps = strtod(argv[3], 0);
-    double end_time = strtod(argv[4], 0);
+    return end / 1000.0;
+}
 
-    if (fps == 0) {
-        printf("fps cannot equal 0\n");
-        exit(1);
+static ASS_Renderer *create_renderer(ASS_Library *lib, const Config *cfg,
+                                     Resolution res, int threads)
+{
+    ASS_Renderer *renderer = ass_renderer_init(lib);
+    if (!renderer)
+        return NULL;
+    ass_set_storage_size(renderer, res.width, res.height);
+    ass_set_frame_size(renderer, res.width, res.height);
+    ass_set_fonts(renderer, NULL, "Sans", ASS_FONTPROVIDER_AUTODETECT, NULL, 1);
+    ass_set_threads(renderer, threads);
+    return renderer;
+}
+
+static uint64_t count_images(const ASS_Image *img)
+{
+    uint64_t n = 0;
+    for (; img; img = img->next)
+        n++;
+    return n;
+}
+
+static uint64_t count_images_rgba(const ASS_ImageRGBA *img)
+{
+    uint64_t n = 0;
+    for (; img; img = img->next)
+        n++;
+    return n;
+}
+
+// Render every frame once and time each of them. Images are counted and
+// freed afterwards, as a player would do after uploading them.
+static void render_frames(ASS_Renderer *renderer, ASS_Track *track, Mode mode,
+                          const long long *times, Run *run)
+{
+    ass_renderer_get_stats(renderer, &run->stats, 1);
+    bool measure_rss = reset_peak_rss();
+    run->n_images = 0;
+    run->total = 0;
+    for (size_t i = 0; i < run->n_frames; i++) {
+        ASS_Image *imgs = NULL;
+        ASS_ImageRGBA *imgs_rgba = NULL;
+        int64_t start = time_ns();
+        switch (mode) {
+        case MODE_FRAME:
+            imgs = ass_render_frame(renderer, track, times[i], NULL);
+            break;
+        case MODE_RGBA:
+            imgs_rgba = ass_render_frame_rgba(renderer, track, times[i], NULL);
+            break;
+        case MODE_AUTO: {
+            ASS_RenderResult res =
+                ass_render_frame_auto(renderer, track, times[i], NULL);
+            imgs = res.use_rgba ? NULL : res.imgs;
+            imgs_rgba = res.imgs_rgba;
+            break;
+        }
+        }
+        int64_t latency = time_ns() - start;
+        run->latency[i] = latency;
+        run->total += latency;
+        run->n_images += count_images(imgs) + count_images_rgba(imgs_rgba);
+        ass_free_images_rgba(imgs_rgba);
+    }
+    run->peak_rss = measure_rss ? peak_rss_kib() : -1;
+    ass_renderer_get_stats(renderer, &run->stats, 0);
+}
+
+static int cmp_latency(const void *a, const void *b)
+{
+    int64_t x = *(const int64_t *) a, y = *(const int64_t *) b;
+    return x < y ? -1 : x > y;
+}
+
+// nearest-rank percentile of sorted values
+static double percentile_ms(const int64_t *sorted, size_t n, double p)
+{
+    size_t rank = (size_t) ceil(p / 100 * n);
+    return sorted[rank ? rank - 1 : 0] / 1e6;
+}
+
+static void print_string(FILE *out, const char *str)
+{
+    fputc('"', out);
+    for (; *str; str++) {
+        unsigned char c = *str;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%04x", c);
+        else
+            fputc(c, out);
     }
+    fputc('"', out);
+}
+
+static const char *const stage_names[ASS_STAGE_COUNT] = {
+    [ASS_STAGE_PARSE] = "parse",
+    [ASS_STAGE_SHAPE] = "shape",
+    [ASS_STAGE_LAYOUT] = "layout",
+    [ASS_STAGE_OUTLINE] = "outline",
+    [ASS_STAGE_STROKE] = "stroke",
+    [ASS_STAGE_RASTERIZE] = "rasterize",
+    [ASS_STAGE_BLUR] = "blur",
+    [ASS_STAGE_COMPOSITE] = "composite",
+    [ASS_STAGE_RGBA] = "rgba",
+    [ASS_STAGE_CLIP] = "clip",
+};
 
-    init(frame_w, frame_h);
-    ASS_Track *track = ass_read_file(ass_library, subfile, NULL);
+static const char *const cache_names[ASS_CACHE_COUNT] = {
+    [ASS_CACHE_FONT] = "font",
+    [ASS_CACHE_OUTLINE] = "outline",
+    [ASS_CACHE_BITMAP] = "bitmap",
+    [ASS_CACHE_COMPOSITE] = "composite",
+    [ASS_CACHE_RGBA] = "rgba",
+    [ASS_CACHE_FACE_SIZE_METRICS] = "face_size_metrics",
+    [ASS_CACHE_GLYPH_METRICS] = "glyph_metrics",
+    [ASS_CACHE_SHAPED_RUN] = "shaped_run",
+};
+
+static void print_run(FILE *out, bool first, const char *script,
+                      Resolution res, Mode mode, int threads, bool cold,
+                      Run *run)
+{
+    size_t n = run->n_frames;
+    qsort(run->latency, n, sizeof(*run->latency), cmp_latency);
+
+    fprintf(out, "%s\n    {\n      \"script\": ", first ? "" : ",");
+    print_string(out, script);
+    fprintf(out, ",\n      \"width\": %d, \"height\": %d, \"mode\": \"%s\", "
+            "\"threads\": %d, \"cache\": \"%s\",\n",
+            res.width, res.height, mode_names[mode], threads,
+            cold ? "cold" : "warm");
+    fprintf(out, "      \"frames\": %zu, \"images\": %llu, \"total_ms\": %.3f, "
+            "\"fps\": %.2f,\n", n, (unsigned long long) run->n_images,
+            run->total / 1e6, run->total ? n * 1e9 / run->total : 0.0);
+    fprintf(out, "      \"latency_ms\": { \"mean\": %.3f, \"p50\": %.3f, "
+            "\"p90\": %.3f, \"p99\": %.3f, \"max\": %.3f },\n",
+            run->total / 1e6 / n, percentile_ms(run->latency, n, 50),
+            percentile_ms(run->latency, n, 90),
+            percentile_ms(run->latency, n, 99), run->latency[n - 1] / 1e6);
+    if (run->peak_rss >= 0)
+        fprintf(out, "      \"peak_rss_kib\": %ld,\n", run->peak_rss);
+    else
+        fprintf(out, "      \"peak_rss_kib\": null,\n");
+
+    const ASS_RendererStats *stats = &run->stats;
+    fprintf(out, "      \"events_rendered\": %llu, \"events_reused\": %llu,\n",
+            (unsigned long long) stats->events_rendered,
+            (unsigned long long) stats->events_reused);
+    fprintf(out, "      \"stages_ms\": {");
+    for (int i = 0; i < ASS_STAGE_COUNT; i++)
+        fprintf(out, "%s \"%s\": %.3f", i ? "," : "", stage_names[i],
+                stats->stage_ns[i] / 1e6);
+    fprintf(out, " },\n      \"caches\": {");
+    for (int i = 0; i < ASS_CACHE_COUNT; i++) {
+        const ASS_CacheStats *cache = &stats->caches[i];
+        fprintf(out, "%s\n        \"%s\": { \"lookups\": %llu, \"hits\": %llu, "
+                "\"misses\": %llu, \"evictions\": %llu, \"construct_ms\": %.3f, "
+                "\"size\": %zu, \"items\": %zu }",
+                i ? "," : "", cache_names[i],
+                (unsigned long long) cache->lookups,
+                (unsigned long long) cache->hits,
+                (unsigned long long) cache->misses,
+                (unsigned long long) cache->evictions,
+                cache->construct_ns / 1e6, cache->size, cache->items);
+    }
+    fprintf(out, "\n      }\n    }");
+}
+
+// Run one configuration with a fresh track and renderer: the first pass
+// over the frames starts with empty caches, the second one reuses them.
+static bool benchmark(FILE *out, bool *first, ASS_Library *lib,
+                      const Config *cfg, const char *script,
+                      Resolution res, Mode mode, int threads)
+{
+    ASS_Track *track = ass_read_file(lib, script, NULL);
     if (!track) {
-        printf("track init failed!\n");
-        exit(1);
+        fprintf(stderr, "Cannot load subtitle file '%s'!\n", script);
+        return false;
     }
 
-    while (tm < end_time) {
-        ass_render_frame(ass_renderer, track, (int) (tm * 1000), NULL);
-        tm += 1 / fps;
+    double end = cfg->end >= 0 ? cfg->end : last_event_end(track);
+    size_t n_frames = end > cfg->start ?
+        (size_t) ceil((end - cfg->start) * cfg->fps) : 0;
+    if (!n_frames) {
+        fprintf(stderr, "No frames to render in '%s'!\n", script);
+        ass_free_track(track);
+        return true;
+    }
+
+    bool ok = false;
+    ASS_Renderer *renderer = NULL;
+    Run run = { .n_frames = n_frames };
+    long long *times = malloc(n_frames * sizeof(*times));
+    run.latency = malloc(n_frames * sizeof(*run.latency));
+    if (!times || !run.latency)
+        goto end;
+    for (size_t i = 0; i < n_frames; i++)
+        times[i] = llround((cfg->start + i / cfg->fps) * 1000);
+
+    renderer = create_renderer(lib, cfg, res, threads);
+    if (!renderer) {
+        fprintf(stderr, "ass_renderer_init failed!\n");
+        goto end;
     }
 
+    render_frames(renderer, track, mode, times, &run);
+    if (cfg->cold) {
+        print_run(out, *first, script, res, mode, threads, true, &run);
+        *first = false;
+    }
+    if (cfg->warm) {
+        render_frames(renderer, track, mode, times, &run);
+        print_run(out, *first, script, res, mode, threads, false, &run);
+        *first = false;
+    }
+    ok = true;
+
+end:
+    if (renderer)
+        ass_renderer_done(renderer);
+    free(run.latency);
+    free(times);
     ass_free_track(track);
-    ass_renderer_done(ass_renderer);
-    ass_library_done(ass_library);
+    return ok;
+}
+
+int main(int argc, char *argv[])
+{
+    Config cfg = {
+        .end = -1,
+        .fps = 24,
+    };
+    const char *output = NULL;
+    bool only_cold = false, only_warm = false;
+    int result = 1;
+    FILE *out = stdout;
+
+    ASS_Library *lib = ass_library_init();
+    if (!lib) {
+        fprintf(stderr, "ass_library_init failed!\n");
+        return 1;
+    }
+    ass_set_message_cb(lib, msg_callback, NULL);
+    ass_set_extract_fonts(lib, 1);
+
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (arg[0] != '-' || !arg[1]) {
+            if (!add_input(&cfg, lib, arg))
+                goto end;
+            continue;
+        }
+        if (arg[2])
+            goto invalid;
+        if (arg[1] == 'c') {
+            only_cold = true;
+            continue;
+        }
+        if (arg[1] == 'w') {
+            only_warm = true;
+            continue;
+        }
+        if (++i == argc)
+            goto invalid;
+        if (arg[1] == 'o') {
+            output = argv[i];
+            continue;
+        }
+        if (!parse_option(&cfg, arg[1], argv[i])) {
+            fprintf(stderr, "Invalid value '%s' for option %s!\n", argv[i], arg);
+            goto end;
+        }
+    }
+    if (!cfg.n_scripts)
+        goto invalid;
+
+    if (!cfg.n_res)
+        cfg.res[cfg.n_res++] = (Resolution) { 1280, 720 };
+    if (!cfg.n_modes)
+        cfg.modes[cfg.n_modes++] = MODE_FRAME;
+    if (!cfg.n_threads)
+        cfg.threads[cfg.n_threads++] = 1;
+    cfg.cold = only_cold || !only_warm;
+    cfg.warm = only_warm || !only_cold;
+    if (cfg.fonts_dir)
+        ass_set_fonts_dir(lib, cfg.fonts_dir);
+
+    if (output && !(out = fopen(output, "w"))) {
+        fprintf(stderr, "Cannot open output file '%s'!\n", output);
+        out = stdout;
+        goto end;
+    }
+
+    fprintf(out, "{\n  \"start\": %.3f, \"fps\": %.3f,\n  \"runs\": [",
+            cfg.start, cfg.fps);
+    bool first = true;
+    result = 0;
+    for (size_t s = 0; s < cfg.n_scripts; s++)
+        for (int r = 0; r < cfg.n_res; r++)
+            for (int m = 0; m < cfg.n_modes; m++)
+                for (int t = 0; t < cfg.n_threads; t++)
+                    if (!benchmark(out, &first, lib, &cfg, cfg.scripts[s],
+                                   cfg.res[r], cfg.modes[m], cfg.threads[t]))
+                        result = 1;
+    fprintf(out, "\n  ]\n}\n");
+    goto end;
 
-    return 0;
+invalid:
+    usage(argv[0]);
+end:
+    if (out != stdout)
+        fclose(out);
+    for (size_t i = 0; i < cfg.n_scripts; i++)
+        free(cfg.scripts[i]);
+    free(cfg.scripts);
+    ass_library_done(lib);
+    return result;
 }